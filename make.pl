@@ -143,7 +143,7 @@ sub build {
         catfile( $mupdf_build_dir, 'libmupdfthird.a' ),
     ];
 
-    my $ldlibs = ['-lm'];
+    my $ldlibs = [ '-lm', '-lpthread' ];
 
     my %args = (
         out          => $out,
@@ -193,7 +193,20 @@ sub build_mupdf (%args) {
     );
 }
 
+sub generate_keys () {
+    my $script = catfile( 'src', 'gen-keys.pl' );
+    my @targets = ( catfile( 'src', 'keys.c' ), catfile( 'src', 'keys.h' ) );
+    my @deps = ( catfile( 'src', 'keys.txt' ), $script );
+    if ( grep { is_outdated( $_, @deps ) } @targets ) {
+        safe_system(
+            msg     => "    GEN src/keys.c src/keys.h",
+            command => [ $^X, $script ]
+        );
+    }
+}
+
 sub build_pdfout (%args) {
+    generate_keys();
     my @sources = glob('src/*.c src/program/*.c');
     my @objects;
 
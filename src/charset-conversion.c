@@ -776,26 +776,44 @@ typedef int (*mbtowc_func) (conv_t conv, ucs4_t *pwc, const unsigned char *s,
 			    int n);
 typedef int (*wctomb_func) (conv_t conv, unsigned char *r, ucs4_t wc, int n);
 
+/* Codepoint classes used for estimating output lengths: U+0000..U+007F,
+   U+0080..U+07FF, U+0800..U+FFFF, U+10000..U+10FFFF and, for UTF-8 only,
+   anything beyond.  */
+enum { CLASS_COUNT = 5 };
+
 /* List of supported encodings.  */
 struct encoding
 {
   const char *name;
   mbtowc_func mbtowc;
   wctomb_func wctomb;
+  /* Minimum number of bytes read by MBTOWC for a codepoint of each class.
+     Zero, if the class cannot be produced.  */
+  unsigned char in_len[CLASS_COUNT];
+  /* Maximum number of bytes written by WCTOMB for a codepoint of each
+     class.  Zero, if the class cannot be stored.  */
+  unsigned char out_len[CLASS_COUNT];
+  /* Length of a byte-order mark written by WCTOMB.  */
+  unsigned char bom_len;
 };
 
+#define UTF8_LEN {1, 2, 3, 4, 5}, {1, 2, 3, 4, 6}, 0
+#define UTF16_LEN {2, 2, 2, 4, 0}, {2, 2, 2, 4, 0}
+#define UTF32_LEN {4, 4, 4, 4, 0}, {4, 4, 4, 4, 0}
+#define PDFDOC_LEN {1, 1, 1, 0, 0}, {1, 1, 1, 0, 0}, 0
+
 static struct encoding encodings[] = {
-  {"ASCII", ascii_mbtowc, ascii_wctomb},
-  {"UTF-8", utf8_mbtowc, utf8_wctomb},
-  {"C", utf8_mbtowc, utf8_wctomb},
-  {"UTF-16", utf16_mbtowc, utf16_wctomb},
-  {"UTF-16BE", utf16be_mbtowc, utf16be_wctomb},
-  {"UTF-16LE", utf16le_mbtowc, utf16le_wctomb},
-  {"UTF-32", utf32_mbtowc, utf32_wctomb},
-  {"UTF-32BE", utf32be_mbtowc, utf32be_wctomb},
-  {"UTF-32LE", utf32le_mbtowc, utf32le_wctomb},
-  {"PDFDOCENCODING", pdfdoc_mbtowc, pdfdoc_wctomb},
-  {"PDFDOC", pdfdoc_mbtowc, pdfdoc_wctomb}
+  {"ASCII", ascii_mbtowc, ascii_wctomb, {1, 0, 0, 0, 0}, {1, 0, 0, 0, 0}, 0},
+  {"UTF-8", utf8_mbtowc, utf8_wctomb, UTF8_LEN},
+  {"C", utf8_mbtowc, utf8_wctomb, UTF8_LEN},
+  {"UTF-16", utf16_mbtowc, utf16_wctomb, UTF16_LEN, 2},
+  {"UTF-16BE", utf16be_mbtowc, utf16be_wctomb, UTF16_LEN, 0},
+  {"UTF-16LE", utf16le_mbtowc, utf16le_wctomb, UTF16_LEN, 0},
+  {"UTF-32", utf32_mbtowc, utf32_wctomb, UTF32_LEN, 4},
+  {"UTF-32BE", utf32be_mbtowc, utf32be_wctomb, UTF32_LEN, 0},
+  {"UTF-32LE", utf32le_mbtowc, utf32le_wctomb, UTF32_LEN, 0},
+  {"PDFDOCENCODING", pdfdoc_mbtowc, pdfdoc_wctomb, PDFDOC_LEN},
+  {"PDFDOC", pdfdoc_mbtowc, pdfdoc_wctomb, PDFDOC_LEN}
 };
 
 
@@ -810,32 +828,176 @@ get_encoding (fz_context *ctx, const char *name)
   pdfout_throw (ctx, "unknown encoding '%s'", name);
 }
 
+/* Return an upper bound for the output of converting SRCLEN bytes from
+   FROM to TO.  For each codepoint class, the ratio of written to read bytes
+   is bounded by out_len / in_len, so the largest such ratio bounds the
+   total.  */
+static int
+max_length (fz_context *ctx, const struct encoding *from,
+	    const struct encoding *to, int srclen)
+{
+  int64_t result = 0;
+
+  for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+      int64_t in = from->in_len[i], out = to->out_len[i];
+      if (in == 0 || out == 0)
+	continue;
+      int64_t len = (srclen * out + in - 1) / in;
+      if (len > result)
+	result = len;
+    }
+  result += to->bom_len;
+
+  /* Leave room for the zero-termination in pdfout_char_conv.  */
+  if (result > INT_MAX - 4)
+    pdfout_throw (ctx, "pdfout_char_conv: input too long");
+
+  return result;
+}
+
+/* Convert SRCLEN bytes at SRC into the DESTLEN bytes at DEST, using and
+   updating the state CONV.  Return the number of bytes written and store
+   the number of bytes read in *CONSUMED.  If FINAL is false, an incomplete
+   multibyte sequence at the end of SRC is left unread.  */
+static int
+conv_chunk (fz_context *ctx, const struct encoding *from,
+	    const struct encoding *to, struct conv *conv, const char *src,
+	    int srclen, unsigned char *dest, int destlen, bool final,
+	    int *consumed)
+{
+  int written = 0;
+  int read_total = 0;
+
+  while (read_total < srclen)
+    {
+      ucs4_t pwc;
+      int left = srclen - read_total;
+      int read;
+
+      /* Bulk conversion between big-endian UTF-16 and UTF-8.  The kernel
+	 stops at byte-order marks and invalid input, which are handled
+	 below.  */
+      if (to->wctomb == utf8_wctomb
+	  && (from->mbtowc == utf16be_mbtowc
+	      || (from->mbtowc == utf16_mbtowc && conv->istate == 0)))
+	{
+	  written += pdfout_utf16be_to_utf8 ((const unsigned char *) src
+					     + read_total, left,
+					     dest + written,
+					     destlen - written, &read);
+	  read_total += read;
+	  left -= read;
+	}
+      else if (from->mbtowc == utf8_mbtowc
+	       && (to->wctomb == utf16be_wctomb
+		   || (to->wctomb == utf16_wctomb && conv->ostate)))
+	{
+	  written += pdfout_utf8_to_utf16be ((const unsigned char *) src
+					     + read_total, left,
+					     dest + written,
+					     destlen - written, &read);
+	  read_total += read;
+	  left -= read;
+	}
+      if (left == 0)
+	break;
+
+      read = from->mbtowc (conv, &pwc,
+			   (const unsigned char *) src + read_total,
+			   10 < left ? 10 : left);
+      if (read < 0)
+	{
+	  /* Byte-order marks are read without producing a codepoint.  */
+	  if (read % 2 == 0 && read < RET_TOOFEW(0))
+	    {
+	      read_total += (-2 - read) / 2;
+	      continue;
+	    }
+	  if (read == RET_TOOFEW(0) && !final)
+	    break;
+	  pdfout_throw (ctx, "pdfout_charset_conv: invalid %s multibyte",
+			from->name);
+	}
+      read_total += read;
+
+      int n = to->wctomb (conv, dest + written, pwc, destlen - written);
+
+      if (n > 0)
+	written += n;
+      else if (n == RET_ILUNI)
+	fz_throw (ctx, FZ_ERROR_ABORT,
+		  "pdfout_charset_conv: codepoint 0x%x invalid in %s",
+		  pwc, to->name);
+      else if (n == RET_TOOSMALL)
+	pdfout_throw (ctx, "pdfout_charset_conv: output buffer of length %d"
+		      " too small", destlen);
+      else
+	abort();
+    }
+
+  *consumed = read_total;
+  return written;
+}
+
+static int
+conv_mem (fz_context *ctx, const struct encoding *from,
+	  const struct encoding *to, const char *src, int srclen,
+	  unsigned char *dest, int destlen)
+{
+  struct conv conv = {0};
+  int consumed;
+
+  return conv_chunk (ctx, from, to, &conv, src, srclen, dest, destlen, true,
+		     &consumed);
+}
+
+int
+pdfout_char_conv_length (fz_context *ctx, const char *fromcode,
+			 const char *tocode, int srclen)
+{
+  return max_length (ctx, get_encoding (ctx, fromcode),
+		     get_encoding (ctx, tocode), srclen);
+}
+
+int
+pdfout_char_conv_mem (fz_context *ctx, const char *fromcode,
+		      const char *tocode, const char *src, int srclen,
+		      char *dest, int destlen)
+{
+  return conv_mem (ctx, get_encoding (ctx, fromcode),
+		   get_encoding (ctx, tocode), src, srclen,
+		   (unsigned char *) dest, destlen);
+}
+
 char *
 pdfout_char_conv (fz_context *ctx, const char *fromcode, const char *tocode,
 		  const char *src, int srclen, int *lengthp)
 {
-  fz_buffer *buf = fz_new_buffer (ctx, 1);
-  unsigned char *result;
-  
+  struct encoding *from = get_encoding (ctx, fromcode);
+  struct encoding *to = get_encoding (ctx, tocode);
+  int size = max_length (ctx, from, to, srclen) + 4;
+  char *result = fz_malloc (ctx, size);
+  int len;
+
   fz_try (ctx)
-  {
-    pdfout_char_conv_buffer (ctx, fromcode, tocode, src, srclen, buf);
-  
-    /* Zero-terminate.  */
-    fz_write_buffer (ctx, buf, "\0\0\0\0", 4);
-  
-  
-    *lengthp = fz_buffer_storage (ctx, buf, &result) - 4;
-  }
+    len = conv_mem (ctx, from, to, src, srclen, (unsigned char *) result,
+		    size - 4);
   fz_catch (ctx)
-  {
-    fz_drop_buffer (ctx, buf);
-    fz_rethrow (ctx);
-  }
+    {
+      free (result);
+      fz_rethrow (ctx);
+    }
+
+  /* Zero-terminate.  */
+  memset (result + len, 0, 4);
 
-  /* Hack: Just free the buffer's struct, but not it's data.  */
-  free (buf);
-  return (char *) result;
+  /* Give back the slack of a loose bound, e.g. for CJK text in UTF-8.  */
+  if (len + 4 < size / 2)
+    result = fz_resize_array (ctx, result, len + 4, 1);
+
+  *lengthp = len;
+  return result;
 }
 
 void
@@ -843,63 +1005,210 @@ pdfout_char_conv_buffer (fz_context *ctx, const char *fromcode,
 			 const char *tocode, const char *src, int srclen,
 			 fz_buffer *buf)
 {
-  mbtowc_func mbtowc = NULL;
-  wctomb_func wctomb = NULL;
-    
-  struct encoding *encoding = get_encoding (ctx, fromcode);
-  
-  
-  mbtowc = encoding->mbtowc;
-  
-  encoding = get_encoding (ctx, tocode);
-  
-  if (encoding == NULL)
-    pdfout_throw (ctx, "unknown encoding '%s'", tocode);
-  
-  wctomb = encoding->wctomb;
+  struct encoding *from = get_encoding (ctx, fromcode);
+  struct encoding *to = get_encoding (ctx, tocode);
+  int needed = max_length (ctx, from, to, srclen);
 
-  struct conv conv = {0};
+  if (buf->cap - buf->len < needed)
+    fz_resize_buffer (ctx, buf, buf->len + needed);
 
-  while (srclen)
+  buf->len += conv_mem (ctx, from, to, src, srclen, buf->data + buf->len,
+			needed);
+}
+
+/* Streaming conversion.  */
+
+/* Longest multibyte sequence accepted by any mbtowc function.  */
+enum { PENDING_MAX = 6 };
+
+struct pdfout_char_converter_s
+{
+  struct encoding *from;
+  struct encoding *to;
+  struct conv conv;
+  /* Incomplete multibyte sequence from the end of the last chunk.  */
+  char pending[PENDING_MAX];
+  int pending_len;
+};
+
+pdfout_char_converter *
+pdfout_char_converter_new (fz_context *ctx, const char *fromcode,
+			   const char *tocode)
+{
+  struct encoding *from = get_encoding (ctx, fromcode);
+  struct encoding *to = get_encoding (ctx, tocode);
+  pdfout_char_converter *conv = fz_malloc_struct (ctx, pdfout_char_converter);
+
+  conv->from = from;
+  conv->to = to;
+  return conv;
+}
+
+void
+pdfout_char_converter_drop (fz_context *ctx, pdfout_char_converter *conv)
+{
+  free (conv);
+}
+
+/* Convert SRCLEN bytes at SRC with CONV's state and append them to BUF.
+   Return the number of bytes read.  */
+static int
+converter_chunk (fz_context *ctx, pdfout_char_converter *conv,
+		 const char *src, int srclen, fz_buffer *buf, bool final)
+{
+  int needed = max_length (ctx, conv->from, conv->to, srclen);
+  int consumed;
+
+  if (buf->cap - buf->len < needed)
+    fz_resize_buffer (ctx, buf, buf->len + needed);
+
+  buf->len += conv_chunk (ctx, conv->from, conv->to, &conv->conv, src,
+			  srclen, buf->data + buf->len, needed, final,
+			  &consumed);
+  return consumed;
+}
+
+void
+pdfout_char_converter_feed (fz_context *ctx, pdfout_char_converter *conv,
+			    const char *src, int srclen, fz_buffer *buf)
+{
+  if (conv->pending_len)
     {
-      ucs4_t pwc;
-      int read;
-	
-      read = mbtowc (&conv, &pwc, (const unsigned char *) src,
-		     10 < srclen ? 10 : srclen);
-      if (read < 0)
-	pdfout_throw (ctx, "pdfout_charset_conv: invalid %s multibyte",
-		      fromcode);
-      src += read;
-      srclen -= read;
-
-      unsigned char tmp[10];
-      int written = wctomb (&conv, tmp, pwc, 10);
-	
-      if (written > 0)
-	fz_write_buffer (ctx, buf, tmp, written);
-      else if (written == RET_ILUNI)
-	fz_throw (ctx, FZ_ERROR_ABORT,
-		  "pdfout_charset_conv: codepoint 0x%x invalid in %s",
-		  pwc, tocode);
-      else
-	abort();
+      /* Complete the pending sequence with the first bytes of SRC.  */
+      char tmp[PENDING_MAX + 10];
+      int old_len = conv->pending_len;
+      int add = srclen < 10 ? srclen : 10;
+
+      memcpy (tmp, conv->pending, old_len);
+      memcpy (tmp + old_len, src, add);
+
+      int consumed = converter_chunk (ctx, conv, tmp, old_len + add, buf,
+				      false);
+      if (consumed < old_len)
+	{
+	  /* Still incomplete, so all of SRC is in TMP.  */
+	  conv->pending_len = old_len + add - consumed;
+	  memcpy (conv->pending, tmp + consumed, conv->pending_len);
+	  return;
+	}
+      src += consumed - old_len;
+      srclen -= consumed - old_len;
+      conv->pending_len = 0;
+    }
+
+  int consumed = converter_chunk (ctx, conv, src, srclen, buf, false);
+
+  conv->pending_len = srclen - consumed;
+  memcpy (conv->pending, src + consumed, conv->pending_len);
+}
+
+void
+pdfout_char_converter_finish (fz_context *ctx, pdfout_char_converter *conv,
+			      fz_buffer *buf)
+{
+  if (conv->pending_len)
+    {
+      int len = conv->pending_len;
+      conv->pending_len = 0;
+      converter_chunk (ctx, conv, conv->pending, len, buf, true);
     }
 }
-    
+
+/* fz_output filter.  */
+
+struct conv_output
+{
+  pdfout_char_converter *conv;
+  fz_output *chain;
+  fz_buffer *buf;
+};
+
+static void
+flush_conv_output (fz_context *ctx, struct conv_output *state)
+{
+  fz_write (ctx, state->chain, state->buf->data, state->buf->len);
+  state->buf->len = 0;
+}
+
+static void
+conv_output_write (fz_context *ctx, void *opaque, const void *data, size_t n)
+{
+  struct conv_output *state = opaque;
+
+  while (n)
+    {
+      int len = n < 4096 ? n : 4096;
+      pdfout_char_converter_feed (ctx, state->conv, data, len, state->buf);
+      flush_conv_output (ctx, state);
+      data = (const char *) data + len;
+      n -= len;
+    }
+}
+
+/* Called by fz_drop_output, which must not throw.  */
+static void
+conv_output_close (fz_context *ctx, void *opaque)
+{
+  struct conv_output *state = opaque;
+
+  fz_try (ctx)
+  {
+    pdfout_char_converter_finish (ctx, state->conv, state->buf);
+    flush_conv_output (ctx, state);
+  }
+  fz_always (ctx)
+  {
+    fz_drop_buffer (ctx, state->buf);
+    pdfout_char_converter_drop (ctx, state->conv);
+    free (state);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_warn (ctx, "conversion output: %s", fz_caught_message (ctx));
+  }
+}
+
+fz_output *
+pdfout_new_char_conv_output (fz_context *ctx, fz_output *chain,
+			     const char *fromcode, const char *tocode)
+{
+  struct conv_output *state = fz_malloc_struct (ctx, struct conv_output);
+  fz_output *out;
+
+  fz_try (ctx)
+  {
+    state->conv = pdfout_char_converter_new (ctx, fromcode, tocode);
+    state->buf = fz_new_buffer (ctx, 4096);
+    state->chain = chain;
+    out = fz_new_output (ctx, state, conv_output_write, conv_output_close);
+  }
+  fz_catch (ctx)
+  {
+    fz_drop_buffer (ctx, state->buf);
+    pdfout_char_converter_drop (ctx, state->conv);
+    free (state);
+    fz_rethrow (ctx);
+  }
+
+  return out;
+}
+
+static const char *
+pdf_string_encoding (const char *s, int len)
+{
+  if (len >= 2
+      && (memcmp (s, "\xfe\xff", 2) == 0 || memcmp (s, "\xff\xfe", 2) == 0))
+    return "UTF-16";
+  else
+    return "PDFDOC";
+}
 
 char *
 pdfout_pdf_to_utf8 (fz_context *ctx, const char *inbuf, int inbuf_len,
 		    int *outbuf_len)
 {
-  if (inbuf_len >= 2
-      && (memcmp (inbuf, "\xfe\xff", 2) == 0
-	  || memcmp (inbuf, "\xff\xfe", 2) == 0))
-    return pdfout_char_conv (ctx, "UTF-16", "C", inbuf, inbuf_len,
-			     outbuf_len);
-  else
-    return pdfout_char_conv (ctx, "PDFDOC", "C", inbuf, inbuf_len,
-			     outbuf_len);
+  return pdfout_char_conv (ctx, pdf_string_encoding (inbuf, inbuf_len), "C",
+			   inbuf, inbuf_len, outbuf_len);
 }
 
 char *
@@ -957,6 +1266,27 @@ pdfout_str_obj_to_utf8 (fz_context *ctx, pdf_obj *string, int *len)
   return pdfout_pdf_to_utf8 (ctx, text, text_len, len);
 }
 
+int
+pdfout_str_obj_utf8_length (fz_context *ctx, pdf_obj *string)
+{
+  const char *text = pdf_to_str_buf (ctx, string);
+  int text_len = pdf_to_str_len (ctx, string);
+
+  return pdfout_char_conv_length (ctx, pdf_string_encoding (text, text_len),
+				  "C", text_len);
+}
+
+int
+pdfout_str_obj_to_utf8_mem (fz_context *ctx, pdf_obj *string, char *dest,
+			    int destlen)
+{
+  const char *text = pdf_to_str_buf (ctx, string);
+  int text_len = pdf_to_str_len (ctx, string);
+
+  return pdfout_char_conv_mem (ctx, pdf_string_encoding (text, text_len),
+			       "C", text, text_len, dest, destlen);
+}
+
 
 /* 
    Copyright (C) 2002, 2005-2006, 2009-2016 Free Software Foundation, Inc.
@@ -1146,3 +1476,31 @@ pdfout_check_utf8 (const char *s, size_t n)
   return (char *) u8_check ((const uint8_t *) s, n);
 }
 
+char *
+pdfout_repair_utf8 (fz_context *ctx, const char *s, int n, int *len)
+{
+  /* Each invalid byte grows from one to three bytes.  */
+  char *result = fz_malloc (ctx, 3 * (size_t) n + 1);
+  char *dest = result;
+  const char *end = s + n;
+
+  while (s < end)
+    {
+      const char *bad = pdfout_check_utf8 (s, end - s);
+      const char *stop = bad ? bad : end;
+      memcpy (dest, s, stop - s);
+      dest += stop - s;
+      s = stop;
+      if (bad)
+	{
+	  memcpy (dest, "\xef\xbf\xbd", 3);
+	  dest += 3;
+	  ++s;
+	}
+    }
+
+  *dest = '\0';
+  *len = dest - result;
+  return result;
+}
+
@@ -16,6 +16,16 @@ pdfout_utf8_to_str_obj (fz_context *ctx, pdf_document *doc,
 char *
 pdfout_str_obj_to_utf8 (fz_context *ctx, pdf_obj *string, int *len);
 
+/* Return an upper bound for the UTF-8 length of STRING.  */
+int
+pdfout_str_obj_utf8_length (fz_context *ctx, pdf_obj *string);
+
+/* Store STRING as UTF-8 in the DESTLEN bytes at DEST, without
+   zero-termination.  Return the number of bytes written.  */
+int
+pdfout_str_obj_to_utf8_mem (fz_context *ctx, pdf_obj *string, char *dest,
+			    int destlen);
+
 /* If a codepoint cannot be stored in the target encoding, throw
    FZ_ERROR_ABORT. On all other errors throw FZ_ERROR_GENERIC.  */
 void
@@ -23,9 +33,84 @@ pdfout_char_conv_buffer (fz_context *ctx, const char *fromcode,
 			 const char *tocode, const char *src, int srclen,
 			 fz_buffer *buf);
 
+/* Return an upper bound for the number of bytes needed to store SRCLEN
+   bytes of FROMCODE in TOCODE.  */
+int
+pdfout_char_conv_length (fz_context *ctx, const char *fromcode,
+			 const char *tocode, int srclen);
+
+/* Like pdfout_char_conv_buffer, but write into the DESTLEN bytes at DEST and
+   return the number of bytes written.  Throw if DESTLEN is too small.
+   DESTLEN = pdfout_char_conv_length (...) is always sufficient.  */
+int
+pdfout_char_conv_mem (fz_context *ctx, const char *fromcode,
+		      const char *tocode, const char *src, int srclen,
+		      char *dest, int destlen);
+
 /* Return newly allocated buffer and store it's length in *LENGTHP.  */
 char *
 pdfout_char_conv (fz_context *ctx, const char *fromcode, const char *tocode,
 		  const char *src, int srclen, int *lengthp);
 
+/* Streaming conversion.  The converter keeps the byte-order mark state and
+   incomplete multibyte sequences between calls of
+   pdfout_char_converter_feed.  */
+typedef struct pdfout_char_converter_s pdfout_char_converter;
+
+pdfout_char_converter *
+pdfout_char_converter_new (fz_context *ctx, const char *fromcode,
+			   const char *tocode);
+
+void
+pdfout_char_converter_drop (fz_context *ctx, pdfout_char_converter *conv);
+
+/* Convert SRCLEN bytes at SRC and append the result to BUF.  */
+void
+pdfout_char_converter_feed (fz_context *ctx, pdfout_char_converter *conv,
+			    const char *src, int srclen, fz_buffer *buf);
+
+/* Throw if the input ended with an incomplete multibyte sequence.  */
+void
+pdfout_char_converter_finish (fz_context *ctx, pdfout_char_converter *conv,
+			      fz_buffer *buf);
+
+/* Return an output which converts everything written to it from FROMCODE
+   to TOCODE and writes the result to CHAIN.  Dropping the output does not
+   drop CHAIN.  As fz_drop_output cannot fail, an incomplete multibyte
+   sequence at the end of the input is only reported as a warning and
+   dropped, so only use this for input which is known to end on a
+   character boundary, like the UTF-8 of the text extraction.  Use
+   pdfout_char_converter_finish to detect truncated input.  */
+fz_output *
+pdfout_new_char_conv_output (fz_context *ctx, fz_output *chain,
+			     const char *fromcode, const char *tocode);
+
+/* Bulk UTF-16BE <-> UTF-8 kernels.  Convert the longest prefix of SRC
+   consisting of complete, valid sequences without byte-order marks into
+   the DESTLEN bytes at DEST.  Store the number of bytes read in *READ and
+   return the number of bytes written.  */
+int
+pdfout_utf16be_to_utf8 (const unsigned char *src, int srclen,
+			unsigned char *dest, int destlen, int *read);
+
+int
+pdfout_utf8_to_utf16be (const unsigned char *src, int srclen,
+			unsigned char *dest, int destlen, int *read);
+
+enum
+{
+  /* Use the generic conversion functions only.  */
+  PDFOUT_KERNELS_NONE,
+  PDFOUT_KERNELS_SCALAR,
+  /* Vectorized kernels, if supported by the CPU.  */
+  PDFOUT_KERNELS_SIMD
+};
+
+/* Select the kernels used by the conversion functions.  The scalar kernels
+   are used until then.  Not thread-safe: the program selects the SIMD
+   kernels at start-up, tests and benchmarks may switch them before any
+   worker thread is started.  */
+void
+pdfout_select_kernels (int kernels);
+
 #endif /* !HAVE_CHARSET_CONVERSION_H */
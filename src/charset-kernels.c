@@ -0,0 +1,407 @@
+/* The pdfout document modification and analysis tool.
+   Copyright (C) 2015 AUTHORS (see AUTHORS file)
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* Bulk UTF-16BE <-> UTF-8 transcoding.  The kernels only handle valid,
+   complete sequences and stop at everything else (byte-order marks,
+   unpaired surrogates, invalid or truncated input), which is left to the
+   generic mbtowc/wctomb loop in charset-conversion.c.  That way errors are
+   reported exactly as before.  */
+
+#include "common.h"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+# define HAVE_SSSE3_KERNELS 1
+# include <tmmintrin.h>
+#endif
+
+typedef int (*kernel_func) (const unsigned char *src, int srclen,
+			    unsigned char *dest, int destlen, int *read);
+
+static int
+utf16be_to_utf8_scalar (const unsigned char *src, int srclen,
+			unsigned char *dest, int destlen, int *read)
+{
+  int i = 0, o = 0;
+
+  while (srclen - i >= 2)
+    {
+      unsigned u = (src[i] << 8) | src[i + 1];
+
+      if (u < 0x80)
+	{
+	  if (destlen - o < 1)
+	    break;
+	  dest[o++] = u;
+	  i += 2;
+	}
+      else if (u < 0x800)
+	{
+	  if (destlen - o < 2)
+	    break;
+	  dest[o++] = 0xc0 | (u >> 6);
+	  dest[o++] = 0x80 | (u & 0x3f);
+	  i += 2;
+	}
+      else if ((u & 0xf800) != 0xd800)
+	{
+	  if (u == 0xfeff || u == 0xfffe || destlen - o < 3)
+	    break;
+	  dest[o++] = 0xe0 | (u >> 12);
+	  dest[o++] = 0x80 | ((u >> 6) & 0x3f);
+	  dest[o++] = 0x80 | (u & 0x3f);
+	  i += 2;
+	}
+      else if (u < 0xdc00)
+	{
+	  if (srclen - i < 4 || destlen - o < 4)
+	    break;
+	  unsigned u2 = (src[i + 2] << 8) | src[i + 3];
+	  if (u2 < 0xdc00 || u2 >= 0xe000)
+	    break;
+	  unsigned c = 0x10000 + ((u - 0xd800) << 10) + (u2 - 0xdc00);
+	  dest[o++] = 0xf0 | (c >> 18);
+	  dest[o++] = 0x80 | ((c >> 12) & 0x3f);
+	  dest[o++] = 0x80 | ((c >> 6) & 0x3f);
+	  dest[o++] = 0x80 | (c & 0x3f);
+	  i += 4;
+	}
+      else
+	break;
+    }
+
+  *read = i;
+  return o;
+}
+
+static int
+utf8_to_utf16be_scalar (const unsigned char *src, int srclen,
+			unsigned char *dest, int destlen, int *read)
+{
+  int i = 0, o = 0;
+
+  while (i < srclen)
+    {
+      unsigned c = src[i];
+
+      if (c < 0x80)
+	{
+	  if (destlen - o < 2)
+	    break;
+	  dest[o++] = 0;
+	  dest[o++] = c;
+	  i += 1;
+	}
+      else if (c < 0xc2)
+	break;
+      else if (c < 0xe0)
+	{
+	  if (srclen - i < 2 || destlen - o < 2 || (src[i + 1] ^ 0x80) >= 0x40)
+	    break;
+	  unsigned u = ((c & 0x1f) << 6) | (src[i + 1] ^ 0x80);
+	  dest[o++] = u >> 8;
+	  dest[o++] = u;
+	  i += 2;
+	}
+      else if (c < 0xf0)
+	{
+	  if (srclen - i < 3 || destlen - o < 2)
+	    break;
+	  unsigned c1 = src[i + 1], c2 = src[i + 2];
+	  if ((c1 ^ 0x80) >= 0x40 || (c2 ^ 0x80) >= 0x40
+	      || (c == 0xe0 && c1 < 0xa0) || (c == 0xed && c1 >= 0xa0))
+	    break;
+	  unsigned u = ((c & 0x0f) << 12) | ((c1 ^ 0x80) << 6) | (c2 ^ 0x80);
+	  /* U+FFFE is rejected by the UTF-16 wctomb.  */
+	  if (u == 0xfffe)
+	    break;
+	  dest[o++] = u >> 8;
+	  dest[o++] = u;
+	  i += 3;
+	}
+      else if (c < 0xf5)
+	{
+	  if (srclen - i < 4 || destlen - o < 4)
+	    break;
+	  unsigned c1 = src[i + 1], c2 = src[i + 2], c3 = src[i + 3];
+	  if ((c1 ^ 0x80) >= 0x40 || (c2 ^ 0x80) >= 0x40 || (c3 ^ 0x80) >= 0x40
+	      || (c == 0xf0 && c1 < 0x90) || (c == 0xf4 && c1 >= 0x90))
+	    break;
+	  unsigned u = (((c & 0x07) << 18) | ((c1 ^ 0x80) << 12)
+			| ((c2 ^ 0x80) << 6) | (c3 ^ 0x80)) - 0x10000;
+	  unsigned w1 = 0xd800 + (u >> 10), w2 = 0xdc00 + (u & 0x3ff);
+	  dest[o++] = w1 >> 8;
+	  dest[o++] = w1;
+	  dest[o++] = w2 >> 8;
+	  dest[o++] = w2;
+	  i += 4;
+	}
+      else
+	break;
+    }
+
+  *read = i;
+  return o;
+}
+
+#ifdef HAVE_SSSE3_KERNELS
+
+/* Number of input bytes handed to the scalar kernel after a block that
+   cannot be vectorized.  */
+#define MIXED_STRETCH (srclen - i < 64 ? srclen - i : 64)
+
+/* Convert 8 code units at a time if they are all ASCII, all two-byte or all
+   three-byte UTF-8 (which covers CJK text).  Mixed blocks and surrogates
+   go through the scalar kernel.  */
+__attribute__ ((target ("ssse3")))
+static int
+utf16be_to_utf8_ssse3 (const unsigned char *src, int srclen,
+		       unsigned char *dest, int destlen, int *read)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i swap = _mm_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6,
+				      9, 8, 11, 10, 13, 12, 15, 14);
+  const __m128i not_ascii = _mm_set1_epi16 ((short) 0xff80);
+  const __m128i top5 = _mm_set1_epi16 ((short) 0xf800);
+  const __m128i surrogate = _mm_set1_epi16 ((short) 0xd800);
+  const __m128i bom = _mm_set1_epi16 ((short) 0xfeff);
+  const __m128i swapped_bom = _mm_set1_epi16 ((short) 0xfffe);
+  const __m128i low6 = _mm_set1_epi16 (0x3f);
+  const __m128i lead2 = _mm_set1_epi16 (0xc0);
+  const __m128i lead3 = _mm_set1_epi16 (0xe0);
+  const __m128i cont = _mm_set1_epi16 (0x80);
+  /* Interleave the lead and first continuation bytes (T) with the second
+     continuation bytes (P2) into 24 output bytes.  */
+  const __m128i t_lo = _mm_setr_epi8 (0, 1, -1, 2, 3, -1, 4, 5,
+				      -1, 6, 7, -1, 8, 9, -1, 10);
+  const __m128i p2_lo = _mm_setr_epi8 (-1, -1, 0, -1, -1, 1, -1, -1,
+				       2, -1, -1, 3, -1, -1, 4, -1);
+  const __m128i t_hi = _mm_setr_epi8 (11, -1, 12, 13, -1, 14, 15, -1,
+				      -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i p2_hi = _mm_setr_epi8 (-1, 5, -1, -1, 6, -1, -1, 7,
+				       -1, -1, -1, -1, -1, -1, -1, -1);
+  int i = 0, o = 0;
+
+  while (srclen - i >= 16 && destlen - o >= 24)
+    {
+      __m128i v = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)
+						     (src + i)), swap);
+      int ascii = _mm_movemask_epi8
+	(_mm_cmpeq_epi16 (_mm_and_si128 (v, not_ascii), zero));
+      int below_800 = _mm_movemask_epi8
+	(_mm_cmpeq_epi16 (_mm_and_si128 (v, top5), zero));
+
+      if (ascii == 0xffff)
+	{
+	  _mm_storel_epi64 ((__m128i *) (dest + o), _mm_packus_epi16 (v, v));
+	  i += 16;
+	  o += 8;
+	  continue;
+	}
+
+      if (below_800 == 0xffff && ascii == 0)
+	{
+	  __m128i b0 = _mm_or_si128 (_mm_srli_epi16 (v, 6), lead2);
+	  __m128i b1 = _mm_or_si128 (_mm_and_si128 (v, low6), cont);
+	  __m128i p0 = _mm_packus_epi16 (b0, b0);
+	  __m128i p1 = _mm_packus_epi16 (b1, b1);
+	  _mm_storeu_si128 ((__m128i *) (dest + o), _mm_unpacklo_epi8 (p0, p1));
+	  i += 16;
+	  o += 16;
+	  continue;
+	}
+
+      int special = _mm_movemask_epi8
+	(_mm_or_si128 (_mm_cmpeq_epi16 (_mm_and_si128 (v, top5), surrogate),
+		       _mm_or_si128 (_mm_cmpeq_epi16 (v, bom),
+				     _mm_cmpeq_epi16 (v, swapped_bom))));
+      if (below_800 == 0 && special == 0)
+	{
+	  __m128i b0 = _mm_or_si128 (_mm_srli_epi16 (v, 12), lead3);
+	  __m128i b1 = _mm_or_si128 (_mm_and_si128 (_mm_srli_epi16 (v, 6),
+						    low6), cont);
+	  __m128i b2 = _mm_or_si128 (_mm_and_si128 (v, low6), cont);
+	  __m128i p0 = _mm_packus_epi16 (b0, b0);
+	  __m128i p1 = _mm_packus_epi16 (b1, b1);
+	  __m128i p2 = _mm_packus_epi16 (b2, b2);
+	  __m128i t = _mm_unpacklo_epi8 (p0, p1);
+	  __m128i lo = _mm_or_si128 (_mm_shuffle_epi8 (t, t_lo),
+				     _mm_shuffle_epi8 (p2, p2_lo));
+	  __m128i hi = _mm_or_si128 (_mm_shuffle_epi8 (t, t_hi),
+				     _mm_shuffle_epi8 (p2, p2_hi));
+	  _mm_storeu_si128 ((__m128i *) (dest + o), lo);
+	  _mm_storel_epi64 ((__m128i *) (dest + o + 16), hi);
+	  i += 16;
+	  o += 24;
+	  continue;
+	}
+
+      /* Mixed block.  Continue with the scalar kernel for a while, as the
+	 next blocks are probably mixed, too.  */
+      int r;
+      o += utf16be_to_utf8_scalar (src + i, MIXED_STRETCH, dest + o,
+				   destlen - o, &r);
+      if (r == 0)
+	break;
+      i += r;
+    }
+
+  int r;
+  o += utf16be_to_utf8_scalar (src + i, srclen - i, dest + o, destlen - o,
+			       &r);
+  *read = i + r;
+  return o;
+}
+
+/* Widen 16 ASCII bytes at a time, or convert five three-byte sequences
+   (CJK text) from 15 bytes.  */
+__attribute__ ((target ("ssse3")))
+static int
+utf8_to_utf16be_ssse3 (const unsigned char *src, int srclen,
+		       unsigned char *dest, int destlen, int *read)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  /* Masks and expected values for lead and continuation bytes.  The last
+     byte is ignored.  */
+  const __m128i class_mask = _mm_setr_epi8 (-16, -64, -64, -16, -64, -64,
+					    -16, -64, -64, -16, -64, -64,
+					    -16, -64, -64, 0);
+  const __m128i class_value = _mm_setr_epi8 (-32, -128, -128, -32, -128, -128,
+					     -32, -128, -128, -32, -128, -128,
+					     -32, -128, -128, 0);
+  const __m128i lead_pos = _mm_setr_epi8 (0, -1, 3, -1, 6, -1, 9, -1,
+					  12, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i c1_pos = _mm_setr_epi8 (1, -1, 4, -1, 7, -1, 10, -1,
+					13, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i c2_pos = _mm_setr_epi8 (2, -1, 5, -1, 8, -1, 11, -1,
+					14, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i swap = _mm_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6,
+				      9, 8, 11, 10, 13, 12, 15, 14);
+  const __m128i low4 = _mm_set1_epi16 (0x0f);
+  const __m128i low6 = _mm_set1_epi16 (0x3f);
+  const __m128i top5 = _mm_set1_epi16 ((short) 0xf800);
+  const __m128i surrogate = _mm_set1_epi16 ((short) 0xd800);
+  const __m128i swapped_bom = _mm_set1_epi16 ((short) 0xfffe);
+  int i = 0, o = 0;
+
+  while (srclen - i >= 16 && destlen - o >= 32)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+
+      if (_mm_movemask_epi8 (v) == 0)
+	{
+	  _mm_storeu_si128 ((__m128i *) (dest + o),
+			    _mm_unpacklo_epi8 (zero, v));
+	  _mm_storeu_si128 ((__m128i *) (dest + o + 16),
+			    _mm_unpackhi_epi8 (zero, v));
+	  i += 16;
+	  o += 32;
+	  continue;
+	}
+
+      if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_and_si128 (v, class_mask),
+					     class_value)) == 0xffff)
+	{
+	  __m128i lead = _mm_and_si128 (_mm_shuffle_epi8 (v, lead_pos), low4);
+	  __m128i c1 = _mm_and_si128 (_mm_shuffle_epi8 (v, c1_pos), low6);
+	  __m128i c2 = _mm_and_si128 (_mm_shuffle_epi8 (v, c2_pos), low6);
+	  __m128i u = _mm_or_si128 (_mm_slli_epi16 (lead, 12),
+				    _mm_or_si128 (_mm_slli_epi16 (c1, 6), c2));
+	  /* Reject overlong forms, surrogates and U+FFFE.  */
+	  __m128i bad = _mm_or_si128
+	    (_mm_cmpeq_epi16 (_mm_and_si128 (u, top5), zero),
+	     _mm_or_si128 (_mm_cmpeq_epi16 (_mm_and_si128 (u, top5),
+					    surrogate),
+			   _mm_cmpeq_epi16 (u, swapped_bom)));
+	  if ((_mm_movemask_epi8 (bad) & 0x3ff) == 0)
+	    {
+	      _mm_storeu_si128 ((__m128i *) (dest + o),
+				_mm_shuffle_epi8 (u, swap));
+	      i += 15;
+	      o += 10;
+	      continue;
+	    }
+	}
+
+      int r;
+      o += utf8_to_utf16be_scalar (src + i, MIXED_STRETCH, dest + o,
+				   destlen - o, &r);
+      if (r == 0)
+	break;
+      i += r;
+    }
+
+  int r;
+  o += utf8_to_utf16be_scalar (src + i, srclen - i, dest + o, destlen - o,
+			       &r);
+  *read = i + r;
+  return o;
+}
+
+#endif	/* HAVE_SSSE3_KERNELS */
+
+static int
+no_kernel (const unsigned char *src, int srclen, unsigned char *dest,
+	   int destlen, int *read)
+{
+  *read = 0;
+  return 0;
+}
+
+/* Only written by pdfout_select_kernels, which the program calls once at
+   start-up, before any worker thread exists.  */
+static kernel_func utf16be_to_utf8_kernel = utf16be_to_utf8_scalar;
+static kernel_func utf8_to_utf16be_kernel = utf8_to_utf16be_scalar;
+
+void
+pdfout_select_kernels (int kernels)
+{
+#ifdef HAVE_SSSE3_KERNELS
+  if (kernels == PDFOUT_KERNELS_SIMD)
+    {
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("ssse3"))
+	{
+	  utf16be_to_utf8_kernel = utf16be_to_utf8_ssse3;
+	  utf8_to_utf16be_kernel = utf8_to_utf16be_ssse3;
+	  return;
+	}
+    }
+#endif
+  if (kernels == PDFOUT_KERNELS_NONE)
+    {
+      utf16be_to_utf8_kernel = no_kernel;
+      utf8_to_utf16be_kernel = no_kernel;
+    }
+  else
+    {
+      utf16be_to_utf8_kernel = utf16be_to_utf8_scalar;
+      utf8_to_utf16be_kernel = utf8_to_utf16be_scalar;
+    }
+}
+
+int
+pdfout_utf16be_to_utf8 (const unsigned char *src, int srclen,
+			unsigned char *dest, int destlen, int *read)
+{
+  return utf16be_to_utf8_kernel (src, srclen, dest, destlen, read);
+}
+
+int
+pdfout_utf8_to_utf16be (const unsigned char *src, int srclen,
+			unsigned char *dest, int destlen, int *read)
+{
+  return utf8_to_utf16be_kernel (src, srclen, dest, destlen, read);
+}
@@ -23,6 +23,15 @@
 #include "page-labels.h"
 #include "info-dict.h"
 #include "outline.h"
+#include "page-index.h"
+#include "hash.h"
+#include "resolve-dest.h"
+#include "reclaim.h"
+#include "keys.h"
+#include "xmp.h"
+#include "text-extraction.h"
+#include "text-search.h"
+#include "text-index.h"
 
 #if __GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR__ >= 7)
 # define PDFOUT_PRINTFLIKE(index)			\
@@ -81,17 +90,12 @@ void pdfout_copy_stream (fz_context *ctx, fz_stream *from, fz_output *too);
 pdf_document *
 pdfout_create_blank_pdf (fz_context *ctx, int page_count, fz_rect *rect);
 
-pdf_obj *pdfout_resolve_dest(fz_context *ctx, pdf_document *doc, pdf_obj *dest);
-
 
 #define pdfout_x2nrealloc(ctx, p, pn, t) \
   ((t *) pdfout_x2nrealloc_imp (ctx, p, pn, sizeof (t)))
 
 void *pdfout_x2nrealloc_imp (fz_context *ctx, void *p, int *pn, unsigned s);
 
-void pdfout_text_get_page (FILE *stream, fz_context *ctx,
-			   pdf_document *doc, int page_number);
-
 
 /* makes incremental update if OUTPUT_FILENAME is NULL, throw on error  */
 void pdfout_write_document (fz_context *ctx, pdf_document *doc,
@@ -101,6 +105,11 @@ void pdfout_write_document (fz_context *ctx, pdf_document *doc,
 int pdfout_uctomb (fz_context *ctx, uint8_t *buf, uint32_t uc, int n);
 
 char *pdfout_check_utf8 (const char *s, size_t n);
+
+/* Return a null-terminated copy of the N bytes at S, with every byte
+   which is not part of a valid UTF-8 sequence replaced by U+FFFD, and
+   store its length in *LEN.  */
+char *pdfout_repair_utf8 (fz_context *ctx, const char *s, int n, int *len);
   
 /* sets *endptr to nptr on overflow */
 int pdfout_strtoint (fz_context *ctx, const char *nptr, char **endptr);
@@ -14,6 +14,8 @@ typedef struct data_scalar_s {
   pdfout_data super;
   int len;
   char *value;
+  /* Emitted with pdfout_emitter_string_scalar.  */
+  bool is_string;
 } data_scalar;
 
 typedef struct data_array_s {
@@ -351,50 +353,67 @@ pdfout_data_scalar_to_pdf_real (fz_context *ctx, pdf_document *doc,
   return pdf_new_real (ctx, doc, f);
 }
 
-pdfout_data *
-pdfout_data_scalar_from_pdf (fz_context *ctx, pdf_obj *obj)
+/* Format OBJ, which must not be a string, into BUF, unless it is a
+   constant.  */
+static const char *
+pdf_scalar_text (fz_context *ctx, pdf_obj *obj, char *buf, int size,
+		 int *len)
 {
   const char *s;
   if (pdf_is_null (ctx, obj))
-    return pdfout_data_scalar_new (ctx, "null", strlen ("null"));
+    s = "null";
   else if (pdf_is_bool (ctx, obj))
-    {
-      if (pdf_to_bool (ctx, obj))
-	s = "true";
-      else
-	s = "false";
-      return pdfout_data_scalar_new (ctx, s, strlen (s));
-    }
+    s = pdf_to_bool (ctx, obj) ? "true" : "false";
   else if (pdf_is_name (ctx, obj))
-    {
-      s = pdf_to_name (ctx, obj);
-      return pdfout_data_scalar_new (ctx, s, strlen (s));
-    }
-  else if (pdf_is_string (ctx, obj))
-    {
-      int len;
-      char *str = pdfout_str_obj_to_utf8 (ctx, obj, &len);
-      pdfout_data *result =  pdfout_data_scalar_new (ctx, str, len);
-      free (str);
-      return result;
-    }
+    s = pdf_to_name (ctx, obj);
   else if (pdf_is_int (ctx, obj))
     {
-      int n = pdf_to_int (ctx, obj);
-      char buf[200];
-      int len = pdfout_snprintf (ctx, buf, "%d", n);
-      return pdfout_data_scalar_new (ctx, buf, len);
+      *len = pdfout_snprintf_imp (ctx, buf, size, "%d",
+				  pdf_to_int (ctx, obj));
+      return buf;
     }
   else if (pdf_is_real (ctx, obj))
     {
-      float f = pdf_to_real (ctx, obj);
-      char buf[200];
-      int len = pdfout_snprintf (ctx, buf, "%g", f);
-      return pdfout_data_scalar_new (ctx, buf, len);
+      *len = pdfout_snprintf_imp (ctx, buf, size, "%g",
+				  pdf_to_real (ctx, obj));
+      return buf;
     }
   else
     abort();
-  
+
+  *len = strlen (s);
+  return s;
+}
+
+pdfout_data *
+pdfout_data_scalar_from_pdf (fz_context *ctx, pdf_obj *obj)
+{
+  if (pdf_is_string (ctx, obj))
+    {
+      /* Convert directly into the scalar's storage.  */
+      int size = pdfout_str_obj_utf8_length (ctx, obj);
+      data_scalar *result = fz_malloc_struct (ctx, data_scalar);
+      result->super.type = SCALAR;
+      fz_try (ctx)
+      {
+	result->value = fz_malloc (ctx, size + 1);
+	result->len = pdfout_str_obj_to_utf8_mem (ctx, obj, result->value,
+						  size);
+	result->value[result->len] = 0;
+      }
+      fz_catch (ctx)
+      {
+	free (result->value);
+	free (result);
+	fz_rethrow (ctx);
+      }
+      return (pdfout_data *) result;
+    }
+
+  char buf[200];
+  int len;
+  const char *s = pdf_scalar_text (ctx, obj, buf, sizeof buf, &len);
+  return pdfout_data_scalar_new (ctx, s, len);
 }
 /* Hash convenience functions */
 
@@ -501,7 +520,9 @@ copy_scalar (fz_context *ctx, pdfout_data *scalar)
 {
   int len;
   const char *data = pdfout_data_scalar_get (ctx, scalar, &len);
-  return pdfout_data_scalar_new (ctx, data, len);
+  pdfout_data *result = pdfout_data_scalar_new (ctx, data, len);
+  to_scalar (ctx, result)->is_string = to_scalar (ctx, scalar)->is_string;
+  return result;
 }
 
 static pdfout_data *
@@ -590,3 +611,261 @@ pdfout_emitter_emit (fz_context *ctx, pdfout_emitter *emitter,
     fz_rethrow (ctx);
 }
 
+void
+pdfout_emitter_emit_events (fz_context *ctx, pdfout_emitter *emitter,
+			    pdfout_data *data)
+{
+  if (pdfout_data_is_scalar (ctx, data))
+    {
+      int len;
+      char *value = pdfout_data_scalar_get (ctx, data, &len);
+      if (to_scalar (ctx, data)->is_string)
+	pdfout_emitter_string_scalar (ctx, emitter, value, len);
+      else
+	emitter->scalar (ctx, emitter, value, len);
+    }
+  else if (pdfout_data_is_array (ctx, data))
+    {
+      emitter->array_start (ctx, emitter);
+      int len = pdfout_data_array_len (ctx, data);
+      for (int i = 0; i < len; ++i)
+	pdfout_emitter_emit_events (ctx, emitter,
+				    pdfout_data_array_get (ctx, data, i));
+      emitter->array_end (ctx, emitter);
+    }
+  else
+    {
+      emitter->hash_start (ctx, emitter);
+      int len = pdfout_data_hash_len (ctx, data);
+      for (int i = 0; i < len; ++i)
+	{
+	  pdfout_emitter_emit_events (ctx, emitter,
+				      pdfout_data_hash_get_key (ctx, data, i));
+	  pdfout_emitter_emit_events (ctx, emitter,
+				      pdfout_data_hash_get_value (ctx, data,
+								  i));
+	}
+      emitter->hash_end (ctx, emitter);
+    }
+}
+
+void
+pdfout_emitter_array_start (fz_context *ctx, pdfout_emitter *emitter)
+{
+  emitter->array_start (ctx, emitter);
+}
+
+void
+pdfout_emitter_array_end (fz_context *ctx, pdfout_emitter *emitter)
+{
+  emitter->array_end (ctx, emitter);
+}
+
+void
+pdfout_emitter_hash_start (fz_context *ctx, pdfout_emitter *emitter)
+{
+  emitter->hash_start (ctx, emitter);
+}
+
+void
+pdfout_emitter_hash_end (fz_context *ctx, pdfout_emitter *emitter)
+{
+  emitter->hash_end (ctx, emitter);
+}
+
+void
+pdfout_emitter_scalar (fz_context *ctx, pdfout_emitter *emitter,
+		       const char *value, int len)
+{
+  emitter->scalar (ctx, emitter, value, len);
+}
+
+void
+pdfout_emitter_string (fz_context *ctx, pdfout_emitter *emitter,
+		       const char *value)
+{
+  emitter->scalar (ctx, emitter, value, strlen (value));
+}
+
+void
+pdfout_emitter_string_scalar (fz_context *ctx, pdfout_emitter *emitter,
+			      const char *value, int len)
+{
+  if (emitter->string_scalar)
+    emitter->string_scalar (ctx, emitter, value, len);
+  else
+    emitter->scalar (ctx, emitter, value, len);
+}
+
+void
+pdfout_emitter_scalar_from_pdf (fz_context *ctx, pdfout_emitter *emitter,
+				pdf_obj *obj)
+{
+  if (pdf_is_string (ctx, obj) == false)
+    {
+      char buf[200];
+      int len;
+      const char *s = pdf_scalar_text (ctx, obj, buf, sizeof buf, &len);
+      emitter->scalar (ctx, emitter, s, len);
+      return;
+    }
+
+  int size = pdfout_str_obj_utf8_length (ctx, obj);
+  char *value = fz_malloc (ctx, size);
+  fz_try (ctx)
+  {
+    int len = pdfout_str_obj_to_utf8_mem (ctx, obj, value, size);
+    emitter->scalar (ctx, emitter, value, len);
+  }
+  fz_always (ctx)
+    free (value);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+/* Data emitter.  */
+
+typedef struct {
+  pdfout_emitter super;
+  pdfout_data *result;
+
+  /* Open arrays and hashes.  */
+  pdfout_data **stack;
+  int depth, cap;
+
+  /* Key of the current hash entry, if its value is still missing.  */
+  pdfout_data *key;
+} data_emitter;
+
+static void
+data_emitter_add (fz_context *ctx, data_emitter *e, pdfout_data *value)
+{
+  if (e->depth == 0)
+    {
+      if (e->result)
+	{
+	  pdfout_data_drop (ctx, value);
+	  pdfout_throw (ctx, "data emitter: more than one toplevel value");
+	}
+      e->result = value;
+      return;
+    }
+
+  pdfout_data *top = e->stack[e->depth - 1];
+  if (pdfout_data_is_array (ctx, top))
+    pdfout_data_array_push (ctx, top, value);
+  else if (e->key == NULL)
+    {
+      if (pdfout_data_is_scalar (ctx, value) == false)
+	{
+	  pdfout_data_drop (ctx, value);
+	  pdfout_throw (ctx, "data emitter: hash key is not a scalar");
+	}
+      e->key = value;
+    }
+  else
+    {
+      pdfout_data_hash_push (ctx, top, e->key, value);
+      e->key = NULL;
+    }
+}
+
+static void
+data_emitter_start (fz_context *ctx, data_emitter *e, pdfout_data *value)
+{
+  data_emitter_add (ctx, e, value);
+  if (e->depth == e->cap)
+    e->stack = pdfout_x2nrealloc (ctx, e->stack, &e->cap, pdfout_data *);
+  e->stack[e->depth++] = value;
+}
+
+static void
+data_emitter_end (fz_context *ctx, data_emitter *e)
+{
+  if (e->depth == 0 || e->key)
+    pdfout_throw (ctx, "data emitter: unbalanced end event");
+  --e->depth;
+}
+
+static void
+data_emitter_array_start (fz_context *ctx, pdfout_emitter *emitter)
+{
+  data_emitter *e = (data_emitter *) emitter;
+  data_emitter_start (ctx, e, pdfout_data_array_new (ctx));
+}
+
+static void
+data_emitter_hash_start (fz_context *ctx, pdfout_emitter *emitter)
+{
+  data_emitter *e = (data_emitter *) emitter;
+  data_emitter_start (ctx, e, pdfout_data_hash_new (ctx));
+}
+
+static void
+data_emitter_container_end (fz_context *ctx, pdfout_emitter *emitter)
+{
+  data_emitter_end (ctx, (data_emitter *) emitter);
+}
+
+static void
+data_emitter_scalar (fz_context *ctx, pdfout_emitter *emitter,
+		     const char *value, int len)
+{
+  data_emitter *e = (data_emitter *) emitter;
+  data_emitter_add (ctx, e, pdfout_data_scalar_new (ctx, value, len));
+}
+
+static void
+data_emitter_string_scalar (fz_context *ctx, pdfout_emitter *emitter,
+			    const char *value, int len)
+{
+  data_emitter *e = (data_emitter *) emitter;
+  pdfout_data *scalar = pdfout_data_scalar_new (ctx, value, len);
+  to_scalar (ctx, scalar)->is_string = true;
+  data_emitter_add (ctx, e, scalar);
+}
+
+static void
+data_emitter_emit (fz_context *ctx, pdfout_emitter *emitter,
+		   pdfout_data *data)
+{
+  data_emitter_add (ctx, (data_emitter *) emitter,
+		    pdfout_data_copy (ctx, data));
+}
+
+static void
+data_emitter_drop (fz_context *ctx, pdfout_emitter *emitter)
+{
+  data_emitter *e = (data_emitter *) emitter;
+  pdfout_data_drop (ctx, e->key);
+  pdfout_data_drop (ctx, e->result);
+  free (e->stack);
+  free (e);
+}
+
+pdfout_emitter *
+pdfout_emitter_data_new (fz_context *ctx)
+{
+  data_emitter *result = fz_malloc_struct (ctx, data_emitter);
+  result->super.drop = data_emitter_drop;
+  result->super.emit = data_emitter_emit;
+  result->super.array_start = data_emitter_array_start;
+  result->super.array_end = data_emitter_container_end;
+  result->super.hash_start = data_emitter_hash_start;
+  result->super.hash_end = data_emitter_container_end;
+  result->super.scalar = data_emitter_scalar;
+  result->super.string_scalar = data_emitter_string_scalar;
+  return &result->super;
+}
+
+pdfout_data *
+pdfout_emitter_data_result (fz_context *ctx, pdfout_emitter *emitter)
+{
+  data_emitter *e = (data_emitter *) emitter;
+  if (e->depth)
+    pdfout_throw (ctx, "data emitter: unfinished value");
+
+  pdfout_data *result = e->result;
+  e->result = NULL;
+  return result;
+}
@@ -112,21 +112,72 @@ typedef struct pdfout_emitter_s pdfout_emitter;
 typedef void (*emitter_drop_fn) (fz_context *ctx, pdfout_emitter *emitter);
 typedef void (*emitter_emit_fn) (fz_context *ctx, pdfout_emitter *emitter,
 				 pdfout_data *data);
+typedef void (*emitter_event_fn) (fz_context *ctx, pdfout_emitter *emitter);
+typedef void (*emitter_scalar_fn) (fz_context *ctx, pdfout_emitter *emitter,
+				   const char *value, int len);
 
 struct pdfout_emitter_s {
   emitter_drop_fn drop;
   emitter_emit_fn emit;
+
+  /* Streaming interface.  Hash entries are passed as key event followed
+     by value event(s).  */
+  emitter_event_fn array_start;
+  emitter_event_fn array_end;
+  emitter_event_fn hash_start;
+  emitter_event_fn hash_end;
+  emitter_scalar_fn scalar;
+  /* Scalar which is always a string, even if it looks like a number or
+     literal.  May be NULL, then SCALAR is used.  */
+  emitter_scalar_fn string_scalar;
 };
 
 
 
 void pdfout_emitter_drop (fz_context *ctx, pdfout_emitter *emitter);
 
+/* Emit DATA and drop EMITTER.  */
 void pdfout_emitter_emit (fz_context *ctx, pdfout_emitter *emitter,
 			  pdfout_data *data);
 
+/* Feed DATA to the streaming interface of EMITTER.  */
+void pdfout_emitter_emit_events (fz_context *ctx, pdfout_emitter *emitter,
+				 pdfout_data *data);
+
+void pdfout_emitter_array_start (fz_context *ctx, pdfout_emitter *emitter);
+void pdfout_emitter_array_end (fz_context *ctx, pdfout_emitter *emitter);
+void pdfout_emitter_hash_start (fz_context *ctx, pdfout_emitter *emitter);
+void pdfout_emitter_hash_end (fz_context *ctx, pdfout_emitter *emitter);
+void pdfout_emitter_scalar (fz_context *ctx, pdfout_emitter *emitter,
+			    const char *value, int len);
+
+/* Null-terminated version of pdfout_emitter_scalar.  */
+void pdfout_emitter_string (fz_context *ctx, pdfout_emitter *emitter,
+			    const char *value);
+
+/* Like pdfout_emitter_scalar, but VALUE is never written as a number,
+   boolean or null, e.g. for extracted text.  */
+void pdfout_emitter_string_scalar (fz_context *ctx, pdfout_emitter *emitter,
+				   const char *value, int len);
+
+/* Emit a null, bool, name, string or number object as scalar.  */
+void pdfout_emitter_scalar_from_pdf (fz_context *ctx,
+				     pdfout_emitter *emitter, pdf_obj *obj);
+
+/* Emitter which collects the events into a pdfout_data tree.  */
+pdfout_emitter *pdfout_emitter_data_new (fz_context *ctx);
+
+/* Return the tree built by a data emitter.  The caller owns the result.  */
+pdfout_data *pdfout_emitter_data_result (fz_context *ctx,
+					 pdfout_emitter *emitter);
+
 pdfout_emitter *pdfout_emitter_json_new (fz_context *ctx, fz_output *out);
 
+/* Like pdfout_emitter_json_new, but write the value on a single line, as
+   used by JSON Lines.  */
+pdfout_emitter *pdfout_emitter_json_line_new (fz_context *ctx,
+					      fz_output *out);
+
 pdfout_emitter *pdfout_emitter_outline_wysiwyg_new (fz_context *ctx,
 						    fz_output *out);
 
@@ -0,0 +1,132 @@
+#!/usr/bin/env perl
+use 5.020;
+use warnings;
+use strict;
+
+use experimental 'signatures';
+
+use File::Basename qw/dirname/;
+use File::Spec::Functions qw/catfile/;
+
+# Generate keys.h and keys.c from keys.txt: an enum with one constant per
+# key and a perfect hash table for pdfout_key_classify.  Like gperf, the
+# table is searched at generation time, so that no two keys share a slot.
+# The hash is 32-bit FNV-1a with a seed.  The slot is taken from the high
+# bits, the low bits of FNV only depend on the low bits of the input.
+
+my $dir = dirname(__FILE__);
+my $input = catfile( $dir, 'keys.txt' );
+
+open my $fh, '<', $input
+    or die "cannot open '$input': $!";
+my @keys;
+my %seen;
+while ( my $line = <$fh> ) {
+    chomp $line;
+    next if $line =~ /^\s*(#|$)/;
+    die "invalid key '$line'\n" if $line !~ /^[A-Za-z_][A-Za-z0-9_]*$/;
+    die "duplicate key '$line'\n" if $seen{$line}++;
+    push @keys, $line;
+}
+close $fh;
+
+sub key_hash ( $key, $seed ) {
+    my $h = ( 2166136261 ^ ( $seed * 2654435761 ) ) & 0xffffffff;
+    for my $c ( unpack 'C*', $key ) {
+        $h = ( ( $h ^ $c ) * 16777619 ) & 0xffffffff;
+    }
+    return $h;
+}
+
+# Return the table for SEED and SIZE, or nothing if two keys collide.
+sub fill_table ( $seed, $bits ) {
+    my @table;
+    for my $key (@keys) {
+        my $slot = key_hash( $key, $seed ) >> ( 32 - $bits );
+        return if defined $table[$slot];
+        $table[$slot] = $key;
+    }
+    return \@table;
+}
+
+my $bits = 1;
+++$bits while 2**$bits < 2 * @keys;
+
+my ( $seed, $table );
+until ($table) {
+    for my $s ( 0 .. 99999 ) {
+        $table = fill_table( $s, $bits );
+        if ($table) {
+            $seed = $s;
+            last;
+        }
+    }
+    ++$bits if not $table;
+}
+my $size  = 2**$bits;
+my $shift = 32 - $bits;
+my @table = $table->@*;
+
+my $header = catfile( $dir, 'keys.h' );
+open $fh, '>', $header
+    or die "cannot open '$header': $!";
+print {$fh} <<'EOD';
+/* Generated by gen-keys.pl from keys.txt, do not edit.  */
+
+#ifndef HAVE_PDFOUT_KEYS_H
+#define HAVE_PDFOUT_KEYS_H
+
+/* The keys and values of the JSON formats and PDF dicts.  */
+typedef enum {
+  PDFOUT_KEY_NONE,
+EOD
+say {$fh} "  PDFOUT_KEY_$_," for @keys;
+print {$fh} <<'EOD';
+} pdfout_key;
+
+/* Return the constant for the LEN bytes at KEY, or PDFOUT_KEY_NONE.  */
+pdfout_key pdfout_key_classify (const char *key, int len);
+
+#endif	/* ! HAVE_PDFOUT_KEYS_H */
+EOD
+close $fh;
+
+my $source = catfile( $dir, 'keys.c' );
+open $fh, '>', $source
+    or die "cannot open '$source': $!";
+my $basis
+    = sprintf( "%uu", ( 2166136261 ^ ( $seed * 2654435761 ) ) & 0xffffffff );
+print {$fh} <<"EOD";
+/* Generated by gen-keys.pl from keys.txt, do not edit.  */
+
+#include "common.h"
+
+static const struct {
+  const char *name;
+  int len;
+  pdfout_key key;
+} key_table[$size] = {
+EOD
+for my $slot ( 0 .. $#table ) {
+    my $key = $table[$slot] // next;
+    my $len = length $key;
+    say {$fh} "  [$slot] = {\"$key\", $len, PDFOUT_KEY_$key},";
+}
+print {$fh} <<"EOD";
+};
+
+pdfout_key
+pdfout_key_classify (const char *key, int len)
+{
+  uint32_t h = $basis;
+  for (int i = 0; i < len; ++i)
+    h = (h ^ (unsigned char) key[i]) * 16777619u;
+
+  int slot = h >> $shift;
+  if (key_table[slot].name && key_table[slot].len == len
+      && memcmp (key_table[slot].name, key, len) == 0)
+    return key_table[slot].key;
+  return PDFOUT_KEY_NONE;
+}
+EOD
+close $fh;
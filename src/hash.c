@@ -0,0 +1,163 @@
+#include "common.h"
+
+struct entry
+{
+  unsigned hash;
+  int key_start, key_len;
+  void *value;
+};
+
+struct pdfout_hash_s
+{
+  /* Entries in insertion order.  */
+  struct entry *entries;
+  int count, cap;
+
+  /* All keys, one after another.  */
+  char *keys;
+  int keys_len, keys_cap;
+
+  /* Open addressing, slots hold entry number + 1, 0 for empty slots.  */
+  int *slots;
+  int mask;
+};
+
+/* FNV-1a.  */
+static unsigned
+hash_bytes (const char *s, int len)
+{
+  unsigned h = 2166136261u;
+  for (int i = 0; i < len; ++i)
+    {
+      h ^= (unsigned char) s[i];
+      h *= 16777619u;
+    }
+  return h;
+}
+
+pdfout_hash *
+pdfout_hash_new (fz_context *ctx)
+{
+  pdfout_hash *hash = fz_malloc_struct (ctx, pdfout_hash);
+  fz_try (ctx)
+  {
+    hash->slots = fz_calloc (ctx, 16, sizeof *hash->slots);
+    hash->mask = 15;
+  }
+  fz_catch (ctx)
+  {
+    free (hash);
+    fz_rethrow (ctx);
+  }
+  return hash;
+}
+
+void
+pdfout_hash_drop (fz_context *ctx, pdfout_hash *hash)
+{
+  if (hash == NULL)
+    return;
+  free (hash->entries);
+  free (hash->keys);
+  free (hash->slots);
+  free (hash);
+}
+
+static bool
+entry_eq (pdfout_hash *hash, struct entry *e, unsigned h, const char *key,
+	  int key_len)
+{
+  return e->hash == h && e->key_len == key_len
+    && memcmp (hash->keys + e->key_start, key, key_len) == 0;
+}
+
+/* Return the slot holding KEY, or the empty slot where it belongs.  */
+static int *
+find_slot (pdfout_hash *hash, unsigned h, const char *key, int key_len)
+{
+  unsigned i = h & hash->mask;
+  while (hash->slots[i])
+    {
+      struct entry *e = &hash->entries[hash->slots[i] - 1];
+      if (entry_eq (hash, e, h, key, key_len))
+	break;
+      i = (i + 1) & hash->mask;
+    }
+  return &hash->slots[i];
+}
+
+static void
+grow_slots (fz_context *ctx, pdfout_hash *hash)
+{
+  int size = 2 * (hash->mask + 1);
+  if (size <= 0)
+    pdfout_throw (ctx, "int overflow in hash table size");
+
+  int *slots = fz_calloc (ctx, size, sizeof *slots);
+  free (hash->slots);
+  hash->slots = slots;
+  hash->mask = size - 1;
+
+  for (int n = 0; n < hash->count; ++n)
+    {
+      unsigned i = hash->entries[n].hash & hash->mask;
+      while (hash->slots[i])
+	i = (i + 1) & hash->mask;
+      hash->slots[i] = n + 1;
+    }
+}
+
+bool
+pdfout_hash_insert (fz_context *ctx, pdfout_hash *hash,
+		    const char *key, int key_len, void *value)
+{
+  unsigned h = hash_bytes (key, key_len);
+  if (*find_slot (hash, h, key, key_len))
+    return false;
+
+  if (key_len > INT_MAX - hash->keys_len)
+    pdfout_throw (ctx, "int overflow in hash table keys");
+  while (hash->keys_len + key_len > hash->keys_cap)
+    hash->keys = pdfout_x2nrealloc (ctx, hash->keys, &hash->keys_cap, char);
+  if (hash->count == hash->cap)
+    hash->entries = pdfout_x2nrealloc (ctx, hash->entries, &hash->cap,
+				       struct entry);
+
+  /* Keep the load factor below 1/2.  */
+  if (2 * (hash->count + 1) > hash->mask + 1)
+    grow_slots (ctx, hash);
+
+  memcpy (hash->keys + hash->keys_len, key, key_len);
+  hash->entries[hash->count] =
+    (struct entry) {h, hash->keys_len, key_len, value};
+  hash->keys_len += key_len;
+  *find_slot (hash, h, key, key_len) = ++hash->count;
+
+  return true;
+}
+
+int
+pdfout_hash_find (fz_context *ctx, pdfout_hash *hash,
+		  const char *key, int key_len)
+{
+  return *find_slot (hash, hash_bytes (key, key_len), key, key_len) - 1;
+}
+
+int
+pdfout_hash_count (fz_context *ctx, pdfout_hash *hash)
+{
+  return hash->count;
+}
+
+const char *
+pdfout_hash_key (fz_context *ctx, pdfout_hash *hash, int i, int *key_len)
+{
+  *key_len = hash->entries[i].key_len;
+  return hash->keys + hash->entries[i].key_start;
+}
+
+void *
+pdfout_hash_value (fz_context *ctx, pdfout_hash *hash, int i)
+{
+  return hash->entries[i].value;
+}
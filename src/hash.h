@@ -0,0 +1,29 @@
+#ifndef HAVE_PDFOUT_HASH_H
+#define HAVE_PDFOUT_HASH_H
+
+/* Hash table mapping byte strings to pointers.  Keys are copied, values
+   are owned by the caller.  Entries are numbered in insertion order.  */
+typedef struct pdfout_hash_s pdfout_hash;
+
+pdfout_hash *pdfout_hash_new (fz_context *ctx);
+
+void pdfout_hash_drop (fz_context *ctx, pdfout_hash *hash);
+
+/* Add KEY with VALUE.  Return false, and keep the old value, if KEY is
+   already present.  */
+bool pdfout_hash_insert (fz_context *ctx, pdfout_hash *hash,
+			 const char *key, int key_len, void *value);
+
+/* Return the number of the entry for KEY, or -1 if there is none.  */
+int pdfout_hash_find (fz_context *ctx, pdfout_hash *hash,
+		      const char *key, int key_len);
+
+int pdfout_hash_count (fz_context *ctx, pdfout_hash *hash);
+
+/* The returned key is not null-terminated.  */
+const char *pdfout_hash_key (fz_context *ctx, pdfout_hash *hash, int i,
+			     int *key_len);
+
+void *pdfout_hash_value (fz_context *ctx, pdfout_hash *hash, int i);
+
+#endif	/* ! HAVE_PDFOUT_HASH_H */
@@ -116,28 +116,39 @@ static void
 check_key_val_pair (fz_context *ctx, const char *name, const char *string,
 		    int string_len)
 {
-  if (!strcmp (name, "CreationDate") || !strcmp (name, "ModDate"))
+  switch (pdfout_key_classify (name, strlen (name)))
     {
+    case PDFOUT_KEY_CreationDate:
+    case PDFOUT_KEY_ModDate:
       check_date_string (ctx, string);
-    }
-  else if (!strcmp (name, "Trapped"))
-    {
+      break;
+    case PDFOUT_KEY_Trapped:
       if (strlen (string) != string_len)
 	pdfout_throw (ctx, "value of key 'Trapped' has embedded null byte");
-      if (strcmp(string, "True") && strcmp (string, "False") &&
-	  strcmp (string, "Unknown"))
+      switch (pdfout_key_classify (string, string_len))
 	{
+	case PDFOUT_KEY_True:
+	case PDFOUT_KEY_False:
+	case PDFOUT_KEY_Unknown:
+	  break;
+	default:
 	  pdfout_throw (ctx, "invalid value '%.*s' of key 'Trapped'.\n"
 			"valid values are True, False, Unknown",
 			string_len, string);
 	}
-    }
- else if (strcmp (name, "Title") && strcmp (name, "Author")
-	  && strcmp (name, "Subject") && strcmp (name, "Keywords")
-	  && strcmp (name, "Creator") && strcmp (name, "Producer"))
-   pdfout_throw (ctx, "'%s' is not a valid infodict key. Valid keys are:\n\
+      break;
+    case PDFOUT_KEY_Title:
+    case PDFOUT_KEY_Author:
+    case PDFOUT_KEY_Subject:
+    case PDFOUT_KEY_Keywords:
+    case PDFOUT_KEY_Creator:
+    case PDFOUT_KEY_Producer:
+      break;
+    default:
+      pdfout_throw (ctx, "'%s' is not a valid infodict key. Valid keys are:\n\
 Title,Author,Subject,Keywords,Creator,Producer,CreationDate,ModDate,Trapped",
-		 name);
+		    name);
+    }
 }
 
 static void
@@ -171,44 +182,56 @@ pdfout_info_dict_set (fz_context *ctx, pdf_document *doc,
   if (info)
     check_info_dict (ctx, info);
 
-  
   pdf_obj *pdf_info = pdf_dict_gets (ctx, pdf_trailer (ctx, doc), "Info");
   pdf_obj *info_ref = NULL, *new_info = NULL;
 
-  /* FIXME: do proper try/catch.  */
-  
-  if (pdf_info == NULL)
-    {
-      pdf_info = pdf_new_dict (ctx, doc, 9);
-      info_ref = pdf_add_object_drop (ctx, doc, pdf_info);
-      pdf_dict_puts_drop (ctx, pdf_trailer (ctx, doc), "Info", info_ref);
-    }
-  else if (append == false)
-    {
-      new_info = pdf_new_dict (ctx, doc, 9);
-      pdf_update_object (ctx, doc, pdf_to_num (ctx, pdf_info), new_info);
-      pdf_drop_obj (ctx, new_info);
-      pdf_info = new_info;
-    }
-  
-  if (info == NULL)
-    /* Empty info dict.  */
-    return;
-
-  int len = pdfout_data_hash_len (ctx, info);
-  for (int i = 0; i < len; ++i)
-    {
-      char *key, *value;
-      int value_len;
-      pdfout_data_hash_get_key_value (ctx, info, &key, &value, &value_len, i);
-      
-      if (!strcmp (key, "Trapped"))
-	/* create name object */
-	pdf_dict_puts_drop (ctx, pdf_info, key,
+  /* Values which are replaced are freed after the update, unless they
+     are also referenced from elsewhere.  Every entry of the info dict is
+     a value of it, so all keys are followed.  */
+  pdfout_reclaim *reclaim = pdfout_reclaim_new (ctx, doc, pdf_info, NULL);
+
+  fz_try (ctx)
+  {
+    if (pdf_info == NULL)
+      {
+	pdf_info = pdf_new_dict (ctx, doc, 9);
+	info_ref = pdf_add_object_drop (ctx, doc, pdf_info);
+	pdf_dict_puts_drop (ctx, pdf_trailer (ctx, doc), "Info", info_ref);
+      }
+    else if (append == false)
+      {
+	new_info = pdf_new_dict (ctx, doc, 9);
+	pdf_update_object (ctx, doc, pdf_to_num (ctx, pdf_info), new_info);
+	pdf_drop_obj (ctx, new_info);
+	pdf_info = new_info;
+      }
+
+    /* INFO is NULL for an empty info dict.  */
+    int len = info ? pdfout_data_hash_len (ctx, info) : 0;
+    for (int i = 0; i < len; ++i)
+      {
+	char *key, *value;
+	int value_len;
+	pdfout_data_hash_get_key_value (ctx, info, &key, &value, &value_len,
+					i);
+
+	if (pdfout_key_classify (key, strlen (key)) == PDFOUT_KEY_Trapped)
+	  /* create name object */
+	  pdf_dict_puts_drop (ctx, pdf_info, key,
 			      pdf_new_name (ctx, doc, value));
-      else
-	insert_key_value (ctx, doc, pdf_info, key, value, value_len);
-    }
+	else
+	  insert_key_value (ctx, doc, pdf_info, key, value, value_len);
+      }
+
+    pdfout_reclaim *sweep = reclaim;
+    reclaim = NULL;
+    pdfout_reclaim_sweep (ctx, sweep,
+			  pdf_dict_gets (ctx, pdf_trailer (ctx, doc), "Info"));
+  }
+  fz_always (ctx)
+    pdfout_reclaim_drop (ctx, reclaim);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
 }
 
 pdfout_data *
@@ -228,31 +251,42 @@ pdfout_info_dict_get (fz_context *ctx, pdf_document *doc)
 
       const char *name = pdf_to_name (ctx, key);
       pdf_obj *val = pdf_dict_get_val (ctx, info, i);
-      if (!strcmp (name, "Title") || !strcmp (name, "Author")
-	  || !strcmp (name, "Subject")|| !strcmp (name, "Keywords")
-	  || !strcmp (name, "Creator") || !strcmp (name, "Producer")
-	  || !strcmp (name, "CreationDate") || !strcmp (name, "ModDate"))
+      switch (pdfout_key_classify (name, strlen (name)))
 	{
-	  if (pdf_is_string (ctx, val) == false)
-	    pdfout_throw (ctx, "value of info dict key '%s' not a string",
-			  name);
-
-	  int string_len;
-	  char *string = pdfout_str_obj_to_utf8 (ctx, val, &string_len);
-	  pdfout_data_hash_push_key_value (ctx, result, name, string,
-					  string_len);
-	  free (string);
-	}
-      else if (strcmp (name, "Trapped") == 0)
-	{
-	  if (pdf_is_name (ctx, val) == 0)
-	    pdfout_throw (ctx, "key '%s' in info dict not a name object", name);
-	  
-	  char *value_string = pdf_to_name (ctx, val);
-	  
-	  pdfout_data_hash_push_key_value (ctx, result, name, value_string,
-					   strlen (value_string));
-
+	case PDFOUT_KEY_Title:
+	case PDFOUT_KEY_Author:
+	case PDFOUT_KEY_Subject:
+	case PDFOUT_KEY_Keywords:
+	case PDFOUT_KEY_Creator:
+	case PDFOUT_KEY_Producer:
+	case PDFOUT_KEY_CreationDate:
+	case PDFOUT_KEY_ModDate:
+	  {
+	    if (pdf_is_string (ctx, val) == false)
+	      pdfout_throw (ctx, "value of info dict key '%s' not a string",
+			    name);
+
+	    int string_len;
+	    char *string = pdfout_str_obj_to_utf8 (ctx, val, &string_len);
+	    pdfout_data_hash_push_key_value (ctx, result, name, string,
+					     string_len);
+	    free (string);
+	    break;
+	  }
+	case PDFOUT_KEY_Trapped:
+	  {
+	    if (pdf_is_name (ctx, val) == 0)
+	      pdfout_throw (ctx, "key '%s' in info dict not a name object",
+			    name);
+
+	    char *value_string = pdf_to_name (ctx, val);
+
+	    pdfout_data_hash_push_key_value (ctx, result, name, value_string,
+					     strlen (value_string));
+	    break;
+	  }
+	default:
+	  break;
 	}
     }
   return result;
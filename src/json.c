@@ -633,22 +633,34 @@ pdfout_parser_json_new (fz_context *ctx, fz_stream *stm)
 
 /* Emitter stuff. */
 
+typedef struct {
+  bool is_hash;
+  /* Number of events on this level, keys and values counted separately.  */
+  int count;
+} json_frame;
+
 typedef struct {
   pdfout_emitter super;
   
   fz_output *out;
-  
   bool finished;
 
   unsigned indent;
   unsigned indent_level;
-  
+  /* Write the whole value on one line.  */
+  bool single_line;
+
+  /* Open arrays and hashes.  */
+  json_frame *stack;
+  int depth, cap;
 } json_emitter;
 
 static void
 emitter_drop (fz_context *ctx, pdfout_emitter *emitter)
 {
-  free (emitter);
+  json_emitter *e = (json_emitter *) emitter;
+  free (e->stack);
+  free (e);
 }
 
 
@@ -664,17 +676,11 @@ static bool is_literal (const char *value, int len)
   return false;
 }
 
+/* Write VALUE as a JSON string.  */
 static void
-json_escape_string (fz_context *ctx, fz_output *out, const char *value,
-			   int value_len)
+json_quote_string (fz_context *ctx, fz_output *out, const char *value,
+		   int value_len)
 {
-  if (is_literal (value, value_len)
-      || json_check_number (value, value_len) == NULL)
-    {
-      fz_write (ctx, out, value, value_len);
-      return;
-    }
-  
   if (pdfout_check_utf8 (value, value_len))
     pdfout_throw (ctx, "invalid UTF-8");
   fz_putc (ctx, out, '"');
@@ -707,13 +713,17 @@ json_escape_string (fz_context *ctx, fz_output *out, const char *value,
     }
   fz_putc (ctx, out, '"');
 }
+
+/* Write VALUE as is if it is a number or literal, else as string.  */
 static void
-emit_string (fz_context *ctx, json_emitter *emitter, pdfout_data *data)
+json_escape_string (fz_context *ctx, fz_output *out, const char *value,
+			   int value_len)
 {
-  fz_output *out = emitter->out;
-  int value_len;
-  const char *value = pdfout_data_scalar_get (ctx, data, &value_len);
-  json_escape_string (ctx, out, value, value_len);
+  if (is_literal (value, value_len)
+      || json_check_number (value, value_len) == NULL)
+    fz_write (ctx, out, value, value_len);
+  else
+    json_quote_string (ctx, out, value, value_len);
 }
 
 static void emit_indent (fz_context *ctx, json_emitter *emitter)
@@ -724,98 +734,131 @@ static void emit_indent (fz_context *ctx, json_emitter *emitter)
 
 static void emit_value_separator (fz_context *ctx, json_emitter *emitter)
 {
+  if (emitter->single_line)
+    {
+      fz_putc (ctx, emitter->out, ',');
+      return;
+    }
   fz_puts (ctx, emitter->out, ",\n");
   emit_indent (ctx, emitter);
 }
 
+/* Write whatever goes before the next key or value.  */
 static void
-emit_value (fz_context *ctx, json_emitter *emitter, pdfout_data *data);
-
-  
-static void
-emit_array (fz_context *ctx, json_emitter *emitter, pdfout_data *data)
+begin_value (fz_context *ctx, json_emitter *e)
 {
-  fz_output *out = emitter->out;
-  fz_puts (ctx, out, "[");
-  int len = pdfout_data_array_len (ctx, data);
-  if (len == 0)
+  if (e->finished)
+    pdfout_throw (ctx, "finished JSON emitter called");
+  if (e->depth == 0)
+    return;
+
+  json_frame *frame = &e->stack[e->depth - 1];
+  if (frame->is_hash && frame->count % 2)
+    fz_puts (ctx, e->out, e->single_line ? ":" : ": ");
+  else if (frame->count)
+    emit_value_separator (ctx, e);
+  else if (e->single_line == false)
     {
-      fz_puts (ctx, out, "]");
-      return;
+      fz_puts (ctx, e->out, "\n");
+      emit_indent (ctx, e);
     }
-  fz_puts (ctx, out, "\n");
-  ++emitter->indent_level;
-  emit_indent (ctx, emitter);
+  ++frame->count;
+}
 
-  for (int i = 0; i < len; ++i)
+static void
+end_value (fz_context *ctx, json_emitter *e)
+{
+  if (e->depth == 0)
     {
-      pdfout_data *item = pdfout_data_array_get (ctx, data, i);
-      emit_value (ctx, emitter, item);
-      if (i < len - 1)
-	emit_value_separator (ctx, emitter);
+      e->finished = true;
+      fz_puts (ctx, e->out, "\n");
     }
-  fz_puts (ctx, out ,"\n");
-  --emitter->indent_level;
-  emit_indent (ctx, emitter);
-  fz_puts (ctx, out, "]");
 }
 
 static void
-emit_hash (fz_context *ctx, json_emitter *emitter, pdfout_data *data)
+container_start (fz_context *ctx, json_emitter *e, bool is_hash)
 {
-  fz_output *out = emitter->out;
-  fz_puts (ctx, out, "{");
-  int len = pdfout_data_hash_len (ctx, data);
-  if (len == 0)
-    {
-      fz_puts (ctx, out, "}");
-      return;
-    }
+  begin_value (ctx, e);
+  if (e->depth == e->cap)
+    e->stack = pdfout_x2nrealloc (ctx, e->stack, &e->cap, json_frame);
+  e->stack[e->depth++] = (json_frame) {is_hash, 0};
+  ++e->indent_level;
+  fz_puts (ctx, e->out, is_hash ? "{" : "[");
+}
 
-  fz_puts (ctx, out, "\n");
-  ++emitter->indent_level;
-  emit_indent (ctx, emitter);
-  
-  for (int i = 0; i < len; ++i)
+static void
+container_end (fz_context *ctx, json_emitter *e, bool is_hash)
+{
+  if (e->depth == 0 || e->stack[e->depth - 1].is_hash != is_hash)
+    pdfout_throw (ctx, "JSON emitter: unbalanced end event");
+  json_frame *frame = &e->stack[--e->depth];
+  if (is_hash && frame->count % 2)
+    pdfout_throw (ctx, "JSON emitter: hash key without value");
+
+  --e->indent_level;
+  if (frame->count && e->single_line == false)
     {
-      pdfout_data *key = pdfout_data_hash_get_key (ctx, data, i);
-      emit_value (ctx, emitter, key);
-      fz_puts (ctx, out, ": ");
-      pdfout_data *value = pdfout_data_hash_get_value (ctx, data, i);
-      emit_value (ctx, emitter, value);
-      if (i < len - 1)
-	emit_value_separator (ctx, emitter);
+      fz_puts (ctx, e->out, "\n");
+      emit_indent (ctx, e);
     }
-  fz_puts (ctx, out, "\n");
-  emitter->indent_level--;
-  emit_indent (ctx, emitter);
-  fz_puts (ctx, out, "}");
+  fz_puts (ctx, e->out, is_hash ? "}" : "]");
+  end_value (ctx, e);
+}
+
+static void
+emitter_array_start (fz_context *ctx, pdfout_emitter *emitter)
+{
+  container_start (ctx, (json_emitter *) emitter, false);
+}
 
+static void
+emitter_array_end (fz_context *ctx, pdfout_emitter *emitter)
+{
+  container_end (ctx, (json_emitter *) emitter, false);
 }
 
 static void
-emit_value (fz_context *ctx, json_emitter *emitter, pdfout_data *data)
+emitter_hash_start (fz_context *ctx, pdfout_emitter *emitter)
 {
-  if (pdfout_data_is_scalar (ctx, data))
-    emit_string (ctx, emitter, data);
-  else if (pdfout_data_is_array (ctx, data))
-    emit_array (ctx, emitter, data);
-  else if (pdfout_data_is_hash (ctx, data))
-    emit_hash (ctx, emitter, data);
+  container_start (ctx, (json_emitter *) emitter, true);
 }
 
 static void
-emitter_emit (fz_context *ctx, pdfout_emitter *emitter, pdfout_data *data)
+emitter_hash_end (fz_context *ctx, pdfout_emitter *emitter)
+{
+  container_end (ctx, (json_emitter *) emitter, true);
+}
+
+static void
+emitter_scalar (fz_context *ctx, pdfout_emitter *emitter, const char *value,
+		int len)
 {
   json_emitter *e = (json_emitter *) emitter;
-  if (e->finished)
-    pdfout_throw (ctx, "finished JSON emitter called");
+  /* Keys are always strings.  */
+  bool is_key = (e->depth && e->stack[e->depth - 1].is_hash
+		 && e->stack[e->depth - 1].count % 2 == 0);
+  begin_value (ctx, e);
+  if (is_key)
+    json_quote_string (ctx, e->out, value, len);
+  else
+    json_escape_string (ctx, e->out, value, len);
+  end_value (ctx, e);
+}
 
-  e->finished = true;
-  
-  emit_value (ctx, e, data);
+static void
+emitter_string_scalar (fz_context *ctx, pdfout_emitter *emitter,
+		       const char *value, int len)
+{
+  json_emitter *e = (json_emitter *) emitter;
+  begin_value (ctx, e);
+  json_quote_string (ctx, e->out, value, len);
+  end_value (ctx, e);
+}
 
-  fz_puts (ctx, e->out, "\n");
+static void
+emitter_emit (fz_context *ctx, pdfout_emitter *emitter, pdfout_data *data)
+{
+  pdfout_emitter_emit_events (ctx, emitter, data);
 }
   
 
@@ -826,6 +869,12 @@ pdfout_emitter_json_new (fz_context *ctx, fz_output *stm)
   
   result->super.drop = emitter_drop;
   result->super.emit = emitter_emit;
+  result->super.array_start = emitter_array_start;
+  result->super.array_end = emitter_array_end;
+  result->super.hash_start = emitter_hash_start;
+  result->super.hash_end = emitter_hash_end;
+  result->super.scalar = emitter_scalar;
+  result->super.string_scalar = emitter_string_scalar;
   
   result->out = stm;
 
@@ -835,6 +884,14 @@ pdfout_emitter_json_new (fz_context *ctx, fz_output *stm)
   return &result->super;
 }
 
+pdfout_emitter *
+pdfout_emitter_json_line_new (fz_context *ctx, fz_output *stm)
+{
+  pdfout_emitter *result = pdfout_emitter_json_new (ctx, stm);
+  ((json_emitter *) result)->single_line = true;
+  return result;
+}
+
 
 
 void
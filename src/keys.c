@@ -0,0 +1,64 @@
+/* Generated by gen-keys.pl from keys.txt, do not edit.  */
+
+#include "common.h"
+
+static const struct {
+  const char *name;
+  int len;
+  pdfout_key key;
+} key_table[128] = {
+  [2] = {"a", 1, PDFOUT_KEY_a},
+  [6] = {"Trapped", 7, PDFOUT_KEY_Trapped},
+  [9] = {"R", 1, PDFOUT_KEY_R},
+  [14] = {"XYZ", 3, PDFOUT_KEY_XYZ},
+  [16] = {"D", 1, PDFOUT_KEY_D},
+  [18] = {"A", 1, PDFOUT_KEY_A},
+  [21] = {"Producer", 8, PDFOUT_KEY_Producer},
+  [25] = {"Unknown", 7, PDFOUT_KEY_Unknown},
+  [30] = {"true", 4, PDFOUT_KEY_true},
+  [32] = {"roman", 5, PDFOUT_KEY_roman},
+  [36] = {"false", 5, PDFOUT_KEY_false},
+  [38] = {"title", 5, PDFOUT_KEY_title},
+  [39] = {"Author", 6, PDFOUT_KEY_Author},
+  [42] = {"kids", 4, PDFOUT_KEY_kids},
+  [56] = {"prefix", 6, PDFOUT_KEY_prefix},
+  [57] = {"CreationDate", 12, PDFOUT_KEY_CreationDate},
+  [58] = {"page", 4, PDFOUT_KEY_page},
+  [59] = {"False", 5, PDFOUT_KEY_False},
+  [60] = {"Creator", 7, PDFOUT_KEY_Creator},
+  [63] = {"open", 4, PDFOUT_KEY_open},
+  [65] = {"FitB", 4, PDFOUT_KEY_FitB},
+  [68] = {"FitH", 4, PDFOUT_KEY_FitH},
+  [69] = {"Subject", 7, PDFOUT_KEY_Subject},
+  [71] = {"FitV", 4, PDFOUT_KEY_FitV},
+  [72] = {"arabic", 6, PDFOUT_KEY_arabic},
+  [73] = {"FitR", 4, PDFOUT_KEY_FitR},
+  [76] = {"null", 4, PDFOUT_KEY_null},
+  [79] = {"Letters", 7, PDFOUT_KEY_Letters},
+  [80] = {"FitBH", 5, PDFOUT_KEY_FitBH},
+  [83] = {"Title", 5, PDFOUT_KEY_Title},
+  [89] = {"Roman", 5, PDFOUT_KEY_Roman},
+  [90] = {"Keywords", 8, PDFOUT_KEY_Keywords},
+  [93] = {"style", 5, PDFOUT_KEY_style},
+  [94] = {"True", 4, PDFOUT_KEY_True},
+  [95] = {"view", 4, PDFOUT_KEY_view},
+  [100] = {"first", 5, PDFOUT_KEY_first},
+  [102] = {"letters", 7, PDFOUT_KEY_letters},
+  [108] = {"ModDate", 7, PDFOUT_KEY_ModDate},
+  [112] = {"Fit", 3, PDFOUT_KEY_Fit},
+  [121] = {"r", 1, PDFOUT_KEY_r},
+};
+
+pdfout_key
+pdfout_key_classify (const char *key, int len)
+{
+  uint32_t h = 614411838u;
+  for (int i = 0; i < len; ++i)
+    h = (h ^ (unsigned char) key[i]) * 16777619u;
+
+  int slot = h >> 25;
+  if (key_table[slot].name && key_table[slot].len == len
+      && memcmp (key_table[slot].name, key, len) == 0)
+    return key_table[slot].key;
+  return PDFOUT_KEY_NONE;
+}
@@ -0,0 +1,54 @@
+/* Generated by gen-keys.pl from keys.txt, do not edit.  */
+
+#ifndef HAVE_PDFOUT_KEYS_H
+#define HAVE_PDFOUT_KEYS_H
+
+/* The keys and values of the JSON formats and PDF dicts.  */
+typedef enum {
+  PDFOUT_KEY_NONE,
+  PDFOUT_KEY_Title,
+  PDFOUT_KEY_Author,
+  PDFOUT_KEY_Subject,
+  PDFOUT_KEY_Keywords,
+  PDFOUT_KEY_Creator,
+  PDFOUT_KEY_Producer,
+  PDFOUT_KEY_CreationDate,
+  PDFOUT_KEY_ModDate,
+  PDFOUT_KEY_Trapped,
+  PDFOUT_KEY_True,
+  PDFOUT_KEY_False,
+  PDFOUT_KEY_Unknown,
+  PDFOUT_KEY_page,
+  PDFOUT_KEY_first,
+  PDFOUT_KEY_prefix,
+  PDFOUT_KEY_style,
+  PDFOUT_KEY_arabic,
+  PDFOUT_KEY_Roman,
+  PDFOUT_KEY_roman,
+  PDFOUT_KEY_Letters,
+  PDFOUT_KEY_letters,
+  PDFOUT_KEY_D,
+  PDFOUT_KEY_R,
+  PDFOUT_KEY_r,
+  PDFOUT_KEY_A,
+  PDFOUT_KEY_a,
+  PDFOUT_KEY_title,
+  PDFOUT_KEY_view,
+  PDFOUT_KEY_open,
+  PDFOUT_KEY_kids,
+  PDFOUT_KEY_true,
+  PDFOUT_KEY_false,
+  PDFOUT_KEY_null,
+  PDFOUT_KEY_XYZ,
+  PDFOUT_KEY_Fit,
+  PDFOUT_KEY_FitB,
+  PDFOUT_KEY_FitH,
+  PDFOUT_KEY_FitV,
+  PDFOUT_KEY_FitBH,
+  PDFOUT_KEY_FitR,
+} pdfout_key;
+
+/* Return the constant for the LEN bytes at KEY, or PDFOUT_KEY_NONE.  */
+pdfout_key pdfout_key_classify (const char *key, int len);
+
+#endif	/* ! HAVE_PDFOUT_KEYS_H */
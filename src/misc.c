@@ -111,21 +111,27 @@ pdfout_getline (fz_context *ctx, fz_buffer **buffer_ptr, fz_stream *stm)
 
   fz_buffer *buffer = *buffer_ptr;
 
-  fz_resize_buffer (ctx, buffer, 0);
+  /* Keep the storage of the previous line.  */
+  buffer->len = 0;
   ssize_t len = 0;
   while (1)
     {
-      int c = fz_read_byte (ctx, stm);
-      if (c == EOF)
+      /* Copy whole chunks of the stream's buffer up to the newline.  */
+      size_t avail = fz_available (ctx, stm, 1);
+      if (avail == 0)
 	{
 	  if (len == 0)
 	    return -1;
           fz_terminate_buffer (ctx, buffer);
 	  return len;
 	}
-      fz_write_buffer_byte(ctx, buffer, c);
-      ++len;
-      if (c == '\n')
+
+      unsigned char *newline = memchr (stm->rp, '\n', avail);
+      size_t n = newline ? (size_t) (newline - stm->rp) + 1 : avail;
+      fz_write_buffer (ctx, buffer, stm->rp, n);
+      stm->rp += n;
+      len += n;
+      if (newline)
 	{
           fz_terminate_buffer (ctx, buffer);
 	  return len;
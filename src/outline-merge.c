@@ -0,0 +1,350 @@
+#include "common.h"
+
+/* Graft the outlines of other documents into a document, e.g. after the
+   pages of these documents were concatenated.  The items are copied
+   object by object, so the outline is never converted to pdfout_data.
+   Appending uses the /Last entries, so merging N sources is linear in the
+   total size of their outlines.  */
+
+typedef struct {
+  /* Next item of the source list, or NULL.  */
+  pdf_obj *src_next;
+  /* Parent item in the target, and the last kid appended to it.  */
+  pdf_obj *dst;
+  pdf_obj *last;
+  /* Visible descendants of DST, if it is open.  */
+  int count;
+  bool open;
+} merge_level;
+
+struct pdfout_outline_merge_s
+{
+  pdf_document *doc;
+  pdfout_page_index *pages;
+  pdf_obj *outlines;
+
+  merge_level *stack;
+  int depth, cap;
+};
+
+static void
+push_level (fz_context *ctx, pdfout_outline_merge *m, pdf_obj *src_first,
+	    pdf_obj *dst, pdf_obj *last, bool open)
+{
+  if (m->depth == m->cap)
+    m->stack = pdfout_x2nrealloc (ctx, m->stack, &m->cap, merge_level);
+  m->stack[m->depth++] = (merge_level) {
+    src_first, pdf_keep_obj (ctx, dst), pdf_keep_obj (ctx, last), 0, open
+  };
+}
+
+/* Pop the top level and fix the Count of its item.  */
+static void
+pop_level (fz_context *ctx, pdfout_outline_merge *m)
+{
+  merge_level *level = &m->stack[--m->depth];
+  merge_level *parent = &m->stack[m->depth - 1];
+
+  if (level->count)
+    pdf_dict_put_drop (ctx, level->dst, PDF_NAME_Count,
+		       pdf_new_int (ctx, m->doc, (level->open ? level->count
+						  : -level->count)));
+  if (level->open)
+    parent->count += level->count;
+
+  pdf_drop_obj (ctx, level->dst);
+  pdf_drop_obj (ctx, level->last);
+}
+
+/* Append a new item to the kids of the top level and return a borrowed
+   reference to it.  */
+static pdf_obj *
+append_item (fz_context *ctx, pdfout_outline_merge *m)
+{
+  merge_level *level = &m->stack[m->depth - 1];
+  pdf_obj *item = pdf_add_object_drop (ctx, m->doc,
+				       pdf_new_dict (ctx, m->doc, 6));
+
+  fz_try (ctx)
+  {
+    pdf_dict_put (ctx, item, PDF_NAME_Parent, level->dst);
+    if (level->last)
+      {
+	pdf_dict_put (ctx, item, PDF_NAME_Prev, level->last);
+	pdf_dict_put (ctx, level->last, PDF_NAME_Next, item);
+      }
+    else
+      pdf_dict_put (ctx, level->dst, PDF_NAME_First, item);
+    pdf_dict_put (ctx, level->dst, PDF_NAME_Last, item);
+  }
+  fz_catch (ctx)
+  {
+    pdf_drop_obj (ctx, item);
+    fz_rethrow (ctx);
+  }
+
+  pdf_drop_obj (ctx, level->last);
+  level->last = item;
+  level->count++;
+  return item;
+}
+
+/* Copy the view of the source destination array SRC_DEST to a new
+   destination array for the target page PAGE.  Return NULL if SRC_DEST
+   is not a valid destination.  */
+static pdf_obj *
+copy_dest (fz_context *ctx, pdfout_outline_merge *m, pdf_obj *src_dest,
+	   int page)
+{
+  int len = pdf_array_len (ctx, src_dest);
+  if (pdf_is_name (ctx, pdf_array_get (ctx, src_dest, 1)) == false)
+    return NULL;
+
+  pdf_obj *dest = pdf_new_array (ctx, m->doc, len);
+  fz_try (ctx)
+  {
+    pdf_array_push (ctx, dest, pdfout_page_index_get (ctx, m->pages, page));
+    for (int i = 1; i < len; ++i)
+      {
+	pdf_obj *obj = pdf_array_get (ctx, src_dest, i);
+	if (pdf_is_name (ctx, obj))
+	  pdf_array_push_drop (ctx, dest,
+			       pdf_new_name (ctx, m->doc,
+					     pdf_to_name (ctx, obj)));
+	else if (pdf_is_int (ctx, obj))
+	  pdf_array_push_drop (ctx, dest,
+			       pdf_new_int (ctx, m->doc,
+					    pdf_to_int (ctx, obj)));
+	else if (pdf_is_real (ctx, obj))
+	  pdf_array_push_drop (ctx, dest,
+			       pdf_new_real (ctx, m->doc,
+					     pdf_to_real (ctx, obj)));
+	else
+	  pdf_array_push_drop (ctx, dest, pdf_new_null (ctx, m->doc));
+      }
+  }
+  fz_catch (ctx)
+  {
+    pdf_drop_obj (ctx, dest);
+    fz_rethrow (ctx);
+  }
+
+  return dest;
+}
+
+static void
+warn_skipped (fz_context *ctx, pdf_obj *title)
+{
+  int len;
+  char *title_str = pdfout_str_obj_to_utf8 (ctx, title, &len);
+  pdfout_warn (ctx, "skipping outline item with title '%s' without valid "
+	       "destination", title_str);
+  free (title_str);
+}
+
+/* Copy the source items of the top level and all their descendants.  */
+static void
+graft (fz_context *ctx, pdfout_outline_merge *m, pdf_document *src,
+       int page_offset)
+{
+  int base = m->depth;
+  int xref_len = pdf_xref_len (ctx, src);
+  unsigned char *visited = fz_calloc (ctx, xref_len / 8 + 1, 1);
+  pdfout_page_index *src_pages = NULL;
+  pdfout_dest_table *dests = NULL;
+
+  fz_var (src_pages);
+  fz_var (dests);
+  fz_try (ctx)
+  {
+    src_pages = pdfout_page_index_new (ctx, src);
+    dests = pdfout_dest_table_new (ctx, src);
+
+    while (true)
+      {
+	merge_level *level = &m->stack[m->depth - 1];
+	pdf_obj *src_item = level->src_next;
+	if (src_item == NULL)
+	  {
+	    if (m->depth == base)
+	      break;
+	    pop_level (ctx, m);
+	    continue;
+	  }
+	level->src_next = pdf_dict_get (ctx, src_item, PDF_NAME_Next);
+
+	int num = pdf_to_num (ctx, src_item);
+	if (num > 0 && num < xref_len)
+	  {
+	    if (visited[num / 8] & (1 << num % 8))
+	      pdfout_throw (ctx, "circular reference");
+	    visited[num / 8] |= 1 << num % 8;
+	  }
+
+	pdf_obj *title = pdf_dict_get (ctx, src_item, PDF_NAME_Title);
+	if (pdf_is_string (ctx, title) == false)
+	  pdfout_throw (ctx, "outline item without 'Title' key");
+
+	pdf_obj *src_dest = pdf_dict_get (ctx, src_item, PDF_NAME_Dest);
+	if (src_dest == NULL)
+	  src_dest = pdf_dict_get (ctx, src_item, PDF_NAME_A);
+	src_dest = pdfout_resolve_dest (ctx, dests, src_dest);
+	int page = -1;
+	if (pdf_is_array (ctx, src_dest))
+	  page = pdfout_page_index_lookup (ctx, src_pages,
+					   pdf_array_get (ctx, src_dest, 0));
+	pdf_obj *dest = NULL;
+	if (page >= 0)
+	  dest = copy_dest (ctx, m, src_dest, page + page_offset);
+	if (dest == NULL)
+	  {
+	    /* Skip the item together with its kids.  */
+	    warn_skipped (ctx, title);
+	    continue;
+	  }
+
+	pdf_obj *item;
+	fz_try (ctx)
+	  item = append_item (ctx, m);
+	fz_catch (ctx)
+	  {
+	    pdf_drop_obj (ctx, dest);
+	    fz_rethrow (ctx);
+	  }
+	pdf_dict_put_drop (ctx, item, PDF_NAME_Dest, dest);
+	pdf_dict_put_drop (ctx, item, PDF_NAME_Title,
+			   pdf_new_string (ctx, m->doc,
+					   pdf_to_str_buf (ctx, title),
+					   pdf_to_str_len (ctx, title)));
+
+	pdf_obj *kids = pdf_dict_get (ctx, src_item, PDF_NAME_First);
+	if (kids)
+	  {
+	    pdf_obj *count = pdf_dict_get (ctx, src_item, PDF_NAME_Count);
+	    push_level (ctx, m, kids, item, NULL, pdf_to_int (ctx, count) > 0);
+	  }
+      }
+  }
+  fz_always (ctx)
+  {
+    pdfout_dest_table_drop (ctx, dests);
+    pdfout_page_index_drop (ctx, src_pages);
+    free (visited);
+  }
+  fz_catch (ctx)
+  {
+    while (m->depth > base)
+      pop_level (ctx, m);
+    fz_rethrow (ctx);
+  }
+}
+
+pdfout_outline_merge *
+pdfout_outline_merge_new (fz_context *ctx, pdf_document *doc)
+{
+  pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, doc), PDF_NAME_Root);
+  if (root == NULL)
+    pdfout_throw (ctx, "no document catalog, cannot update outline");
+
+  pdfout_outline_merge *m = fz_malloc_struct (ctx, pdfout_outline_merge);
+
+  fz_try (ctx)
+  {
+    m->doc = doc;
+    m->pages = pdfout_page_index_new (ctx, doc);
+
+    pdf_obj *outlines = pdf_dict_get (ctx, root, PDF_NAME_Outlines);
+    if (pdf_is_indirect (ctx, outlines))
+      m->outlines = pdf_keep_obj (ctx, outlines);
+    else if (pdf_is_dict (ctx, outlines))
+      {
+	/* The new items need an indirect reference to their parent.  */
+	m->outlines = pdf_add_object (ctx, doc, outlines);
+	pdf_dict_put (ctx, root, PDF_NAME_Outlines, m->outlines);
+      }
+    else
+      {
+	m->outlines = pdf_add_object_drop (ctx, doc,
+					   pdf_new_dict (ctx, doc, 4));
+	pdf_dict_put_drop (ctx, m->outlines, PDF_NAME_Type,
+			   pdf_new_name (ctx, doc, "Outlines"));
+	pdf_dict_put (ctx, root, PDF_NAME_Outlines, m->outlines);
+      }
+
+    /* The top level stays on the stack between the sources.  */
+    push_level (ctx, m, NULL, m->outlines,
+		pdf_dict_get (ctx, m->outlines, PDF_NAME_Last), true);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_outline_merge_drop (ctx, m);
+    fz_rethrow (ctx);
+  }
+
+  return m;
+}
+
+void
+pdfout_outline_merge_add (fz_context *ctx, pdfout_outline_merge *m,
+			  pdf_document *src, int page_offset,
+			  const char *parent_title)
+{
+  pdf_obj *src_root = pdf_dict_get (ctx, pdf_trailer (ctx, src),
+				    PDF_NAME_Root);
+  pdf_obj *src_outlines = pdf_dict_get (ctx, src_root, PDF_NAME_Outlines);
+  pdf_obj *first = pdf_dict_get (ctx, src_outlines, PDF_NAME_First);
+  merge_level *top = &m->stack[0];
+  int old_count = top->count;
+
+  if (parent_title)
+    {
+      pdf_obj *item = append_item (ctx, m);
+      pdf_dict_put_drop (ctx, item, PDF_NAME_Title,
+			 pdfout_utf8_to_str_obj (ctx, m->doc, parent_title,
+						 strlen (parent_title)));
+
+      pdf_obj *dest = pdf_new_array (ctx, m->doc, 5);
+      pdf_dict_put_drop (ctx, item, PDF_NAME_Dest, dest);
+      pdf_array_push (ctx, dest, pdfout_page_index_get (ctx, m->pages,
+							page_offset));
+      pdf_array_push_drop (ctx, dest, pdf_new_name (ctx, m->doc, "XYZ"));
+      for (int i = 0; i < 3; ++i)
+	pdf_array_push_drop (ctx, dest, pdf_new_null (ctx, m->doc));
+
+      /* Parent entries start closed.  */
+      push_level (ctx, m, first, item, NULL, false);
+      fz_try (ctx)
+	graft (ctx, m, src, page_offset);
+      fz_always (ctx)
+	pop_level (ctx, m);
+      fz_catch (ctx)
+	fz_rethrow (ctx);
+    }
+  else
+    {
+      top->src_next = first;
+      graft (ctx, m, src, page_offset);
+    }
+
+  /* The outline dict counts all visible items.  */
+  pdf_obj *count = pdf_dict_get (ctx, m->outlines, PDF_NAME_Count);
+  pdf_dict_put_drop (ctx, m->outlines, PDF_NAME_Count,
+		     pdf_new_int (ctx, m->doc, (pdf_to_int (ctx, count)
+						+ top->count - old_count)));
+}
+
+void
+pdfout_outline_merge_drop (fz_context *ctx, pdfout_outline_merge *m)
+{
+  if (m == NULL)
+    return;
+  for (int i = 0; i < m->depth; ++i)
+    {
+      pdf_drop_obj (ctx, m->stack[i].dst);
+      pdf_drop_obj (ctx, m->stack[i].last);
+    }
+  free (m->stack);
+  pdf_drop_obj (ctx, m->outlines);
+  pdfout_page_index_drop (ctx, m->pages);
+  free (m);
+}
@@ -0,0 +1,338 @@
+#include "common.h"
+#include <regex.h>
+
+/* Transform the outline objects of a document in place.  The items are
+   walked once, in document order.  Each item is only written back if one
+   of its entries actually changes, so an incremental save contains just
+   the modified items.  */
+
+typedef struct {
+  /* The item whose kids are walked, or the outline dict.  */
+  pdf_obj *parent;
+  /* Next kid to visit, or NULL.  */
+  pdf_obj *next;
+  /* Number of visible descendants, if PARENT is open.  */
+  int count;
+} transform_level;
+
+typedef struct {
+  pdf_document *doc;
+  const pdfout_outline_transform_options *opts;
+  pdfout_page_index *pages;
+
+  regex_t regex;
+  bool has_regex;
+
+  transform_level *stack;
+  int depth, cap;
+
+  unsigned char *visited;
+  int xref_len;
+
+  /* First kids of the truncated items.  */
+  pdf_obj *truncated;
+} outline_transform;
+
+static void
+put_int_if_changed (fz_context *ctx, outline_transform *t, pdf_obj *dict,
+		    pdf_obj *key, int value)
+{
+  pdf_obj *old = pdf_dict_get (ctx, dict, key);
+  if (pdf_is_int (ctx, old) && pdf_to_int (ctx, old) == value)
+    return;
+  pdf_dict_put_drop (ctx, dict, key, pdf_new_int (ctx, t->doc, value));
+}
+
+/* Append REPLACE to BUF, with \0 to \9 replaced by the matched
+   subexpressions of SUBJECT.  */
+static void
+append_replacement (fz_context *ctx, fz_buffer *buf, const char *replace,
+		    const char *subject, regmatch_t *match)
+{
+  for (const char *p = replace; *p; ++p)
+    {
+      if (*p == '\\' && p[1] >= '0' && p[1] <= '9')
+	{
+	  regmatch_t *m = &match[p[1] - '0'];
+	  if (m->rm_so >= 0)
+	    fz_write_buffer (ctx, buf, subject + m->rm_so,
+			     m->rm_eo - m->rm_so);
+	  ++p;
+	}
+      else if (*p == '\\' && p[1] == '\\')
+	fz_write_buffer_byte (ctx, buf, *++p);
+      else
+	fz_write_buffer_byte (ctx, buf, *p);
+    }
+}
+
+/* Replace all matches of the title regex in the UTF-8 string TITLE.
+   Return whether anything was replaced.  */
+static bool
+replace_title (fz_context *ctx, outline_transform *t, const char *title,
+	       fz_buffer *buf)
+{
+  regmatch_t match[10];
+  const char *pos = title;
+  int flags = 0;
+  bool replaced = false;
+
+  while (*pos && regexec (&t->regex, pos, 10, match, flags) == 0)
+    {
+      replaced = true;
+      fz_write_buffer (ctx, buf, pos, match[0].rm_so);
+      append_replacement (ctx, buf, t->opts->title_replace, pos, match);
+
+      int end = match[0].rm_eo;
+      if (end == match[0].rm_so)
+	{
+	  /* Copy one UTF-8 character after an empty match.  */
+	  if (pos[end] == '\0')
+	    return true;
+	  do
+	    fz_write_buffer_byte (ctx, buf, pos[end++]);
+	  while ((pos[end] & 0xc0) == 0x80);
+	}
+      pos += end;
+      flags = REG_NOTBOL;
+    }
+  fz_write_buffer (ctx, buf, pos, strlen (pos));
+
+  return replaced;
+}
+
+static void
+transform_title (fz_context *ctx, outline_transform *t, pdf_obj *item)
+{
+  pdf_obj *title = pdf_dict_get (ctx, item, PDF_NAME_Title);
+  if (pdf_is_string (ctx, title) == false)
+    pdfout_throw (ctx, "outline item without 'Title' key");
+
+  int len;
+  char *text = pdfout_str_obj_to_utf8 (ctx, title, &len);
+  fz_buffer *buf = NULL;
+
+  fz_var (buf);
+  fz_try (ctx)
+  {
+    buf = fz_new_buffer (ctx, len + 16);
+    if (replace_title (ctx, t, text, buf))
+      pdf_dict_put_drop (ctx, item, PDF_NAME_Title,
+			 pdfout_utf8_to_str_obj (ctx, t->doc,
+						 (char *) buf->data,
+						 buf->len));
+  }
+  fz_always (ctx)
+  {
+    fz_drop_buffer (ctx, buf);
+    free (text);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+/* Rewrite the explicit destination array of ITEM, either its Dest entry
+   or the D entry of a GoTo action.  Named destinations are left alone,
+   they may be used elsewhere in the document.  */
+static void
+transform_dest (fz_context *ctx, outline_transform *t, pdf_obj *item)
+{
+  const pdfout_outline_transform_options *opts = t->opts;
+  pdf_obj *owner = item, *key = PDF_NAME_Dest;
+  pdf_obj *dest = pdf_dict_get (ctx, item, PDF_NAME_Dest);
+
+  if (dest == NULL)
+    {
+      owner = pdf_dict_get (ctx, item, PDF_NAME_A);
+      if (pdf_name_eq (ctx, pdf_dict_get (ctx, owner, PDF_NAME_S),
+		       PDF_NAME_GoTo) == false)
+	return;
+      key = PDF_NAME_D;
+      dest = pdf_dict_get (ctx, owner, key);
+    }
+  if (pdf_is_array (ctx, dest) == false)
+    return;
+
+  int len = pdf_array_len (ctx, dest);
+  pdf_obj *page_ref = pdf_array_get (ctx, dest, 0);
+  bool fit = (opts->fit_to_xyz && len == 2
+	      && pdf_name_eq (ctx, pdf_array_get (ctx, dest, 1),
+			      PDF_NAME_Fit));
+
+  if (opts->page_offset)
+    {
+      int page = pdfout_page_index_lookup (ctx, t->pages, page_ref);
+      if (page < 0)
+	pdfout_throw (ctx, "destination does not point to a page");
+      page_ref = pdfout_page_index_get (ctx, t->pages,
+					page + opts->page_offset);
+    }
+  else if (fit == false)
+    return;
+
+  pdf_obj *new_dest = pdf_new_array (ctx, t->doc, fit ? 5 : len);
+  fz_try (ctx)
+  {
+    pdf_array_push (ctx, new_dest, page_ref);
+    if (fit)
+      {
+	pdf_array_push_drop (ctx, new_dest,
+			     pdf_new_name (ctx, t->doc, "XYZ"));
+	for (int i = 0; i < 3; ++i)
+	  pdf_array_push_drop (ctx, new_dest, pdf_new_null (ctx, t->doc));
+      }
+    else
+      for (int i = 1; i < len; ++i)
+	pdf_array_push (ctx, new_dest, pdf_array_get (ctx, dest, i));
+
+    pdf_dict_put (ctx, owner, key, new_dest);
+  }
+  fz_always (ctx)
+    pdf_drop_obj (ctx, new_dest);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static void
+push_level (fz_context *ctx, outline_transform *t, pdf_obj *parent,
+	    pdf_obj *first)
+{
+  if (t->depth == t->cap)
+    t->stack = pdfout_x2nrealloc (ctx, t->stack, &t->cap, transform_level);
+  t->stack[t->depth++] = (transform_level) {parent, first, 0};
+}
+
+/* All kids of LEVEL->parent are done.  Fix its Count and pass the number
+   of visible items up.  */
+static void
+finish_level (fz_context *ctx, outline_transform *t, transform_level *level)
+{
+  pdf_obj *parent = level->parent;
+
+  if (t->depth == 0)
+    {
+      /* The outline dict counts all visible items.  */
+      put_int_if_changed (ctx, t, parent, PDF_NAME_Count, level->count);
+      return;
+    }
+
+  pdf_obj *count = pdf_dict_get (ctx, parent, PDF_NAME_Count);
+  bool open = (t->opts->open ? t->opts->open > 0
+	       : pdf_to_int (ctx, count) > 0);
+
+  put_int_if_changed (ctx, t, parent, PDF_NAME_Count,
+		      open ? level->count : -level->count);
+  if (open)
+    t->stack[t->depth - 1].count += level->count;
+}
+
+static void
+visit_item (fz_context *ctx, outline_transform *t, pdf_obj *item)
+{
+  int num = pdf_to_num (ctx, item);
+  if (num > 0 && num < t->xref_len)
+    {
+      if (t->visited[num / 8] & (1 << num % 8))
+	pdfout_throw (ctx, "circular reference");
+      t->visited[num / 8] |= 1 << num % 8;
+    }
+
+  if (t->has_regex)
+    transform_title (ctx, t, item);
+  transform_dest (ctx, t, item);
+
+  t->stack[t->depth - 1].count++;
+
+  pdf_obj *first = pdf_dict_get (ctx, item, PDF_NAME_First);
+  if (first == NULL)
+    return;
+
+  if (t->opts->max_depth > 0 && t->depth >= t->opts->max_depth)
+    {
+      pdf_array_push (ctx, t->truncated, first);
+      pdf_dict_del (ctx, item, PDF_NAME_First);
+      pdf_dict_del (ctx, item, PDF_NAME_Last);
+      pdf_dict_del (ctx, item, PDF_NAME_Count);
+      return;
+    }
+
+  push_level (ctx, t, item, first);
+}
+
+static void
+transform_outline (fz_context *ctx, outline_transform *t, pdf_obj *outlines)
+{
+  push_level (ctx, t, outlines, pdf_dict_get (ctx, outlines, PDF_NAME_First));
+
+  while (t->depth)
+    {
+      transform_level *level = &t->stack[t->depth - 1];
+      pdf_obj *item = level->next;
+
+      if (item == NULL)
+	{
+	  transform_level done = *level;
+	  --t->depth;
+	  finish_level (ctx, t, &done);
+	  continue;
+	}
+
+      level->next = pdf_dict_get (ctx, item, PDF_NAME_Next);
+      visit_item (ctx, t, item);
+    }
+}
+
+void
+pdfout_outline_transform (fz_context *ctx, pdf_document *doc,
+			  const pdfout_outline_transform_options *opts)
+{
+  /* Entries leading to the objects of a truncated subtree.  */
+  static const char *item_keys[] = { "First", "Next", "Title", NULL };
+  pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, doc), PDF_NAME_Root);
+  pdf_obj *outlines = pdf_dict_get (ctx, root, PDF_NAME_Outlines);
+  if (pdf_dict_get (ctx, outlines, PDF_NAME_First) == NULL)
+    return;
+
+  outline_transform t = { doc, opts };
+
+  if (opts->title_regex)
+    {
+      int err = regcomp (&t.regex, opts->title_regex, REG_EXTENDED);
+      if (err)
+	{
+	  char msg[200];
+	  regerror (err, &t.regex, msg, sizeof msg);
+	  pdfout_throw (ctx, "invalid regular expression '%s': %s",
+			opts->title_regex, msg);
+	}
+      t.has_regex = true;
+    }
+
+  fz_try (ctx)
+  {
+    t.pages = pdfout_page_index_new (ctx, doc);
+    t.xref_len = pdf_xref_len (ctx, doc);
+    t.visited = fz_calloc (ctx, t.xref_len / 8 + 1, 1);
+    t.truncated = pdf_new_array (ctx, doc, 8);
+
+    transform_outline (ctx, &t, outlines);
+
+    if (pdf_array_len (ctx, t.truncated))
+      {
+	pdfout_reclaim *reclaim =
+	  pdfout_reclaim_new (ctx, doc, t.truncated, item_keys);
+	pdfout_reclaim_sweep (ctx, reclaim, outlines);
+      }
+  }
+  fz_always (ctx)
+  {
+    pdf_drop_obj (ctx, t.truncated);
+    free (t.visited);
+    free (t.stack);
+    pdfout_page_index_drop (ctx, t.pages);
+    if (t.has_regex)
+      regfree (&t.regex);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
@@ -1,10 +1,38 @@
 #include "common.h"
 
+/* The emitter only looks at the "title", "page" and "kids" keys of the
+   outline items.  All other values are skipped.  */
+typedef enum {
+  FRAME_LIST,			/* Array of outline items.  */
+  FRAME_ITEM,			/* Outline item hash.  */
+  FRAME_SKIP,			/* Ignored array or hash.  */
+} frame_type;
+
+typedef enum {
+  KEY_NONE,			/* Expecting a key.  */
+  KEY_TITLE,
+  KEY_PAGE,
+  KEY_KIDS,
+  KEY_OTHER,
+} key_type;
+
+typedef struct {
+  frame_type type;
+  key_type key;
+} frame;
+
 typedef struct {
   pdfout_emitter super;
   fz_output *out;
   bool finished;
   int indent_level;
+
+  frame *stack;
+  int depth, cap;
+
+  /* Title and page of the innermost item, until its line is written.  */
+  char *title, *page;
+  bool line_pending;
 } emitter;
 
 static void
@@ -15,16 +43,9 @@ emit_indent (fz_context *ctx, emitter *e)
 }
 
 static void
-emit_array (fz_context *ctx, emitter *e, pdfout_data *data);
-
-static void
-emit_title (fz_context *ctx, fz_output *out, pdfout_data *title)
+emit_title (fz_context *ctx, fz_output *out, char *title_str)
 {
-  int len;
-
-  char *title_str = pdfout_data_scalar_get(ctx, title, &len);
-
-  if (memchr (title_str, '\n', len) == NULL)
+  if (strchr (title_str, '\n') == NULL)
     {
       fz_puts(ctx, out, title_str);
       return;
@@ -42,53 +63,187 @@ emit_title (fz_context *ctx, fz_output *out, pdfout_data *title)
 }
 
 static void
-emit_hash (fz_context *ctx, emitter *e, pdfout_data *hash)
+emit_line (fz_context *ctx, emitter *e)
 {
-  pdfout_data *title = pdfout_data_hash_gets (ctx, hash, "title");
-  pdfout_data *page = pdfout_data_hash_gets (ctx, hash, "page");
-  int len;
+  if (e->line_pending == false)
+    return;
+  if (e->title == NULL || e->page == NULL)
+    pdfout_throw (ctx, "outline item without title or page");
+
+  e->line_pending = false;
   emit_indent (ctx, e);
-  emit_title (ctx, e->out, title);
-  
+  emit_title (ctx, e->out, e->title);
   fz_puts (ctx, e->out, " ");
-  fz_puts (ctx, e->out, pdfout_data_scalar_get (ctx, page, &len));
+  fz_puts (ctx, e->out, e->page);
   fz_puts (ctx, e->out, "\n");
+}
+
+static void
+set_string (fz_context *ctx, char **dest, const char *value, int len)
+{
+  char *copy = fz_malloc (ctx, len + 1);
+  memcpy (copy, value, len);
+  copy[len] = 0;
+  free (*dest);
+  *dest = copy;
+}
+
+static void
+push_frame (fz_context *ctx, emitter *e, frame_type type)
+{
+  if (e->depth == e->cap)
+    e->stack = pdfout_x2nrealloc (ctx, e->stack, &e->cap, frame);
+  e->stack[e->depth++] = (frame) {type, KEY_NONE};
+}
+
+/* Return the type of a new array or hash at the current position and
+   consume the current item value.  */
+static frame_type
+container_type (fz_context *ctx, emitter *e, bool is_hash)
+{
+  if (e->finished)
+    pdfout_throw (ctx, "finished outline wysiwyg emitter called");
 
-  pdfout_data *kids = pdfout_data_hash_gets (ctx, hash, "kids");
+  if (e->depth == 0)
+    {
+      if (is_hash)
+	pdfout_throw (ctx, "outline wysiwyg emitter: expected array");
+      return FRAME_LIST;
+    }
 
-  if (kids)
+  frame *top = &e->stack[e->depth - 1];
+  switch (top->type)
     {
+    case FRAME_LIST:
+      if (is_hash == false)
+	pdfout_throw (ctx, "outline wysiwyg emitter: expected outline item");
+      return FRAME_ITEM;
+    case FRAME_ITEM:
+      {
+	key_type key = top->key;
+	if (key == KEY_NONE)
+	  pdfout_throw (ctx, "outline wysiwyg emitter: key is not a scalar");
+	top->key = KEY_NONE;
+	if (key == KEY_KIDS && is_hash == false)
+	  return FRAME_LIST;
+	if (key == KEY_TITLE || key == KEY_PAGE || key == KEY_KIDS)
+	  pdfout_throw (ctx, "outline wysiwyg emitter: invalid value");
+	return FRAME_SKIP;
+      }
+    default:
+      return FRAME_SKIP;
+    }
+}
+
+static void
+emitter_array_start (fz_context *ctx, pdfout_emitter *emit)
+{
+  emitter *e = (emitter *) emit;
+  frame_type type = container_type (ctx, e, false);
+  if (type == FRAME_LIST && e->depth)
+    {
+      emit_line (ctx, e);
       e->indent_level++;
-      emit_array (ctx, e, kids);
-      e->indent_level--;
     }
-  
+  push_frame (ctx, e, type);
 }
 
 static void
-emit_array (fz_context *ctx, emitter *e, pdfout_data *data)
+emitter_hash_start (fz_context *ctx, pdfout_emitter *emit)
 {
-  int len = pdfout_data_array_len(ctx, data);
-  for (int i = 0; i < len; ++i)
-    emit_hash (ctx, e, pdfout_data_array_get (ctx, data, i));
-      
+  emitter *e = (emitter *) emit;
+  frame_type type = container_type (ctx, e, true);
+  if (type == FRAME_ITEM)
+    {
+      free (e->title);
+      free (e->page);
+      e->title = e->page = NULL;
+      e->line_pending = true;
+    }
+  push_frame (ctx, e, type);
 }
 
 static void
-emit (fz_context *ctx, pdfout_emitter *emit, pdfout_data *data)
+container_end (fz_context *ctx, emitter *e)
+{
+  if (e->depth == 0)
+    pdfout_throw (ctx, "outline wysiwyg emitter: unbalanced end event");
+
+  frame_type type = e->stack[--e->depth].type;
+  if (type == FRAME_ITEM)
+    emit_line (ctx, e);
+  else if (type == FRAME_LIST && e->depth)
+    e->indent_level--;
+
+  if (e->depth == 0)
+    e->finished = true;
+}
+
+static void
+emitter_array_end (fz_context *ctx, pdfout_emitter *emit)
+{
+  container_end (ctx, (emitter *) emit);
+}
+
+static void
+emitter_hash_end (fz_context *ctx, pdfout_emitter *emit)
+{
+  container_end (ctx, (emitter *) emit);
+}
+
+static void
+emitter_scalar (fz_context *ctx, pdfout_emitter *emit, const char *value,
+		int len)
 {
   emitter *e = (emitter *) emit;
-  if (e->finished)
-    pdfout_throw (ctx, "finished outline wysiwyg emitter called");
-  e->finished = true;
+  if (e->finished || e->depth == 0)
+    pdfout_throw (ctx, "outline wysiwyg emitter: unexpected scalar");
+
+  frame *top = &e->stack[e->depth - 1];
+  if (top->type == FRAME_LIST)
+    pdfout_throw (ctx, "outline wysiwyg emitter: expected outline item");
+  else if (top->type == FRAME_SKIP)
+    return;
 
-  emit_array(ctx, e, data);
+  switch (top->key)
+    {
+    case KEY_NONE:
+#define key_equal(literal)					\
+      (sizeof literal == len + 1 && memcmp (literal, value, len) == 0)
+      top->key = (key_equal ("title") ? KEY_TITLE
+		  : key_equal ("page") ? KEY_PAGE
+		  : key_equal ("kids") ? KEY_KIDS
+		  : KEY_OTHER);
+#undef key_equal
+      return;
+    case KEY_TITLE:
+      set_string (ctx, &e->title, value, len);
+      break;
+    case KEY_PAGE:
+      set_string (ctx, &e->page, value, len);
+      break;
+    case KEY_KIDS:
+      pdfout_throw (ctx, "outline wysiwyg emitter: kids is not an array");
+    default:
+      break;
+    }
+  top->key = KEY_NONE;
+}
+
+static void
+emit (fz_context *ctx, pdfout_emitter *emit, pdfout_data *data)
+{
+  pdfout_emitter_emit_events (ctx, emit, data);
 }
 
 static void
-emitter_drop(fz_context *ctx, pdfout_emitter *emitter)
+emitter_drop(fz_context *ctx, pdfout_emitter *emit)
 {
-  free (emitter);
+  emitter *e = (emitter *) emit;
+  free (e->title);
+  free (e->page);
+  free (e->stack);
+  free (e);
 }
 
 pdfout_emitter *
@@ -97,22 +252,36 @@ pdfout_emitter_outline_wysiwyg_new (fz_context *ctx, fz_output *stm)
   emitter *result = fz_malloc_struct (ctx, emitter);
   result->super.drop = emitter_drop;
   result->super.emit = emit;
+  result->super.array_start = emitter_array_start;
+  result->super.array_end = emitter_array_end;
+  result->super.hash_start = emitter_hash_start;
+  result->super.hash_end = emitter_hash_end;
+  result->super.scalar = emitter_scalar;
   result->out = stm;
   return &result->super;
 }
 
 
+/* The parser reads the input line by line and builds the outline in the
+   same pass.  The kids arrays which are still open are kept on a stack,
+   together with the last item of each array, which receives the kids of
+   the next deeper level.  */
+typedef struct {
+  pdfout_data *kids;
+  pdfout_data *last;
+} parser_level;
+
 typedef struct {
   pdfout_parser super;
   fz_stream *stream;
   bool finished;
 
-  
-  /* Used during get_lines.  */
   int line_number;
   int previous_indent_level;
   int difference;		/* Set by 'd=...' */
-  
+
+  parser_level *stack;
+  int depth, cap;
 } parser;
 
 
@@ -176,23 +345,48 @@ parse_error (fz_context *ctx, const char *msg, const char *line, int len,
 static void
 data_hash_push_int (fz_context *ctx, pdfout_data *hash, const char *key, int x)
 {
-  pdfout_data *key_data = pdfout_data_scalar_new (ctx, key, strlen (key));
   char buf[100];
   int len = pdfout_snprintf(ctx, buf, "%d", x);
-  pdfout_data *value = pdfout_data_scalar_new (ctx, buf, len);
-  pdfout_data_hash_push (ctx, hash, key_data, value);
+  pdfout_data_hash_push_key_value (ctx, hash, key, buf, len);
 }
 
 static void
-data_hash_push_string_key (fz_context *ctx, pdfout_data *hash, const char *key,
-			   pdfout_data *value)
+push_level (fz_context *ctx, parser *p, pdfout_data *kids)
 {
-  pdfout_data *key_data = pdfout_data_scalar_new (ctx, key, strlen (key));
-  pdfout_data_hash_push (ctx, hash, key_data, value);
+  if (p->depth == p->cap)
+    p->stack = pdfout_x2nrealloc (ctx, p->stack, &p->cap, parser_level);
+  p->stack[p->depth++] = (parser_level) {kids, NULL};
 }
-  
+
+/* Append an item to the kids array of INDENT_LEVEL.  The indentation was
+   checked before, so it is at most one level deeper than the previous
+   item.  */
 static void
-add_line (fz_context *ctx, pdfout_data *lines, fz_buffer *line_buf, parser *p)
+add_item (fz_context *ctx, parser *p, int indent_level, const char *title,
+	  int title_len, int page)
+{
+  if (indent_level >= p->depth)
+    {
+      pdfout_data *parent = p->stack[p->depth - 1].last;
+      pdfout_data *kids = pdfout_data_array_new (ctx);
+      pdfout_data *key = pdfout_data_scalar_new (ctx, "kids", strlen ("kids"));
+      pdfout_data_hash_push (ctx, parent, key, kids);
+      push_level (ctx, p, kids);
+    }
+  else
+    p->depth = indent_level + 1;
+
+  parser_level *level = &p->stack[p->depth - 1];
+  pdfout_data *hash = pdfout_data_hash_new (ctx);
+  pdfout_data_array_push (ctx, level->kids, hash);
+  level->last = hash;
+
+  pdfout_data_hash_push_key_value (ctx, hash, "title", title, title_len);
+  data_hash_push_int (ctx, hash, "page", page);
+}
+
+static void
+parse_line (fz_context *ctx, parser *p, fz_buffer *line_buf)
 {
   ++p->line_number;
   char *line;
@@ -241,8 +435,9 @@ add_line (fz_context *ctx, pdfout_data *lines, fz_buffer *line_buf, parser *p)
     parse_error (ctx, "no separator between title and page number", line, len,
 		 p);
 
-  /* Check indent level.   */
-  if (p->line_number == 1 && indent_level != 0)
+  /* Check indent level.  The first item is at the top level, even if it
+     is preceded by empty lines.  */
+  if (pdfout_data_array_len (ctx, p->stack[0].kids) == 0 && indent_level != 0)
     parse_error (ctx, "first line must not have indentation", line, len, p);
 
   if (indent_level > p->previous_indent_level + 1)
@@ -250,39 +445,30 @@ add_line (fz_context *ctx, pdfout_data *lines, fz_buffer *line_buf, parser *p)
 
   p->previous_indent_level = indent_level;
 
-  /* Success.  */
-  
-  pdfout_data *hash = pdfout_data_hash_new(ctx);
-  pdfout_data_hash_push_key_value (ctx, hash, "title", title,
-				   separator - title);
-  fz_try (ctx)
-  {
-    /* Throws on overflow.  */
-    int page = pdfout_strtoint (ctx, number, NULL);
-    page += p->difference;
-    data_hash_push_int (ctx, hash, "page", page);
-    
-    data_hash_push_int (ctx, hash, "level", indent_level);
-
-    pdfout_data_array_push (ctx, lines, hash);
-  }
-  fz_catch (ctx)
-  {
-    pdfout_data_drop (ctx, hash);
-    fz_rethrow (ctx);
-  }
+  /* Throws on overflow.  */
+  int page = pdfout_strtoint (ctx, number, NULL);
+  page += p->difference;
+
+  add_item (ctx, p, indent_level, title, separator - title, page);
 }
 
 static pdfout_data *
-get_lines (fz_context *ctx, parser *p)
+parser_parse (fz_context *ctx, pdfout_parser *parse)
 {
+  parser *p = (parser *) parse;
+
+  if (p->finished)
+    pdfout_throw (ctx, "call to finished outline wysiwyg parser");
+  p->finished = true;
+
   fz_buffer *line_buf = NULL;
-  pdfout_data *lines = pdfout_data_array_new (ctx);
+  pdfout_data *outline = pdfout_data_array_new (ctx);
 
   fz_try (ctx)
   {
+    push_level (ctx, p, outline);
     while (pdfout_getline (ctx, &line_buf, p->stream) != -1)
-      add_line (ctx, lines, line_buf, p);
+      parse_line (ctx, p, line_buf);
   }
   fz_always (ctx)
   {
@@ -290,224 +476,9 @@ get_lines (fz_context *ctx, parser *p)
   }
   fz_catch (ctx)
   {
-    pdfout_data_drop (ctx, lines);
+    pdfout_data_drop (ctx, outline);
     fz_rethrow (ctx);
   }
-  return lines;
-}
-
-static void
-add_title_token (fz_context *ctx, pdfout_data *tokens, pdfout_data *line_hash)
-{
-  pdfout_data *token = pdfout_data_copy (ctx, line_hash);
-  const char *type = "title";
-  pdfout_data_hash_push_key_value (ctx, token, "type", type, strlen (type));
-  pdfout_data_array_push (ctx, tokens, token);
-}
-
-static void
-add_eof_token (fz_context *ctx, pdfout_data *tokens)
-{
-  pdfout_data *token = pdfout_data_hash_new (ctx);
-  pdfout_data_hash_push_key_value (ctx, token, "type", "eof", strlen ("eof"));
-  pdfout_data_array_push (ctx, tokens, token);
-}
-
-static void
-add_kids_token (fz_context *ctx, pdfout_data *tokens, const char *type)
-{
-  pdfout_data *token = pdfout_data_hash_new (ctx);
-  pdfout_data_hash_push_key_value (ctx, token, "type", type, strlen (type));
-  pdfout_data_array_push (ctx, tokens, token);
-}
-
-static void
-add_kids_start_token (fz_context *ctx, pdfout_data *tokens)
-{
-  add_kids_token (ctx, tokens, "kids-start");
-}
-
-static void
-add_kids_end_token (fz_context *ctx, pdfout_data *tokens)
-{
-  add_kids_token (ctx, tokens, "kids-end");
-}
-
-
-
-static int
-data_hash_key_to_int (fz_context *ctx, pdfout_data *hash, const char *key)
-{
-  pdfout_data *scalar = pdfout_data_hash_gets (ctx, hash, key);
-  int len;
-  const char *str = pdfout_data_scalar_get (ctx, scalar, &len);
-  return pdfout_strtoint_null (ctx, str);
-}
-
-static pdfout_data *get_tokens (fz_context *ctx, pdfout_data *lines)
-{
-  pdfout_data *tokens = pdfout_data_array_new (ctx);
-  int num = pdfout_data_array_len (ctx, lines);
-
-  int previous_level = 0;
-
-  /* Surround with start/end tokens to make it simpler to parse.  */
-  add_kids_start_token (ctx, tokens);
-  
-  pdfout_data *line = pdfout_data_array_get (ctx, lines, 0);
-  add_title_token (ctx, tokens, line);
-  
-  for (int i = 1; i < num; ++i) {
-     line = pdfout_data_array_get (ctx, lines, i);
-     int level = data_hash_key_to_int (ctx, line, "level");
-
-     if (level > previous_level)
-       add_kids_start_token (ctx, tokens);
-     else if (level < previous_level)
-       for (int j = 0; j < previous_level - level; ++j)
-	 add_kids_end_token (ctx, tokens);
-     
-     add_title_token (ctx, tokens, line);
-     previous_level = level;
-  }
-  
-  for (int i = 0; i < previous_level; ++i)
-    add_kids_end_token (ctx, tokens);
-
-  add_kids_end_token (ctx, tokens);
-  add_eof_token (ctx, tokens);
-  
-  return tokens;
-}
-
-typedef enum {
-  TITLE_TOKEN,
-  KIDS_START_TOKEN,
-  KIDS_END_TOKEN,
-  EOF_TOKEN,
-} token_type;
-
-typedef struct {
-  pdfout_data *tokens;
-  int read;
-  token_type lah;
-} token_parser;
-
-static bool
-eq(const char *a, const char *b)
-{
-  return strcmp(a, b) == false;
-}
-
-static void
-token_parser_read (fz_context *ctx, token_parser *parser)
-{
-  pdfout_data *token = pdfout_data_array_get (ctx, parser->tokens,
-					      parser->read);
-  ++parser->read;
-  pdfout_data *type = pdfout_data_hash_gets (ctx, token, "type");
-  int len;
-  const char *type_str = pdfout_data_scalar_get (ctx, type, &len);
-  parser->lah = eq (type_str, "title") ? TITLE_TOKEN :
-    eq (type_str, "kids-start") ? KIDS_START_TOKEN :
-    eq (type_str, "kids-end") ? KIDS_END_TOKEN :
-    EOF_TOKEN;
-}
-
-static token_parser *
-token_parser_new (fz_context *ctx, pdfout_data *tokens)
-{
-  token_parser *result = fz_malloc_struct (ctx, token_parser);
-  result->tokens = tokens;
-  token_parser_read (ctx, result);
-  return result;
-}
-
-static void
-token_parser_drop (fz_context *ctx, token_parser *parser)
-{
-  free (parser);
-}
-
-static void
-token_parse_terminal (fz_context *ctx, token_parser *parser, token_type tok)
-{
-  if (parser->lah != tok)
-    pdfout_throw (ctx, "got token: %d, expected: %d", parser->lah, tok);
-  
-  token_parser_read (ctx, parser);
-}
-
-static pdfout_data *
-token_parse_kids_array (fz_context *ctx, token_parser *parser);
-  
-static pdfout_data *
-token_parse_title (fz_context *ctx, token_parser *parser)
-{
-  token_parse_terminal (ctx, parser, TITLE_TOKEN);
-  pdfout_data *tokens = parser->tokens;
-  
-  pdfout_data *token = pdfout_data_array_get (ctx, tokens, parser->read - 2);
-  pdfout_data *title = pdfout_data_hash_gets (ctx, token, "title");
-  pdfout_data *page = pdfout_data_hash_gets (ctx, token, "page");
-  pdfout_data *outline = pdfout_data_hash_new (ctx);
-  pdfout_data *title_copy = pdfout_data_copy (ctx, title);
-  pdfout_data *page_copy = pdfout_data_copy (ctx, page);
-  
-  data_hash_push_string_key (ctx, outline, "title", title_copy);
-  data_hash_push_string_key (ctx, outline, "page", page_copy);
-
-  if (parser->lah == KIDS_START_TOKEN)
-    {
-      pdfout_data *kids = token_parse_kids_array (ctx, parser);
-      data_hash_push_string_key (ctx, outline, "kids", kids);
-    }
-
-  return outline;
-}
-
-static pdfout_data *
-token_parse_kids_array (fz_context *ctx, token_parser *parser)
-{
-  pdfout_data *kids = pdfout_data_array_new (ctx);
-  token_parse_terminal (ctx, parser, KIDS_START_TOKEN);
-  while (parser->lah == TITLE_TOKEN)
-    {
-      pdfout_data *kid = token_parse_title (ctx, parser);
-      pdfout_data_array_push (ctx, kids, kid);
-    }
-  token_parse_terminal (ctx, parser, KIDS_END_TOKEN);
-  return kids;
-}
-
-static pdfout_data *
-token_parse (fz_context *ctx, pdfout_data *tokens)
-{
-  token_parser *parser = token_parser_new (ctx, tokens);
-  pdfout_data *outline = token_parse_kids_array (ctx, parser);
-  assert (parser->lah == EOF_TOKEN);
-  token_parser_drop (ctx, parser);
-  return outline;
-}
-
-static pdfout_data *
-parser_parse (fz_context *ctx, pdfout_parser *parse)
-{
-  parser *p = (parser *) parse;
-
-  if (p->finished)
-    pdfout_throw (ctx, "call to finished outline wysiwyg parser");
-  p->finished = true;
-  
-  pdfout_data *lines = get_lines (ctx, p);
-  if (pdfout_data_array_len (ctx, lines) == 0)
-    return lines;
-  
-  pdfout_data *tokens = get_tokens (ctx, lines);
-  pdfout_data *outline = token_parse(ctx, tokens);
-  
-  pdfout_data_drop (ctx, tokens);
-  pdfout_data_drop (ctx, lines);
 
   return outline;
 }
@@ -517,6 +488,7 @@ parser_drop(fz_context *ctx, pdfout_parser *parse)
 {
   parser *p = (parser *) parse;
   fz_drop_stream (ctx, p->stream);
+  free (p->stack);
   free (p);
 }
 
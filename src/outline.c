@@ -1,28 +1,5 @@
 #include "common.h"
 
-static bool
-streq (const char *a, const char *b)
-{
-  return strcmp (a, b) == 0;
-}
-
-static const char *
-data_hash_get_string_key (fz_context *ctx, pdfout_data *hash,
-			  const char *key)
-{
-  pdfout_data *scalar = pdfout_data_hash_gets (ctx, hash, key);
-
-  if (scalar == NULL)
-    return NULL;
-  
-
-  int len;
-  char *value = pdfout_data_scalar_get (ctx, scalar, &len);
-  if (strlen (value) != len)
-    pdfout_throw (ctx, "embedded null byte for key '%s'", key);
-  return value;
-}
-
 static const char *
 data_array_get_string (fz_context *ctx, pdfout_data *array, int i)
 {
@@ -47,17 +24,22 @@ data_scalar_get_string (fz_context *ctx, pdfout_data *scalar)
 static int
 dest_sequence_length (fz_context *ctx, const char *label)
 {
-  if (streq (label, "XYZ"))
-    return 4;
-  else if (streq (label, "Fit") || streq (label, "FitB"))
-    return 1;
-  else if (streq (label, "FitH") || streq (label, "FitV")
-	   || streq (label, "FitBH"))
-    return 2;
-  else if (streq (label, "FitR"))
-    return 5;
-  else
-    pdfout_throw (ctx, "unknown destination: '%s'", label);
+  switch (pdfout_key_classify (label, strlen (label)))
+    {
+    case PDFOUT_KEY_XYZ:
+      return 4;
+    case PDFOUT_KEY_Fit:
+    case PDFOUT_KEY_FitB:
+      return 1;
+    case PDFOUT_KEY_FitH:
+    case PDFOUT_KEY_FitV:
+    case PDFOUT_KEY_FitBH:
+      return 2;
+    case PDFOUT_KEY_FitR:
+      return 5;
+    default:
+      pdfout_throw (ctx, "unknown destination: '%s'", label);
+    }
 }
 
 static void
@@ -67,7 +49,7 @@ check_sequence_numbers (fz_context *ctx, pdfout_data *dest)
   for (int i = 1; i < len; ++i)
     {
       const char *num = data_array_get_string (ctx, dest, i);
-      if (streq (num, "null"))
+      if (pdfout_key_classify (num, strlen (num)) == PDFOUT_KEY_null)
 	continue;
 
       pdfout_strtof(ctx, num);
@@ -89,157 +71,340 @@ check_dest_sequence (fz_context *ctx, pdfout_data *dest)
   check_sequence_numbers (ctx, dest);
 }
 
-static void
-check_outline_array (fz_context *ctx, pdf_document *doc, pdfout_data *outline);
+/* The outline is validated and built in a single post-order pass over the
+   input.  The dicts of each sibling list are allocated first, so that
+   their Prev and Next entries can refer to each other.
+
+   The new dicts are collected and only stored in the document after
+   success.  In patch mode, the new items are first matched with old
+   items of the same title, in document order.  Matched items keep their
+   object numbers, the remaining new items take the remaining old numbers
+   in order, and dicts which did not change are not written at all.  An
+   inserted, deleted or retitled item thus leaves the numbers of the other
+   items alone.  */
+typedef struct {
+  int num, gen;
+} outline_ref;
+
+typedef struct {
+  outline_ref ref;
+  /* Next old item with the same title, or -1.  */
+  int same_title;
+  bool claimed;
+} old_item;
+
+typedef struct {
+  pdf_document *doc;
+  pdfout_page_index *pages;
+
+  /* New dicts, with their object numbers and whether these are old.  */
+  pdf_obj **dicts;
+  outline_ref *refs;
+  bool *reused;
+  int len, cap;
+
+  /* Items of the old outline, with the first item of each title.  */
+  old_item *old;
+  int old_len, old_cap, old_next;
+  pdfout_hash *old_titles;
+
+  /* The old item matched with each new dict, or -1, in allocation
+     order.  */
+  int *claims;
+  int claims_len, claims_cap;
+
+  /* Objects created with pdf_create_object, deleted again on error.  */
+  int *created;
+  int created_len, created_cap;
+} outline_build;
 
-static void
-check_outline_hash (fz_context *ctx, pdf_document *doc, pdfout_data *hash)
+static pdf_obj *
+add_object (fz_context *ctx, outline_build *b, pdf_obj **dict)
 {
-  int len = pdfout_data_hash_len (ctx, hash);
-  bool has_title = false, has_page = false;
-  
-  for (int i = 0; i < len; ++i)
+  if (b->len == b->cap)
     {
-      pdfout_data *key = pdfout_data_hash_get_key (ctx, hash, i);
-      pdfout_data *value = pdfout_data_hash_get_value (ctx, hash, i);
-      if (pdfout_data_scalar_eq (ctx, key, "title"))
-	{
-	  if (pdfout_data_is_scalar (ctx, value) == false)
-	    pdfout_throw (ctx, "value of key 'title' not a scalar");
-	  has_title = true;
-	}
-      else if (pdfout_data_scalar_eq (ctx, key, "page"))
+      int cap = b->cap;
+      b->refs = pdfout_x2nrealloc (ctx, b->refs, &cap, outline_ref);
+      cap = b->cap;
+      b->reused = pdfout_x2nrealloc (ctx, b->reused, &cap, bool);
+      b->dicts = pdfout_x2nrealloc (ctx, b->dicts, &b->cap, pdf_obj *);
+    }
+  if (b->created_len == b->created_cap)
+    b->created = pdfout_x2nrealloc (ctx, b->created, &b->created_cap, int);
+
+  /* Take the matched old item, or else the next unmatched one.  */
+  int old = b->len < b->claims_len ? b->claims[b->len] : -1;
+  if (old < 0)
+    {
+      while (b->old_next < b->old_len && b->old[b->old_next].claimed)
+	++b->old_next;
+      if (b->old_next < b->old_len)
 	{
-	  const char *s = data_scalar_get_string (ctx, value);
-	  int page = pdfout_strtoint_null (ctx, s);
-	  int count = pdf_count_pages (ctx, doc);
-	  if (page < 1)
-	    pdfout_throw (ctx, "page number '%d' is not positive", page);
-	  if (page > count)
-	    pdfout_throw (ctx,
-			  "page number '%d' is bigger than page count %d",
-			  page, count);
-
-	  has_page = true;
+	  old = b->old_next;
+	  b->old[old].claimed = true;
 	}
-      else if (pdfout_data_scalar_eq (ctx, key, "view"))
-	check_dest_sequence (ctx, value);
-      else if (pdfout_data_scalar_eq (ctx, key, "open"))
+    }
+
+  outline_ref ref;
+  if (old >= 0)
+    ref = b->old[old].ref;
+  else
+    {
+      ref = (outline_ref) { pdf_create_object (ctx, b->doc), 0 };
+      b->created[b->created_len++] = ref.num;
+    }
+
+  *dict = pdf_new_dict (ctx, b->doc, 8);
+  b->dicts[b->len] = *dict;
+  b->reused[b->len] = old >= 0;
+  b->refs[b->len++] = ref;
+
+  return pdf_new_indirect (ctx, b->doc, ref.num, ref.gen);
+}
+
+/* Compare the way it matters for the outline: numbers by value, indirect
+   references by object number, dicts regardless of key order.  */
+static bool
+obj_eq (fz_context *ctx, pdf_obj *a, pdf_obj *b)
+{
+  if (pdf_is_indirect (ctx, a) || pdf_is_indirect (ctx, b))
+    return (pdf_is_indirect (ctx, a) && pdf_is_indirect (ctx, b)
+	    && pdf_to_num (ctx, a) == pdf_to_num (ctx, b)
+	    && pdf_to_gen (ctx, a) == pdf_to_gen (ctx, b));
+
+  if (pdf_is_number (ctx, a) || pdf_is_number (ctx, b))
+    return (pdf_is_number (ctx, a) && pdf_is_number (ctx, b)
+	    && pdf_to_real (ctx, a) == pdf_to_real (ctx, b));
+
+  if (pdf_is_array (ctx, a) || pdf_is_array (ctx, b))
+    {
+      int len = pdf_array_len (ctx, a);
+      if (pdf_is_array (ctx, a) == false || pdf_is_array (ctx, b) == false
+	  || len != pdf_array_len (ctx, b))
+	return false;
+      for (int i = 0; i < len; ++i)
+	if (obj_eq (ctx, pdf_array_get (ctx, a, i),
+		    pdf_array_get (ctx, b, i)) == false)
+	  return false;
+      return true;
+    }
+
+  if (pdf_is_dict (ctx, a) || pdf_is_dict (ctx, b))
+    {
+      int len = pdf_dict_len (ctx, a);
+      if (pdf_is_dict (ctx, a) == false || pdf_is_dict (ctx, b) == false
+	  || len != pdf_dict_len (ctx, b))
+	return false;
+      for (int i = 0; i < len; ++i)
 	{
-	  if (pdfout_data_scalar_eq (ctx, value, "true") == false
-	      && pdfout_data_scalar_eq (ctx, value, "false") == false)
-	    pdfout_throw (ctx, "value of key 'open' not a bool");
+	  pdf_obj *key = pdf_dict_get_key (ctx, a, i);
+	  pdf_obj *value = pdf_dict_get (ctx, b, key);
+	  if (value == NULL
+	      || obj_eq (ctx, pdf_dict_get_val (ctx, a, i), value) == false)
+	    return false;
 	}
-      else if (pdfout_data_scalar_eq (ctx, key, "kids"))
-	check_outline_array (ctx, doc, value);
+      return true;
     }
 
-  if (has_title == false)
-    pdfout_throw (ctx, "missing title in outline hash");
-  if (has_page == false)
-    pdfout_throw (ctx, "missing page in outline hash");
-  
+  return pdf_objcmp (ctx, a, b) == 0;
 }
 
+/* Store the new dicts in the document, skipping the unchanged ones.  */
 static void
-check_outline_array (fz_context *ctx, pdf_document *doc, pdfout_data *outline)
+commit_objects (fz_context *ctx, outline_build *b)
 {
-  int len = pdfout_data_array_len (ctx, outline);
-  if (len < 1)
-    pdfout_throw (ctx, "empty outline array");
-  for (int i = 0; i < len; ++i)
+  for (int i = 0; i < b->len; ++i)
     {
-      pdfout_data *hash = pdfout_data_array_get (ctx, outline, i);
-      check_outline_hash (ctx, doc, hash);
+      int num = b->refs[i].num;
+      bool changed = true;
+
+      if (b->reused[i])
+	{
+	  pdf_obj *old = pdf_load_object (ctx, b->doc, num, b->refs[i].gen);
+	  changed = obj_eq (ctx, old, b->dicts[i]) == false;
+	  pdf_drop_obj (ctx, old);
+	}
+
+      if (changed)
+	pdf_update_object (ctx, b->doc, num, b->dicts[i]);
     }
 }
 
 static void
-check_outline (fz_context *ctx, pdf_document *doc, pdfout_data *outline)
+add_reuse (fz_context *ctx, outline_build *b, pdf_obj *obj)
 {
-  int len = pdfout_data_array_len (ctx, outline);
-
-  if (len == 0)
+  if (pdf_is_indirect (ctx, obj) == false)
     return;
-  
-  check_outline_array (ctx, doc, outline);
+  if (b->old_len == b->old_cap)
+    b->old = pdfout_x2nrealloc (ctx, b->old, &b->old_cap, old_item);
+  int i = b->old_len++;
+  b->old[i] = (old_item) {
+    { pdf_to_num (ctx, obj), pdf_to_gen (ctx, obj) }, -1, false };
+
+  pdf_obj *title = pdf_dict_get (ctx, obj, PDF_NAME_Title);
+  if (pdf_is_string (ctx, title) == false)
+    return;
+
+  pdfout_data *scalar = pdfout_data_scalar_from_pdf (ctx, title);
+  fz_try (ctx)
+  {
+    int len;
+    const char *s = pdfout_data_scalar_get (ctx, scalar, &len);
+    if (pdfout_hash_insert (ctx, b->old_titles, s, len,
+			    (void *) (intptr_t) i) == false)
+      {
+	/* Append to the items with the same title.  */
+	int e = pdfout_hash_find (ctx, b->old_titles, s, len);
+	int j = (intptr_t) pdfout_hash_value (ctx, b->old_titles, e);
+	while (b->old[j].same_title >= 0)
+	  j = b->old[j].same_title;
+	b->old[j].same_title = i;
+      }
+  }
+  fz_always (ctx)
+    pdfout_data_drop (ctx, scalar);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
 }
 
-static int
-calculate_kids_count (fz_context *ctx, pdfout_data *hash)
+/* Collect the object numbers and titles of the old outline in the order
+   in which build_outline_array allocates them: all items of a sibling
+   list, then the kids of each item in turn.  */
+static void
+collect_reuse (fz_context *ctx, outline_build *b, pdf_obj *outlines)
 {
-  pdfout_data *kids = pdfout_data_hash_gets (ctx, hash, "kids");
-  if (kids == NULL)
-    return 0;
-  int kids_len = pdfout_data_array_len (ctx, kids);
-  int count = kids_len;
-  for (int i = 0; i < kids_len; ++i)
+  int xref_len = pdf_xref_len (ctx, b->doc);
+  unsigned char *visited = fz_calloc (ctx, xref_len / 8 + 1, 1);
+  pdf_obj **items = NULL;
+  int items_len = 0, items_cap = 0;
+  struct level { int start, len, next; } *stack = NULL;
+  int depth = 0, stack_cap = 0;
+
+  fz_try (ctx)
+  {
+    add_reuse (ctx, b, outlines);
+    pdf_obj *list = outlines;
+    while (true)
+      {
+	/* Append the kids of LIST.  */
+	int start = items_len;
+	for (pdf_obj *item = pdf_dict_get (ctx, list, PDF_NAME_First);
+	     pdf_is_dict (ctx, item);
+	     item = pdf_dict_get (ctx, item, PDF_NAME_Next))
+	  {
+	    int num = pdf_to_num (ctx, item);
+	    if (num <= 0 || num >= xref_len
+		|| visited[num / 8] & (1 << num % 8))
+	      break;
+	    visited[num / 8] |= 1 << num % 8;
+
+	    add_reuse (ctx, b, item);
+	    if (items_len == items_cap)
+	      items = pdfout_x2nrealloc (ctx, items, &items_cap, pdf_obj *);
+	    items[items_len++] = item;
+	  }
+	if (items_len > start)
+	  {
+	    if (depth == stack_cap)
+	      stack = pdfout_x2nrealloc (ctx, stack, &stack_cap, struct level);
+	    stack[depth++] = (struct level) { start, items_len - start, 0 };
+	  }
+
+	while (depth && stack[depth - 1].next == stack[depth - 1].len)
+	  --depth;
+	if (depth == 0)
+	  break;
+
+	struct level *top = &stack[depth - 1];
+	list = items[top->start + top->next++];
+      }
+  }
+  fz_always (ctx)
+  {
+    free (stack);
+    free (items);
+    free (visited);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static void
+add_claim (fz_context *ctx, outline_build *b, pdfout_data *title)
+{
+  int old = -1;
+  if (title && pdfout_data_is_scalar (ctx, title))
     {
-      pdfout_data *kid_hash = pdfout_data_array_get (ctx, kids, i);
-      int kid_count = calculate_kids_count (ctx, kid_hash);
-      if (kid_count > 0)
-	count += kid_count;
+      int len;
+      const char *s = pdfout_data_scalar_get (ctx, title, &len);
+      int e = pdfout_hash_find (ctx, b->old_titles, s, len);
+      if (e >= 0)
+	old = (intptr_t) pdfout_hash_value (ctx, b->old_titles, e);
+      while (old >= 0 && b->old[old].claimed)
+	old = b->old[old].same_title;
+      if (old >= 0)
+	b->old[old].claimed = true;
     }
 
-  const char *open = data_hash_get_string_key (ctx, hash, "open");
-  bool is_open = false;
-  if (open && streq (open, "true"))
-    is_open = true;
-
-  if (is_open == false)
-    count *= -1;
-
-  char buf[200];
-  pdfout_snprintf (ctx, buf, "%d", count);
-  pdfout_data *key = pdfout_data_scalar_new (ctx, "count", strlen ("count"));
-  pdfout_data *value = pdfout_data_scalar_new (ctx, buf, strlen (buf));
-  pdfout_data_hash_push (ctx, hash, key, value);
-
-  return count;
+  if (b->claims_len == b->claims_cap)
+    b->claims = pdfout_x2nrealloc (ctx, b->claims, &b->claims_cap, int);
+  b->claims[b->claims_len++] = old;
 }
 
+/* Match the items of OUTLINE with old items by title, in the order in
+   which build_outline_array allocates them.  Malformed input is skipped
+   here and reported by the build.  */
 static void
-calculate_counts (fz_context *ctx, pdfout_data *outline)
+claim_items (fz_context *ctx, outline_build *b, pdfout_data *outline)
 {
+  if (pdfout_data_is_array (ctx, outline) == false)
+    return;
+
   int len = pdfout_data_array_len (ctx, outline);
   for (int i = 0; i < len; ++i)
     {
       pdfout_data *hash = pdfout_data_array_get (ctx, outline, i);
-      calculate_kids_count (ctx, hash);
+      pdfout_data *title = NULL;
+      if (pdfout_data_is_hash (ctx, hash))
+	title = pdfout_data_hash_gets (ctx, hash, "title");
+      add_claim (ctx, b, title);
     }
-}
 
-static pdf_obj *
-copy_indirect_ref (fz_context *ctx, pdf_document *doc, pdf_obj *ref)
-{
-  int num = pdf_to_num (ctx, ref);
-  int gen = pdf_to_gen (ctx, ref);
-  return pdf_new_indirect (ctx, doc, num, gen);
+  for (int i = 0; i < len; ++i)
+    {
+      pdfout_data *hash = pdfout_data_array_get (ctx, outline, i);
+      if (pdfout_data_is_hash (ctx, hash))
+	{
+	  pdfout_data *kids = pdfout_data_hash_gets (ctx, hash, "kids");
+	  if (kids)
+	    claim_items (ctx, b, kids);
+	}
+    }
 }
 
 static pdf_obj *
 default_view_array (fz_context *ctx, pdf_document *doc, pdf_obj *dest_array)
 {
-  pdf_array_push (ctx, dest_array, pdf_new_name (ctx, doc, "XYZ"));
+  pdf_array_push_drop (ctx, dest_array, pdf_new_name (ctx, doc, "XYZ"));
   for (int i = 0; i < 3; ++i)
-    pdf_array_push (ctx, dest_array, pdf_new_null (ctx, doc));
+    pdf_array_push_drop (ctx, dest_array, pdf_new_null (ctx, doc));
 
   return dest_array;
 }
 
 static pdf_obj *
-convert_dest_array (fz_context *ctx, pdf_document *doc, pdfout_data *view,
-		    int page)
+convert_dest_array (fz_context *ctx, pdf_document *doc,
+		    pdfout_page_index *pages, pdfout_data *view, int page)
 {
   pdf_obj *dest_array = pdf_new_array (ctx, doc, 5);
-  pdf_obj *page_ref = pdf_lookup_page_obj (ctx, doc, page - 1);
+  pdf_obj *page_ref = pdfout_page_index_get (ctx, pages, page - 1);
   pdf_array_push (ctx, dest_array, page_ref);
   if (view == NULL)
     return default_view_array (ctx, doc, dest_array);
 
   pdfout_data *label = pdfout_data_array_get (ctx, view, 0);
   pdf_obj *label_obj = pdfout_data_scalar_to_pdf_name (ctx, doc, label);
-  pdf_array_push (ctx, dest_array, label_obj);
+  pdf_array_push_drop (ctx, dest_array, label_obj);
   
   int len = pdfout_data_array_len (ctx, view);
   
@@ -247,7 +412,9 @@ convert_dest_array (fz_context *ctx, pdf_document *doc, pdfout_data *view,
     {
       pdf_obj *null_or_real;
       pdfout_data *scalar = pdfout_data_array_get (ctx, view, i);
-      if (pdfout_data_scalar_eq (ctx, scalar, "null"))
+      int len;
+      const char *value = pdfout_data_scalar_get (ctx, scalar, &len);
+      if (pdfout_key_classify (value, len) == PDFOUT_KEY_null)
 	null_or_real = pdf_new_null(ctx, doc);
       else
 	{
@@ -259,139 +426,299 @@ convert_dest_array (fz_context *ctx, pdf_document *doc, pdfout_data *view,
   return dest_array;
 }
 
-static void
-create_outline_kids_array (fz_context *ctx, pdf_document *doc,
-			   pdfout_data *outline, pdf_obj *parent,
-			   pdf_obj **first, pdf_obj **last);
+static int
+build_outline_array (fz_context *ctx, outline_build *b, pdfout_data *outline,
+		     pdf_obj *parent, pdf_obj **first, pdf_obj **last);
 
-static void
-create_outline_dict (fz_context *ctx, pdf_document *doc, pdf_obj *dict,
-		     pdfout_data *hash, pdf_obj *parent,
-		     pdf_obj *prev, pdf_obj *next)
+/* Validate HASH and fill DICT.  Return the item's Count, which is zero if
+   it has no kids.  */
+static int
+build_outline_item (fz_context *ctx, outline_build *b, pdfout_data *hash,
+		    pdf_obj *dict, pdf_obj *ref, pdf_obj *parent,
+		    pdf_obj *prev, pdf_obj *next)
 {
-  /* Title.  */
-  pdfout_data *value = pdfout_data_hash_gets (ctx, hash, "title");
-  pdf_obj *title = pdfout_data_scalar_to_pdf_str (ctx, doc, value);
-  pdf_dict_puts_drop (ctx, dict, "Title", title);
+  pdf_document *doc = b->doc;
+  int len = pdfout_data_hash_len (ctx, hash);
+  pdfout_data *title = NULL, *view = NULL, *kids = NULL;
+  bool is_open = false;
+  int page = 0;
+  
+  for (int i = 0; i < len; ++i)
+    {
+      pdfout_data *key = pdfout_data_hash_get_key (ctx, hash, i);
+      pdfout_data *value = pdfout_data_hash_get_value (ctx, hash, i);
+      int key_len;
+      const char *key_str = pdfout_data_scalar_get (ctx, key, &key_len);
+      switch (pdfout_key_classify (key_str, key_len))
+	{
+	case PDFOUT_KEY_title:
+	  if (pdfout_data_is_scalar (ctx, value) == false)
+	    pdfout_throw (ctx, "value of key 'title' not a scalar");
+	  title = value;
+	  break;
+	case PDFOUT_KEY_page:
+	  {
+	    const char *s = data_scalar_get_string (ctx, value);
+	    page = pdfout_strtoint_null (ctx, s);
+	    int count = pdfout_page_index_count (ctx, b->pages);
+	    if (page < 1)
+	      pdfout_throw (ctx, "page number '%d' is not positive", page);
+	    if (page > count)
+	      pdfout_throw (ctx,
+			    "page number '%d' is bigger than page count %d",
+			    page, count);
+	    break;
+	  }
+	case PDFOUT_KEY_view:
+	  check_dest_sequence (ctx, value);
+	  view = value;
+	  break;
+	case PDFOUT_KEY_open:
+	  {
+	    int len;
+	    const char *s = pdfout_data_scalar_get (ctx, value, &len);
+	    switch (pdfout_key_classify (s, len))
+	      {
+	      case PDFOUT_KEY_true:
+		is_open = true;
+		break;
+	      case PDFOUT_KEY_false:
+		break;
+	      default:
+		pdfout_throw (ctx, "value of key 'open' not a bool");
+	      }
+	    break;
+	  }
+	case PDFOUT_KEY_kids:
+	  kids = value;
+	  break;
+	default:
+	  break;
+	}
+    }
 
-  /* Dest.  */
-  const char *page_string = data_hash_get_string_key (ctx, hash, "page");
-  int page = pdfout_strtoint_null (ctx, page_string);
+  if (title == NULL)
+    pdfout_throw (ctx, "missing title in outline hash");
+  if (page == 0)
+    pdfout_throw (ctx, "missing page in outline hash");
+
+  pdf_obj *title_obj = pdfout_data_scalar_to_pdf_str (ctx, doc, title);
+  pdf_dict_puts_drop (ctx, dict, "Title", title_obj);
 
-  pdfout_data *view = pdfout_data_hash_gets (ctx, hash, "view");
-  pdf_obj *dest_array = convert_dest_array (ctx, doc, view, page);
+  pdf_obj *dest_array = convert_dest_array (ctx, doc, b->pages, view, page);
   pdf_dict_puts_drop (ctx, dict, "Dest", dest_array);
 
-  /* Kids.  */
-  pdfout_data *kids = pdfout_data_hash_gets (ctx, hash, "kids");
+  /* Kids and Count.  */
+  int count = 0;
   if (kids)
     {
       pdf_obj *first, *last;
-      create_outline_kids_array (ctx, doc, kids, dict, &first, &last);
+      count = build_outline_array (ctx, b, kids, ref, &first, &last);
       pdf_dict_puts_drop (ctx, dict, "First", first);
       pdf_dict_puts_drop (ctx, dict, "Last", last);
 
-      /* Count.  */
-      pdfout_data *count = pdfout_data_hash_gets (ctx, hash, "count");
-      assert (count);
-      pdf_obj *count_obj = pdfout_data_scalar_to_pdf_int (ctx, doc, count);
-      pdf_dict_puts_drop (ctx, dict, "Count", count_obj);
+      if (is_open == false)
+	count *= -1;
+      pdf_dict_puts_drop (ctx, dict, "Count", pdf_new_int (ctx, doc, count));
     }
-  
-  /* Parent.  */
-  pdf_obj *parent_copy = copy_indirect_ref (ctx, doc, parent);
-  pdf_dict_puts_drop (ctx, dict, "Parent", parent_copy);
 
-  /* Prev and Next. */
+  pdf_dict_puts (ctx, dict, "Parent", parent);
   if (prev)
-    {
-      pdf_obj *prev_copy = copy_indirect_ref (ctx, doc, prev);
-      pdf_dict_puts_drop (ctx, dict, "Prev", prev_copy);
-    }
+    pdf_dict_puts (ctx, dict, "Prev", prev);
   if (next)
-    {
-      pdf_obj *prev_copy = copy_indirect_ref (ctx, doc, next);
-      pdf_dict_puts_drop (ctx, dict, "Next", prev_copy);
-    }
-  
-    
+    pdf_dict_puts (ctx, dict, "Next", next);
+
+  return count;
 }
 
-static void
-create_outline_kids_array (fz_context *ctx, pdf_document *doc,
-			   pdfout_data *outline, pdf_obj *parent,
-			   pdf_obj **first, pdf_obj **last)
+/* Return the number of visible items in OUTLINE and its open
+   descendants.  */
+static int
+build_outline_array (fz_context *ctx, outline_build *b, pdfout_data *outline,
+		     pdf_obj *parent, pdf_obj **first, pdf_obj **last)
 {
   int len = pdfout_data_array_len (ctx, outline);
+  if (len < 1)
+    pdfout_throw (ctx, "empty outline array");
 
-  /* Create a table of indirect references. To avoid circular references, all
-     the created objects will make their own copies from these.  */
-  pdf_obj **ref_table = fz_malloc_array (ctx, len, sizeof (pdf_obj *));
-  pdf_obj **dict_table = fz_malloc_array (ctx, len, sizeof (pdf_obj *));
-  for (int i = 0; i < len; ++i)
-    {
-      dict_table[i] = pdf_new_dict (ctx, doc, 8);
-      ref_table[i] = pdf_add_object_drop (ctx, doc, dict_table[i]);
-    }
+  pdf_obj **ref_table = fz_calloc (ctx, len, sizeof (pdf_obj *));
+  pdf_obj **dict_table = NULL;
+  int count = len;
+
+  fz_try (ctx)
+  {
+    dict_table = fz_calloc (ctx, len, sizeof (pdf_obj *));
+    for (int i = 0; i < len; ++i)
+      ref_table[i] = add_object (ctx, b, &dict_table[i]);
   
-  /* Populate objects.  */
-  for (int i = 0; i < len; ++i)
-    {
-      pdfout_data *hash = pdfout_data_array_get (ctx, outline, i);
-      create_outline_dict (ctx, doc, dict_table[i], hash, parent,
-			   i > 0 ? ref_table[i - 1] : NULL,
-			   i < len - 1 ? ref_table[i + 1]: NULL);
-    }
-  *first = pdf_new_indirect (ctx, doc, pdf_to_num (ctx, ref_table[0]),
-			     pdf_to_gen (ctx, ref_table[0]));
-  *last = pdf_new_indirect (ctx, doc, pdf_to_num (ctx, ref_table[len - 1]),
-			    pdf_to_gen (ctx, ref_table[len - 1]));
+    for (int i = 0; i < len; ++i)
+      {
+	pdfout_data *hash = pdfout_data_array_get (ctx, outline, i);
+	int kid_count =
+	  build_outline_item (ctx, b, hash, dict_table[i], ref_table[i],
+			      parent, i > 0 ? ref_table[i - 1] : NULL,
+			      i < len - 1 ? ref_table[i + 1] : NULL);
+	if (kid_count > 0)
+	  count += kid_count;
+      }
+
+    *first = pdf_keep_obj (ctx, ref_table[0]);
+    *last = pdf_keep_obj (ctx, ref_table[len - 1]);
+  }
+  fz_always (ctx)
+  {
+    for (int i = 0; i < len; ++i)
+      pdf_drop_obj (ctx, ref_table[i]);
+    free (ref_table);
+    free (dict_table);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
 
-  /* Cleanup. */
-  for (int i = 0; i < len; ++i)
-    free (ref_table[i]);
-  free (ref_table);
-  free (dict_table);
+  return count;
 }
 
-void
-pdfout_outline_set (fz_context *ctx, pdf_document *doc, pdfout_data *outline)
+static void
+outline_set (fz_context *ctx, outline_build *b, pdfout_data *outline)
 {
-  if (outline)
-    check_outline (ctx, doc, outline);
-
+  pdf_document *doc = b->doc;
   pdf_obj *root = pdf_dict_gets (ctx, pdf_trailer (ctx, doc), "Root");
   if (root == NULL)
     pdfout_throw (ctx, "no document catalog, cannot update outline");
 
-  /* Create new outline dict and write it into the Root dict.  */
-  pdf_obj *dict = pdf_new_dict (ctx, doc, 4);
-  pdf_obj *outline_ref = pdf_add_object_drop (ctx, doc, dict);
-  pdf_dict_puts_drop (ctx, root, "Outlines", outline_ref);
-
-  /* Populate the outline dict.  */
-  pdf_obj *type_name = pdf_new_name (ctx, doc, "Outlines");
-  pdf_dict_puts_drop (ctx, dict, "Type", type_name);
-
-  if (outline == NULL)
-    /* Remove outline.  */
-    return;
+  /* Create new outline dict.  */
+  pdf_obj *dict;
+  pdf_obj *outline_ref = add_object (ctx, b, &dict);
+
+  fz_try (ctx)
+  {
+    pdf_dict_puts_drop (ctx, dict, "Type", pdf_new_name (ctx, doc, "Outlines"));
+
+    /* An empty outline is the same as no outline.  */
+    if (outline && pdfout_data_array_len (ctx, outline))
+      {
+	pdf_obj *first, *last;
+	build_outline_array (ctx, b, outline, outline_ref, &first, &last);
+	pdf_dict_puts_drop (ctx, dict, "First", first);
+	pdf_dict_puts_drop (ctx, dict, "Last", last);
+      }
+
+    /* Only touch the document after success.  */
+    commit_objects (ctx, b);
+    if (obj_eq (ctx, pdf_dict_gets (ctx, root, "Outlines"), outline_ref)
+	== false)
+      pdf_dict_puts (ctx, root, "Outlines", outline_ref);
+  }
+  fz_always (ctx)
+    pdf_drop_obj (ctx, outline_ref);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
 
-  calculate_counts (ctx, outline);
+static void
+outline_set_imp (fz_context *ctx, pdf_document *doc, pdfout_data *outline,
+		 bool patch)
+{
+  /* Keys leading to objects owned by the outline.  Destinations and
+     actions may be shared with other parts of the document.  */
+  static const char *owned_keys[] = { "First", "Next", "Title", NULL };
+  outline_build b = { doc };
+  pdfout_reclaim *reclaim = NULL;
+
+  fz_try (ctx)
+  {
+    pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, doc),
+				  PDF_NAME_Root);
+    pdf_obj *outlines = pdf_dict_get (ctx, root, PDF_NAME_Outlines);
+
+    b.pages = pdfout_page_index_new (ctx, doc);
+    reclaim = pdfout_reclaim_new (ctx, doc, outlines, owned_keys);
+    if (patch && pdf_is_dict (ctx, outlines))
+      {
+	b.old_titles = pdfout_hash_new (ctx);
+	collect_reuse (ctx, &b, outlines);
+
+	/* The outline dict itself has no title.  */
+	add_claim (ctx, &b, NULL);
+	if (outline)
+	  claim_items (ctx, &b, outline);
+      }
+
+    outline_set (ctx, &b, outline);
+
+    pdfout_reclaim *sweep = reclaim;
+    reclaim = NULL;
+    pdfout_reclaim_sweep (ctx, sweep,
+			  pdf_dict_get (ctx, root, PDF_NAME_Outlines));
+  }
+  fz_always (ctx)
+  {
+    pdfout_reclaim_drop (ctx, reclaim);
+    for (int i = 0; i < b.len; ++i)
+      pdf_drop_obj (ctx, b.dicts[i]);
+    free (b.dicts);
+    free (b.refs);
+    free (b.reused);
+    free (b.old);
+    free (b.claims);
+    pdfout_hash_drop (ctx, b.old_titles);
+    pdfout_page_index_drop (ctx, b.pages);
+  }
+  fz_catch (ctx)
+  {
+    for (int i = 0; i < b.created_len; ++i)
+      pdf_delete_object (ctx, doc, b.created[i]);
+    free (b.created);
+    fz_rethrow (ctx);
+  }
+
+  free (b.created);
+}
 
-  pdf_obj *first, *last;
-  create_outline_kids_array (ctx, doc, outline, outline_ref, &first, &last);
+void
+pdfout_outline_set (fz_context *ctx, pdf_document *doc, pdfout_data *outline)
+{
+  outline_set_imp (ctx, doc, outline, false);
+}
 
-  pdf_dict_puts_drop (ctx, dict, "First", first);
-  pdf_dict_puts_drop (ctx, dict, "Last", last);
+void
+pdfout_outline_patch (fz_context *ctx, pdf_document *doc,
+		      pdfout_data *outline)
+{
+  outline_set_imp (ctx, doc, outline, true);
 }
 
 /* Get outline.  */
 
-static void
-check_dest (fz_context *ctx, pdf_document *doc, pdf_obj *dest)
+/* Outline items are visited in document order with an explicit stack of
+   open sibling lists, so that neither deep nor wide outlines use up the
+   C stack.  */
+typedef struct {
+  /* Next item of this list, or NULL.  */
+  pdf_obj *next;
+  /* Whether the array for this list was started.  */
+  bool started;
+} outline_level;
+
+typedef struct {
+  pdfout_emitter *emitter;
+  pdfout_dest_table *dests;
+  pdfout_page_index *pages;
+
+  outline_level *stack;
+  int depth, cap;
+
+  /* Bitset of the visited items, indexed by object number.  */
+  unsigned char *visited;
+  int xref_len;
+} outline_walk;
+
+/* Return the destination array and store its zero-based page number
+   in *PAGE.  */
+static pdf_obj *
+check_dest (fz_context *ctx, outline_walk *w, pdf_obj *dest, int *page)
 {
-  dest = pdfout_resolve_dest(ctx, doc, dest);
+  dest = pdfout_resolve_dest (ctx, w->dests, dest);
   if (dest == NULL)
     pdfout_throw (ctx, "undefined link kind");
   if (pdf_is_array (ctx, dest) == false)
@@ -399,10 +726,11 @@ check_dest (fz_context *ctx, pdf_document *doc, pdf_obj *dest)
   int len = pdf_array_len (ctx, dest);
 
   pdf_obj *page_ref = pdf_array_get (ctx, dest, 0);
-  int page = pdf_lookup_page_number (ctx, doc, page_ref);
-  int page_count = pdf_count_pages (ctx, doc);
-  if (page >= page_count)
-    pdfout_throw (ctx, "page %d is exceeds page count %d", page, page_count);
+  *page = pdfout_page_index_lookup (ctx, w->pages, page_ref);
+  int page_count = pdfout_page_index_count (ctx, w->pages);
+  if (*page >= page_count)
+    pdfout_throw (ctx, "page %d is exceeds page count %d", *page,
+		  page_count);
   
   pdf_obj *name = pdf_array_get (ctx, dest, 1);
   char *name_str = pdf_to_name (ctx, name);
@@ -420,172 +748,185 @@ check_dest (fz_context *ctx, pdf_document *doc, pdf_obj *dest)
 	pdfout_throw (ctx, "illegal dest array");
     }
 
+  return dest;
 }
 
 static void
-check_pdf_outline (fz_context *ctx, pdf_document *doc, pdf_obj *outline)
+warn_no_dest (fz_context *ctx, pdf_obj *title)
 {
-  do
-    {
-      if (pdf_mark_obj (ctx, outline))
-	pdfout_throw (ctx, "circular reference");
-      
-      pdf_obj *title = pdf_dict_gets (ctx, outline, "Title");
-      if (pdf_is_string (ctx, title) == false)
-	pdfout_throw (ctx, "outline item without 'Title' key");
-      
-      pdf_obj *count = pdf_dict_gets (ctx, outline, "Count");
-      if (count && pdf_is_int (ctx, count) == false)
-	pdfout_throw (ctx, "value for key 'Count' not an integer");
-      
-      pdf_obj *dest = pdf_dict_gets (ctx, outline, "Dest");
-      if (dest)
-	check_dest (ctx, doc, dest);
-
-      pdf_obj *first = pdf_dict_gets (ctx, outline, "First");
-      if (first)
-	check_pdf_outline (ctx, doc, first);
-      
-    }
-  while ((outline = pdf_dict_gets (ctx, outline, "Next")));
+  int len;
+  char *title_str = pdfout_str_obj_to_utf8 (ctx, title, &len);
+  pdfout_warn (ctx, "outline item with title '%s' has no destination",
+	       title_str);
+  free (title_str);
 }
 
 static void
-data_hash_push_string_key (fz_context *ctx, pdfout_data *hash, const char *key,
-			   pdfout_data *value)
+push_level (fz_context *ctx, outline_walk *w, pdf_obj *first, bool started)
 {
-  pdfout_data *key_data = pdfout_data_scalar_new (ctx, key, strlen (key));
-  pdfout_data_hash_push (ctx, hash, key_data, value);
+  if (w->depth == w->cap)
+    w->stack = pdfout_x2nrealloc (ctx, w->stack, &w->cap, outline_level);
+  w->stack[w->depth++] = (outline_level) {first, started};
 }
 
-static pdfout_data *
-data_scalar_from_int (fz_context *ctx, int number)
+static void
+mark_visited (fz_context *ctx, outline_walk *w, pdf_obj *outline)
 {
-  char buf[200];
-  int len = pdfout_snprintf (ctx, buf, "%d", number);
-  return pdfout_data_scalar_new (ctx, buf, len);
+  /* Direct objects cannot be part of a cycle on their own.  */
+  int num = pdf_to_num (ctx, outline);
+  if (num <= 0 || num >= w->xref_len)
+    return;
+
+  if (w->visited[num / 8] & (1 << num % 8))
+    pdfout_throw (ctx, "circular reference");
+  w->visited[num / 8] |= 1 << num % 8;
 }
 
-static pdfout_data *
-get_view_array (fz_context *ctx, pdf_document *doc, pdf_obj *dest, int *page)
+/* Emit everything of OUTLINE, except for the kids and the end of the
+   hash.  */
+static void
+emit_outline_item_start (fz_context *ctx, outline_walk *w, pdf_obj *outline,
+			 pdf_obj *title, pdf_obj *dest, int page)
 {
-  dest = pdfout_resolve_dest(ctx, doc, dest);
+  pdfout_emitter *e = w->emitter;
 
-  pdf_obj *page_ref = pdf_array_get (ctx, dest, 0);
-  *page = pdf_lookup_page_number (ctx, doc, page_ref);
+  pdfout_emitter_hash_start (ctx, e);
 
-  pdfout_data *view_array = pdfout_data_array_new (ctx);
+  pdfout_emitter_string (ctx, e, "title");
+  pdfout_emitter_scalar_from_pdf (ctx, e, title);
 
-  pdf_obj *kind = pdf_array_get (ctx, dest, 1);
-  pdfout_data *kind_data = pdfout_data_scalar_from_pdf (ctx, kind);
-  pdfout_data_array_push (ctx, view_array, kind_data);
+  char buf[200];
+  int len = pdfout_snprintf (ctx, buf, "%d", page + 1);
+  pdfout_emitter_string (ctx, e, "page");
+  pdfout_emitter_scalar (ctx, e, buf, len);
 
-  int len = pdf_array_len (ctx, dest);
-  
-  for (int i = 2; i < len; ++i)
+  pdfout_emitter_string (ctx, e, "view");
+  pdfout_emitter_array_start (ctx, e);
+  len = pdf_array_len (ctx, dest);
+  for (int i = 1; i < len; ++i)
+    pdfout_emitter_scalar_from_pdf (ctx, e, pdf_array_get (ctx, dest, i));
+  pdfout_emitter_array_end (ctx, e);
+
+  pdf_obj *count_obj = pdf_dict_gets (ctx, outline, "Count");
+  if (count_obj)
     {
-      pdf_obj *item = pdf_array_get (ctx, dest, i);
-      pdfout_data *item_data = pdfout_data_scalar_from_pdf (ctx, item);
-      pdfout_data_array_push (ctx, view_array, item_data);
+      pdfout_emitter_string (ctx, e, "open");
+      pdfout_emitter_string (ctx, e, (pdf_to_int (ctx, count_obj) > 0
+				      ? "true" : "false"));
     }
-
-  return view_array;
 }
 
-static pdfout_data *
-get_outline_array (fz_context *ctx, pdf_document *doc, pdf_obj *outline);
-
-static pdfout_data *
-get_outline_hash (fz_context *ctx, pdf_document *doc, pdf_obj *outline)
+/* Validate and emit the outline starting at FIRST.  Items without
+   destination are skipped together with their kids.  The "kids" key and
+   array of an item are only emitted if there is at least one kid.  */
+static void
+emit_outline (fz_context *ctx, outline_walk *w, pdf_obj *first)
 {
-  pdf_obj *title_obj = pdf_dict_gets (ctx, outline, "Title");
-  pdfout_data *title = pdfout_data_scalar_from_pdf (ctx, title_obj);
-
-  pdf_obj *dest = pdf_dict_gets (ctx, outline, "Dest");
-  pdfout_data *view_array;
+  pdfout_emitter_array_start (ctx, w->emitter);
+  push_level (ctx, w, first, true);
 
-  int page;
-  
-  if (dest)
-    view_array = get_view_array (ctx, doc, dest, &page);
-  else
+  while (w->depth)
     {
-      int title_len;
-      char *title_str = pdfout_data_scalar_get (ctx, title, &title_len);
-      pdfout_warn (ctx, "outline item with title '%s' has no destination",
-		   title_str);
-      pdfout_data_drop (ctx, title);
-      return NULL;
-    }
-  
-  
-  pdfout_data *hash = pdfout_data_hash_new (ctx);
-  
-  
-  data_hash_push_string_key (ctx, hash, "title", title);
-  
-  pdfout_data *page_value = data_scalar_from_int (ctx, page + 1);
+      outline_level *level = &w->stack[w->depth - 1];
+      pdf_obj *outline = level->next;
 
-  data_hash_push_string_key (ctx, hash, "page", page_value);
-  
-  data_hash_push_string_key (ctx, hash, "view", view_array);
-  
-  pdf_obj *count_obj = pdf_dict_gets (ctx, outline, "Count");
-  if (count_obj)
-    {
-      int count_int = pdf_to_int (ctx, count_obj);
-      const char *value = count_int > 0 ? "true" : "false";
-      pdfout_data_hash_push_key_value (ctx, hash, "open", value,
-				       strlen (value));
-    }
+      if (outline == NULL)
+	{
+	  if (level->started)
+	    pdfout_emitter_array_end (ctx, w->emitter);
+	  if (--w->depth)
+	    pdfout_emitter_hash_end (ctx, w->emitter);
+	  continue;
+	}
 
-  /* Kids.  */
-  pdf_obj *first = pdf_dict_gets (ctx, outline, "First");
-  if (first)
-    {
-      pdfout_data *kids_array = get_outline_array (ctx, doc, first);
-      if (kids_array)
-	data_hash_push_string_key (ctx, hash, "kids", kids_array);
-    }
+      mark_visited (ctx, w, outline);
+      level->next = pdf_dict_gets (ctx, outline, "Next");
 
-  return hash;
-}
+      pdf_obj *title = pdf_dict_gets (ctx, outline, "Title");
+      if (pdf_is_string (ctx, title) == false)
+	pdfout_throw (ctx, "outline item without 'Title' key");
+      
+      pdf_obj *count = pdf_dict_gets (ctx, outline, "Count");
+      if (count && pdf_is_int (ctx, count) == false)
+	pdfout_throw (ctx, "value for key 'Count' not an integer");
+      
+      pdf_obj *dest = pdf_dict_gets (ctx, outline, "Dest");
+      if (dest == NULL)
+	{
+	  warn_no_dest (ctx, title);
+	  continue;
+	}
 
-static pdfout_data *
-get_outline_array (fz_context *ctx, pdf_document *doc, pdf_obj *outline)
-{
-  pdfout_data *result_array = pdfout_data_array_new (ctx);
-  do
-    {
-      pdfout_data *hash = get_outline_hash (ctx, doc, outline);
-      if (hash)
-	pdfout_data_array_push (ctx, result_array, hash);
-    }
-  while ((outline = pdf_dict_gets (ctx, outline, "Next")));
+      int page;
+      dest = check_dest (ctx, w, dest, &page);
 
-  if (pdfout_data_array_len (ctx, result_array))
-    return result_array;
-  else
-    {
-      /* Empty list, return NULL.  */
-      pdfout_data_drop (ctx, result_array);
-      return NULL;
+      if (level->started == false)
+	{
+	  pdfout_emitter_string (ctx, w->emitter, "kids");
+	  pdfout_emitter_array_start (ctx, w->emitter);
+	  level->started = true;
+	}
+      emit_outline_item_start (ctx, w, outline, title, dest, page);
+
+      pdf_obj *kids = pdf_dict_gets (ctx, outline, "First");
+      if (kids)
+	push_level (ctx, w, kids, false);
+      else
+	pdfout_emitter_hash_end (ctx, w->emitter);
     }
 }
 
-pdfout_data *
-pdfout_outline_get (fz_context *ctx, pdf_document *doc)
+void
+pdfout_outline_emit (fz_context *ctx, pdf_document *doc,
+		     pdfout_emitter *emitter)
 {
   pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, doc), PDF_NAME_Root);
   pdf_obj *outline_obj = pdf_dict_get (ctx, root, PDF_NAME_Outlines);
   pdf_obj *first = pdf_dict_get (ctx, outline_obj, PDF_NAME_First);
 
-  if (first)
+  if (first == NULL)
     {
-      check_pdf_outline (ctx, doc, first);
-      return get_outline_array (ctx, doc, first);
+      pdfout_emitter_array_start (ctx, emitter);
+      pdfout_emitter_array_end (ctx, emitter);
+      return;
     }
-  else
-    return pdfout_data_array_new (ctx);
+
+  outline_walk w = { emitter };
+
+  fz_try (ctx)
+  {
+    w.pages = pdfout_page_index_new (ctx, doc);
+    w.dests = pdfout_dest_table_new (ctx, doc);
+    w.xref_len = pdf_xref_len (ctx, doc);
+    w.visited = fz_calloc (ctx, w.xref_len / 8 + 1, 1);
+    emit_outline (ctx, &w, first);
+  }
+  fz_always (ctx)
+  {
+    free (w.visited);
+    free (w.stack);
+    pdfout_dest_table_drop (ctx, w.dests);
+    pdfout_page_index_drop (ctx, w.pages);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
 }
 
+pdfout_data *
+pdfout_outline_get (fz_context *ctx, pdf_document *doc)
+{
+  pdfout_emitter *emitter = pdfout_emitter_data_new (ctx);
+  pdfout_data *result = NULL;
+
+  fz_try (ctx)
+  {
+    pdfout_outline_emit (ctx, doc, emitter);
+    result = pdfout_emitter_data_result (ctx, emitter);
+  }
+  fz_always (ctx)
+    pdfout_emitter_drop (ctx, emitter);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return result;
+}
@@ -4,6 +4,52 @@
 void pdfout_outline_set (fz_context *ctx, pdf_document *doc,
 			 pdfout_data *outline);
 
+/* Like pdfout_outline_set, but reuse the object numbers of the existing
+   outline and only update the objects which changed.  */
+void pdfout_outline_patch (fz_context *ctx, pdf_document *doc,
+			   pdfout_data *outline);
+
 pdfout_data *pdfout_outline_get (fz_context *ctx, pdf_document *doc);
 
+/* Like pdfout_outline_get, but feed the outline to the streaming interface
+   of EMITTER while it is read.  */
+void pdfout_outline_emit (fz_context *ctx, pdf_document *doc,
+			  pdfout_emitter *emitter);
+
+typedef struct {
+  /* 1 to open, -1 to close all items with kids, 0 to keep them.  */
+  int open;
+  /* Replace [page /Fit] destinations with [page /XYZ null null null].  */
+  bool fit_to_xyz;
+  /* Added to the page of each destination.  */
+  int page_offset;
+  /* If positive, remove all items nested deeper.  */
+  int max_depth;
+  /* If not NULL, replace all matches of this POSIX extended regex in the
+     titles with TITLE_REPLACE, where \0 to \9 insert subexpressions.  */
+  const char *title_regex;
+  const char *title_replace;
+} pdfout_outline_transform_options;
+
+/* Apply OPTS to the outline objects of DOC in place.  Only the items
+   which change are modified.  */
+void pdfout_outline_transform (fz_context *ctx, pdf_document *doc,
+			       const pdfout_outline_transform_options *opts);
+
+/* Graft the outlines of other documents into a document.  */
+typedef struct pdfout_outline_merge_s pdfout_outline_merge;
+
+pdfout_outline_merge *pdfout_outline_merge_new (fz_context *ctx,
+						pdf_document *doc);
+
+/* Append the outline of SRC to the outline of the merge target.  Page N
+   of SRC (zero-based) is mapped to page N + PAGE_OFFSET of the target.
+   If PARENT_TITLE is not NULL, the items are grafted as kids of a new,
+   closed item with this title, which points to page PAGE_OFFSET.  */
+void pdfout_outline_merge_add (fz_context *ctx, pdfout_outline_merge *m,
+			       pdf_document *src, int page_offset,
+			       const char *parent_title);
+
+void pdfout_outline_merge_drop (fz_context *ctx, pdfout_outline_merge *m);
+
 #endif
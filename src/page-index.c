@@ -0,0 +1,181 @@
+#include "common.h"
+
+struct pdfout_page_index_s
+{
+  /* References to the page objects, in page order.  */
+  pdf_obj **pages;
+  int count, cap;
+
+  /* Open-addressing hash table from object numbers to page numbers.
+     Empty slots have num 0.  */
+  struct page_slot { int num; int page; } *slots;
+  int mask;
+};
+
+static unsigned
+hash_num (int num)
+{
+  return (unsigned) num * 2654435761u;
+}
+
+static void
+push_page (fz_context *ctx, pdfout_page_index *index, pdf_obj *page)
+{
+  if (index->count == index->cap)
+    index->pages = pdfout_x2nrealloc (ctx, index->pages, &index->cap,
+				      pdf_obj *);
+  index->pages[index->count++] = pdf_keep_obj (ctx, page);
+}
+
+/* Walk the page tree iteratively, in page order.  Nodes are pushed on a
+   stack together with the position of the next kid to visit.  */
+static void
+collect_pages (fz_context *ctx, pdf_document *doc, pdfout_page_index *index)
+{
+  pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, doc), PDF_NAME_Root);
+  pdf_obj *pages = pdf_dict_get (ctx, root, PDF_NAME_Pages);
+  int xref_len = pdf_xref_len (ctx, doc);
+  unsigned char *visited = fz_calloc (ctx, xref_len / 8 + 1, 1);
+  struct node { pdf_obj *kids; int next; } *stack = NULL;
+  int depth = 0, stack_cap = 0;
+
+  fz_try (ctx)
+  {
+    pdf_obj *kids = pdf_dict_get (ctx, pages, PDF_NAME_Kids);
+    if (pdf_is_array (ctx, kids))
+      {
+	stack = pdfout_x2nrealloc (ctx, stack, &stack_cap, struct node);
+	stack[depth++] = (struct node) {kids, 0};
+      }
+
+    while (depth)
+      {
+	struct node *node = &stack[depth - 1];
+	if (node->next == pdf_array_len (ctx, node->kids))
+	  {
+	    --depth;
+	    continue;
+	  }
+
+	pdf_obj *kid = pdf_array_get (ctx, node->kids, node->next++);
+
+	/* Like mupdf, treat every node with a Kids array as intermediate
+	   node.  */
+	kids = pdf_dict_get (ctx, kid, PDF_NAME_Kids);
+	if (pdf_is_array (ctx, kids))
+	  {
+	    int num = pdf_to_num (ctx, kid);
+	    if (num > 0 && num < xref_len)
+	      {
+		if (visited[num / 8] & (1 << num % 8))
+		  pdfout_throw (ctx, "circular reference in page tree");
+		visited[num / 8] |= 1 << num % 8;
+	      }
+	    if (depth == stack_cap)
+	      stack = pdfout_x2nrealloc (ctx, stack, &stack_cap, struct node);
+	    stack[depth++] = (struct node) {kids, 0};
+	  }
+	else
+	  push_page (ctx, index, kid);
+      }
+  }
+  fz_always (ctx)
+  {
+    free (stack);
+    free (visited);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static void
+build_table (fz_context *ctx, pdfout_page_index *index)
+{
+  int size = 16;
+  while (size < 2 * index->count)
+    size *= 2;
+
+  index->slots = fz_calloc (ctx, size, sizeof *index->slots);
+  index->mask = size - 1;
+
+  for (int i = 0; i < index->count; ++i)
+    {
+      int num = pdf_to_num (ctx, index->pages[i]);
+      if (num <= 0)
+	continue;
+
+      unsigned h = hash_num (num) & index->mask;
+      while (index->slots[h].num && index->slots[h].num != num)
+	h = (h + 1) & index->mask;
+      /* For a page object listed twice, keep the first occurrence.  */
+      if (index->slots[h].num == 0)
+	index->slots[h] = (struct page_slot) {num, i};
+    }
+}
+
+pdfout_page_index *
+pdfout_page_index_new (fz_context *ctx, pdf_document *doc)
+{
+  pdfout_page_index *index = fz_malloc_struct (ctx, pdfout_page_index);
+
+  fz_try (ctx)
+  {
+    collect_pages (ctx, doc, index);
+    build_table (ctx, index);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_page_index_drop (ctx, index);
+    fz_rethrow (ctx);
+  }
+
+  return index;
+}
+
+void
+pdfout_page_index_drop (fz_context *ctx, pdfout_page_index *index)
+{
+  if (index == NULL)
+    return;
+
+  for (int i = 0; i < index->count; ++i)
+    pdf_drop_obj (ctx, index->pages[i]);
+  free (index->pages);
+  free (index->slots);
+  free (index);
+}
+
+int
+pdfout_page_index_count (fz_context *ctx, pdfout_page_index *index)
+{
+  return index->count;
+}
+
+pdf_obj *
+pdfout_page_index_get (fz_context *ctx, pdfout_page_index *index, int page)
+{
+  if (page < 0 || page >= index->count)
+    pdfout_throw (ctx, "page %d out of range", page + 1);
+
+  return index->pages[page];
+}
+
+int
+pdfout_page_index_lookup (fz_context *ctx, pdfout_page_index *index,
+			  pdf_obj *page_ref)
+{
+  int num = pdf_to_num (ctx, page_ref);
+
+  if (num <= 0)
+    return -1;
+
+  unsigned h = hash_num (num) & index->mask;
+  while (index->slots[h].num)
+    {
+      if (index->slots[h].num == num)
+	return index->slots[h].page;
+      h = (h + 1) & index->mask;
+    }
+
+  return -1;
+}
@@ -0,0 +1,25 @@
+#ifndef HAVE_PDFOUT_PAGE_INDEX_H
+#define HAVE_PDFOUT_PAGE_INDEX_H
+
+/* Flat index of a document's page tree.  Building the index walks the page
+   tree once, afterwards all lookups are O(1).  */
+typedef struct pdfout_page_index_s pdfout_page_index;
+
+pdfout_page_index *pdfout_page_index_new (fz_context *ctx,
+					  pdf_document *doc);
+
+void pdfout_page_index_drop (fz_context *ctx, pdfout_page_index *index);
+
+int pdfout_page_index_count (fz_context *ctx, pdfout_page_index *index);
+
+/* Return the indirect reference to the page object of the zero-based page
+   PAGE.  The result is borrowed from INDEX.  */
+pdf_obj *pdfout_page_index_get (fz_context *ctx, pdfout_page_index *index,
+				int page);
+
+/* Return the zero-based page number of PAGE_REF, or -1 if PAGE_REF is not
+   a reference to a page object.  */
+int pdfout_page_index_lookup (fz_context *ctx, pdfout_page_index *index,
+			      pdf_obj *page_ref);
+
+#endif	/* ! HAVE_PDFOUT_PAGE_INDEX_H */
@@ -4,18 +4,6 @@
 
 
 
-static bool
-streq (const char *a, const char *b)
-{
-  return strcmp (a, b) == 0;
-}
-
-static bool
-strneq (const char *a, const char *b)
-{
-  return strcmp (a, b) != 0;
-}
-
 static void
 assert_c_string (fz_context *ctx, const char *s, int len)
 {
@@ -38,6 +26,33 @@ scalar_to_int (fz_context *ctx, pdfout_data *scalar)
   return pdfout_strtoint_null (ctx, string);
 }
 
+/* Return the name of the numbering style KEY, or NULL if KEY is not a
+   style.  */
+static const char *
+style_name (pdfout_key key)
+{
+  switch (key)
+    {
+    case PDFOUT_KEY_arabic:
+      return "D";
+    case PDFOUT_KEY_Roman:
+      return "R";
+    case PDFOUT_KEY_roman:
+      return "r";
+    case PDFOUT_KEY_Letters:
+      return "A";
+    case PDFOUT_KEY_letters:
+      return "a";
+    default:
+      return NULL;
+    }
+}
+
+/* Largest start value of a label range.  Roman numerals get one letter
+   per thousand and letters one per 26 above this, so the labels would
+   grow without bound.  */
+#define MAX_FIRST 100000
+
 /* Return page number.  */
 static int
 check_hash (fz_context *ctx, pdfout_data *hash, int previous_page)
@@ -55,16 +70,16 @@ check_hash (fz_context *ctx, pdfout_data *hash, int previous_page)
       int first = scalar_to_int (ctx, scalar);
       if (first < 1)
 	    pdfout_throw (ctx, "value of key 'first' must be >= 1");
+      if (first > MAX_FIRST)
+	pdfout_throw (ctx, "value of key 'first' must be <= %d", MAX_FIRST);
     }
 
   scalar = pdfout_data_hash_gets (ctx, hash, "style");
   if (scalar)
     {
       char *style = scalar_to_string (ctx, scalar);
-       if (strneq (style, "arabic") && strneq (style, "Roman")
-	      && strneq (style, "roman") && strneq (style, "Letters")
-	      && strneq (style, "letters"))
-	    pdfout_throw (ctx, "invalid style '%s'", style);
+      if (style_name (pdfout_key_classify (style, strlen (style))) == NULL)
+	pdfout_throw (ctx, "invalid style '%s'", style);
     }
   
   if (previous_page == 0 && page != 1)
@@ -103,37 +118,37 @@ hash_to_pdf_dict (fz_context *ctx, pdf_document *doc, pdfout_data *hash,
       int value_len;
       pdfout_data_hash_get_key_value (ctx, hash, &key, &value, &value_len, j);
 
-      if (streq (key, "page"))
-	*page = pdfout_strtoint_null (ctx, value);
-      else if (streq (key, "prefix"))
+      switch (pdfout_key_classify (key, strlen (key)))
 	{
-	  pdf_obj *string = pdfout_utf8_to_str_obj (ctx, doc, value,
-						    value_len);
-	  pdf_dict_puts_drop (ctx, dict_obj, "P", string);
-	}
-      else if (streq (key, "first"))
-	{
-	  int first = pdfout_strtoint_null (ctx, value);
-	  pdf_dict_puts_drop (ctx, dict_obj, "St",
-			      pdf_new_int (ctx, doc, first));
-	}
-      else if (streq (key, "style"))
-	{
-	  const char *name;
-	  if (streq (value, "arabic"))
-	    name = "D";
-	  else if (streq (value, "Roman"))
-	    name = "R";
-	  else if (streq (value, "roman"))
-	    name = "r";
-	  else if (streq (value, "Letters"))
-	    name = "A";
-	  else if (streq (value, "letters"))
-	    name = "a";
-	  else
-	    abort ();
-	  pdf_obj *name_obj = pdf_new_name (ctx, doc, name);
-	  pdf_dict_puts_drop (ctx, dict_obj, "S", name_obj);
+	case PDFOUT_KEY_page:
+	  *page = pdfout_strtoint_null (ctx, value);
+	  break;
+	case PDFOUT_KEY_prefix:
+	  {
+	    pdf_obj *string = pdfout_utf8_to_str_obj (ctx, doc, value,
+						      value_len);
+	    pdf_dict_puts_drop (ctx, dict_obj, "P", string);
+	    break;
+	  }
+	case PDFOUT_KEY_first:
+	  {
+	    int first = pdfout_strtoint_null (ctx, value);
+	    pdf_dict_puts_drop (ctx, dict_obj, "St",
+				pdf_new_int (ctx, doc, first));
+	    break;
+	  }
+	case PDFOUT_KEY_style:
+	  {
+	    const char *name =
+	      style_name (pdfout_key_classify (value, value_len));
+	    if (name == NULL)
+	      abort ();
+	    pdf_obj *name_obj = pdf_new_name (ctx, doc, name);
+	    pdf_dict_puts_drop (ctx, dict_obj, "S", name_obj);
+	    break;
+	  }
+	default:
+	  break;
 	}
      
     }
@@ -141,10 +156,171 @@ hash_to_pdf_dict (fz_context *ctx, pdf_document *doc, pdfout_data *hash,
   return dict_obj;
 }
 
+/* Number tree nodes under construction: indirect references with the
+   first and last key below them.  */
+typedef struct {
+  pdf_obj **refs;
+  int *first, *last;
+  int len;
+} tree_level;
+
+static void
+tree_level_drop (fz_context *ctx, tree_level *level)
+{
+  for (int i = 0; i < level->len; ++i)
+    pdf_drop_obj (ctx, level->refs[i]);
+  free (level->refs);
+  free (level->first);
+  free (level->last);
+  *level = (tree_level) { NULL };
+}
+
+static void
+tree_level_init (fz_context *ctx, tree_level *level, int len)
+{
+  level->refs = fz_calloc (ctx, len, sizeof *level->refs);
+  level->first = fz_calloc (ctx, len, sizeof *level->first);
+  level->last = fz_calloc (ctx, len, sizeof *level->last);
+  level->len = 0;
+}
+
+static pdf_obj *
+limits_array (fz_context *ctx, pdf_document *doc, int first, int last)
+{
+  pdf_obj *limits = pdf_new_array (ctx, doc, 2);
+  pdf_array_push_drop (ctx, limits, pdf_new_int (ctx, doc, first));
+  pdf_array_push_drop (ctx, limits, pdf_new_int (ctx, doc, last));
+  return limits;
+}
+
+/* Append the [key value ...] pairs of LABELS[START] to LABELS[END - 1] to
+   NUMS.  Return the first and last key.  */
+static void
+push_nums (fz_context *ctx, pdf_document *doc, pdf_obj *nums,
+	   pdfout_data *labels, int start, int end, int *first, int *last)
+{
+  for (int i = start; i < end; ++i)
+    {
+      pdfout_data *hash = pdfout_data_array_get (ctx, labels, i);
+      int page;
+      pdf_obj *dict_obj = hash_to_pdf_dict (ctx, doc, hash, &page);
+
+      /* The keys are zero-based page indices.  */
+      pdf_obj *page_obj = pdf_new_int (ctx, doc, page - 1);
+      pdf_array_push_drop (ctx, nums, page_obj);
+
+      pdf_array_push_drop (ctx, nums, dict_obj);
+
+      if (i == start)
+	*first = page - 1;
+      *last = page - 1;
+    }
+}
+
+/* Add a node for the entries START to END - 1 of the level below, or of
+   LABELS if BELOW is NULL, to LEVEL.  */
+static void
+add_tree_node (fz_context *ctx, pdf_document *doc, tree_level *level,
+	       tree_level *below, pdfout_data *labels, int start, int end)
+{
+  pdf_obj *node = pdf_new_dict (ctx, doc, 2);
+  pdf_obj *ref = pdf_add_object_drop (ctx, doc, node);
+  int i = level->len++;
+  level->refs[i] = ref;
+
+  if (below)
+    {
+      pdf_obj *kids = pdf_new_array (ctx, doc, end - start);
+      pdf_dict_put_drop (ctx, ref, PDF_NAME_Kids, kids);
+      for (int j = start; j < end; ++j)
+	pdf_array_push (ctx, kids, below->refs[j]);
+      level->first[i] = below->first[start];
+      level->last[i] = below->last[end - 1];
+    }
+  else
+    {
+      pdf_obj *nums = pdf_new_array (ctx, doc, 2 * (end - start));
+      pdf_dict_put_drop (ctx, ref, PDF_NAME_Nums, nums);
+      push_nums (ctx, doc, nums, labels, start, end, &level->first[i],
+		 &level->last[i]);
+    }
+
+  pdf_dict_put_drop (ctx, ref, PDF_NAME_Limits,
+		     limits_array (ctx, doc, level->first[i], level->last[i]));
+}
+
+/* Split COUNT entries into the fewest groups of at most FANOUT entries,
+   with sizes differing by at most one, and add a node for each group.  */
+static void
+add_tree_level (fz_context *ctx, pdf_document *doc, tree_level *level,
+		tree_level *below, pdfout_data *labels, int count, int fanout)
+{
+  int groups = (count + fanout - 1) / fanout;
+  tree_level_init (ctx, level, groups);
+  for (int g = 0; g < groups; ++g)
+    add_tree_node (ctx, doc, level, below, labels,
+		   (int) ((long) count * g / groups),
+		   (int) ((long) count * (g + 1) / groups));
+}
+
+/* Fill the root node LABELS_OBJ.  Up to FANOUT ranges are stored in one
+   Nums array, more are stored in a balanced tree of indirect nodes with
+   at most FANOUT entries each.  */
+static void
+build_number_tree (fz_context *ctx, pdf_document *doc, pdf_obj *labels_obj,
+		   pdfout_data *labels, int fanout)
+{
+  int num = pdfout_data_array_len (ctx, labels);
+  if (num <= fanout)
+    {
+      pdf_obj *nums = pdf_new_array (ctx, doc, 2 * num);
+      pdf_dict_puts_drop (ctx, labels_obj, "Nums", nums);
+      int first, last;
+      push_nums (ctx, doc, nums, labels, 0, num, &first, &last);
+      return;
+    }
+
+  tree_level level = { NULL }, below = { NULL };
+  fz_try (ctx)
+  {
+    add_tree_level (ctx, doc, &level, NULL, labels, num, fanout);
+    while (level.len > fanout)
+      {
+	tree_level_drop (ctx, &below);
+	below = level;
+	level = (tree_level) { NULL };
+	add_tree_level (ctx, doc, &level, &below, NULL, below.len, fanout);
+      }
+
+    pdf_obj *kids = pdf_new_array (ctx, doc, level.len);
+    pdf_dict_puts_drop (ctx, labels_obj, "Kids", kids);
+    for (int i = 0; i < level.len; ++i)
+      pdf_array_push (ctx, kids, level.refs[i]);
+  }
+  fz_always (ctx)
+  {
+    tree_level_drop (ctx, &level);
+    tree_level_drop (ctx, &below);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
 void
 pdfout_page_labels_set (fz_context *ctx, pdf_document *doc,
 			pdfout_data *labels)
 {
+  pdfout_page_labels_set_tree (ctx, doc, labels,
+			       PDFOUT_PAGE_LABELS_DEFAULT_FANOUT);
+}
+
+void
+pdfout_page_labels_set_tree (fz_context *ctx, pdf_document *doc,
+			     pdfout_data *labels, int fanout)
+{
+  if (fanout < 2)
+    pdfout_throw (ctx, "number tree fanout %d is less than 2", fanout);
+
   if (labels)
     check_page_labels (ctx, labels);
   
@@ -152,33 +328,33 @@ pdfout_page_labels_set (fz_context *ctx, pdf_document *doc,
   
   if (root == NULL)
     pdfout_throw (ctx, "no document catalog, cannot set/unset page labels");
-  
-  if (labels == NULL)
-    {
+
+  /* The old number tree is freed after the update.  */
+  static const char *owned_keys[] = { "Kids", "Nums", "P", NULL };
+  pdfout_reclaim *reclaim =
+    pdfout_reclaim_new (ctx, doc, pdf_dict_gets (ctx, root, "PageLabels"),
+			owned_keys);
+
+  fz_try (ctx)
+  {
+    if (labels == NULL)
       /* Remove page labels.  */
       pdf_dict_dels (ctx, root, "PageLabels");
-      return;
-    }
+    else
+      {
+	pdf_obj *labels_obj = pdf_new_dict (ctx, doc, 1);
+	pdf_dict_puts_drop (ctx, root, "PageLabels", labels_obj);
+	build_number_tree (ctx, doc, labels_obj, labels, fanout);
+      }
 
-  int num = pdfout_data_array_len (ctx, labels);
-  pdf_obj *array_obj = pdf_new_array (ctx, doc, 2 * num);
-  
-  for (int i = 0; i < num; ++i)
-    {
-      pdfout_data *hash = pdfout_data_array_get (ctx, labels, i);
-      int page;
-      pdf_obj *dict_obj = hash_to_pdf_dict (ctx, doc, hash, &page);
-
-      pdf_obj *page_obj = pdf_new_int (ctx, doc, page);
-      pdf_array_push_drop (ctx, array_obj, page_obj);
-      
-      pdf_array_push_drop (ctx, array_obj, dict_obj);
-    }
-      
-  pdf_obj *labels_obj = pdf_new_dict (ctx, doc, 1);
-  pdf_dict_puts_drop (ctx, labels_obj, "Nums", array_obj);
-  pdf_dict_puts_drop (ctx, root, "PageLabels", labels_obj);
-  
+    pdfout_reclaim *sweep = reclaim;
+    reclaim = NULL;
+    pdfout_reclaim_sweep (ctx, sweep, pdf_dict_gets (ctx, root, "PageLabels"));
+  }
+  fz_always (ctx)
+    pdfout_reclaim_drop (ctx, reclaim);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
 }
 
 static void
@@ -201,24 +377,27 @@ parse_dict (fz_context *ctx, pdf_obj *dict, pdfout_data *hash)
       const char *value;
       if (pdf_is_name (ctx, style) == false)
 	pdfout_throw (ctx, "style key 'S' not a name object");
-      /* pdf_to_name returns the empty string, not NULL, on all errors,
-	 so the strcmps are allowed.  */
-      if (pdf_name_eq (ctx, style, PDF_NAME_D))
-	value = "arabic";
-      else if (pdf_name_eq (ctx, style, PDF_NAME_R))
-	value = "Roman";
-      else if (pdf_name_eq (ctx, style, PDF_NAME_A))
-	value = "Letters";
-      else
+      /* pdf_to_name returns the empty string, not NULL, on all errors.  */
+      const char *string = pdf_to_name (ctx, style);
+      switch (pdfout_key_classify (string, strlen (string)))
 	{
-	  /* FIXME once PDF_NAMES for "r" and "a" available.  */
-	  const char *string = pdf_to_name (ctx, style);
-	  if (streq(string, "r"))
-	    value = "roman";
-	  else if (streq (string, "a"))
-	    value = "letters";
-	  else
-	    pdfout_throw (ctx, "unknown numbering style '%s'", string);
+	case PDFOUT_KEY_D:
+	  value = "arabic";
+	  break;
+	case PDFOUT_KEY_R:
+	  value = "Roman";
+	  break;
+	case PDFOUT_KEY_r:
+	  value = "roman";
+	  break;
+	case PDFOUT_KEY_A:
+	  value = "Letters";
+	  break;
+	case PDFOUT_KEY_a:
+	  value = "letters";
+	  break;
+	default:
+	  pdfout_throw (ctx, "unknown numbering style '%s'", string);
 	}
 
       int len = strlen (value);
@@ -231,6 +410,8 @@ parse_dict (fz_context *ctx, pdf_obj *dict, pdfout_data *hash)
       int value  = pdf_to_int (ctx, first);
       if (value < 1)
 	pdfout_throw (ctx, "value %d of 'St' is < 1 or not an int", value);
+      if (value > MAX_FIRST)
+	pdfout_throw (ctx, "value %d of 'St' is > %d", value, MAX_FIRST);
 
       push_int_key (ctx, hash, "first", value);
     }
@@ -248,43 +429,320 @@ parse_dict (fz_context *ctx, pdf_obj *dict, pdfout_data *hash)
     }
 }  
       
+static void
+push_label (fz_context *ctx, pdfout_data *labels, pdf_obj *key, pdf_obj *dict)
+{
+  if (pdf_is_int (ctx, key) == false)
+    pdfout_throw (ctx, "key in number tree not an int");
+
+  /* Zero-based page index, see push_nums.  */
+  int page = pdf_to_int (ctx, key);
+  if (page < 0)
+    pdfout_throw (ctx, "key in number tree is < 0");
+
+  if (pdf_is_dict (ctx, dict) == false)
+    pdfout_throw (ctx, "value in number tree not a dict");
+
+  pdfout_data *hash = pdfout_data_hash_new (ctx);
+  pdfout_data_array_push (ctx, labels, hash);
+  push_int_key (ctx, hash, "page", page + 1);
+  parse_dict (ctx, dict, hash);
+}
+
+/* Walk the number tree at NODE iteratively, in key order.  Each stack
+   entry is a Kids array together with the position of the next kid.  */
+static void
+read_number_tree (fz_context *ctx, pdf_document *doc, pdf_obj *node,
+		  pdfout_data *labels)
+{
+  int xref_len = pdf_xref_len (ctx, doc);
+  unsigned char *visited = fz_calloc (ctx, xref_len / 8 + 1, 1);
+  struct tree_node { pdf_obj *kids; int next; } *stack = NULL;
+  int depth = 0, stack_cap = 0;
+
+  fz_try (ctx)
+  {
+    while (true)
+      {
+	if (node)
+	  {
+	    int num = pdf_to_num (ctx, node);
+	    if (num > 0 && num < xref_len)
+	      {
+		if (visited[num / 8] & (1 << num % 8))
+		  pdfout_throw (ctx, "circular reference in number tree");
+		visited[num / 8] |= 1 << num % 8;
+	      }
+
+	    pdf_obj *nums = pdf_dict_get (ctx, node, PDF_NAME_Nums);
+	    pdf_obj *kids = pdf_dict_get (ctx, node, PDF_NAME_Kids);
+	    if (nums && pdf_is_array (ctx, nums) == false)
+	      pdfout_throw (ctx, "Nums is not an array");
+	    if (kids && pdf_is_array (ctx, kids) == false)
+	      pdfout_throw (ctx, "Kids is not an array");
+
+	    int length = pdf_array_len (ctx, nums);
+	    for (int i = 0; i < length / 2; ++i)
+	      push_label (ctx, labels, pdf_array_get (ctx, nums, 2 * i),
+			  pdf_array_get (ctx, nums, 2 * i + 1));
+
+	    if (kids)
+	      {
+		if (depth == stack_cap)
+		  stack = pdfout_x2nrealloc (ctx, stack, &stack_cap,
+					     struct tree_node);
+		stack[depth++] = (struct tree_node) {kids, 0};
+	      }
+	  }
+
+	while (depth
+	       && stack[depth - 1].next == pdf_array_len (ctx,
+							  stack[depth - 1].kids))
+	  --depth;
+	if (depth == 0)
+	  break;
+
+	struct tree_node *top = &stack[depth - 1];
+	node = pdf_array_get (ctx, top->kids, top->next++);
+	if (pdf_is_dict (ctx, node) == false)
+	  pdfout_throw (ctx, "kid in number tree not a dict");
+      }
+  }
+  fz_always (ctx)
+  {
+    free (stack);
+    free (visited);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
 pdfout_data *
 pdfout_page_labels_get (fz_context *ctx, pdf_document *doc)
 {
   pdf_obj *trailer = pdf_trailer (ctx, doc);
   pdf_obj *labels_obj = pdf_dict_getp (ctx, trailer, "Root/PageLabels");
-  pdf_obj *array = pdf_dict_gets (ctx, labels_obj, "Nums");
+  pdfout_data *labels = pdfout_data_array_new (ctx);
 
-  if (array && pdf_is_array (ctx, array) == false)
-    pdfout_throw (ctx, "Nums is not an array");
-		  
-  int length = pdf_array_len (ctx, array);
+  fz_try (ctx)
+  {
+    if (labels_obj)
+      read_number_tree (ctx, doc, labels_obj, labels);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_data_drop (ctx, labels);
+    fz_rethrow (ctx);
+  }
 
-  pdfout_data *labels = pdfout_data_array_new (ctx);
+  return labels;
+}
 
-  for (int i = 0; i < length / 2; ++i)
-    {
-      pdf_obj *object = pdf_array_get (ctx, array, 2 * i);
-      
-      if (pdf_is_int (ctx, object) == false)
-	pdfout_throw (ctx, "key in number tree not an int");
+/* Resolving labels of single pages.  */
 
-      pdfout_data *hash = pdfout_data_hash_new (ctx);
-      
-      int page = pdf_to_int (ctx, object);
-      if (page < 0)
-	pdfout_throw (ctx, "key in number tree is < 0");
+typedef struct {
+  /* Zero-based index of the first page of the range.  */
+  int page;
+  /* One of D, R, r, A, a, or 0 for no numbering.  */
+  char style;
+  int first;
+  char *prefix;
+  int prefix_len;
+} label_range;
 
-      push_int_key (ctx, hash, "page", page);
-      
-      pdf_obj *dict = pdf_array_get (ctx, array, 2 * i + 1);
-      if (pdf_is_dict (ctx, dict) == false)
-	pdfout_throw (ctx, "value in number tree not a dict");
+struct pdfout_page_labels
+{
+  label_range *ranges;
+  int len;
+};
 
-      parse_dict (ctx, dict, hash);
-      
-      pdfout_data_array_push (ctx, labels, hash);
+void
+pdfout_page_labels_drop (fz_context *ctx, pdfout_page_labels *labels)
+{
+  if (labels == NULL)
+    return;
+  for (int i = 0; i < labels->len; ++i)
+    free (labels->ranges[i].prefix);
+  free (labels->ranges);
+  free (labels);
+}
+
+static void
+hash_to_range (fz_context *ctx, pdfout_data *hash, label_range *range)
+{
+  pdfout_data *scalar;
+
+  range->page = scalar_to_int (ctx, pdfout_data_hash_gets (ctx, hash, "page"))
+    - 1;
+
+  scalar = pdfout_data_hash_gets (ctx, hash, "first");
+  range->first = scalar ? scalar_to_int (ctx, scalar) : 1;
+
+  scalar = pdfout_data_hash_gets (ctx, hash, "style");
+  if (scalar)
+    {
+      char *style = scalar_to_string (ctx, scalar);
+      range->style = style_name (pdfout_key_classify (style,
+						      strlen (style)))[0];
     }
-  
+
+  scalar = pdfout_data_hash_gets (ctx, hash, "prefix");
+  if (scalar)
+    {
+      char *prefix = pdfout_data_scalar_get (ctx, scalar, &range->prefix_len);
+      range->prefix = fz_malloc (ctx, range->prefix_len);
+      memcpy (range->prefix, prefix, range->prefix_len);
+    }
+}
+
+pdfout_page_labels *
+pdfout_page_labels_new (fz_context *ctx, pdf_document *doc)
+{
+  pdfout_page_labels *labels = fz_malloc_struct (ctx, pdfout_page_labels);
+  pdfout_data *data = NULL;
+
+  fz_var (data);
+  fz_try (ctx)
+  {
+    data = pdfout_page_labels_get (ctx, doc);
+    int len = pdfout_data_array_len (ctx, data);
+    labels->ranges = fz_calloc (ctx, len, sizeof *labels->ranges);
+    for (; labels->len < len; ++labels->len)
+      {
+	pdfout_data *hash = pdfout_data_array_get (ctx, data, labels->len);
+	label_range *range = &labels->ranges[labels->len];
+	hash_to_range (ctx, hash, range);
+	if (labels->len && range->page <= range[-1].page)
+	  pdfout_throw (ctx, "keys in number tree not increasing");
+      }
+  }
+  fz_always (ctx)
+    pdfout_data_drop (ctx, data);
+  fz_catch (ctx)
+  {
+    pdfout_page_labels_drop (ctx, labels);
+    fz_rethrow (ctx);
+  }
+
   return labels;
 }
+
+int
+pdfout_page_labels_lookup (fz_context *ctx, pdfout_page_labels *labels,
+			   int page)
+{
+  int low = 0, high = labels->len;
+
+  /* Find the last range starting at or before PAGE.  */
+  while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+      if (labels->ranges[mid].page <= page)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+
+  return low - 1;
+}
+
+int
+pdfout_page_labels_next (fz_context *ctx, pdfout_page_labels *labels,
+			 int range, int page)
+{
+  while (range + 1 < labels->len && labels->ranges[range + 1].page <= page)
+    ++range;
+  return range;
+}
+
+/* Write the decimal digits of the positive VALUE to the end of BUF.  */
+static char *
+format_arabic (char *end, int value)
+{
+  do
+    *--end = '0' + value % 10;
+  while (value /= 10);
+  return end;
+}
+
+static void
+format_roman (fz_context *ctx, fz_buffer *buf, int value, bool upper)
+{
+  static const char *const digits[4][10] = {
+    { "", "i", "ii", "iii", "iv", "v", "vi", "vii", "viii", "ix" },
+    { "", "x", "xx", "xxx", "xl", "l", "lx", "lxx", "lxxx", "xc" },
+    { "", "c", "cc", "ccc", "cd", "d", "dc", "dcc", "dccc", "cm" },
+    { "", "m", "mm", "mmm" }
+  };
+  char tmp[32];
+  int len = 0;
+
+  /* There is no roman numeral above 3999, so larger values get more m's.  */
+  for (; value >= 4000; value -= 1000)
+    fz_write_buffer_byte (ctx, buf, upper ? 'M' : 'm');
+
+  for (int place = 3, scale = 1000; place >= 0; --place, scale /= 10)
+    for (const char *d = digits[place][value / scale % 10]; *d; ++d)
+      tmp[len++] = upper ? *d - 'a' + 'A' : *d;
+
+  fz_write_buffer (ctx, buf, tmp, len);
+}
+
+/* A to Z, then AA to ZZ, then AAA and so on.  */
+static void
+format_letters (fz_context *ctx, fz_buffer *buf, int value, bool upper)
+{
+  char letter = (upper ? 'A' : 'a') + (value - 1) % 26;
+  for (int count = (value - 1) / 26 + 1; count > 0; --count)
+    fz_write_buffer_byte (ctx, buf, letter);
+}
+
+void
+pdfout_page_labels_format (fz_context *ctx, pdfout_page_labels *labels,
+			   int range, int page, fz_buffer *buf)
+{
+  char tmp[16];
+  char *end = tmp + sizeof tmp;
+
+  buf->len = 0;
+
+  if (range < 0)
+    {
+      /* No label for this page, use the page number.  */
+      char *start = format_arabic (end, page + 1);
+      fz_write_buffer (ctx, buf, start, end - start);
+      return;
+    }
+
+  label_range *r = &labels->ranges[range];
+  int value = r->first + page - r->page;
+
+  if (r->prefix_len)
+    fz_write_buffer (ctx, buf, r->prefix, r->prefix_len);
+
+  switch (r->style)
+    {
+    case 'D':
+      {
+	char *start = format_arabic (end, value);
+	fz_write_buffer (ctx, buf, start, end - start);
+	break;
+      }
+    case 'R':
+    case 'r':
+      format_roman (ctx, buf, value, r->style == 'R');
+      break;
+    case 'A':
+    case 'a':
+      format_letters (ctx, buf, value, r->style == 'A');
+      break;
+    }
+}
+
+void
+pdfout_page_labels_resolve (fz_context *ctx, pdfout_page_labels *labels,
+			    int page, fz_buffer *buf)
+{
+  int range = pdfout_page_labels_lookup (ctx, labels, page);
+  pdfout_page_labels_format (ctx, labels, range, page, buf);
+}
@@ -4,6 +4,47 @@
 void pdfout_page_labels_set (fz_context *ctx, pdf_document *doc,
 			     pdfout_data *labels);
 
+/* Default for the maximum number of entries in a node of the page label
+   number tree.  */
+#define PDFOUT_PAGE_LABELS_DEFAULT_FANOUT 64
+
+/* Like pdfout_page_labels_set, but with at most FANOUT label ranges or
+   kids per node of the number tree.  With more than FANOUT ranges, a
+   balanced tree is written.  */
+void pdfout_page_labels_set_tree (fz_context *ctx, pdf_document *doc,
+				  pdfout_data *labels, int fanout);
+
 pdfout_data *pdfout_page_labels_get (fz_context *ctx, pdf_document *doc);
 
+/* The label ranges of a document, sorted by page, for looking up the
+   labels of single pages.  */
+typedef struct pdfout_page_labels pdfout_page_labels;
+
+pdfout_page_labels *pdfout_page_labels_new (fz_context *ctx,
+					    pdf_document *doc);
+
+void pdfout_page_labels_drop (fz_context *ctx, pdfout_page_labels *labels);
+
+/* Replace the contents of BUF with the label of the zero-based PAGE.
+   The range is found by binary search.  Pages which are not covered by a
+   label range get their one-based page number as label.  */
+void pdfout_page_labels_resolve (fz_context *ctx, pdfout_page_labels *labels,
+				 int page, fz_buffer *buf);
+
+/* Return the index of the range containing PAGE, or -1 if there is no
+   such range.  */
+int pdfout_page_labels_lookup (fz_context *ctx, pdfout_page_labels *labels,
+			       int page);
+
+/* Return the index of the range containing PAGE, starting the search at
+   RANGE, which must contain a page before PAGE.  For walking pages in
+   increasing order.  */
+int pdfout_page_labels_next (fz_context *ctx, pdfout_page_labels *labels,
+			     int range, int page);
+
+/* Like pdfout_page_labels_resolve, with RANGE from
+   pdfout_page_labels_lookup or pdfout_page_labels_next.  */
+void pdfout_page_labels_format (fz_context *ctx, pdfout_page_labels *labels,
+				int range, int page, fz_buffer *buf);
+
 #endif	/* ! HAVE_PDFOUT_PAGE_LABELS_H */
@@ -0,0 +1,223 @@
+#include "common.h"
+#include "shared.h"
+
+/* Run a command on many PDF files with a worker pool.  Each worker opens
+   its own documents; the results are written as JSON Lines.  */
+
+typedef struct {
+  pdfout_batch_func *func;
+  char **files;
+  fz_output *out;
+  int failed;
+} batch;
+
+static void *
+batch_run (fz_context *ctx, void *arg, void *worker, int i)
+{
+  batch *b = arg;
+  pdf_document *doc = pdf_open_document (ctx, b->files[i]);
+  pdfout_data *result = NULL;
+
+  fz_try (ctx)
+    result = b->func (ctx, doc);
+  fz_always (ctx)
+    pdf_drop_document (ctx, doc);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return result;
+}
+
+static void
+batch_drop_result (fz_context *ctx, void *result)
+{
+  pdfout_data_drop (ctx, result);
+}
+
+/* File names and error messages are not necessarily UTF-8.  */
+static void
+emit_repaired (fz_context *ctx, pdfout_emitter *emitter, const char *s)
+{
+  int len;
+  char *utf8 = pdfout_repair_utf8 (ctx, s, strlen (s), &len);
+
+  fz_try (ctx)
+    pdfout_emitter_string_scalar (ctx, emitter, utf8, len);
+  fz_always (ctx)
+    free (utf8);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+/* Write the line of file I to BUF.  */
+static void
+write_line (fz_context *ctx, batch *b, int i, pdfout_data *result,
+	    const char *error, fz_buffer *buf)
+{
+  fz_output *out = fz_new_output_with_buffer (ctx, buf);
+  pdfout_emitter *emitter = NULL;
+
+  fz_var (emitter);
+  fz_try (ctx)
+  {
+    emitter = pdfout_emitter_json_line_new (ctx, out);
+    pdfout_emitter_hash_start (ctx, emitter);
+    pdfout_emitter_string (ctx, emitter, "file");
+    emit_repaired (ctx, emitter, b->files[i]);
+    if (error)
+      {
+	pdfout_emitter_string (ctx, emitter, "error");
+	emit_repaired (ctx, emitter, error);
+      }
+    else
+      {
+	pdfout_emitter_string (ctx, emitter, "result");
+	pdfout_emitter_emit_events (ctx, emitter, result);
+      }
+    pdfout_emitter_hash_end (ctx, emitter);
+  }
+  fz_always (ctx)
+  {
+    pdfout_emitter_drop (ctx, emitter);
+    fz_drop_output (ctx, out);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static bool
+batch_consume (fz_context *ctx, void *arg, int i, void *result,
+	       const char *error)
+{
+  batch *b = arg;
+  fz_buffer *buf = fz_new_buffer (ctx, 256);
+  char *message = NULL;
+
+  fz_var (message);
+  fz_try (ctx)
+  {
+    /* Only write complete lines.  If the result cannot be written, report
+       that as the error of the file.  */
+    fz_try (ctx)
+      write_line (ctx, b, i, result, error, buf);
+    fz_catch (ctx)
+    {
+      message = fz_strdup (ctx, fz_caught_message (ctx));
+      buf->len = 0;
+      write_line (ctx, b, i, NULL, message, buf);
+      error = message;
+    }
+    if (error)
+      ++b->failed;
+    fz_write (ctx, b->out, buf->data, buf->len);
+  }
+  fz_always (ctx)
+  {
+    free (message);
+    fz_drop_buffer (ctx, buf);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return true;
+}
+
+static const pdfout_pool_ops batch_ops = {
+  NULL, NULL, batch_run, batch_drop_result, batch_consume
+};
+
+/* Append the file names in ARGV to FILES.  "-" is replaced by the lines
+   of standard input.  */
+static char **
+collect_files (fz_context *ctx, int argc, char **argv, int *n_files)
+{
+  char **files = NULL;
+  int len = 0, cap = 0;
+  fz_buffer *line = NULL;
+  fz_stream *stm = NULL;
+
+  fz_var (files);
+  fz_var (len);
+  fz_var (line);
+  fz_var (stm);
+  fz_try (ctx)
+  {
+    for (int i = 0; i < argc; ++i)
+      {
+	if (strcmp (argv[i], "-"))
+	  {
+	    if (len == cap)
+	      files = pdfout_x2nrealloc (ctx, files, &cap, char *);
+	    files[len++] = fz_strdup (ctx, argv[i]);
+	    continue;
+	  }
+
+	stm = fz_open_file_ptr (ctx, stdin);
+	ssize_t n;
+	while ((n = pdfout_getline (ctx, &line, stm)) != -1)
+	  {
+	    char *name = (char *) line->data;
+	    while (n && (name[n - 1] == '\n' || name[n - 1] == '\r'))
+	      --n;
+	    if (n == 0)
+	      continue;
+	    if (len == cap)
+	      files = pdfout_x2nrealloc (ctx, files, &cap, char *);
+	    files[len] = fz_malloc (ctx, n + 1);
+	    memcpy (files[len], name, n);
+	    files[len++][n] = '\0';
+	  }
+	fz_drop_stream (ctx, stm);
+	stm = NULL;
+      }
+  }
+  fz_always (ctx)
+  {
+    fz_drop_stream (ctx, stm);
+    fz_drop_buffer (ctx, line);
+  }
+  fz_catch (ctx)
+  {
+    for (int i = 0; i < len; ++i)
+      free (files[i]);
+    free (files);
+    fz_rethrow (ctx);
+  }
+
+  *n_files = len;
+  return files;
+}
+
+bool
+pdfout_batch_wanted (int argc, char **argv)
+{
+  return argc > 1 || (argc == 1 && strcmp (argv[0], "-") == 0);
+}
+
+int
+pdfout_batch_run (fz_context *ctx, int argc, char **argv, int jobs,
+		  pdfout_batch_func *func, FILE *output)
+{
+  batch b = { func };
+  int n_files = 0;
+
+  fz_var (b.out);
+  fz_var (n_files);
+  fz_try (ctx)
+  {
+    b.files = collect_files (ctx, argc, argv, &n_files);
+    b.out = fz_new_output_with_file_ptr (ctx, output, false);
+    pdfout_pool_run (ctx, &batch_ops, &b, n_files, jobs);
+  }
+  fz_always (ctx)
+  {
+    fz_drop_output (ctx, b.out);
+    for (int i = 0; i < n_files; ++i)
+      free (b.files[i]);
+    free (b.files);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return b.failed;
+}
@@ -188,11 +188,67 @@ static void print_string (const char *string, size_t len)
       free (result_back);						\
     } while (0);
 
+/* Feed SRC to a converter in chunks ending at the offsets SPLITS, and
+   through a conversion output byte by byte, and compare with EXPECTED.  */
+static void
+check_converter_chunks (const char *from, const char *too, const char *src,
+			int srclen, const int *splits, int n_splits,
+			const char *expected, int expected_len)
+{
+  pdfout_char_converter *conv = pdfout_char_converter_new (ctx, from, too);
+  fz_buffer *buf = fz_new_buffer (ctx, 16);
+  int start = 0;
+  for (int i = 0; i <= n_splits; ++i)
+    {
+      int end = i < n_splits ? splits[i] : srclen;
+      pdfout_char_converter_feed (ctx, conv, src + start, end - start, buf);
+      start = end;
+    }
+  pdfout_char_converter_finish (ctx, conv, buf);
+  test_equal ((char *) buf->data, expected, (int) buf->len, expected_len);
+  pdfout_char_converter_drop (ctx, conv);
+
+  buf->len = 0;
+  fz_output *chain = fz_new_output_with_buffer (ctx, buf);
+  fz_output *out = pdfout_new_char_conv_output (ctx, chain, from, too);
+  for (int i = 0; i < srclen; ++i)
+    fz_write (ctx, out, src + i, 1);
+  fz_drop_output (ctx, out);
+  fz_drop_output (ctx, chain);
+  test_equal ((char *) buf->data, expected, (int) buf->len, expected_len);
+  fz_drop_buffer (ctx, buf);
+}
+
+/* Check all ways to split SRC in two and three chunks.  */
+static void
+check_converter_splits (const char *from, const char *too, const char *src,
+			int srclen, const char *expected, int expected_len)
+{
+  for (int i = 0; i <= srclen; ++i)
+    {
+      check_converter_chunks (from, too, src, srclen, &i, 1, expected,
+			      expected_len);
+      for (int j = i; j <= srclen; ++j)
+	{
+	  int splits[] = { i, j };
+	  check_converter_chunks (from, too, src, srclen, splits, 2, expected,
+				  expected_len);
+	}
+    }
+
+  /* A truncated sequence at the end is an error.  */
+  pdfout_char_converter *conv = pdfout_char_converter_new (ctx, from, too);
+  fz_buffer *buf = fz_new_buffer (ctx, 16);
+  pdfout_char_converter_feed (ctx, conv, src, srclen - 1, buf);
+  assert_throw (ctx, pdfout_char_converter_finish (ctx, conv, buf));
+  pdfout_char_converter_drop (ctx, conv);
+  fz_drop_buffer (ctx, buf);
+}
+
 static void
 check_string_conversions (void)
 {
   /* FIXME: check trailing zero for 'C' encoding. */
-  /* FIXME: check with just enough space and just too little space.  */
   
   test_from_utf8 ("ASCII", "0123456789", "0123456789");
   test_from_utf8 ("UTF-8", "0123456789", "0123456789");
@@ -229,6 +285,63 @@ check_string_conversions (void)
     }
   }
 
+  /* Caller-provided buffers: just enough and just too little space.  */
+  {
+    const char src[] = "a\xce\xb1\xe4\xb8\x80\xf0\x9d\x93\x93";
+    const char expected[] = "\xfe\xff\0a\x03\xb1\x4e\x00\xd8\x35\xdc\xd3";
+    char dest[sizeof expected];
+    int len = sizeof expected - 1;
+    int bound = pdfout_char_conv_length (ctx, "UTF-8", "UTF-16",
+					 sizeof src - 1);
+    test_assert (bound >= len);
+
+    int written = pdfout_char_conv_mem (ctx, "UTF-8", "UTF-16", src,
+					sizeof src - 1, dest, len);
+    test_equal (dest, expected, written, len);
+
+    fz_try (ctx)
+    {
+      pdfout_char_conv_mem (ctx, "UTF-8", "UTF-16", src, sizeof src - 1,
+			    dest, len - 1);
+      test_assert (0);
+    }
+    fz_catch (ctx)
+    {
+      test_assert (ctx->error->errcode == FZ_ERROR_GENERIC);
+    }
+  }
+
+  /* A lone byte-order mark converts to the empty string.  */
+  {
+    int len;
+    char *result = pdfout_char_conv (ctx, "UTF-16", "UTF-8", "\xfe\xff", 2,
+				     &len);
+    test_equal (result, "", len, 0);
+    free (result);
+  }
+
+  /* Bytes which are not part of valid UTF-8 become U+FFFD.  */
+  {
+    int len;
+    char *result = pdfout_repair_utf8 (ctx, "a\xe9" "b\xce\xb1\xce", 6,
+				       &len);
+    test_equal (result, "a\xef\xbf\xbd" "b\xce\xb1\xef\xbf\xbd", len, 10);
+    free (result);
+  }
+
+  /* Streaming conversion, with multibyte sequences and surrogate pairs
+     split at every offset.  */
+  {
+    const char utf8[] = "a\xce\xb1\xe4\xb8\x80\xf0\x9d\x93\x93";
+    const char utf16[] = "\xfe\xff\0a\x03\xb1\x4e\x00\xd8\x35\xdc\xd3";
+    check_converter_splits ("UTF-8", "UTF-16", utf8, sizeof utf8 - 1,
+			    utf16, sizeof utf16 - 1);
+    check_converter_splits ("UTF-16", "UTF-8", utf16, sizeof utf16 - 1,
+			    utf8, sizeof utf8 - 1);
+    check_converter_splits ("UTF-8", "UTF-16LE", utf8, sizeof utf8 - 1,
+			    "a\0\xb1\x03\x00\x4e\x35\xd8\xd3\xdc", 10);
+  }
+
   exit (0);
 }
 
@@ -538,6 +651,184 @@ static void check_data (void)
   exit (0);
 }
 
+/* Test corpora for the UTF-16 kernels: random text with codepoints from
+   the given ranges, encoded as UTF-16BE and UTF-8.  */
+
+static unsigned corpus_seed = 1;
+
+static unsigned
+corpus_random (void)
+{
+  corpus_seed = corpus_seed * 1103515245 + 12345;
+  return corpus_seed >> 8;
+}
+
+enum { CORPUS_CJK, CORPUS_MIXED, CORPUS_INVALID };
+
+static unsigned
+corpus_codepoint (int corpus)
+{
+  if (corpus == CORPUS_CJK)
+    return 0x4e00 + corpus_random () % 0x5200;
+
+  switch (corpus_random () % (corpus == CORPUS_MIXED ? 8 : 11))
+    {
+    case 0: case 1: case 2: case 3: return 0x20 + corpus_random () % 0x5f;
+    case 4: return 0x391 + corpus_random () % 0x38;
+    case 5: return 0x4e00 + corpus_random () % 0x5200;
+    case 6: return 0x3041 + corpus_random () % 0x56;
+    case 7: return 0x1f600 + corpus_random () % 0x50;
+    case 8: return 0xfeff;
+    case 9: return 0xfffe;
+    default: return 0xd800 + corpus_random () % 0x800;
+    }
+}
+
+/* Append LEN codepoints to the UTF-16BE buffer U16 and the UTF-8 buffer
+   U8.  Surrogates are stored unpaired.  */
+static void
+corpus_fill (int corpus, int len, fz_buffer *u16, fz_buffer *u8)
+{
+  for (int i = 0; i < len; ++i)
+    {
+      unsigned c = corpus_codepoint (corpus);
+      if (c >= 0x10000)
+	{
+	  unsigned w1 = 0xd800 + ((c - 0x10000) >> 10);
+	  unsigned w2 = 0xdc00 + ((c - 0x10000) & 0x3ff);
+	  fz_write_buffer_byte (ctx, u16, w1 >> 8);
+	  fz_write_buffer_byte (ctx, u16, w1);
+	  fz_write_buffer_byte (ctx, u16, w2 >> 8);
+	  fz_write_buffer_byte (ctx, u16, w2);
+	}
+      else
+	{
+	  fz_write_buffer_byte (ctx, u16, c >> 8);
+	  fz_write_buffer_byte (ctx, u16, c);
+	}
+      if (c >= 0xd800 && c < 0xe000)
+	{
+	  fz_write_buffer_byte (ctx, u8, 0xed);
+	  fz_write_buffer_byte (ctx, u8, 0x80 | ((c >> 6) & 0x3f));
+	  fz_write_buffer_byte (ctx, u8, 0x80 | (c & 0x3f));
+	}
+      else
+	fz_write_buffer_rune (ctx, u8, c);
+    }
+}
+
+/* Convert with the selected kernels.  On error, return NULL and store the
+   error message in ERROR.  */
+static char *
+kernel_conv (int kernels, const char *from, const char *to,
+	     fz_buffer *src, int len, int *result_len, char *error)
+{
+  char *result = NULL;
+  pdfout_select_kernels (kernels);
+  error[0] = 0;
+  fz_try (ctx)
+    result = pdfout_char_conv (ctx, from, to, (char *) src->data, len,
+			       result_len);
+  fz_catch (ctx)
+    snprintf (error, 200, "%s", fz_caught_message (ctx));
+  return result;
+}
+
+static void
+check_kernels (void)
+{
+  const char *pairs[][2] = {
+    {"UTF-16", "UTF-8"}, {"UTF-16BE", "C"},
+    {"UTF-8", "UTF-16"}, {"UTF-8", "UTF-16BE"}
+  };
+
+  for (int i = 0; i < 3000; ++i)
+    {
+      int corpus = i % 3;
+      fz_buffer *u16 = fz_new_buffer (ctx, 1);
+      fz_buffer *u8 = fz_new_buffer (ctx, 1);
+      corpus_fill (corpus, corpus_random () % 100, u16, u8);
+
+      for (int p = 0; p < 4; ++p)
+	{
+	  fz_buffer *src = p < 2 ? u16 : u8;
+	  int len = src->len;
+	  /* Truncate some of the invalid input.  */
+	  if (corpus == CORPUS_INVALID && len && i % 2)
+	    len--;
+
+	  char error[3][200];
+	  int result_len[3];
+	  char *result[3];
+	  for (int k = 0; k < 3; ++k)
+	    result[k] = kernel_conv (k, pairs[p][0], pairs[p][1], src, len,
+				     &result_len[k], error[k]);
+
+	  for (int k = 1; k < 3; ++k)
+	    {
+	      test_assert (strcmp (error[0], error[k]) == 0);
+	      if (result[0])
+		test_equal (result[k], result[0], result_len[k],
+			    result_len[0]);
+	      free (result[k]);
+	    }
+	  free (result[0]);
+	}
+      fz_drop_buffer (ctx, u16);
+      fz_drop_buffer (ctx, u8);
+    }
+
+  exit (0);
+}
+
+static void
+benchmark_conv (const char *name, int kernels, const char *from,
+		const char *to, fz_buffer *src)
+{
+  clock_t start = clock ();
+  double seconds;
+  int rounds = 0;
+
+  pdfout_select_kernels (kernels);
+  do
+    {
+      int len;
+      free (pdfout_char_conv (ctx, from, to, (char *) src->data, src->len,
+			      &len));
+      ++rounds;
+      seconds = (double) (clock () - start) / CLOCKS_PER_SEC;
+    }
+  while (seconds < 0.5);
+
+  printf ("%-6s %-9s -> %-9s %-7s %8.1f MB/s\n", name, from, to,
+	  kernels == PDFOUT_KERNELS_NONE ? "generic"
+	  : kernels == PDFOUT_KERNELS_SCALAR ? "scalar" : "simd",
+	  rounds * (src->len / 1e6) / seconds);
+}
+
+static void
+charset_benchmark (void)
+{
+  const char *names[] = {"cjk", "mixed"};
+
+  for (int corpus = CORPUS_CJK; corpus <= CORPUS_MIXED; ++corpus)
+    {
+      fz_buffer *u16 = fz_new_buffer (ctx, 1 << 20);
+      fz_buffer *u8 = fz_new_buffer (ctx, 1 << 20);
+      corpus_fill (corpus, 1 << 20, u16, u8);
+
+      for (int k = PDFOUT_KERNELS_NONE; k <= PDFOUT_KERNELS_SIMD; ++k)
+	benchmark_conv (names[corpus], k, "UTF-16BE", "UTF-8", u16);
+      for (int k = PDFOUT_KERNELS_NONE; k <= PDFOUT_KERNELS_SIMD; ++k)
+	benchmark_conv (names[corpus], k, "UTF-8", "UTF-16BE", u8);
+
+      fz_drop_buffer (ctx, u16);
+      fz_drop_buffer (ctx, u8);
+    }
+
+  exit (0);
+}
+
 static void check_strsep (void)
 {
   char *string = fz_strdup(ctx, "abc.def..ghi");
@@ -560,6 +851,163 @@ static void check_strsep (void)
   free (string);
   exit(0);
 }
+static void check_matcher (void)
+{
+  static const struct {
+    const char *pattern;
+    pdfout_match_syntax syntax;
+    /* The required literal.  */
+    const char *literal;
+  } tests[] = {
+    {"hello", PDFOUT_MATCH_BASIC, "hello"},
+    {"a\\.b", PDFOUT_MATCH_BASIC, "a.b"},
+    {"a.b", PDFOUT_MATCH_BASIC, "a"},
+    {"a.b", PDFOUT_MATCH_FIXED, "a.b"},
+    {"ab*cde", PDFOUT_MATCH_BASIC, "cde"},
+    {"ba[rz]", PDFOUT_MATCH_BASIC, "ba"},
+    {"fo+", PDFOUT_MATCH_BASIC, "fo+"},
+    {"fo+", PDFOUT_MATCH_EXTENDED, "f"},
+    {"x\\(y\\)", PDFOUT_MATCH_BASIC, ""},
+    {"x(y)", PDFOUT_MATCH_BASIC, "x(y)"},
+    {"foo|bar", PDFOUT_MATCH_EXTENDED, ""},
+    {"\\(ab\\)", PDFOUT_MATCH_EXTENDED, "(ab)"},
+    /* The bounds of an interval are not literal.  */
+    {"x{10}", PDFOUT_MATCH_EXTENDED, ""},
+    {"x\\{2,3\\}", PDFOUT_MATCH_BASIC, ""},
+    {"ab{1}c", PDFOUT_MATCH_EXTENDED, "a"},
+    {"ab\\{1\\}c", PDFOUT_MATCH_BASIC, "a"},
+    {"x\\{10\\}", PDFOUT_MATCH_EXTENDED, "x{10}"},
+  };
+
+  for (int i = 0; i < sizeof tests / sizeof tests[0]; ++i)
+    {
+      pdfout_matcher *m = pdfout_matcher_new (ctx, tests[i].pattern,
+					      tests[i].syntax, false);
+      int len;
+      const char *literal = pdfout_matcher_literal (ctx, m, &len);
+      test_assert (len == strlen (tests[i].literal));
+      test_assert (len == 0 || memcmp (literal, tests[i].literal, len) == 0);
+      pdfout_matcher_drop (ctx, m);
+    }
+
+  /* Only the lines containing the literal reach the regex.  */
+  static const char text[] = "bar\nHello, a.b\naab\nlast";
+  pdfout_matcher *m = pdfout_matcher_new (ctx, "a.b$", PDFOUT_MATCH_BASIC,
+					  false);
+  fz_buffer *buf = fz_new_buffer (ctx, sizeof text);
+  fz_write_buffer (ctx, buf, text, sizeof text - 1);
+  int pos = 0, len;
+  test_assert (pdfout_matcher_next_line (ctx, m, buf, &pos, &len) == 4);
+  test_assert (len == 10);
+  test_assert (pdfout_matcher_next_line (ctx, m, buf, &pos, &len) == 15);
+  test_assert (len == 3);
+  test_assert (pdfout_matcher_next_line (ctx, m, buf, &pos, &len) == -1);
+  fz_drop_buffer (ctx, buf);
+  pdfout_matcher_drop (ctx, m);
+
+  exit (0);
+}
+
+static void check_text_index (void)
+{
+  pdfout_text_index_builder *builder = pdfout_text_index_builder_new (ctx);
+  pdfout_text_index_file file = { "a.pdf", 100, 1000, 1, 3 };
+  int a = pdfout_text_index_builder_add_file (ctx, builder, &file);
+  file.name = "b.pdf";
+  int b = pdfout_text_index_builder_add_file (ctx, builder, &file);
+  /* Left out.  */
+  file.name = "c.pdf";
+  file.page_count = 0;
+  int c = pdfout_text_index_builder_add_file (ctx, builder, &file);
+
+  static const char page[] = "Hello, World!  \xc3\x9c" "ber hello";
+  pdfout_text_index_builder_add_text (ctx, builder, a, 0, page,
+				      sizeof page - 1);
+  pdfout_text_index_builder_add_text (ctx, builder, a, 2, "world", 5);
+  pdfout_text_index_builder_add_text (ctx, builder, b, 200, "world", 5);
+  pdfout_text_index_builder_add_text (ctx, builder, c, 0, "world", 5);
+  /* CJK text without spaces, longer than a term.  */
+  char cjk[40 * 3 + 1] = "";
+  for (int i = 0; i < 40; ++i)
+    strcat (cjk, "\xe4\xb8\x80");
+  pdfout_text_index_builder_add_text (ctx, builder, a, 5, cjk, strlen (cjk));
+
+  fz_buffer *buf = fz_new_buffer (ctx, 1024);
+  fz_output *out = fz_new_output_with_buffer (ctx, buf);
+  pdfout_text_index_builder_write (ctx, builder, out);
+  fz_drop_output (ctx, out);
+  pdfout_text_index_builder_drop (ctx, builder);
+
+  pdfout_text_index *index = pdfout_text_index_new_from_buffer (ctx, buf);
+  test_assert (pdfout_text_index_file_count (ctx, index) == 2);
+  pdfout_text_index_get_file (ctx, index, 1, &file);
+  test_assert (strcmp (file.name, "b.pdf") == 0);
+  test_assert (file.size == 100 && file.mtime == 1000 && file.hash == 1);
+
+  int n;
+  pdfout_text_hit *hits = pdfout_text_index_search (ctx, index, "WORLD",
+						    &n);
+  test_assert (n == 3);
+  test_assert (hits[0].file == 0 && hits[0].page == 0);
+  test_assert (hits[1].file == 0 && hits[1].page == 2);
+  test_assert (hits[2].file == 1 && hits[2].page == 200);
+  free (hits);
+
+  hits = pdfout_text_index_search (ctx, index, cjk, &n);
+  test_assert (n == 1 && hits[0].file == 0 && hits[0].page == 5);
+  free (hits);
+
+  /* Latin-1 letters are folded, too.  */
+  hits = pdfout_text_index_search (ctx, index, "hello \xc3\xbc" "ber",
+				   &n);
+  test_assert (n == 1 && hits[0].file == 0 && hits[0].page == 0);
+  free (hits);
+
+  hits = pdfout_text_index_search (ctx, index, "hello missing", &n);
+  test_assert (n == 0);
+  free (hits);
+
+  /* Copy the postings of the second file only.  */
+  builder = pdfout_text_index_builder_new (ctx);
+  file.name = "b.pdf";
+  file.page_count = 201;
+  b = pdfout_text_index_builder_add_file (ctx, builder, &file);
+  int map[] = { -1, b };
+  pdfout_text_index_builder_copy (ctx, builder, index, map);
+  pdfout_text_index_drop (ctx, index);
+  fz_drop_buffer (ctx, buf);
+
+  buf = fz_new_buffer (ctx, 1024);
+  out = fz_new_output_with_buffer (ctx, buf);
+  pdfout_text_index_builder_write (ctx, builder, out);
+  fz_drop_output (ctx, out);
+  pdfout_text_index_builder_drop (ctx, builder);
+
+  index = pdfout_text_index_new_from_buffer (ctx, buf);
+  hits = pdfout_text_index_search (ctx, index, "world", &n);
+  test_assert (n == 1 && hits[0].file == 0 && hits[0].page == 200);
+  free (hits);
+  hits = pdfout_text_index_search (ctx, index, "hello", &n);
+  test_assert (n == 0);
+  free (hits);
+  pdfout_text_index_drop (ctx, index);
+
+  /* A file table offset which wraps around, and too many files.  */
+  unsigned char header[48];
+  memcpy (header, buf->data, sizeof header);
+  memset (buf->data + 24, 0xff, 8);
+  buf->data[24] = 0xf8;
+  assert_throw (ctx, pdfout_text_index_new_from_buffer (ctx, buf));
+  memcpy (buf->data, header, sizeof header);
+  memset (buf->data + 12, 0xff, 3);
+  assert_throw (ctx, pdfout_text_index_new_from_buffer (ctx, buf));
+  memcpy (buf->data, header, sizeof header);
+  pdfout_text_index_drop (ctx, pdfout_text_index_new_from_buffer (ctx, buf));
+  fz_drop_buffer (ctx, buf);
+
+  exit (0);
+}
+
 enum {
   INCREMENTAL_UPDATE = CHAR_MAX + 1,
   INCREMENTAL_UPDATE_XREF,
@@ -567,6 +1015,10 @@ enum {
   JSON,
   DATA,
   STRSEP,
+  KERNELS,
+  CHARSET_BENCHMARK,
+  MATCHER,
+  TEXT_INDEX,
 };
 
 static struct option longopts[] = {
@@ -578,6 +1030,10 @@ static struct option longopts[] = {
   {"json", no_argument, NULL, JSON},
   {"data", no_argument, NULL, DATA},
   {"strsep", no_argument, NULL, STRSEP},
+  {"kernels", no_argument, NULL, KERNELS},
+  {"charset-benchmark", no_argument, NULL, CHARSET_BENCHMARK},
+  {"matcher", no_argument, NULL, MATCHER},
+  {"text-index", no_argument, NULL, TEXT_INDEX},
   {NULL, 0 , NULL, 0}
 };
 
@@ -601,6 +1057,10 @@ Run whitebox test.\n\
       --json\n\
       --data\n\
       --strsep\n\
+      --kernels\n\
+      --charset-benchmark    Print UTF-16 <-> UTF-8 throughput\n\
+      --matcher\n\
+      --text-index\n\
 \n\
  general options:\n\
   -h, --help                 Give this help list\n\
@@ -624,6 +1084,10 @@ parse_options (int argc, char **argv)
 	case JSON: check_json (); break;
 	case DATA: check_data (); break;
         case STRSEP: check_strsep(); break;
+	case KERNELS: check_kernels (); break;
+	case CHARSET_BENCHMARK: charset_benchmark (); break;
+	case MATCHER: check_matcher (); break;
+	case TEXT_INDEX: check_text_index (); break;
 	default:
 	  print_usage ();
 	  exit (1);
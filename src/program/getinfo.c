@@ -5,18 +5,22 @@
 static fz_context *ctx;
 static char *pdf_filename;
 static FILE *output;
+static int jobs;
+static int n_files;
+static char **files;
 
 static struct option longopts[] = {
   {"help", no_argument, NULL, 'h'},
   {"usage", no_argument, NULL, 'u'},
   {"default-filename", no_argument, NULL, 'd'},
+  {"jobs", required_argument, NULL, 'j'},
   {NULL, 0, NULL, 0}
 };
 
 static void
 print_usage ()
 {
-  printf ("Usage: %s [OPTIONS] PDF_FILE\n", pdfout_program_name);
+  printf ("Usage: %s [OPTIONS] PDF_FILE...\n", pdfout_program_name);
 }
 
 static void
@@ -25,9 +29,13 @@ print_help ()
   print_usage ();
   puts ("\
 Dump info dict as JSON to standard output.\n\
+\n\
+With more than one PDF_FILE, or with PDF_FILE '-' to read the file names\n\
+from standard input, write one JSON object per line and file.\n\
 \n\
  Options:\n\
   -d, --default-filename     Write output to PDF_FILE.info\n\
+  -j, --jobs=N               Process N files in parallel\n\
 \n\
  general options:\n\
   -h, --help                 Give this help list\n\
@@ -40,7 +48,8 @@ parse_options (int argc, char **argv)
 {
   int optc;
   bool use_default_filename = false;
-  while ((optc = getopt_long (argc, argv, "hud", longopts, NULL)) != -1)
+  jobs = pdfout_pool_default_jobs ();
+  while ((optc = getopt_long (argc, argv, "hudj:", longopts, NULL)) != -1)
     {
       switch (optc)
 	{
@@ -53,6 +62,9 @@ parse_options (int argc, char **argv)
 	case 'd':
 	  use_default_filename = true;
 	  break;
+	case 'j':
+	  jobs = pdfout_pool_parse_jobs (ctx, optarg);
+	  break;
 	default:
 	  print_usage ();
 	  exit (1);
@@ -65,6 +77,11 @@ parse_options (int argc, char **argv)
       exit (1);
     }
   pdf_filename = argv[optind];
+  n_files = argc - optind;
+  files = &argv[optind];
+
+  if (use_default_filename && pdfout_batch_wanted (n_files, files))
+    pdfout_throw (ctx, "option '--default-filename' needs a single PDF_FILE");
 
   if (use_default_filename)
     output = open_default_write_file (ctx, pdf_filename, ".info");
@@ -72,6 +89,12 @@ parse_options (int argc, char **argv)
     output = stdout;
 }
 
+static pdfout_data *
+get_info (fz_context *ctx, pdf_document *doc)
+{
+  return pdfout_info_dict_get (ctx, doc);
+}
+
 void
 pdfout_command_getinfo (fz_context *ctx_arg, int argc, char **argv)
 {
@@ -81,6 +104,10 @@ pdfout_command_getinfo (fz_context *ctx_arg, int argc, char **argv)
   ctx = ctx_arg;
 
   parse_options (argc, argv);
+
+  if (pdfout_batch_wanted (n_files, files))
+    exit (pdfout_batch_run (ctx, n_files, files, jobs, get_info, output)
+	  ? 1 : 0);
   
   doc = pdf_open_document (ctx, pdf_filename);
 
@@ -5,19 +5,23 @@ static fz_context *ctx;
 static char *pdf_filename;
 static FILE *output;
 static bool use_wysiwyg;
+static int jobs;
+static int n_files;
+static char **files;
 
 static struct option longopts[] = {
   {"help", no_argument, NULL, 'h'},
   {"usage", no_argument, NULL, 'u'},
   {"default-filename", no_argument, NULL, 'd'},
   {"wysiwyg", no_argument, NULL, 'w'},
+  {"jobs", required_argument, NULL, 'j'},
   {NULL, 0, NULL, 0}
 };
 
 static void
 print_usage ()
 {
-  printf ("Usage: %s [OPTIONS] PDF_FILE\n", pdfout_program_name);
+  printf ("Usage: %s [OPTIONS] PDF_FILE...\n", pdfout_program_name);
 }
 
 static void
@@ -26,10 +30,14 @@ print_help ()
   print_usage ();
   puts ("\
 Dump outline as JSON to standard output.\n\
+\n\
+With more than one PDF_FILE, or with PDF_FILE '-' to read the file names\n\
+from standard input, write one JSON object per line and file.\n\
 \n\
  Options:\n\
   -d, --default-filename     Write output to PDF_FILE.outline\n\
   -w, --wysiwyg              Use wysiwyg format\n\
+  -j, --jobs=N               Process N files in parallel\n\
 \n\
  general options:\n\
   -h, --help                 Give this help list\n\
@@ -42,7 +50,8 @@ parse_options (int argc, char **argv)
 {
   int optc;
   bool use_default_filename = false;
-  while ((optc = getopt_long (argc, argv, "hudw", longopts, NULL)) != -1)
+  jobs = pdfout_pool_default_jobs ();
+  while ((optc = getopt_long (argc, argv, "hudwj:", longopts, NULL)) != -1)
     {
       switch (optc)
 	{
@@ -58,6 +67,9 @@ parse_options (int argc, char **argv)
 	case 'w':
 	  use_wysiwyg = true;
 	  break;
+	case 'j':
+	  jobs = pdfout_pool_parse_jobs (ctx, optarg);
+	  break;
 	default:
 	  print_usage ();
 	  exit (1);
@@ -70,6 +82,17 @@ parse_options (int argc, char **argv)
       exit (1);
     }
   pdf_filename = argv[optind];
+  n_files = argc - optind;
+  files = &argv[optind];
+
+  if (pdfout_batch_wanted (n_files, files))
+    {
+      if (use_default_filename)
+	pdfout_throw (ctx,
+		      "option '--default-filename' needs a single PDF_FILE");
+      if (use_wysiwyg)
+	pdfout_throw (ctx, "option '--wysiwyg' needs a single PDF_FILE");
+    }
 
   if (use_default_filename)
     output = open_default_write_file (ctx, pdf_filename, ".outline");
@@ -77,17 +100,24 @@ parse_options (int argc, char **argv)
     output = stdout;
 }
 
+static pdfout_data *
+get_outline (fz_context *ctx, pdf_document *doc)
+{
+  return pdfout_outline_get (ctx, doc);
+}
+
 void
 pdfout_command_getoutline (fz_context *ctx_arg, int argc, char **argv)
 {
   ctx = ctx_arg;
 
   parse_options (argc, argv);
+
+  if (pdfout_batch_wanted (n_files, files))
+    exit (pdfout_batch_run (ctx, n_files, files, jobs, get_outline, output)
+	  ? 1 : 0);
   
   pdf_document *doc = pdf_open_document (ctx, pdf_filename);
-
-  pdfout_data *outline = pdfout_outline_get (ctx, doc);
-  pdf_drop_document (ctx, doc);
   
   fz_output *out = fz_new_output_with_file_ptr (ctx, output, false);
 
@@ -97,9 +127,9 @@ pdfout_command_getoutline (fz_context *ctx_arg, int argc, char **argv)
   else
     emitter = pdfout_emitter_json_new (ctx, out);
 
-  pdfout_emitter_emit (ctx, emitter, outline);
+  pdfout_outline_emit (ctx, doc, emitter);
   
-  pdfout_data_drop (ctx, outline);
+  pdfout_emitter_drop (ctx, emitter);
   fz_drop_output (ctx, out);
+  pdf_drop_document (ctx, doc);
 }
-
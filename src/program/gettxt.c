@@ -5,12 +5,20 @@ static fz_context *ctx;
 static char *pdf_filename;
 static FILE *output;
 static char *page_range;
+static char *encoding;
+static int jobs = 1;
+static bool use_json;
+static pdfout_text_granularity granularity = PDFOUT_TEXT_LINE;
 
 static struct option longopts[] = {
   {"help", no_argument, NULL, 'h'},
   {"usage", no_argument, NULL, 'u'},
   {"default-filename", no_argument, NULL, 'd'},
   {"page-range", required_argument, NULL, 'p'},
+  {"encoding", required_argument, NULL, 'e'},
+  {"jobs", required_argument, NULL, 'j'},
+  {"json", no_argument, NULL, 'J'},
+  {"granularity", required_argument, NULL, 'g'},
   {NULL, 0, NULL, 0}
 };
 
@@ -28,9 +36,19 @@ print_help ()
 Extract text and print it to stdout.\n\
 \n\
  Options:\n\
-  -d, --default-filename     Write output to PDF_FILE.txt\n\
+  -d, --default-filename     Write output to PDF_FILE.txt, or PDF_FILE.json\n\
+                             with --json\n\
   -p, --page-range=PAGE1[-PAGE2][,PAGE3[-PAGE4]...]\n\
                              Only print text for the specified page ranges\n\
+                             Pages are page numbers or page labels,\n\
+                             numeric labels need the prefix 'label:'\n\
+  -e, --encoding=ENCODING    Convert output to ENCODING, e.g. UTF-16\n\
+                             (default: UTF-8)\n\
+  -j, --jobs=N               Extract N pages in parallel (default: 1)\n\
+      --json                 Print blocks and lines with bounding boxes\n\
+                             as JSON, one hash per page\n\
+  -g, --granularity=LEVEL    Level of detail for --json: block, line (the\n\
+                             default), word or char.  Implies --json\n\
 \n\
  general options:\n\
   -h, --help                 Give this help list\n\
@@ -43,7 +61,10 @@ parse_options (int argc, char **argv)
 {
   int optc;
   bool use_default_filename = false;
-  while ((optc = getopt_long (argc, argv, "hudp:", longopts, NULL)) != -1)
+  static const char *granularities[] = {"block", "line", "word", "char", NULL};
+  int level;
+  while ((optc = getopt_long (argc, argv, "hudp:e:j:g:", longopts, NULL))
+	 != -1)
     {
       switch (optc)
 	{
@@ -59,6 +80,22 @@ parse_options (int argc, char **argv)
 	case 'p':
 	  page_range = optarg;
 	  break;
+	case 'e':
+	  encoding = optarg;
+	  break;
+	case 'j':
+	  jobs = pdfout_pool_parse_jobs (ctx, optarg);
+	  break;
+	case 'J':
+	  use_json = true;
+	  break;
+	case 'g':
+	  level = strmatch (optarg, granularities);
+	  if (level < 0)
+	    pdfout_throw (ctx, "invalid granularity '%s'", optarg);
+	  granularity = PDFOUT_TEXT_BLOCK + level;
+	  use_json = true;
+	  break;
 	default:
 	  print_usage ();
 	  exit (1);
@@ -72,16 +109,176 @@ parse_options (int argc, char **argv)
     }
   pdf_filename = argv[optind];
 
+  if (use_json && encoding)
+    pdfout_throw (ctx, "option '--encoding' cannot be used with '--json'");
+
   if (use_default_filename)
-    output = open_default_write_file (ctx, pdf_filename, ".txt");
+    output = open_default_write_file (ctx, pdf_filename,
+				      use_json ? ".json" : ".txt");
   else
     output = stdout;
 }
 
+/* Parallel extraction.  Each worker opens its own copy of the document
+   and extracts pages into buffers, which are written in page order.  */
+
+typedef struct {
+  /* Zero-based page numbers, in output order.  */
+  int *pages;
+  fz_output *out;
+  /* With --json.  */
+  pdfout_emitter *emitter;
+} text_job;
+
+typedef struct {
+  pdf_document *doc;
+  pdfout_text_session *session;
+} text_worker;
+
+static void
+text_worker_drop (fz_context *ctx, void *worker)
+{
+  text_worker *w = worker;
+  pdfout_text_session_drop (ctx, w->session);
+  pdf_drop_document (ctx, w->doc);
+  free (w);
+}
+
+static void *
+text_worker_new (fz_context *ctx, void *arg)
+{
+  text_worker *w = fz_malloc_struct (ctx, text_worker);
+
+  fz_try (ctx)
+  {
+    w->doc = pdf_open_document (ctx, pdf_filename);
+    w->session = pdfout_text_session_new (ctx, w->doc);
+  }
+  fz_catch (ctx)
+  {
+    text_worker_drop (ctx, w);
+    fz_rethrow (ctx);
+  }
+
+  return w;
+}
+
+static void *
+text_run (fz_context *ctx, void *arg, void *worker, int i)
+{
+  text_job *job = arg;
+  text_worker *w = worker;
+  fz_buffer *text = pdfout_text_session_extract (ctx, w->session,
+						 job->pages[i]);
+
+  /* The session buffer is reused for the next page.  */
+  fz_buffer *buf = fz_new_buffer (ctx, text->len + 1);
+  fz_write_buffer (ctx, buf, text->data, text->len);
+  return buf;
+}
+
+static void
+text_drop_result (fz_context *ctx, void *result)
+{
+  fz_drop_buffer (ctx, result);
+}
+
+static bool
+text_consume (fz_context *ctx, void *arg, int i, void *result,
+	      const char *error)
+{
+  text_job *job = arg;
+  fz_buffer *buf = result;
+
+  if (error)
+    pdfout_throw (ctx, "page %d: %s", job->pages[i] + 1, error);
+  fz_write (ctx, job->out, buf->data, buf->len);
+  return true;
+}
+
+static const pdfout_pool_ops text_ops = {
+  text_worker_new, text_worker_drop, text_run, text_drop_result,
+  text_consume
+};
+
+/* With --json, the workers collect each page in a data tree.  */
+
+static void *
+json_run (fz_context *ctx, void *arg, void *worker, int i)
+{
+  text_job *job = arg;
+  text_worker *w = worker;
+  pdfout_emitter *emitter = pdfout_emitter_data_new (ctx);
+  pdfout_data *page = NULL;
+
+  fz_try (ctx)
+  {
+    pdfout_text_session_emit_page (ctx, w->session, job->pages[i],
+				   granularity, emitter);
+    page = pdfout_emitter_data_result (ctx, emitter);
+  }
+  fz_always (ctx)
+    pdfout_emitter_drop (ctx, emitter);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return page;
+}
+
+static void
+json_drop_result (fz_context *ctx, void *result)
+{
+  pdfout_data_drop (ctx, result);
+}
+
+static bool
+json_consume (fz_context *ctx, void *arg, int i, void *result,
+	      const char *error)
+{
+  text_job *job = arg;
+
+  if (error)
+    pdfout_throw (ctx, "page %d: %s", job->pages[i] + 1, error);
+  pdfout_emitter_emit_events (ctx, job->emitter, result);
+  return true;
+}
+
+static const pdfout_pool_ops json_ops = {
+  text_worker_new, text_worker_drop, json_run, json_drop_result,
+  json_consume
+};
+
+static void
+get_pages_parallel (fz_context *ctx, int *ranges, fz_output *out,
+		    pdfout_emitter *emitter)
+{
+  text_job job = { NULL, out, emitter };
+  int n = 0;
+
+  for (int *r = ranges; r[0]; r += 2)
+    n += r[1] - r[0] + 1;
+
+  job.pages = fz_malloc_array (ctx, n, sizeof *job.pages);
+  n = 0;
+  for (int *r = ranges; r[0]; r += 2)
+    for (int i = r[0]; i <= r[1]; ++i)
+      job.pages[n++] = i - 1;
+
+  fz_try (ctx)
+    pdfout_pool_run (ctx, emitter ? &json_ops : &text_ops, &job, n, jobs);
+  fz_always (ctx)
+    free (job.pages);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
 void
 pdfout_command_gettxt (fz_context *ctx_arg, int argc, char **argv)
 {
   pdf_document *doc;
+  fz_output *out, *conv_out = NULL;
+  pdfout_emitter *emitter = NULL;
+  pdfout_text_session *session;
   int  i, page_count;
   int *pages;
 
@@ -100,13 +297,49 @@ pdfout_command_gettxt (fz_context *ctx_arg, int argc, char **argv)
     pages[0] = 1; pages[1] = page_count; pages[2] = 0;
   }
   else
-    pages = pdfout_parse_page_range (ctx, page_range, page_count);
+    pages = pdfout_parse_page_range (ctx, page_range, doc);
   
 
-  for (pages_ptr = pages; pages_ptr[0]; pages_ptr += 2)
-    for (i = pages_ptr[0]; i <= pages_ptr[1]; ++i)
-      pdfout_text_get_page (output, ctx, doc, i - 1);
+  out = fz_new_output_with_file_ptr (ctx, output, false);
+  if (encoding)
+    {
+      /* Convert on the fly, without buffering whole pages.  */
+      conv_out = pdfout_new_char_conv_output (ctx, out, "UTF-8", encoding);
+    }
+
+  if (use_json)
+    {
+      /* Stream the pages into one array.  */
+      emitter = pdfout_emitter_json_new (ctx, out);
+      pdfout_emitter_array_start (ctx, emitter);
+    }
+
+  if (jobs > 1)
+    get_pages_parallel (ctx, pages, conv_out ? conv_out : out, emitter);
+  else
+    {
+      session = pdfout_text_session_new (ctx, doc);
+      for (pages_ptr = pages; pages_ptr[0]; pages_ptr += 2)
+	for (i = pages_ptr[0]; i <= pages_ptr[1]; ++i)
+	  {
+	    if (emitter)
+	      pdfout_text_session_emit_page (ctx, session, i - 1, granularity,
+					     emitter);
+	    else
+	      pdfout_text_session_write_page (ctx, session, i - 1,
+					      conv_out ? conv_out : out);
+	  }
+      pdfout_text_session_drop (ctx, session);
+    }
+
+  if (emitter)
+    {
+      pdfout_emitter_array_end (ctx, emitter);
+      pdfout_emitter_drop (ctx, emitter);
+    }
 
+  fz_drop_output (ctx, conv_out);
+  fz_drop_output (ctx, out);
   free (pages);
   pdf_drop_document (ctx, doc);
 }
@@ -0,0 +1,577 @@
+#include "common.h"
+#include "shared.h"
+
+static fz_context *ctx;
+static char *pattern;
+static pdfout_match_syntax syntax = PDFOUT_MATCH_BASIC;
+static bool ignore_case;
+static bool list_files;
+static bool quiet;
+static bool show_labels;
+/* Negative for no limit.  */
+static int max_count = -1;
+static int jobs;
+
+static struct option longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {"basic-regexp", no_argument, NULL, 'G'},
+  {"extended-regexp", no_argument, NULL, 'E'},
+  {"fixed-strings", no_argument, NULL, 'F'},
+  {"ignore-case", no_argument, NULL, 'i'},
+  {"files-with-matches", no_argument, NULL, 'l'},
+  {"quiet", no_argument, NULL, 'q'},
+  {"silent", no_argument, NULL, 'q'},
+  {"max-count", required_argument, NULL, 'm'},
+  {"page-label", no_argument, NULL, 'L'},
+  {"jobs", required_argument, NULL, 'j'},
+  {NULL, 0, NULL, 0}
+};
+
+static void
+print_usage ()
+{
+  printf ("Usage: %s [OPTIONS] PATTERN PDF_FILE...\n", pdfout_program_name);
+}
+
+static void
+print_help ()
+{
+  print_usage ();
+  puts ("\
+Search for PATTERN in the text of each PDF_FILE.\n\
+Matching lines are printed as PAGE:LINE, prefixed with the file name\n\
+if there is more than one file.\n\
+Exit status is 0 if a line matched, 1 if none matched and 2 on errors.\n\
+\n\
+ Options:\n\
+  -G, --basic-regexp         PATTERN is a basic regular expression\n\
+                             (the default)\n\
+  -E, --extended-regexp      PATTERN is an extended regular expression\n\
+  -F, --fixed-strings        PATTERN is a string\n\
+  -i, --ignore-case          Ignore case distinctions\n\
+  -l, --files-with-matches   Only print the names of matching files\n\
+  -q, --quiet, --silent      Print nothing, stop at the first match\n\
+  -m, --max-count=NUM        Stop after NUM matching lines per file\n\
+      --page-label           Print PAGE:LABEL:LINE, where LABEL is the\n\
+                             page label\n\
+  -j, --jobs=N               Search N files, or the pages of a single\n\
+                             file, in parallel\n\
+                             (default: number of processors)\n\
+\n\
+ general options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+static void
+parse_options (int argc, char **argv)
+{
+  int optc;
+  jobs = pdfout_pool_default_jobs ();
+  while ((optc = getopt_long (argc, argv, "huGEFilqm:j:", longopts, NULL))
+	 != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	case 'u':
+	  print_usage ();
+	  exit (0);
+	case 'G':
+	  syntax = PDFOUT_MATCH_BASIC;
+	  break;
+	case 'E':
+	  syntax = PDFOUT_MATCH_EXTENDED;
+	  break;
+	case 'F':
+	  syntax = PDFOUT_MATCH_FIXED;
+	  break;
+	case 'i':
+	  ignore_case = true;
+	  break;
+	case 'l':
+	  list_files = true;
+	  break;
+	case 'q':
+	  quiet = true;
+	  break;
+	case 'm':
+	  max_count = pdfout_strtoint_null (ctx, optarg);
+	  break;
+	case 'L':
+	  show_labels = true;
+	  break;
+	case 'j':
+	  jobs = pdfout_pool_parse_jobs (ctx, optarg);
+	  break;
+	default:
+	  print_usage ();
+	  exit (2);
+	}
+    }
+
+  if (argc - 2 < optind)
+    {
+      print_usage ();
+      exit (2);
+    }
+  pattern = argv[optind];
+}
+
+/* The worker pool searches several files in parallel, one file per item,
+   so that each file is opened and parsed once.  A single file is split
+   into its pages instead.  Either way, each worker has its own text
+   session and matcher, and the output is printed in order by the main
+   thread, which is also where the search stops for -l, -q and -m.  */
+
+typedef struct {
+  pdf_document *doc;
+  pdfout_text_session *session;
+  pdfout_matcher *matcher;
+  fz_buffer *label;
+} grep_worker;
+
+static void
+grep_worker_drop (fz_context *ctx, void *worker)
+{
+  grep_worker *w = worker;
+  fz_drop_buffer (ctx, w->label);
+  pdfout_matcher_drop (ctx, w->matcher);
+  pdfout_text_session_drop (ctx, w->session);
+  pdf_drop_document (ctx, w->doc);
+  free (w);
+}
+
+static fz_buffer *
+extract_page (fz_context *ctx, grep_worker *w, int page)
+{
+  fz_buffer *text = pdfout_text_session_extract (ctx, w->session, page);
+  /* Drop the form feed line which ends the page.  */
+  text->len -= 2;
+  return text;
+}
+
+/* Write the prefix of a matching line on zero-based PAGE to OUT.  */
+static void
+print_prefix (fz_context *ctx, fz_output *out, const char *filename,
+	      pdfout_page_labels *labels, fz_buffer *label, int page)
+{
+  char number[16];
+
+  if (filename)
+    {
+      fz_puts (ctx, out, filename);
+      fz_putc (ctx, out, ':');
+    }
+  pdfout_snprintf (ctx, number, "%d:", page + 1);
+  fz_puts (ctx, out, number);
+  if (show_labels)
+    {
+      pdfout_page_labels_resolve (ctx, labels, page, label);
+      fz_write (ctx, out, label->data, label->len);
+      fz_putc (ctx, out, ':');
+    }
+}
+
+/* Searching the pages of a single file.  */
+
+typedef struct {
+  const char *filename;
+  pdfout_page_labels *labels;
+  fz_output *out;
+  fz_buffer *label;
+  /* Number of printed lines.  */
+  int count;
+  bool matched;
+  bool failed;
+} grep_job;
+
+static void *
+grep_worker_new (fz_context *ctx, void *arg)
+{
+  grep_job *job = arg;
+  grep_worker *w = fz_malloc_struct (ctx, grep_worker);
+
+  fz_try (ctx)
+  {
+    w->doc = pdf_open_document (ctx, job->filename);
+    w->session = pdfout_text_session_new (ctx, w->doc);
+    w->matcher = pdfout_matcher_new (ctx, pattern, syntax, ignore_case);
+  }
+  fz_catch (ctx)
+  {
+    grep_worker_drop (ctx, w);
+    fz_rethrow (ctx);
+  }
+
+  return w;
+}
+
+/* Return the matching lines of page I, each terminated by a newline, or
+   NULL if there are none.  */
+static void *
+grep_run (fz_context *ctx, void *arg, void *worker, int i)
+{
+  grep_worker *w = worker;
+  fz_buffer *text = extract_page (ctx, w, i);
+  fz_buffer *lines = NULL;
+  int pos = 0, start, len, count = 0;
+
+  fz_var (lines);
+  fz_try (ctx)
+  {
+    while ((start = pdfout_matcher_next_line (ctx, w->matcher, text,
+					      &pos, &len)) >= 0)
+      {
+	if (lines == NULL)
+	  lines = fz_new_buffer (ctx, len + 1);
+	fz_write_buffer (ctx, lines, text->data + start, len);
+	fz_write_buffer_byte (ctx, lines, '\n');
+	/* The rest of the page is not needed.  */
+	if (list_files || quiet || ++count == max_count)
+	  break;
+      }
+  }
+  fz_catch (ctx)
+  {
+    fz_drop_buffer (ctx, lines);
+    fz_rethrow (ctx);
+  }
+
+  return lines;
+}
+
+static void
+grep_drop_result (fz_context *ctx, void *result)
+{
+  fz_drop_buffer (ctx, result);
+}
+
+static bool
+grep_consume (fz_context *ctx, void *arg, int i, void *result,
+	      const char *error)
+{
+  grep_job *job = arg;
+  fz_buffer *lines = result;
+
+  if (error)
+    {
+      if (quiet == false)
+	pdfout_warn (ctx, "%s: page %d: %s", job->filename, i + 1, error);
+      job->failed = true;
+      return true;
+    }
+  if (lines == NULL)
+    return true;
+
+  job->matched = true;
+  if (quiet)
+    return false;
+  if (list_files)
+    {
+      fz_puts (ctx, job->out, job->filename);
+      fz_putc (ctx, job->out, '\n');
+      return false;
+    }
+
+  const char *p = (const char *) lines->data;
+  const char *end = p + lines->len;
+  while (p < end)
+    {
+      const char *newline = memchr (p, '\n', end - p);
+      print_prefix (ctx, job->out, NULL, job->labels, job->label, i);
+      fz_write (ctx, job->out, p, newline + 1 - p);
+      p = newline + 1;
+      if (++job->count == max_count)
+	return false;
+    }
+  return true;
+}
+
+static const pdfout_pool_ops grep_ops = {
+  grep_worker_new, grep_worker_drop, grep_run, grep_drop_result,
+  grep_consume
+};
+
+static void
+grep_file (fz_context *ctx, grep_job *job)
+{
+  pdf_document *doc = pdf_open_document (ctx, job->filename);
+
+  fz_try (ctx)
+  {
+    int page_count = pdf_count_pages (ctx, doc);
+    if (show_labels)
+      job->labels = pdfout_page_labels_new (ctx, doc);
+    pdfout_pool_run (ctx, &grep_ops, job, page_count, jobs);
+  }
+  fz_always (ctx)
+  {
+    pdfout_page_labels_drop (ctx, job->labels);
+    job->labels = NULL;
+    pdf_drop_document (ctx, doc);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+/* Searching several files.  */
+
+typedef struct {
+  char **filenames;
+  fz_output *out;
+  bool matched;
+  bool failed;
+} grep_files_job;
+
+typedef struct {
+  /* The output lines, with prefixes.  */
+  fz_buffer *lines;
+  /* The warnings about pages, one per line.  */
+  fz_buffer *warnings;
+  bool matched;
+} grep_file_result;
+
+static void *
+grep_files_worker_new (fz_context *ctx, void *arg)
+{
+  grep_worker *w = fz_malloc_struct (ctx, grep_worker);
+
+  fz_try (ctx)
+  {
+    w->matcher = pdfout_matcher_new (ctx, pattern, syntax, ignore_case);
+    w->label = fz_new_buffer (ctx, 32);
+  }
+  fz_catch (ctx)
+  {
+    grep_worker_drop (ctx, w);
+    fz_rethrow (ctx);
+  }
+
+  return w;
+}
+
+static void
+grep_files_drop_result (fz_context *ctx, void *result)
+{
+  grep_file_result *r = result;
+  fz_drop_buffer (ctx, r->lines);
+  fz_drop_buffer (ctx, r->warnings);
+  free (r);
+}
+
+/* Search page PAGE of the open document of W.  Return false if the rest
+   of the file is not needed.  */
+static bool
+grep_page (fz_context *ctx, grep_worker *w, grep_file_result *r,
+	   fz_output *out, const char *filename, pdfout_page_labels *labels,
+	   int page, int *count)
+{
+  fz_buffer *text = extract_page (ctx, w, page);
+  int pos = 0, start, len;
+
+  while ((start = pdfout_matcher_next_line (ctx, w->matcher, text,
+					    &pos, &len)) >= 0)
+    {
+      r->matched = true;
+      if (list_files || quiet)
+	return false;
+      print_prefix (ctx, out, filename, labels, w->label, page);
+      fz_write (ctx, out, text->data + start, len);
+      fz_putc (ctx, out, '\n');
+      if (++*count == max_count)
+	return false;
+    }
+  return true;
+}
+
+/* Search all pages of file I, one after the other.  */
+static void *
+grep_files_run (fz_context *ctx, void *arg, void *worker, int i)
+{
+  grep_files_job *job = arg;
+  grep_worker *w = worker;
+  const char *filename = job->filenames[i];
+  grep_file_result *r = fz_malloc_struct (ctx, grep_file_result);
+  pdfout_page_labels *labels = NULL;
+  fz_output *out = NULL;
+
+  fz_var (labels);
+  fz_var (out);
+  fz_try (ctx)
+  {
+    r->lines = fz_new_buffer (ctx, 256);
+    out = fz_new_output_with_buffer (ctx, r->lines);
+    w->doc = pdf_open_document (ctx, filename);
+    w->session = pdfout_text_session_new (ctx, w->doc);
+    if (show_labels)
+      labels = pdfout_page_labels_new (ctx, w->doc);
+
+    int page_count = pdf_count_pages (ctx, w->doc);
+    int count = 0;
+    bool more = true;
+    fz_var (more);
+    for (int page = 0; page < page_count && more; ++page)
+      {
+	fz_try (ctx)
+	  more = grep_page (ctx, w, r, out, filename, labels, page, &count);
+	fz_catch (ctx)
+	{
+	  if (r->warnings == NULL)
+	    r->warnings = fz_new_buffer (ctx, 64);
+	  char number[16];
+	  pdfout_snprintf (ctx, number, ": page %d: ", page + 1);
+	  const char *msg = fz_caught_message (ctx);
+	  fz_write_buffer (ctx, r->warnings, filename, strlen (filename));
+	  fz_write_buffer (ctx, r->warnings, number, strlen (number));
+	  fz_write_buffer (ctx, r->warnings, msg, strlen (msg));
+	  fz_write_buffer_byte (ctx, r->warnings, '\n');
+	}
+      }
+  }
+  fz_always (ctx)
+  {
+    fz_drop_output (ctx, out);
+    pdfout_page_labels_drop (ctx, labels);
+    pdfout_text_session_drop (ctx, w->session);
+    w->session = NULL;
+    pdf_drop_document (ctx, w->doc);
+    w->doc = NULL;
+  }
+  fz_catch (ctx)
+  {
+    grep_files_drop_result (ctx, r);
+    fz_rethrow (ctx);
+  }
+
+  return r;
+}
+
+static bool
+grep_files_consume (fz_context *ctx, void *arg, int i, void *result,
+		    const char *error)
+{
+  grep_files_job *job = arg;
+  grep_file_result *r = result;
+  const char *filename = job->filenames[i];
+
+  if (error)
+    {
+      if (quiet == false)
+	pdfout_warn (ctx, "%s: %s", filename, error);
+      job->failed = true;
+      return true;
+    }
+
+  if (r->warnings)
+    {
+      job->failed = true;
+      const char *p = (const char *) r->warnings->data;
+      const char *end = p + r->warnings->len;
+      while (quiet == false && p < end)
+	{
+	  const char *newline = memchr (p, '\n', end - p);
+	  pdfout_warn (ctx, "%.*s", (int) (newline - p), p);
+	  p = newline + 1;
+	}
+    }
+
+  if (r->matched == false)
+    return true;
+  job->matched = true;
+  if (quiet)
+    return false;
+  if (list_files)
+    {
+      fz_puts (ctx, job->out, filename);
+      fz_putc (ctx, job->out, '\n');
+    }
+  else
+    fz_write (ctx, job->out, r->lines->data, r->lines->len);
+  return true;
+}
+
+static const pdfout_pool_ops grep_files_ops = {
+  grep_files_worker_new, grep_worker_drop, grep_files_run,
+  grep_files_drop_result, grep_files_consume
+};
+
+void
+pdfout_command_grep (fz_context *ctx_arg, int argc, char **argv)
+{
+  grep_job job = { NULL };
+  bool matched = false, failed = false;
+  fz_output *out = NULL;
+
+  ctx = ctx_arg;
+
+  parse_options (argc, argv);
+
+  fz_try (ctx)
+  {
+    /* Report an invalid pattern once, before any file is opened.  */
+    pdfout_matcher_drop (ctx, pdfout_matcher_new (ctx, pattern, syntax,
+						  ignore_case));
+    out = fz_new_output_with_file_ptr (ctx, stdout, false);
+  }
+  fz_catch (ctx)
+  {
+    fprintf (stderr, "%s: %s\n", pdfout_program_name,
+	     fz_caught_message (ctx));
+    exit (2);
+  }
+
+  int n_files = argc - optind - 1;
+  char **filenames = argv + optind + 1;
+  if (max_count == 0)
+    {
+      fz_drop_output (ctx, out);
+      exit (1);
+    }
+
+  if (n_files == 1)
+    {
+      job.filename = filenames[0];
+      job.out = out;
+
+      fz_try (ctx)
+      {
+	job.label = fz_new_buffer (ctx, 32);
+	grep_file (ctx, &job);
+      }
+      fz_catch (ctx)
+      {
+	if (quiet == false)
+	  pdfout_warn (ctx, "%s: %s", job.filename, fz_caught_message (ctx));
+	job.failed = true;
+      }
+      fz_drop_buffer (ctx, job.label);
+      matched = job.matched;
+      failed = job.failed;
+    }
+  else
+    {
+      grep_files_job files = { filenames, out };
+
+      fz_try (ctx)
+	pdfout_pool_run (ctx, &grep_files_ops, &files, n_files, jobs);
+      fz_catch (ctx)
+      {
+	if (quiet == false)
+	  pdfout_warn (ctx, "%s", fz_caught_message (ctx));
+	files.failed = true;
+      }
+      matched = files.matched;
+      failed = files.failed;
+    }
+
+  fz_drop_output (ctx, out);
+
+  if (matched && quiet)
+    exit (0);
+  exit (failed ? 2 : matched ? 0 : 1);
+}
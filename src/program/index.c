@@ -0,0 +1,777 @@
+#include "common.h"
+#include "shared.h"
+#include <sys/stat.h>
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <dirent.h>
+#endif
+
+static fz_context *ctx;
+static const char *index_filename = "pdfout.index";
+static int jobs;
+static bool full_rebuild;
+static bool list_files;
+
+static void
+print_usage ()
+{
+  printf ("Usage: %s build [OPTIONS] DIR...\n"
+	  "  or:  %s search [OPTIONS] QUERY...\n", pdfout_program_name,
+	  pdfout_program_name);
+}
+
+static void
+print_help ()
+{
+  print_usage ();
+  puts ("\
+Build and search a full text index of PDF files.\n\
+Try 'build --help' and 'search --help' for the options.\n\
+\n\
+ Options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+static struct option build_longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {"index", required_argument, NULL, 'f'},
+  {"jobs", required_argument, NULL, 'j'},
+  {"full", no_argument, NULL, 'F'},
+  {NULL, 0, NULL, 0}
+};
+
+static void
+print_build_usage ()
+{
+  printf ("Usage: %s [OPTIONS] DIR...\n", pdfout_program_name);
+}
+
+static void
+print_build_help ()
+{
+  print_build_usage ();
+  puts ("\
+Index the text of the PDF files in each DIR and its subdirectories.\n\
+A DIR may also be a single PDF file.\n\
+If the index exists, files whose size and modification time, or\n\
+contents, did not change are not read again.\n\
+\n\
+ Options:\n\
+  -f, --index=FILE           Index file (default: pdfout.index)\n\
+  -j, --jobs=N               Read N files in parallel\n\
+                             (default: number of processors)\n\
+      --full                 Read all files, even if the index exists\n\
+\n\
+ general options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+static void
+parse_build_options (int argc, char **argv)
+{
+  int optc;
+  jobs = pdfout_pool_default_jobs ();
+  while ((optc = getopt_long (argc, argv, "huf:j:", build_longopts, NULL))
+	 != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_build_help ();
+	  exit (0);
+	case 'u':
+	  print_build_usage ();
+	  exit (0);
+	case 'f':
+	  index_filename = optarg;
+	  break;
+	case 'j':
+	  jobs = pdfout_pool_parse_jobs (ctx, optarg);
+	  break;
+	case 'F':
+	  full_rebuild = true;
+	  break;
+	default:
+	  print_build_usage ();
+	  exit (1);
+	}
+    }
+
+  if (argc - 1 < optind)
+    {
+      print_build_usage ();
+      exit (1);
+    }
+}
+
+static struct option search_longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {"index", required_argument, NULL, 'f'},
+  {"files-with-matches", no_argument, NULL, 'l'},
+  {NULL, 0, NULL, 0}
+};
+
+static void
+print_search_usage ()
+{
+  printf ("Usage: %s [OPTIONS] QUERY...\n", pdfout_program_name);
+}
+
+static void
+print_search_help ()
+{
+  print_search_usage ();
+  puts ("\
+Print the pages which contain all words of QUERY as FILE:PAGE.\n\
+Case is ignored.\n\
+Exit status is 0 if a page matched, 1 if none matched and 2 on errors.\n\
+\n\
+ Options:\n\
+  -f, --index=FILE           Index file (default: pdfout.index)\n\
+  -l, --files-with-matches   Only print the names of matching files\n\
+\n\
+ general options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+static void
+parse_search_options (int argc, char **argv)
+{
+  int optc;
+  while ((optc = getopt_long (argc, argv, "huf:l", search_longopts, NULL))
+	 != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_search_help ();
+	  exit (0);
+	case 'u':
+	  print_search_usage ();
+	  exit (0);
+	case 'f':
+	  index_filename = optarg;
+	  break;
+	case 'l':
+	  list_files = true;
+	  break;
+	default:
+	  print_search_usage ();
+	  exit (1);
+	}
+    }
+
+  if (argc - 1 < optind)
+    {
+      print_search_usage ();
+      exit (1);
+    }
+}
+
+/* Building.  */
+
+typedef struct {
+  char *name;
+  int64_t size, mtime;
+  /* Number in the old index, or -1.  */
+  int old;
+  /* Number in the builder.  */
+  int id;
+} source_file;
+
+typedef struct {
+  source_file *files;
+  int n_files, files_cap;
+  /* The files which need to be checked by the workers.  */
+  int *todo;
+  int n_todo;
+
+  pdfout_text_index *old;
+  /* For each file of OLD, its number in BUILDER, or -1.  */
+  int *old_map;
+  pdfout_text_index_builder *builder;
+  bool failed;
+} index_build;
+
+static bool
+has_pdf_suffix (const char *name)
+{
+  size_t len = strlen (name);
+  return len > 4 && name[len - 4] == '.'
+    && (name[len - 3] | 0x20) == 'p' && (name[len - 2] | 0x20) == 'd'
+    && (name[len - 1] | 0x20) == 'f';
+}
+
+static void
+add_source (fz_context *ctx, index_build *b, const char *name,
+	    struct stat *st)
+{
+  if (b->n_files == b->files_cap)
+    b->files = pdfout_x2nrealloc (ctx, b->files, &b->files_cap,
+				  source_file);
+  source_file *f = &b->files[b->n_files];
+  f->name = fz_strdup (ctx, name);
+  f->size = st->st_size;
+  f->mtime = st->st_mtime;
+  f->old = -1;
+  ++b->n_files;
+}
+
+static void collect_dir (fz_context *ctx, index_build *b, const char *path);
+
+/* Add NAME in the directory PATH if it is a PDF file, or the PDF files
+   below it if it is a directory.  */
+static void
+collect_entry (fz_context *ctx, index_build *b, const char *path,
+	       const char *name)
+{
+  size_t len = strlen (path) + strlen (name) + 2;
+  char *file = fz_malloc (ctx, len);
+  struct stat st;
+
+  fz_try (ctx)
+  {
+    pdfout_snprintf_imp (ctx, file, len, "%s/%s", path, name);
+#ifdef _WIN32
+    /* Links are skipped by the caller.  */
+    if (stat (file, &st) == 0)
+#else
+    if (lstat (file, &st) == 0)
+#endif
+      {
+	if (S_ISDIR (st.st_mode))
+	  collect_dir (ctx, b, file);
+	else if (has_pdf_suffix (file) && stat (file, &st) == 0
+		 && S_ISREG (st.st_mode))
+	  add_source (ctx, b, file, &st);
+      }
+  }
+  fz_always (ctx)
+    free (file);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static bool
+is_dot_dir (const char *name)
+{
+  return strcmp (name, ".") == 0 || strcmp (name, "..") == 0;
+}
+
+/* Add the PDF files below the directory PATH.  Symbolic links to
+   directories are not followed.  */
+#ifdef _WIN32
+
+static void
+collect_dir (fz_context *ctx, index_build *b, const char *path)
+{
+  size_t len = strlen (path) + 3;
+  char *pattern = fz_malloc (ctx, len);
+  WIN32_FIND_DATAA data;
+  HANDLE find = INVALID_HANDLE_VALUE;
+
+  fz_var (find);
+  fz_try (ctx)
+  {
+    pdfout_snprintf_imp (ctx, pattern, len, "%s/*", path);
+    find = FindFirstFileA (pattern, &data);
+  }
+  fz_always (ctx)
+    free (pattern);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  if (find == INVALID_HANDLE_VALUE)
+    pdfout_throw (ctx, "cannot open directory '%s'", path);
+
+  fz_try (ctx)
+  {
+    do
+      if (is_dot_dir (data.cFileName) == false
+	  && (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0)
+	collect_entry (ctx, b, path, data.cFileName);
+    while (FindNextFileA (find, &data));
+  }
+  fz_always (ctx)
+    FindClose (find);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+#else
+
+static void
+collect_dir (fz_context *ctx, index_build *b, const char *path)
+{
+  DIR *dir = opendir (path);
+
+  if (dir == NULL)
+    pdfout_throw_errno (ctx, "cannot open directory '%s'", path);
+
+  fz_try (ctx)
+  {
+    struct dirent *entry;
+    while ((entry = readdir (dir)))
+      if (is_dot_dir (entry->d_name) == false)
+	collect_entry (ctx, b, path, entry->d_name);
+  }
+  fz_always (ctx)
+    closedir (dir);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+#endif
+
+static int
+compare_sources (const void *a, const void *b)
+{
+  return strcmp (((const source_file *) a)->name,
+		 ((const source_file *) b)->name);
+}
+
+static void
+collect_sources (fz_context *ctx, index_build *b, int argc, char **argv)
+{
+  for (int i = 0; i < argc; ++i)
+    {
+      struct stat st;
+      if (stat (argv[i], &st))
+	pdfout_throw_errno (ctx, "cannot access '%s'", argv[i]);
+      if (S_ISDIR (st.st_mode))
+	{
+	  /* Avoid names like "dir//a.pdf".  */
+	  size_t len = strlen (argv[i]);
+	  while (len > 1 && argv[i][len - 1] == '/')
+	    argv[i][--len] = '\0';
+	  collect_dir (ctx, b, argv[i]);
+	}
+      else
+	add_source (ctx, b, argv[i], &st);
+    }
+
+  qsort (b->files, b->n_files, sizeof *b->files, compare_sources);
+
+  /* Drop duplicates, e.g. from overlapping arguments.  */
+  int len = 0;
+  for (int i = 0; i < b->n_files; ++i)
+    {
+      if (len && strcmp (b->files[len - 1].name, b->files[i].name) == 0)
+	free (b->files[i].name);
+      else
+	b->files[len++] = b->files[i];
+    }
+  b->n_files = len;
+}
+
+/* Decide which files need to be read, and add all files to the
+   builder.  */
+static void
+plan_build (fz_context *ctx, index_build *b)
+{
+  pdfout_hash *old_names = NULL;
+  int n_old = b->old ? pdfout_text_index_file_count (ctx, b->old) : 0;
+
+  b->old_map = fz_malloc_array (ctx, fz_maxi (n_old, 1),
+				sizeof *b->old_map);
+  b->todo = fz_malloc_array (ctx, fz_maxi (b->n_files, 1),
+			     sizeof *b->todo);
+
+  fz_var (old_names);
+  fz_try (ctx)
+  {
+    old_names = pdfout_hash_new (ctx);
+    for (int i = 0; i < n_old; ++i)
+      {
+	pdfout_text_index_file file;
+	pdfout_text_index_get_file (ctx, b->old, i, &file);
+	/* Entry numbers are file numbers.  */
+	if (pdfout_hash_insert (ctx, old_names, file.name, strlen (file.name),
+				NULL) == false)
+	  pdfout_throw (ctx, "duplicate file '%s' in text index", file.name);
+	b->old_map[i] = -1;
+      }
+
+    for (int i = 0; i < b->n_files; ++i)
+      {
+	source_file *f = &b->files[i];
+	pdfout_text_index_file file = {
+	  f->name, f->size, f->mtime
+	};
+	f->old = pdfout_hash_find (ctx, old_names, f->name,
+				   strlen (f->name));
+	if (f->old >= 0)
+	  {
+	    pdfout_text_index_file old;
+	    pdfout_text_index_get_file (ctx, b->old, f->old, &old);
+	    if (old.size == f->size && old.mtime == f->mtime)
+	      {
+		/* Unchanged, keep its terms.  */
+		file.page_count = old.page_count;
+		file.hash = old.hash;
+		f->id = pdfout_text_index_builder_add_file (ctx, b->builder,
+							    &file);
+		b->old_map[f->old] = f->id;
+		continue;
+	      }
+	  }
+	f->id = pdfout_text_index_builder_add_file (ctx, b->builder, &file);
+	b->todo[b->n_todo++] = i;
+      }
+  }
+  fz_always (ctx)
+    pdfout_hash_drop (ctx, old_names);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+/* A file read by a worker.  If its contents did not change, only the
+   hash is set.  */
+typedef struct {
+  uint64_t hash;
+  bool unchanged;
+  int page_count;
+  /* The text of all pages, page I ends at ENDS[I].  */
+  fz_buffer *text;
+  int *ends;
+} read_result;
+
+static void
+build_drop_result (fz_context *ctx, void *result)
+{
+  read_result *r = result;
+  fz_drop_buffer (ctx, r->text);
+  free (r->ends);
+  free (r);
+}
+
+static void
+read_pages (fz_context *ctx, read_result *r, pdf_document *doc)
+{
+  pdfout_text_session *session = pdfout_text_session_new (ctx, doc);
+
+  fz_try (ctx)
+  {
+    r->page_count = pdf_count_pages (ctx, doc);
+    r->ends = fz_malloc_array (ctx, fz_maxi (r->page_count, 1),
+			       sizeof *r->ends);
+    r->text = fz_new_buffer (ctx, 4096);
+    for (int i = 0; i < r->page_count; ++i)
+      {
+	fz_buffer *page = pdfout_text_session_extract (ctx, session, i);
+	fz_write_buffer (ctx, r->text, page->data, page->len);
+	r->ends[i] = r->text->len;
+      }
+  }
+  fz_always (ctx)
+    pdfout_text_session_drop (ctx, session);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static void *
+build_run (fz_context *ctx, void *arg, void *worker, int i)
+{
+  index_build *b = arg;
+  source_file *f = &b->files[b->todo[i]];
+  read_result *r = fz_malloc_struct (ctx, read_result);
+  pdf_document *doc = NULL;
+
+  fz_var (doc);
+  fz_try (ctx)
+  {
+    r->hash = pdfout_text_index_hash_file (ctx, f->name);
+    if (f->old >= 0)
+      {
+	/* E.g. copied or touched.  */
+	pdfout_text_index_file old;
+	pdfout_text_index_get_file (ctx, b->old, f->old, &old);
+	r->unchanged = old.size == f->size && old.hash == r->hash;
+      }
+    if (r->unchanged == false)
+      {
+	doc = pdf_open_document (ctx, f->name);
+	read_pages (ctx, r, doc);
+      }
+  }
+  fz_always (ctx)
+    pdf_drop_document (ctx, doc);
+  fz_catch (ctx)
+  {
+    build_drop_result (ctx, r);
+    fz_rethrow (ctx);
+  }
+
+  return r;
+}
+
+static bool
+build_consume (fz_context *ctx, void *arg, int i, void *result,
+	       const char *error)
+{
+  index_build *b = arg;
+  source_file *f = &b->files[b->todo[i]];
+  read_result *r = result;
+
+  if (error)
+    {
+      /* Left out of the index, so it is read again next time.  */
+      pdfout_warn (ctx, "%s: %s", f->name, error);
+      b->failed = true;
+      return true;
+    }
+
+  if (r->unchanged)
+    {
+      pdfout_text_index_file old;
+      pdfout_text_index_get_file (ctx, b->old, f->old, &old);
+      pdfout_text_index_builder_set_file (ctx, b->builder, f->id,
+					  old.page_count, r->hash);
+      b->old_map[f->old] = f->id;
+      return true;
+    }
+
+  pdfout_text_index_builder_set_file (ctx, b->builder, f->id,
+				      r->page_count, r->hash);
+  const char *text = (const char *) r->text->data;
+  for (int page = 0, start = 0; page < r->page_count; ++page)
+    {
+      pdfout_text_index_builder_add_text (ctx, b->builder, f->id, page,
+					  text + start,
+					  r->ends[page] - start);
+      start = r->ends[page];
+    }
+  return true;
+}
+
+static const pdfout_pool_ops build_ops = {
+  NULL, NULL, build_run, build_drop_result, build_consume
+};
+
+/* Write the index next to its final name and rename it, so that searches
+   never see a partial index.  */
+static void
+write_index (fz_context *ctx, index_build *b)
+{
+  size_t len = strlen (index_filename) + 5;
+  char *tmp_name = fz_malloc (ctx, len);
+  FILE *file = NULL;
+  fz_output *out = NULL;
+
+  fz_var (file);
+  fz_var (out);
+  fz_try (ctx)
+  {
+    pdfout_snprintf_imp (ctx, tmp_name, len, "%s.tmp", index_filename);
+    file = fz_fopen (tmp_name, "wb");
+    if (file == NULL)
+      pdfout_throw_errno (ctx, "cannot open '%s'", tmp_name);
+    out = fz_new_output_with_file_ptr (ctx, file, false);
+    pdfout_text_index_builder_write (ctx, b->builder, out);
+    fz_drop_output (ctx, out);
+    out = NULL;
+
+    FILE *f = file;
+    file = NULL;
+    if (fclose (f))
+      pdfout_throw_errno (ctx, "cannot write '%s'", tmp_name);
+#ifdef _WIN32
+    /* rename does not replace an existing file on Windows.  */
+    remove (index_filename);
+#endif
+    if (rename (tmp_name, index_filename))
+      pdfout_throw_errno (ctx, "cannot rename '%s' to '%s'", tmp_name,
+			  index_filename);
+  }
+  fz_always (ctx)
+  {
+    fz_drop_output (ctx, out);
+    if (file)
+      fclose (file);
+    free (tmp_name);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static void
+index_build_command (int argc, char **argv)
+{
+  index_build b = { NULL };
+
+  parse_build_options (argc, argv);
+
+  struct stat st;
+  if (full_rebuild == false && stat (index_filename, &st) == 0)
+    {
+      fz_try (ctx)
+	b.old = pdfout_text_index_open (ctx, index_filename);
+      fz_catch (ctx)
+	pdfout_warn (ctx, "%s: %s, reading all files", index_filename,
+		     fz_caught_message (ctx));
+    }
+
+  collect_sources (ctx, &b, argc - optind, argv + optind);
+  b.builder = pdfout_text_index_builder_new (ctx);
+  plan_build (ctx, &b);
+  pdfout_pool_run (ctx, &build_ops, &b, b.n_todo, jobs);
+  if (b.old)
+    pdfout_text_index_builder_copy (ctx, b.builder, b.old, b.old_map);
+
+  /* The old index may be mapped, but renaming over it is fine.  */
+  write_index (ctx, &b);
+
+  pdfout_text_index_builder_drop (ctx, b.builder);
+  pdfout_text_index_drop (ctx, b.old);
+  for (int i = 0; i < b.n_files; ++i)
+    free (b.files[i].name);
+  free (b.files);
+  free (b.todo);
+  free (b.old_map);
+
+  exit (b.failed ? 1 : 0);
+}
+
+/* Searching.  */
+
+/* Print the hits for QUERY and return their number.  */
+static int
+search_index (fz_context *ctx, const char *query)
+{
+  pdfout_text_index *index = pdfout_text_index_open (ctx, index_filename);
+  pdfout_text_hit *hits = NULL;
+  fz_output *out = NULL;
+  int n_hits = 0;
+
+  fz_var (hits);
+  fz_var (out);
+  fz_try (ctx)
+  {
+    hits = pdfout_text_index_search (ctx, index, query, &n_hits);
+    out = fz_new_output_with_file_ptr (ctx, stdout, false);
+    for (int i = 0; i < n_hits; ++i)
+      {
+	pdfout_text_index_file file;
+	char page[16];
+
+	if (list_files && i && hits[i].file == hits[i - 1].file)
+	  continue;
+	pdfout_text_index_get_file (ctx, index, hits[i].file, &file);
+	fz_puts (ctx, out, file.name);
+	if (list_files == false)
+	  {
+	    pdfout_snprintf (ctx, page, ":%d", hits[i].page + 1);
+	    fz_puts (ctx, out, page);
+	  }
+	fz_putc (ctx, out, '\n');
+      }
+  }
+  fz_always (ctx)
+  {
+    fz_drop_output (ctx, out);
+    free (hits);
+    pdfout_text_index_drop (ctx, index);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return n_hits;
+}
+
+static void
+index_search_command (int argc, char **argv)
+{
+  int n_hits = 0;
+
+  parse_search_options (argc, argv);
+
+  /* The words of all arguments.  */
+  fz_buffer *query = fz_new_buffer (ctx, 64);
+  for (int i = optind; i < argc; ++i)
+    {
+      if (i > optind)
+	fz_write_buffer_byte (ctx, query, ' ');
+      fz_write_buffer (ctx, query, argv[i], strlen (argv[i]));
+    }
+  fz_terminate_buffer (ctx, query);
+
+  fz_try (ctx)
+    n_hits = search_index (ctx, (const char *) query->data);
+  fz_always (ctx)
+    fz_drop_buffer (ctx, query);
+  fz_catch (ctx)
+  {
+    fprintf (stderr, "%s: %s\n", pdfout_program_name,
+	     fz_caught_message (ctx));
+    exit (2);
+  }
+
+  exit (n_hits ? 0 : 1);
+}
+
+static struct option longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {NULL, 0, NULL, 0}
+};
+
+/* Parse the options of the index command itself.  Does not return.  */
+static void
+parse_options (int argc, char **argv)
+{
+  int optc;
+  while ((optc = getopt_long (argc, argv, "hu", longopts, NULL)) != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	case 'u':
+	  print_usage ();
+	  exit (0);
+	default:
+	  print_usage ();
+	  exit (1);
+	}
+    }
+  print_usage ();
+  exit (1);
+}
+
+void
+pdfout_command_index (fz_context *ctx_arg, int argc, char **argv)
+{
+  static const char *subcommands[] = {"build", "search", NULL};
+
+  ctx = ctx_arg;
+
+  /* Only options before the subcommand, which parses its own.  */
+  if (argc < 2 || argv[1][0] == '-')
+    parse_options (argc, argv);
+
+  int subcommand = strmatch (argv[1], subcommands);
+  if (subcommand < 0)
+    pdfout_throw (ctx, "invalid subcommand '%s'", argv[1]);
+
+  int name_len = strlen (pdfout_program_name) + strlen (argv[1]) + 2;
+  char *name = fz_malloc (ctx, name_len);
+  pdfout_snprintf_imp (ctx, name, name_len, "%s %s", pdfout_program_name,
+		       argv[1]);
+  pdfout_program_name = name;
+
+  if (subcommand == 0)
+    index_build_command (argc - 1, argv + 1);
+  else
+    index_search_command (argc - 1, argv + 1);
+}
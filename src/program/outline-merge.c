@@ -0,0 +1,128 @@
+#include "common.h"
+#include "shared.h"
+
+static fz_context *ctx;
+static char *pdf_filename;
+static char *output_filename;
+static char **sources;
+static int source_count;
+static int first_page = 1;
+static bool use_parents;
+
+static struct option longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {"output", required_argument, NULL, 'o'},
+  {"first-page", required_argument, NULL, 'f'},
+  {"parents", no_argument, NULL, 'p'},
+  {NULL, 0, NULL, 0}
+};
+
+static void
+print_usage ()
+{
+  printf ("Usage: %s [OPTIONS] PDF_FILE SOURCE...\n", pdfout_program_name);
+}
+
+static void
+print_help ()
+{
+  print_usage ();
+  puts ("\
+Append the outlines of the SOURCE files to the outline of PDF_FILE.\n\
+PDF_FILE is expected to contain the pages of all SOURCE files, in order.\n\
+\n\
+ Options:\n\
+  -o, --output=FILE          Write modified document to FILE\n\
+  -f, --first-page=N         The pages of the first SOURCE start at page N\n\
+                             of PDF_FILE (default: 1)\n\
+  -p, --parents              Put the items of each SOURCE under a new item,\n\
+                             titled with its info dict title or file name\n\
+\n\
+ general options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+static void
+parse_options (int argc, char **argv)
+{
+  int optc;
+  while ((optc = getopt_long (argc, argv, "huo:f:p", longopts, NULL)) != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	case 'u':
+	  print_usage ();
+	  exit (0);
+	case 'o':
+	  output_filename = optarg;
+	  break;
+	case 'f':
+	  first_page = pdfout_strtoint_null (ctx, optarg);
+	  if (first_page < 1)
+	    pdfout_throw (ctx, "argument of --first-page not positive");
+	  break;
+	case 'p':
+	  use_parents = true;
+	  break;
+	default:
+	  print_usage ();
+	  exit (1);
+	}
+    }
+
+  if (argc - 2 < optind)
+    {
+      print_usage ();
+      exit (1);
+    }
+  pdf_filename = argv[optind];
+  sources = &argv[optind + 1];
+  source_count = argc - optind - 1;
+}
+
+/* Return the title of SRC's info dict, or a copy of FILENAME.  */
+static char *
+source_title (pdf_document *src, const char *filename)
+{
+  pdf_obj *info = pdf_dict_get (ctx, pdf_trailer (ctx, src), PDF_NAME_Info);
+  pdf_obj *title = pdf_dict_get (ctx, info, PDF_NAME_Title);
+  if (pdf_is_string (ctx, title) && pdf_to_str_len (ctx, title))
+    {
+      int len;
+      return pdfout_str_obj_to_utf8 (ctx, title, &len);
+    }
+  return fz_strdup (ctx, filename);
+}
+
+void
+pdfout_command_outline_merge (fz_context *ctx_arg, int argc, char **argv)
+{
+  ctx = ctx_arg;
+
+  parse_options (argc, argv);
+
+  pdf_document *doc = pdf_open_document (ctx, pdf_filename);
+  pdfout_outline_merge *merge = pdfout_outline_merge_new (ctx, doc);
+
+  int page_offset = first_page - 1;
+  for (int i = 0; i < source_count; ++i)
+    {
+      pdf_document *src = pdf_open_document (ctx, sources[i]);
+      char *title = use_parents ? source_title (src, sources[i]) : NULL;
+
+      pdfout_outline_merge_add (ctx, merge, src, page_offset, title);
+      page_offset += pdf_count_pages (ctx, src);
+
+      free (title);
+      pdf_drop_document (ctx, src);
+    }
+
+  pdfout_outline_merge_drop (ctx, merge);
+  pdfout_write_document (ctx, doc, pdf_filename, output_filename);
+}
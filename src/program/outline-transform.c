@@ -0,0 +1,121 @@
+#include "common.h"
+#include "shared.h"
+
+static fz_context *ctx;
+static char *pdf_filename;
+static char *output_filename;
+static pdfout_outline_transform_options opts;
+
+static struct option longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {"output", required_argument, NULL, 'o'},
+  {"open-all", no_argument, NULL, 'a'},
+  {"close-all", no_argument, NULL, 'c'},
+  {"fit-to-xyz", no_argument, NULL, 'x'},
+  {"page-offset", required_argument, NULL, 'p'},
+  {"max-depth", required_argument, NULL, 'm'},
+  {"title-regex", required_argument, NULL, 'r'},
+  {"title-replace", required_argument, NULL, 's'},
+  {NULL, 0, NULL, 0}
+};
+
+static void
+print_usage ()
+{
+  printf ("Usage: %s [OPTIONS] PDF_FILE\n", pdfout_program_name);
+}
+
+static void
+print_help ()
+{
+  print_usage ();
+  puts ("\
+Modify the outline items of PDF_FILE in place.\n\
+\n\
+ Options:\n\
+  -o, --output=FILE          Write modified document to FILE\n\
+  -a, --open-all             Open all items with kids\n\
+  -c, --close-all            Close all items with kids\n\
+  -x, --fit-to-xyz           Convert [Fit] views to [XYZ, null, null, null]\n\
+  -p, --page-offset=N        Add N to the page of each item\n\
+  -m, --max-depth=N          Remove items nested deeper than N levels\n\
+  -r, --title-regex=REGEX    Replace matches of the extended REGEX in titles\n\
+  -s, --title-replace=STRING Replacement for --title-regex; \\0 to \\9 insert\n\
+                             subexpressions\n\
+\n\
+ general options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+static void
+parse_options (int argc, char **argv)
+{
+  int optc;
+  while ((optc = getopt_long (argc, argv, "huo:acxp:m:r:s:", longopts, NULL))
+	 != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	case 'u':
+	  print_usage ();
+	  exit (0);
+	case 'o':
+	  output_filename = optarg;
+	  break;
+	case 'a':
+	  opts.open = 1;
+	  break;
+	case 'c':
+	  opts.open = -1;
+	  break;
+	case 'x':
+	  opts.fit_to_xyz = true;
+	  break;
+	case 'p':
+	  opts.page_offset = pdfout_strtoint_null (ctx, optarg);
+	  break;
+	case 'm':
+	  opts.max_depth = pdfout_strtoint_null (ctx, optarg);
+	  if (opts.max_depth < 1)
+	    pdfout_throw (ctx, "argument of --max-depth not positive");
+	  break;
+	case 'r':
+	  opts.title_regex = optarg;
+	  break;
+	case 's':
+	  opts.title_replace = optarg;
+	  break;
+	default:
+	  print_usage ();
+	  exit (1);
+	}
+    }
+
+  if (argc - 1 < optind)
+    {
+      print_usage ();
+      exit (1);
+    }
+  pdf_filename = argv[optind];
+
+  if (opts.title_regex && opts.title_replace == NULL)
+    opts.title_replace = "";
+}
+
+void
+pdfout_command_outline_transform (fz_context *ctx_arg, int argc, char **argv)
+{
+  ctx = ctx_arg;
+
+  parse_options (argc, argv);
+
+  pdf_document *doc = pdf_open_document (ctx, pdf_filename);
+  pdfout_outline_transform (ctx, doc, &opts);
+  pdfout_write_document (ctx, doc, pdf_filename, output_filename);
+}
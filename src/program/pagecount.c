@@ -2,16 +2,20 @@
 #include "shared.h"
 
 static char *pdf_filename;
+static int jobs;
+static int n_files;
+static char **files;
 static struct option longopts[] = {
   {"help", no_argument, NULL, 'h'},
   {"usage", no_argument, NULL, 'u'},
+  {"jobs", required_argument, NULL, 'j'},
   {NULL, 0, NULL, 0}
 };
 
 static void
 print_usage ()
 {
-  printf ("Usage: %s [OPTIONS] PDF_FILE\n", pdfout_program_name);
+  printf ("Usage: %s [OPTIONS] PDF_FILE...\n", pdfout_program_name);
 }
 
 static void
@@ -20,8 +24,13 @@ print_help ()
   print_usage ();
   puts ("\
 Print page count of PDF_FILE to standard output.\n\
+\n\
+With more than one PDF_FILE, or with PDF_FILE '-' to read the file names\n\
+from standard input, write one JSON object per line and file.\n\
 \n\
  Options:\n\
+  -j, --jobs=N               Process N files in parallel\n\
+\n\
  general options:\n\
   -h, --help                 Give this help list\n\
   -u, --usage                Give a short usage message\n\
@@ -29,10 +38,11 @@ Print page count of PDF_FILE to standard output.\n\
 }	
 
 static void
-parse_options (int argc, char **argv)
+parse_options (fz_context *ctx, int argc, char **argv)
 {
   int optc;
-  while ((optc = getopt_long (argc, argv, "hu", longopts, NULL)) != -1)
+  jobs = pdfout_pool_default_jobs ();
+  while ((optc = getopt_long (argc, argv, "huj:", longopts, NULL)) != -1)
     {
       switch (optc)
 	{
@@ -42,6 +52,9 @@ parse_options (int argc, char **argv)
 	case 'u':
 	  print_usage ();
 	  exit (0);
+	case 'j':
+	  jobs = pdfout_pool_parse_jobs (ctx, optarg);
+	  break;
 	default:
 	  print_usage ();
 	  exit (1);
@@ -54,6 +67,16 @@ parse_options (int argc, char **argv)
       exit (1);
     }
   pdf_filename = argv[optind];
+  n_files = argc - optind;
+  files = &argv[optind];
+}
+
+static pdfout_data *
+get_page_count (fz_context *ctx, pdf_document *doc)
+{
+  char buf[20];
+  int len = pdfout_snprintf (ctx, buf, "%d", pdf_count_pages (ctx, doc));
+  return pdfout_data_scalar_new (ctx, buf, len);
 }
 
 
@@ -61,8 +84,12 @@ void
 pdfout_command_pagecount (fz_context *ctx, int argc, char **argv)
 {
   pdf_document *doc;
-  parse_options (argc, argv);
-  ctx = pdfout_new_context ();
+  parse_options (ctx, argc, argv);
+
+  if (pdfout_batch_wanted (n_files, files))
+    exit (pdfout_batch_run (ctx, n_files, files, jobs, get_page_count,
+			    stdout) ? 1 : 0);
+
   doc = pdf_open_document (ctx, pdf_filename);
 
   
@@ -0,0 +1,114 @@
+#include "common.h"
+#include "shared.h"
+
+static fz_context *ctx;
+static char *pdf_filename;
+static char *page_range;
+
+static struct option longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {"page-range", required_argument, NULL, 'p'},
+  {NULL, 0, NULL, 0}
+};
+
+static void
+print_usage ()
+{
+  printf ("Usage: %s [OPTIONS] PDF_FILE\n", pdfout_program_name);
+}
+
+static void
+print_help ()
+{
+  print_usage ();
+  puts ("\
+Print the page label of each page, one per line.\n\
+Pages without a label range get their page number.\n\
+\n\
+ Options:\n\
+  -p, --page-range=PAGE1[-PAGE2][,PAGE3[-PAGE4]...]\n\
+                             Only print the labels of the given pages\n\
+                             Pages are page numbers or page labels,\n\
+                             numeric labels need the prefix 'label:'\n\
+\n\
+ general options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+static void
+parse_options (int argc, char **argv)
+{
+  int optc;
+  while ((optc = getopt_long (argc, argv, "hup:", longopts, NULL)) != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	case 'u':
+	  print_usage ();
+	  exit (0);
+	case 'p':
+	  page_range = optarg;
+	  break;
+	default:
+	  print_usage ();
+	  exit (1);
+	}
+    }
+
+  if (argc - 1 < optind)
+    {
+      print_usage ();
+      exit (1);
+    }
+  pdf_filename = argv[optind];
+}
+
+void
+pdfout_command_pagelabel (fz_context *ctx_arg, int argc, char **argv)
+{
+  ctx = ctx_arg;
+
+  parse_options (argc, argv);
+
+  pdf_document *doc = pdf_open_document (ctx, pdf_filename);
+  int page_count = pdf_count_pages (ctx, doc);
+
+  int *pages;
+  if (page_range == NULL)
+    {
+      pages = fz_malloc (ctx, 3 * sizeof (int));
+      pages[0] = 1; pages[1] = page_count; pages[2] = 0;
+    }
+  else
+    pages = pdfout_parse_page_range (ctx, page_range, doc);
+
+  pdfout_page_labels *labels = pdfout_page_labels_new (ctx, doc);
+  fz_buffer *buf = fz_new_buffer (ctx, 32);
+  fz_output *out = fz_new_output_with_file_ptr (ctx, stdout, false);
+
+  /* One binary search per range, then walk the label ranges along with
+     the pages.  */
+  for (int *p = pages; p[0]; p += 2)
+    {
+      int range = pdfout_page_labels_lookup (ctx, labels, p[0] - 1);
+      for (int page = p[0] - 1; page < p[1]; ++page)
+	{
+	  range = pdfout_page_labels_next (ctx, labels, range, page);
+	  pdfout_page_labels_format (ctx, labels, range, page, buf);
+	  fz_write (ctx, out, buf->data, buf->len);
+	  fz_putc (ctx, out, '\n');
+	}
+    }
+
+  fz_drop_output (ctx, out);
+  fz_drop_buffer (ctx, buf);
+  pdfout_page_labels_drop (ctx, labels);
+  free (pages);
+  pdf_drop_document (ctx, doc);
+}
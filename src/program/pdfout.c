@@ -1,5 +1,6 @@
 #include "common.h"
 #include "shared.h"
+#include "charset-conversion.h"
 
 char *pdfout_program_name = NULL;
 
@@ -122,6 +123,8 @@ main (int argc, char **argv)
     }
 
   fz_context *ctx = pdfout_new_context ();
+  /* Before any command can start worker threads.  */
+  pdfout_select_kernels (PDFOUT_KERNELS_SIMD);
 
   int name_len = strlen (argv[0]) + strlen(argv[1]) + 2;
   pdfout_program_name = fz_malloc (ctx, name_len);
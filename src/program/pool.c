@@ -0,0 +1,256 @@
+#include "common.h"
+#include "shared.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/* Worker threads take the next item from a shared counter and store the
+   outcome in the item's slot.  The main thread consumes the slots in
+   order as soon as they are done, so the output does not depend on the
+   number of threads.  Workers stay at most WINDOW items ahead of the
+   main thread, which bounds the memory held by finished results.  */
+
+typedef struct {
+  void *result;
+  /* Message of the exception, may be NULL if FAILED.  */
+  char *error;
+  bool failed;
+  bool done;
+} pool_slot;
+
+typedef struct {
+  /* Context with locks, cloned by each worker.  */
+  fz_context *ctx;
+  const pdfout_pool_ops *ops;
+  void *arg;
+  int n_items;
+  pool_slot *slots;
+
+  /* Protects the fields below and the DONE flags of the slots.  */
+  pthread_mutex_t mutex;
+  /* Signalled when a slot is done.  */
+  pthread_cond_t done_cond;
+  /* Signalled when the main thread consumed a slot.  */
+  pthread_cond_t window_cond;
+  int next;
+  int consumed;
+  int window;
+} pool;
+
+static pthread_mutex_t fz_mutexes[FZ_LOCK_MAX];
+
+static void
+lock_fz (void *user, int lock)
+{
+  pthread_mutex_lock (&((pthread_mutex_t *) user)[lock]);
+}
+
+static void
+unlock_fz (void *user, int lock)
+{
+  pthread_mutex_unlock (&((pthread_mutex_t *) user)[lock]);
+}
+
+static char *
+caught_message (fz_context *ctx)
+{
+  return strdup (fz_caught_message (ctx));
+}
+
+/* Return the next item, or -1 if there are no more.  */
+static int
+take_item (pool *p)
+{
+  pthread_mutex_lock (&p->mutex);
+  while (p->next < p->n_items && p->next >= p->consumed + p->window)
+    pthread_cond_wait (&p->window_cond, &p->mutex);
+  int i = p->next < p->n_items ? p->next++ : -1;
+  pthread_mutex_unlock (&p->mutex);
+  return i;
+}
+
+static void *
+worker (void *arg)
+{
+  pool *p = arg;
+  fz_context *ctx = fz_clone_context (p->ctx);
+  void *state = NULL;
+  char *init_error = NULL;
+  bool ok = ctx != NULL;
+
+  fz_var (state);
+  if (ok && p->ops->worker_new)
+    {
+      fz_try (ctx)
+	state = p->ops->worker_new (ctx, p->arg);
+      fz_catch (ctx)
+      {
+	ok = false;
+	init_error = caught_message (ctx);
+      }
+    }
+
+  int i;
+  while ((i = take_item (p)) >= 0)
+    {
+      pool_slot slot = { NULL };
+      if (ok)
+	{
+	  fz_try (ctx)
+	    slot.result = p->ops->run (ctx, p->arg, state, i);
+	  fz_catch (ctx)
+	  {
+	    slot.failed = true;
+	    slot.error = caught_message (ctx);
+	  }
+	}
+      else
+	{
+	  slot.failed = true;
+	  slot.error = init_error ? strdup (init_error) : NULL;
+	}
+
+      pthread_mutex_lock (&p->mutex);
+      p->slots[i] = slot;
+      p->slots[i].done = true;
+      pthread_cond_signal (&p->done_cond);
+      pthread_mutex_unlock (&p->mutex);
+    }
+
+  if (ok && p->ops->worker_drop)
+    p->ops->worker_drop (ctx, state);
+  free (init_error);
+  fz_drop_context (ctx);
+  return NULL;
+}
+
+static void
+drop_slot (fz_context *ctx, pool *p, pool_slot *slot)
+{
+  if (slot->result)
+    p->ops->drop_result (ctx, slot->result);
+  slot->result = NULL;
+  free (slot->error);
+  slot->error = NULL;
+}
+
+static void
+consume_slots (fz_context *ctx, pool *p)
+{
+  for (int i = 0; i < p->n_items; ++i)
+    {
+      pool_slot *slot = &p->slots[i];
+
+      pthread_mutex_lock (&p->mutex);
+      while (slot->done == false)
+	pthread_cond_wait (&p->done_cond, &p->mutex);
+      pthread_mutex_unlock (&p->mutex);
+
+      const char *error = NULL;
+      if (slot->failed)
+	error = slot->error ? slot->error : "out of memory";
+      bool more = p->ops->consume (ctx, p->arg, i, slot->result, error);
+      drop_slot (ctx, p, slot);
+      if (more == false)
+	return;
+
+      pthread_mutex_lock (&p->mutex);
+      p->consumed = i + 1;
+      pthread_cond_broadcast (&p->window_cond);
+      pthread_mutex_unlock (&p->mutex);
+    }
+}
+
+static void
+run_workers (fz_context *ctx, pool *p, int jobs)
+{
+  pthread_t *threads = fz_malloc_array (ctx, jobs, sizeof *threads);
+  int started = 0;
+
+  while (started < jobs
+	 && pthread_create (&threads[started], NULL, worker, p) == 0)
+    ++started;
+
+  fz_try (ctx)
+  {
+    if (started == 0)
+      pdfout_throw (ctx, "cannot create worker thread");
+    consume_slots (ctx, p);
+  }
+  fz_always (ctx)
+  {
+    /* Let the workers stop after their current item.  */
+    pthread_mutex_lock (&p->mutex);
+    p->next = p->n_items;
+    pthread_cond_broadcast (&p->window_cond);
+    pthread_mutex_unlock (&p->mutex);
+    for (int i = 0; i < started; ++i)
+      pthread_join (threads[i], NULL);
+    free (threads);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+int
+pdfout_pool_default_jobs (void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+  if (n > 0)
+    return MIN (n, 64);
+#endif
+  return 1;
+}
+
+int
+pdfout_pool_parse_jobs (fz_context *ctx, const char *arg)
+{
+  int jobs = pdfout_strtoint_null (ctx, arg);
+  if (jobs < 1)
+    pdfout_throw (ctx, "number of jobs must be positive");
+  return jobs;
+}
+
+void
+pdfout_pool_run (fz_context *ctx, const pdfout_pool_ops *ops, void *arg,
+		 int n_items, int jobs)
+{
+  if (n_items == 0)
+    return;
+
+  jobs = MIN (jobs, n_items);
+  pool p = { NULL, ops, arg, n_items };
+  p.window = 4 * jobs;
+  fz_locks_context locks = { fz_mutexes, lock_fz, unlock_fz };
+
+  for (int i = 0; i < FZ_LOCK_MAX; ++i)
+    pthread_mutex_init (&fz_mutexes[i], NULL);
+  pthread_mutex_init (&p.mutex, NULL);
+  pthread_cond_init (&p.done_cond, NULL);
+  pthread_cond_init (&p.window_cond, NULL);
+
+  fz_try (ctx)
+  {
+    p.slots = fz_calloc (ctx, n_items, sizeof *p.slots);
+    p.ctx = fz_new_context (NULL, &locks, FZ_STORE_DEFAULT);
+    if (p.ctx == NULL)
+      pdfout_throw (ctx, "cannot create context");
+
+    run_workers (ctx, &p, jobs);
+  }
+  fz_always (ctx)
+  {
+    if (p.slots)
+      for (int i = 0; i < n_items; ++i)
+	drop_slot (ctx, &p, &p.slots[i]);
+    free (p.slots);
+    fz_drop_context (p.ctx);
+    pthread_cond_destroy (&p.window_cond);
+    pthread_cond_destroy (&p.done_cond);
+    pthread_mutex_destroy (&p.mutex);
+    for (int i = 0; i < FZ_LOCK_MAX; ++i)
+      pthread_mutex_destroy (&fz_mutexes[i]);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
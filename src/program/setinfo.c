@@ -6,6 +6,7 @@ static char *pdf_filename;
 static char *pdf_output_filename;
 static bool append;
 static bool remove_info;
+static bool sync_xmp;
 static FILE *input;
 
 static struct option longopts[] = {
@@ -15,6 +16,7 @@ static struct option longopts[] = {
   {"output", required_argument, NULL, 'o'},
   {"remove", no_argument, NULL, 'r'},
   {"append", no_argument, NULL, 'a'},
+  {"sync-xmp", no_argument, NULL, 'x'},
   {NULL, 0, NULL, 0}
 };
 
@@ -36,6 +38,8 @@ Modify info dict. Reads JSON from stdin\n\
   -o, --output=FILE          Write modified document to FILE\n\
   -r, --remove               Remove page labels\n\
   -a, --append               Do not remove existing keys\n\
+  -x, --sync-xmp             Update the corresponding XMP metadata\n\
+                             properties as well\n\
 \n\
  general options:\n\
   -h, --help                 Give this help list\n\
@@ -49,7 +53,7 @@ parse_options (int argc, char **argv)
 {
   int optc;
   bool use_default_filename = false;
-  while ((optc = getopt_long (argc, argv, "hudo:ra", longopts, NULL)) != -1)
+  while ((optc = getopt_long (argc, argv, "hudo:rax", longopts, NULL)) != -1)
     {
       switch (optc)
 	{
@@ -71,6 +75,9 @@ parse_options (int argc, char **argv)
 	case 'a':
 	  append = true;
 	  break;
+	case 'x':
+	  sync_xmp = true;
+	  break;
 	default:
 	  print_usage ();
 	  exit (1);
@@ -111,6 +118,9 @@ pdfout_command_setinfo (fz_context *ctx_arg, int argc, char **argv)
 
   pdfout_info_dict_set (ctx, doc, info, append);
   pdfout_data_drop (ctx, info);
+
+  if (sync_xmp)
+    pdfout_xmp_sync_info (ctx, doc);
   
   pdfout_write_document (ctx, doc, pdf_filename, pdf_output_filename);
 }
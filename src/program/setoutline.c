@@ -7,6 +7,7 @@ static char *output_filename;
 static FILE *input;
 static bool remove_outline;
 static bool use_wysiwyg;
+static bool patch;
 
 static struct option longopts[] = {
   {"help", no_argument, NULL, 'h'},
@@ -15,6 +16,7 @@ static struct option longopts[] = {
   {"output", required_argument, NULL, 'o'},
   {"remove", no_argument, NULL, 'r'},
   {"wysiwyg", no_argument, NULL, 'w'},
+  {"patch", no_argument, NULL, 'p'},
   {NULL, 0, NULL, 0}
 };
 
@@ -36,6 +38,7 @@ Modify outline. Reads JSON from stdin\n\
   -o, --output=FILE          Write modified document to FILE\n\
   -r, --remove               Remove outline\n\
   -w, --wysiwyg              Use wysiwyg format\n\
+  -p, --patch                Only update the changed outline items\n\
 \n\
  general options:\n\
   -h, --help                 Give this help list\n\
@@ -49,7 +52,7 @@ parse_options (int argc, char **argv)
 {
   int optc;
   bool use_default_filename = false;
-  while ((optc = getopt_long (argc, argv, "hudo:rw", longopts, NULL)) != -1)
+  while ((optc = getopt_long (argc, argv, "hudo:rwp", longopts, NULL)) != -1)
     {
       switch (optc)
 	{
@@ -71,6 +74,9 @@ parse_options (int argc, char **argv)
 	case 'w':
 	  use_wysiwyg = true;
 	  break;
+	case 'p':
+	  patch = true;
+	  break;
 	default:
 	  print_usage ();
 	  exit (1);
@@ -115,7 +121,10 @@ pdfout_command_setoutline (fz_context *ctx_arg, int argc, char **argv)
     outline = NULL;
   
 
-  pdfout_outline_set (ctx, doc, outline);
+  if (patch)
+    pdfout_outline_patch (ctx, doc, outline);
+  else
+    pdfout_outline_set (ctx, doc, outline);
   pdfout_data_drop (ctx, outline);
   pdfout_write_document (ctx, doc, pdf_filename, output_filename);
 }
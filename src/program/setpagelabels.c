@@ -6,6 +6,7 @@ static char *pdf_filename;
 static char *output_filename;
 static FILE *input;
 static bool remove_page_labels;
+static int fanout = PDFOUT_PAGE_LABELS_DEFAULT_FANOUT;
 
 static struct option longopts[] = {
   {"help", no_argument, NULL, 'h'},
@@ -13,6 +14,7 @@ static struct option longopts[] = {
   {"default-filename", no_argument, NULL, 'd'},
   {"output", required_argument, NULL, 'o'},
   {"remove", no_argument, NULL, 'r'},
+  {"fanout", required_argument, NULL, 'f'},
   {NULL, 0, NULL, 0}
 };
 
@@ -33,6 +35,8 @@ Modify page labels. Reads JSON from stdin\n\
   -d, --default-filename     Write output to PDF_FILE.pagelabels\n\
   -o, --output=FILE          Write modified document to FILE\n\
   -r, --remove               Remove page labels\n\
+  -f, --fanout=N             Store at most N label ranges per node of the\n\
+                             number tree (default: 64)\n\
 \n\
  general options:\n\
   -h, --help                 Give this help list\n\
@@ -46,7 +50,7 @@ parse_options (int argc, char **argv)
 {
   int optc;
   bool use_default_filename = false;
-  while ((optc = getopt_long (argc, argv, "hudo:r", longopts, NULL)) != -1)
+  while ((optc = getopt_long (argc, argv, "hudo:rf:", longopts, NULL)) != -1)
     {
       switch (optc)
 	{
@@ -65,6 +69,11 @@ parse_options (int argc, char **argv)
 	case 'r':
 	  remove_page_labels = true;
 	  break;
+	case 'f':
+	  fanout = pdfout_strtoint_null (ctx, optarg);
+	  if (fanout < 2)
+	    pdfout_throw (ctx, "argument of --fanout less than 2");
+	  break;
 	default:
 	  print_usage ();
 	  exit (1);
@@ -105,7 +114,7 @@ pdfout_command_setpagelabels (fz_context *ctx_arg, int argc, char **argv)
     labels = NULL;
   
 
-  pdfout_page_labels_set (ctx, doc, labels);
+  pdfout_page_labels_set_tree (ctx, doc, labels, fanout);
   pdfout_data_drop (ctx, labels);
   
   pdfout_write_document (ctx, doc, pdf_filename, output_filename);
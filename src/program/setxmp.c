@@ -0,0 +1,116 @@
+#include "common.h"
+#include "shared.h"
+
+static fz_context *ctx;
+static char *pdf_filename;
+static char *pdf_output_filename;
+static bool append;
+static bool remove_xmp;
+static FILE *input;
+
+static struct option longopts[] = {
+  {"help", no_argument, NULL, 'h'},
+  {"usage", no_argument, NULL, 'u'},
+  {"default-filename", no_argument, NULL, 'd'},
+  {"output", required_argument, NULL, 'o'},
+  {"remove", no_argument, NULL, 'r'},
+  {"append", no_argument, NULL, 'a'},
+  {NULL, 0, NULL, 0}
+};
+
+static void
+print_usage ()
+{
+  printf ("Usage: %s [OPTIONS] PDF_FILE\n", pdfout_program_name);
+}
+
+static void
+print_help ()
+{
+  print_usage ();
+  puts ("\
+Modify XMP metadata properties. Reads JSON from stdin\n\
+\n\
+ Options:\n\
+  -d, --default-filename     Write output to PDF_FILE.xmp\n\
+  -o, --output=FILE          Write modified document to FILE\n\
+  -r, --remove               Remove all supported properties\n\
+  -a, --append               Do not remove existing properties\n\
+\n\
+ general options:\n\
+  -h, --help                 Give this help list\n\
+  -u, --usage                Give a short usage message\n\
+");
+}
+
+
+static void
+parse_options (int argc, char **argv)
+{
+  int optc;
+  bool use_default_filename = false;
+  while ((optc = getopt_long (argc, argv, "hudo:ra", longopts, NULL)) != -1)
+    {
+      switch (optc)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	case 'u':
+	  print_usage ();
+	  exit (0);
+	case 'd':
+	  use_default_filename = true;
+	  break;
+	case 'o':
+	  pdf_output_filename = optarg;
+	  break;
+	case 'r':
+	  remove_xmp = true;
+	  break;
+	case 'a':
+	  append = true;
+	  break;
+	default:
+	  print_usage ();
+	  exit (1);
+	}
+    }
+
+  if (argc - 1 < optind)
+    {
+      print_usage ();
+      exit (1);
+    }
+  pdf_filename = argv[optind];
+
+  if (use_default_filename)
+    input = open_default_read_file (ctx, pdf_filename, ".xmp");
+  else
+    input = stdin;
+}
+
+void
+pdfout_command_setxmp (fz_context *ctx_arg, int argc, char **argv)
+{
+  ctx = ctx_arg;
+
+  parse_options (argc, argv);
+  
+  pdf_document *doc = pdf_open_document (ctx, pdf_filename);
+
+  pdfout_data *xmp = NULL;
+  
+  if (remove_xmp == false)
+    {
+      fz_stream *stm = fz_open_file_ptr (ctx, input);
+      pdfout_parser *parser = pdfout_parser_json_new (ctx, stm);
+      xmp = pdfout_parser_parse (ctx, parser);
+      fz_drop_stream (ctx, stm);
+    }
+
+  pdfout_xmp_set (ctx, doc, xmp, append);
+  pdfout_data_drop (ctx, xmp);
+  
+  pdfout_write_document (ctx, doc, pdf_filename, pdf_output_filename);
+}
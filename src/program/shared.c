@@ -112,8 +112,170 @@ pdfout_strsep (fz_context *ctx, char **string_ptr, char delimiter)
   return begin;
 }
 
+typedef struct {
+  int page_count;
+  /* Page labels mapped to one-based page numbers, or NULL if the
+     document has no page labels.  */
+  pdfout_hash *labels;
+} page_range_parser;
+
+/* Build the label hash once.  If a label occurs more than once, the
+   first page wins.  Broken page labels are ignored with a warning, so
+   that plain page numbers still work.  */
+static pdfout_hash *
+label_hash_new (fz_context *ctx, pdf_document *doc, int page_count)
+{
+  pdfout_page_labels *labels = NULL;
+  pdfout_hash *hash = NULL;
+  fz_buffer *buf = NULL;
+
+  fz_var (labels);
+  fz_var (hash);
+  fz_var (buf);
+  fz_try (ctx)
+  {
+    labels = pdfout_page_labels_new (ctx, doc);
+    if (page_count && pdfout_page_labels_lookup (ctx, labels,
+						 page_count - 1) >= 0)
+      {
+	hash = pdfout_hash_new (ctx);
+	buf = fz_new_buffer (ctx, 32);
+	int range = -1;
+	for (int page = 0; page < page_count; ++page)
+	  {
+	    range = pdfout_page_labels_next (ctx, labels, range, page);
+	    pdfout_page_labels_format (ctx, labels, range, page, buf);
+	    pdfout_hash_insert (ctx, hash, (const char *) buf->data, buf->len,
+				(void *) (intptr_t) (page + 1));
+	  }
+      }
+  }
+  fz_always (ctx)
+  {
+    fz_drop_buffer (ctx, buf);
+    pdfout_page_labels_drop (ctx, labels);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_hash_drop (ctx, hash);
+    hash = NULL;
+    pdfout_warn (ctx, "ignoring page labels: %s", fz_caught_message (ctx));
+  }
+
+  return hash;
+}
+
+#define LABEL_PREFIX "label:"
+#define LABEL_PREFIX_LEN (sizeof LABEL_PREFIX - 1)
+
+static bool
+is_number (const char *token, int len)
+{
+  if (len == 0)
+    return false;
+  for (int i = 0; i < len; ++i)
+    if (token[i] < '0' || token[i] > '9')
+      return false;
+  return true;
+}
+
+/* Return the one-based page number of the page label TOKEN of LEN bytes,
+   or 0 if there is no such label.  Numbers are always page numbers, so
+   that page ranges keep their meaning when labels are added.  A label
+   which looks like a number is selected with the prefix "label:".  */
+static int
+find_label (fz_context *ctx, page_range_parser *p, const char *token,
+	    int len)
+{
+  if (p->labels == NULL)
+    return 0;
+
+  if (len >= LABEL_PREFIX_LEN
+      && memcmp (token, LABEL_PREFIX, LABEL_PREFIX_LEN) == 0)
+    {
+      token += LABEL_PREFIX_LEN;
+      len -= LABEL_PREFIX_LEN;
+    }
+  else if (is_number (token, len))
+    return 0;
+
+  int i = pdfout_hash_find (ctx, p->labels, token, len);
+  return i >= 0 ? (intptr_t) pdfout_hash_value (ctx, p->labels, i) : 0;
+}
+
+/* Return the one-based page number of the page number or page label
+   TOKEN, or 0 on errors.  */
 static int
-get_range (fz_context *ctx, int *result, char *ranges, int page_count)
+get_page (fz_context *ctx, page_range_parser *p, const char *token)
+{
+  char *tailptr;
+  int number;
+
+  if (token[0] == '\0')
+    {
+      MSG (ctx, "empty page number");
+      return 0;
+    }
+
+  number = find_label (ctx, p, token, strlen (token));
+  if (number)
+    return number;
+
+  if (strncmp (token, LABEL_PREFIX, LABEL_PREFIX_LEN) == 0)
+    {
+      MSG (ctx, "no page label '%s'", token + LABEL_PREFIX_LEN);
+      return 0;
+    }
+
+  number = pdfout_strtoint (ctx, token, &tailptr);
+  if (tailptr[0] != '\0')
+    {
+      if (p->labels)
+	MSG (ctx, "no page label '%s'", token);
+      else
+	MSG (ctx, "not part of an integer: '%s'", tailptr);
+      return 0;
+    }
+
+  if (number < 1)
+    {
+      MSG (ctx, "page %d is not positive", number);
+      return 0;
+    }
+
+  if (number > p->page_count)
+    {
+      MSG (ctx, "%d is greater than page count %d", number, p->page_count);
+      return 0;
+    }
+
+  return number;
+}
+
+/* Find the hyphen separating the first and last page of RANGE_TOKEN, or
+   return NULL.  Page labels may contain hyphens themselves, but two
+   numbers are always a range of page numbers.  */
+static char *
+find_hyphen (fz_context *ctx, page_range_parser *p, char *range_token)
+{
+  char *hyphen = strchr (range_token, '-');
+  if (hyphen && is_number (range_token, hyphen - range_token)
+      && is_number (hyphen + 1, strlen (hyphen + 1)))
+    return hyphen;
+
+  if (find_label (ctx, p, range_token, strlen (range_token)))
+    return NULL;
+
+  for (char *h = hyphen; h; h = strchr (h + 1, '-'))
+    if (find_label (ctx, p, range_token, h - range_token)
+	&& find_label (ctx, p, h + 1, strlen (h + 1)))
+      return h;
+
+  return hyphen;
+}
+
+static int
+get_range (fz_context *ctx, page_range_parser *p, int *result, char *ranges)
 {
   char *range_token;
   int pos = 0;
@@ -121,62 +283,27 @@ get_range (fz_context *ctx, int *result, char *ranges, int page_count)
   for (range_token = pdfout_strsep (ctx, &ranges, ','); range_token;
        range_token = pdfout_strsep (ctx, &ranges, ','), pos += 2)
     {
-      char *tailptr, *number_token = pdfout_strsep (ctx, &range_token, '-');
-      int number;
+      char *hyphen = find_hyphen (ctx, p, range_token);
+      if (hyphen)
+	*hyphen = '\0';
 
-      if (number_token[0] == '\0')
-	{
-	  MSG (ctx, "empty page number");
-	  return 1;
-	}
-
-      number = pdfout_strtoint(ctx, number_token, &tailptr);
-      if (tailptr[0] != '\0')
-	{
-	  MSG (ctx, "not part of an integer: '%s'", tailptr);
-	  return 1;
-	}
-
-      if (number < 1)
-	{
-	  MSG (ctx, "page %d is not positive", number);
-	  return 1;
-	}
-      
-      if (number > page_count)
-      	{
-	  MSG (ctx, "%d is greater than page count %d", number, page_count);
-	  return 1;
-	}
+      int number = get_page (ctx, p, range_token);
+      if (number == 0)
+	return 1;
       
       result[pos] = number;
 
-      if (range_token == NULL)
+      if (hyphen == NULL)
 	{
 	  /* no hyphen => last = first */
 	  result[pos + 1] = number;
 	  continue;
 	}
       
-      /* parse second number after the hyphen*/
-      number = pdfout_strtoint (ctx, range_token, &tailptr);
-      if (tailptr[0] != '\0')
-	{
-	  MSG (ctx, "not part of an integer: '%s'", tailptr);
-	  return 1;
-	}
-      
-      if (number < 1)
-	{
-	  MSG (ctx, "page %d is not positive", number);
-	  return 1;
-	}
-      
-      if (number > page_count)
-	{
-	  MSG (ctx, "%d is greater than page count %d", number, page_count);
-	  return 1;
-	}
+      /* parse second page after the hyphen*/
+      number = get_page (ctx, p, hyphen + 1);
+      if (number == 0)
+	return 1;
       
       if (number < result[pos])
 	{
@@ -193,13 +320,15 @@ get_range (fz_context *ctx, int *result, char *ranges, int page_count)
 }
 
 int *
-pdfout_parse_page_range (fz_context *ctx, const char *ranges, int page_count)
+pdfout_parse_page_range (fz_context *ctx, const char *ranges,
+			 pdf_document *doc)
 {
   int *result;
   int result_len = 2;
   /* find result len */
   const char *range_ptr;
   char *ranges_copy = fz_strdup (ctx, ranges);
+  page_range_parser parser;
 
   for (range_ptr = ranges; *range_ptr; ++range_ptr)
     {
@@ -208,11 +337,14 @@ pdfout_parse_page_range (fz_context *ctx, const char *ranges, int page_count)
     }
 
   result = fz_malloc (ctx, 2 * result_len * sizeof (int));
+
+  parser.page_count = pdf_count_pages (ctx, doc);
+  parser.labels = label_hash_new (ctx, doc, parser.page_count);
   
-  if (get_range (ctx, result, ranges_copy, page_count))
+  if (get_range (ctx, &parser, result, ranges_copy))
     exit (1);
 
+  pdfout_hash_drop (ctx, parser.labels);
   free (ranges_copy);
   return result;
 }
-
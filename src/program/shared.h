@@ -35,8 +35,58 @@ FILE *open_default_write_file (fz_context *ctx, const char *filename,
 
 char * pdfout_strsep (fz_context *ctx, char **string_ptr, char delimiter);
 
+/* Parse a comma separated list of pages or ranges PAGE1-PAGE2.  Pages
+   are given as page labels or page numbers, labels take precedence.
+   Return an array of first and last page pairs, terminated by 0.  */
 int *pdfout_parse_page_range (fz_context *ctx, const char *range,
-			      int page_count);
+			      pdf_document *doc);
+
+/* Worker pool, see pool.c.  */
+
+typedef struct {
+  /* Create the state of a worker thread, e.g. open a document.  May be
+     NULL.  */
+  void *(*worker_new) (fz_context *ctx, void *arg);
+  void (*worker_drop) (fz_context *ctx, void *worker);
+
+  /* Compute item I in a worker thread.  Throw on errors.  */
+  void *(*run) (fz_context *ctx, void *arg, void *worker, int i);
+  void (*drop_result) (fz_context *ctx, void *result);
+
+  /* Called in the calling thread for every item, in order.  ERROR is the
+     exception message if the item failed.  RESULT is dropped
+     afterwards.  Return false to skip the remaining items.  */
+  bool (*consume) (fz_context *ctx, void *arg, int i, void *result,
+		   const char *error);
+} pdfout_pool_ops;
+
+/* Compute N_ITEMS items with JOBS worker threads.  Each worker clones a
+   context which was created with locks, so CTX itself needs none.  */
+void pdfout_pool_run (fz_context *ctx, const pdfout_pool_ops *ops,
+		      void *arg, int n_items, int jobs);
+
+/* Number of jobs if no --jobs option is given.  */
+int pdfout_pool_default_jobs (void);
+
+/* Parse the argument of --jobs.  */
+int pdfout_pool_parse_jobs (fz_context *ctx, const char *arg);
+
+/* Batch mode, used by commands which accept many PDF files.  */
+
+/* Return the result for DOC, or throw.  Called from worker threads.  */
+typedef pdfout_data *pdfout_batch_func (fz_context *ctx, pdf_document *doc);
+
+/* Whether the ARGC file arguments in ARGV ask for batch mode, i.e. there
+   is more than one file or the file list is read from stdin ("-").  */
+bool pdfout_batch_wanted (int argc, char **argv);
+
+/* Call FUNC for the files in ARGV with JOBS worker threads.  An argument
+   "-" is replaced by the file names on stdin, one per line.  Write one
+   JSON object per line and file to OUTPUT, in input order: either
+   {"file":FILE,"result":RESULT} or {"file":FILE,"error":MESSAGE}.
+   Return the number of failed files.  */
+int pdfout_batch_run (fz_context *ctx, int argc, char **argv, int jobs,
+		      pdfout_batch_func *func, FILE *output);
 
 #define PDFOUT_VERSION \
 "pdfout 0.1\n\
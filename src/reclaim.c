@@ -0,0 +1,162 @@
+#include "common.h"
+
+struct pdfout_reclaim_s
+{
+  pdf_document *doc;
+  const char **keys;
+
+  /* Bitset of the collected object numbers.  */
+  unsigned char *marked;
+  int xref_len;
+};
+
+static bool
+follow_key (fz_context *ctx, pdfout_reclaim *reclaim, pdf_obj *key)
+{
+  if (reclaim->keys == NULL)
+    return true;
+
+  const char *name = pdf_to_name (ctx, key);
+  for (const char **k = reclaim->keys; *k; ++k)
+    if (strcmp (*k, name) == 0)
+      return true;
+  return false;
+}
+
+/* Objects which belong to the document structure, no matter how they were
+   reached.  */
+static bool
+is_protected (fz_context *ctx, pdf_obj *obj)
+{
+  pdf_obj *type = pdf_dict_get (ctx, obj, PDF_NAME_Type);
+  return (pdf_name_eq (ctx, type, PDF_NAME_Page)
+	  || pdf_name_eq (ctx, type, PDF_NAME_Pages)
+	  || pdf_name_eq (ctx, type, PDF_NAME_Catalog));
+}
+
+/* Walk the subgraph at OBJ iteratively and set (or clear) the bit of each
+   indirect object in RECLAIM->marked.  Clearing follows every dict entry
+   and passes through protected objects, so that nothing which is still
+   referenced gets deleted.  */
+static void
+walk (fz_context *ctx, pdfout_reclaim *reclaim, pdf_obj *obj, bool set)
+{
+  /* Objects added since pdfout_reclaim_new can still refer to old ones.  */
+  int xref_len = pdf_xref_len (ctx, reclaim->doc);
+  unsigned char *seen = fz_calloc (ctx, xref_len / 8 + 1, 1);
+  pdf_obj **stack = NULL;
+  int depth = 0, stack_cap = 0;
+
+  fz_try (ctx)
+  {
+    stack = pdfout_x2nrealloc (ctx, stack, &stack_cap, pdf_obj *);
+    stack[depth++] = obj;
+
+    while (depth)
+      {
+	obj = stack[--depth];
+	if (pdf_is_indirect (ctx, obj))
+	  {
+	    int num = pdf_to_num (ctx, obj);
+	    if (num <= 0 || num >= xref_len || seen[num / 8] & (1 << num % 8))
+	      continue;
+	    seen[num / 8] |= 1 << num % 8;
+	    if (set && is_protected (ctx, obj))
+	      continue;
+
+	    if (num < reclaim->xref_len)
+	      {
+		if (set)
+		  reclaim->marked[num / 8] |= 1 << num % 8;
+		else
+		  reclaim->marked[num / 8] &= ~(1 << num % 8);
+	      }
+	  }
+
+	if (pdf_is_array (ctx, obj))
+	  {
+	    for (int i = pdf_array_len (ctx, obj) - 1; i >= 0; --i)
+	      {
+		if (depth == stack_cap)
+		  stack = pdfout_x2nrealloc (ctx, stack, &stack_cap,
+					     pdf_obj *);
+		stack[depth++] = pdf_array_get (ctx, obj, i);
+	      }
+	  }
+	else if (pdf_is_dict (ctx, obj))
+	  {
+	    for (int i = pdf_dict_len (ctx, obj) - 1; i >= 0; --i)
+	      {
+		if (set
+		    && follow_key (ctx, reclaim,
+				   pdf_dict_get_key (ctx, obj, i)) == false)
+		  continue;
+		if (depth == stack_cap)
+		  stack = pdfout_x2nrealloc (ctx, stack, &stack_cap,
+					     pdf_obj *);
+		stack[depth++] = pdf_dict_get_val (ctx, obj, i);
+	      }
+	  }
+      }
+  }
+  fz_always (ctx)
+  {
+    free (stack);
+    free (seen);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+pdfout_reclaim *
+pdfout_reclaim_new (fz_context *ctx, pdf_document *doc, pdf_obj *old,
+		    const char **keys)
+{
+  pdfout_reclaim *reclaim = fz_malloc_struct (ctx, pdfout_reclaim);
+
+  fz_try (ctx)
+  {
+    reclaim->doc = doc;
+    reclaim->keys = keys;
+    reclaim->xref_len = pdf_xref_len (ctx, doc);
+    reclaim->marked = fz_calloc (ctx, reclaim->xref_len / 8 + 1, 1);
+    if (old)
+      walk (ctx, reclaim, old, true);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_reclaim_drop (ctx, reclaim);
+    fz_rethrow (ctx);
+  }
+
+  return reclaim;
+}
+
+void
+pdfout_reclaim_sweep (fz_context *ctx, pdfout_reclaim *reclaim, pdf_obj *new)
+{
+  fz_try (ctx)
+  {
+    if (new)
+      walk (ctx, reclaim, new, false);
+    /* Keep the objects which are shared with the rest of the document.  */
+    walk (ctx, reclaim, pdf_trailer (ctx, reclaim->doc), false);
+
+    for (int num = 1; num < reclaim->xref_len; ++num)
+      if (reclaim->marked[num / 8] & (1 << num % 8))
+	pdf_delete_object (ctx, reclaim->doc, num);
+  }
+  fz_always (ctx)
+    pdfout_reclaim_drop (ctx, reclaim);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+void
+pdfout_reclaim_drop (fz_context *ctx, pdfout_reclaim *reclaim)
+{
+  if (reclaim == NULL)
+    return;
+  free (reclaim->marked);
+  free (reclaim);
+}
@@ -0,0 +1,28 @@
+#ifndef HAVE_PDFOUT_RECLAIM_H
+#define HAVE_PDFOUT_RECLAIM_H
+
+/* Free the objects of a subgraph which is replaced by a setter.
+
+   pdfout_reclaim_new collects the indirect objects reachable from OLD,
+   following only the dict entries named in KEYS (a NULL-terminated list,
+   or NULL for all entries) and all array elements.  Page, page tree and
+   catalog objects are never collected.
+
+   pdfout_reclaim_sweep removes the objects which are still reachable from
+   NEW or from the trailer (following all entries) and deletes the rest
+   from the document, so objects shared with other parts of the document
+   are kept.
+   Deleted objects get free entries in the xref, both when the document is
+   rewritten and when it is saved incrementally.  NEW may be NULL.  The
+   sweep also drops RECLAIM.  */
+typedef struct pdfout_reclaim_s pdfout_reclaim;
+
+pdfout_reclaim *pdfout_reclaim_new (fz_context *ctx, pdf_document *doc,
+				    pdf_obj *old, const char **keys);
+
+void pdfout_reclaim_sweep (fz_context *ctx, pdfout_reclaim *reclaim,
+			   pdf_obj *new);
+
+void pdfout_reclaim_drop (fz_context *ctx, pdfout_reclaim *reclaim);
+
+#endif	/* ! HAVE_PDFOUT_RECLAIM_H */
@@ -18,39 +18,343 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "common.h"
 
-static pdf_obj *
-resolve_dest_rec (fz_context *ctx, pdf_document *doc, pdf_obj *dest, int depth)
+struct pdfout_dest_table_s
 {
-  if (depth > 10) /* Arbitrary to avoid infinite recursion */
+  pdf_document *doc;
+  bool loaded;
+
+  /* Maps names to kept destination objects.  */
+  pdfout_hash *hash;
+};
+
+pdfout_dest_table *
+pdfout_dest_table_new (fz_context *ctx, pdf_document *doc)
+{
+  pdfout_dest_table *dests = fz_malloc_struct (ctx, pdfout_dest_table);
+  fz_try (ctx)
+    dests->hash = pdfout_hash_new (ctx);
+  fz_catch (ctx)
+  {
+    free (dests);
+    fz_rethrow (ctx);
+  }
+  dests->doc = doc;
+
+  return dests;
+}
+
+void
+pdfout_dest_table_drop (fz_context *ctx, pdfout_dest_table *dests)
+{
+  if (dests == NULL)
+    return;
+
+  int count = pdfout_hash_count (ctx, dests->hash);
+  for (int i = 0; i < count; ++i)
+    pdf_drop_obj (ctx, pdfout_hash_value (ctx, dests->hash, i));
+  pdfout_hash_drop (ctx, dests->hash);
+  free (dests);
+}
+
+static void
+add_dest (fz_context *ctx, pdfout_dest_table *dests, const char *name,
+	  int name_len, pdf_obj *dest)
+{
+  /* Like pdf_lookup_dest, prefer the /Dests dictionary and earlier
+     entries.  */
+  pdf_keep_obj (ctx, dest);
+  fz_try (ctx)
+  {
+    if (pdfout_hash_insert (ctx, dests->hash, name, name_len, dest) == false)
+      pdf_drop_obj (ctx, dest);
+  }
+  fz_catch (ctx)
+  {
+    pdf_drop_obj (ctx, dest);
+    fz_rethrow (ctx);
+  }
+}
+
+static void
+add_name_tree_leaf (fz_context *ctx, pdfout_dest_table *dests, pdf_obj *node)
+{
+  pdf_obj *names = pdf_dict_get (ctx, node, PDF_NAME_Names);
+  int len = pdf_array_len (ctx, names);
+
+  for (int i = 0; i + 1 < len; i += 2)
+    {
+      pdf_obj *key = pdf_array_get (ctx, names, i);
+      pdf_obj *value = pdf_array_get (ctx, names, i + 1);
+      if (pdf_is_string (ctx, key))
+	add_dest (ctx, dests, pdf_to_str_buf (ctx, key),
+		  pdf_to_str_len (ctx, key), value);
+    }
+}
+
+/* Flatten the name tree iteratively, in key order.  */
+static void
+load_name_tree (fz_context *ctx, pdfout_dest_table *dests, pdf_obj *root)
+{
+  int xref_len = pdf_xref_len (ctx, dests->doc);
+  unsigned char *visited = fz_calloc (ctx, xref_len / 8 + 1, 1);
+  struct node { pdf_obj *kids; int next; } *stack = NULL;
+  int depth = 0, stack_cap = 0;
+
+  fz_try (ctx)
+  {
+    pdf_obj *node = root;
+    while (true)
+      {
+	int num = pdf_to_num (ctx, node);
+	if (num > 0 && num < xref_len)
+	  {
+	    if (visited[num / 8] & (1 << num % 8))
+	      pdfout_throw (ctx, "circular reference in name tree");
+	    visited[num / 8] |= 1 << num % 8;
+	  }
+
+	add_name_tree_leaf (ctx, dests, node);
+
+	pdf_obj *kids = pdf_dict_get (ctx, node, PDF_NAME_Kids);
+	if (pdf_is_array (ctx, kids))
+	  {
+	    if (depth == stack_cap)
+	      stack = pdfout_x2nrealloc (ctx, stack, &stack_cap, struct node);
+	    stack[depth++] = (struct node) {kids, 0};
+	  }
+
+	while (depth && stack[depth - 1].next
+	       == pdf_array_len (ctx, stack[depth - 1].kids))
+	  --depth;
+	if (depth == 0)
+	  break;
+
+	struct node *top = &stack[depth - 1];
+	node = pdf_array_get (ctx, top->kids, top->next++);
+      }
+  }
+  fz_always (ctx)
+  {
+    free (stack);
+    free (visited);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static void
+load_dests (fz_context *ctx, pdfout_dest_table *dests)
+{
+  pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, dests->doc),
+				PDF_NAME_Root);
+
+  pdf_obj *dict = pdf_dict_get (ctx, root, PDF_NAME_Dests);
+  int len = pdf_dict_len (ctx, dict);
+  for (int i = 0; i < len; ++i)
+    {
+      const char *name = pdf_to_name (ctx, pdf_dict_get_key (ctx, dict, i));
+      add_dest (ctx, dests, name, strlen (name),
+		pdf_dict_get_val (ctx, dict, i));
+    }
+
+  pdf_obj *names = pdf_dict_get (ctx, root, PDF_NAME_Names);
+  pdf_obj *tree = pdf_dict_get (ctx, names, PDF_NAME_Dests);
+  if (pdf_is_dict (ctx, tree))
+    load_name_tree (ctx, dests, tree);
+}
+
+static void
+ensure_loaded (fz_context *ctx, pdfout_dest_table *dests)
+{
+  if (dests->loaded)
+    return;
+
+  /* Do not retry after an error.  */
+  dests->loaded = true;
+  load_dests (ctx, dests);
+}
+
+pdf_obj *
+pdfout_dest_table_lookup (fz_context *ctx, pdfout_dest_table *dests,
+			  pdf_obj *name)
+{
+  const char *key;
+  int key_len;
+
+  if (pdf_is_name (ctx, name))
+    {
+      key = pdf_to_name (ctx, name);
+      key_len = strlen (key);
+    }
+  else if (pdf_is_string (ctx, name))
+    {
+      key = pdf_to_str_buf (ctx, name);
+      key_len = pdf_to_str_len (ctx, name);
+    }
+  else
     return NULL;
 
-  if (pdf_is_name(ctx, dest) || pdf_is_string(ctx, dest))
+  ensure_loaded (ctx, dests);
+
+  int i = pdfout_hash_find (ctx, dests->hash, key, key_len);
+  if (i < 0)
+    return NULL;
+  return pdfout_hash_value (ctx, dests->hash, i);
+}
+
+int
+pdfout_dest_table_count (fz_context *ctx, pdfout_dest_table *dests)
+{
+  ensure_loaded (ctx, dests);
+  return pdfout_hash_count (ctx, dests->hash);
+}
+
+pdf_obj *
+pdfout_dest_table_get (fz_context *ctx, pdfout_dest_table *dests, int i,
+		       const char **name, int *name_len)
+{
+  ensure_loaded (ctx, dests);
+  *name = pdfout_hash_key (ctx, dests->hash, i, name_len);
+  return pdfout_hash_value (ctx, dests->hash, i);
+}
+
+pdf_obj *
+pdfout_resolve_dest (fz_context *ctx, pdfout_dest_table *dests, pdf_obj *dest)
+{
+  /* Arbitrary limit to avoid infinite loops.  */
+  for (int depth = 0; depth <= 10; ++depth)
     {
-      dest = pdf_lookup_dest(ctx, doc, dest);
-      dest = resolve_dest_rec (ctx, doc, dest, depth+1);
+      if (pdf_is_name (ctx, dest) || pdf_is_string (ctx, dest))
+	dest = pdfout_dest_table_lookup (ctx, dests, dest);
+      else if (pdf_is_array (ctx, dest))
+	return dest;
+      else if (pdf_is_dict (ctx, dest))
+	dest = pdf_dict_get (ctx, dest, PDF_NAME_D);
+      else if (pdf_is_indirect (ctx, dest))
+	return dest;
+      else
+	return NULL;
+    }
+
+  return NULL;
+}
 
-      return dest;
+pdfout_data *
+pdfout_dest_view_get (fz_context *ctx, pdfout_page_index *pages,
+		      pdf_obj *dest, int *page)
+{
+  pdf_obj *page_ref = pdf_array_get (ctx, dest, 0);
+  *page = pdfout_page_index_lookup (ctx, pages, page_ref);
+
+  pdfout_data *view_array = pdfout_data_array_new (ctx);
+
+  pdf_obj *kind = pdf_array_get (ctx, dest, 1);
+  pdfout_data *kind_data = pdfout_data_scalar_from_pdf (ctx, kind);
+  pdfout_data_array_push (ctx, view_array, kind_data);
+
+  int len = pdf_array_len (ctx, dest);
+  
+  for (int i = 2; i < len; ++i)
+    {
+      pdf_obj *item = pdf_array_get (ctx, dest, i);
+      pdfout_data *item_data = pdfout_data_scalar_from_pdf (ctx, item);
+      pdfout_data_array_push (ctx, view_array, item_data);
     }
 
-  else if (pdf_is_array (ctx, dest))
+  return view_array;
+}
+
+static void
+hash_push (fz_context *ctx, pdfout_data *hash, const char *key,
+	   pdfout_data *value)
+{
+  pdfout_data *key_data = pdfout_data_scalar_new (ctx, key, strlen (key));
+  pdfout_data_hash_push (ctx, hash, key_data, value);
+}
+
+static pdfout_data *
+get_dest_hash (fz_context *ctx, pdf_document *doc, pdfout_page_index *pages,
+	       pdfout_dest_table *dests, int i)
+{
+  const char *name;
+  int name_len;
+  pdf_obj *dest = pdfout_dest_table_get (ctx, dests, i, &name, &name_len);
+
+  /* Names are either PDF strings or name objects.  Convert both like
+     strings, so that UTF-16 names come out as UTF-8.  */
+  pdf_obj *name_obj = pdf_new_string (ctx, doc, name, name_len);
+  pdfout_data *name_data;
+  fz_try (ctx)
+    name_data = pdfout_data_scalar_from_pdf (ctx, name_obj);
+  fz_always (ctx)
+    pdf_drop_obj (ctx, name_obj);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  int len;
+  char *name_str = pdfout_data_scalar_get (ctx, name_data, &len);
+
+  dest = pdfout_resolve_dest (ctx, dests, dest);
+  if (pdf_is_array (ctx, dest) == false)
     {
-      return dest;
+      pdfout_warn (ctx, "destination '%s' is not a destination array",
+		   name_str);
+      pdfout_data_drop (ctx, name_data);
+      return NULL;
     }
 
-  else if (pdf_is_dict (ctx, dest))
+  int page;
+  pdfout_data *view = pdfout_dest_view_get (ctx, pages, dest, &page);
+  if (page < 0)
     {
-      dest = pdf_dict_get (ctx, dest, PDF_NAME_D);
-      return resolve_dest_rec (ctx, doc, dest, depth+1);
+      pdfout_warn (ctx, "destination '%s' does not point to a page",
+		   name_str);
+      pdfout_data_drop (ctx, name_data);
+      pdfout_data_drop (ctx, view);
+      return NULL;
     }
 
-  else if (pdf_is_indirect (ctx, dest))
-    return dest;
+  char buf[200];
+  int buf_len = pdfout_snprintf (ctx, buf, "%d", page + 1);
 
-  return NULL;
+  pdfout_data *hash = pdfout_data_hash_new (ctx);
+  hash_push (ctx, hash, "name", name_data);
+  hash_push (ctx, hash, "page", pdfout_data_scalar_new (ctx, buf, buf_len));
+  hash_push (ctx, hash, "view", view);
+
+  return hash;
 }
 
-pdf_obj *
-pdfout_resolve_dest (fz_context *ctx, pdf_document *doc, pdf_obj *dest)
+pdfout_data *
+pdfout_dests_get (fz_context *ctx, pdf_document *doc)
 {
-  return resolve_dest_rec (ctx, doc, dest, 0);
+  pdfout_page_index *pages = pdfout_page_index_new (ctx, doc);
+  pdfout_dest_table *dests = NULL;
+  pdfout_data *result = NULL;
+
+  fz_try (ctx)
+  {
+    dests = pdfout_dest_table_new (ctx, doc);
+    result = pdfout_data_array_new (ctx);
+
+    int count = pdfout_dest_table_count (ctx, dests);
+    for (int i = 0; i < count; ++i)
+      {
+	pdfout_data *hash = get_dest_hash (ctx, doc, pages, dests, i);
+	if (hash)
+	  pdfout_data_array_push (ctx, result, hash);
+      }
+  }
+  fz_always (ctx)
+  {
+    pdfout_dest_table_drop (ctx, dests);
+    pdfout_page_index_drop (ctx, pages);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_data_drop (ctx, result);
+    fz_rethrow (ctx);
+  }
+
+  return result;
 }
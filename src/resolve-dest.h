@@ -0,0 +1,39 @@
+#ifndef HAVE_PDFOUT_RESOLVE_DEST_H
+#define HAVE_PDFOUT_RESOLVE_DEST_H
+
+/* Table of the named destinations of a document, from both the /Dests
+   dictionary of the catalog and the /Dests name tree.  The table is filled
+   on first use.  */
+typedef struct pdfout_dest_table_s pdfout_dest_table;
+
+pdfout_dest_table *pdfout_dest_table_new (fz_context *ctx,
+					  pdf_document *doc);
+
+void pdfout_dest_table_drop (fz_context *ctx, pdfout_dest_table *dests);
+
+/* NAME is a name or string object.  Return NULL if there is no such
+   destination.  */
+pdf_obj *pdfout_dest_table_lookup (fz_context *ctx, pdfout_dest_table *dests,
+				   pdf_obj *name);
+
+int pdfout_dest_table_count (fz_context *ctx, pdfout_dest_table *dests);
+
+/* Return the I-th destination and store its name in *NAME and *NAME_LEN.
+   The name is not null-terminated.  */
+pdf_obj *pdfout_dest_table_get (fz_context *ctx, pdfout_dest_table *dests,
+				int i, const char **name, int *name_len);
+
+/* Follow named destinations and action dictionaries to the destination
+   array.  Return NULL for anything else.  */
+pdf_obj *pdfout_resolve_dest (fz_context *ctx, pdfout_dest_table *dests,
+			      pdf_obj *dest);
+
+/* Convert the destination array DEST to a view array like ["XYZ", 0, 0,
+   null] and store the zero-based page number in *PAGE.  */
+pdfout_data *pdfout_dest_view_get (fz_context *ctx, pdfout_page_index *pages,
+				   pdf_obj *dest, int *page);
+
+/* Return an array of {"name", "page", "view"} hashes.  */
+pdfout_data *pdfout_dests_get (fz_context *ctx, pdf_document *doc);
+
+#endif	/* ! HAVE_PDFOUT_RESOLVE_DEST_H */
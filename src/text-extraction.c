@@ -1,61 +1,366 @@
 #include "common.h"
 
+struct pdfout_text_session_s {
+  pdf_document *doc;
+  fz_stext_sheet *sheet;
+  /* Text of the current page.  Its storage is kept between pages.  */
+  fz_buffer *buf;
+};
+
+/* Return a pointer to room for N more bytes at the end of BUF.  */
+static unsigned char *
+reserve (fz_context *ctx, fz_buffer *buf, size_t n)
+{
+  if (buf->cap - buf->len < n)
+    {
+      size_t cap = buf->cap * 2;
+      if (cap < buf->len + n)
+	cap = buf->len + n;
+      fz_resize_buffer (ctx, buf, cap);
+    }
+  return buf->data + buf->len;
+}
+
+/* Append the N characters at CH to BUF as UTF-8.  They are encoded in a
+   single pass directly into the buffer's storage, skipping null
+   characters.  */
 static void
-process_block (fz_context *ctx, FILE *memstream, fz_stext_block *block)
+append_chars (fz_context *ctx, fz_buffer *buf, const fz_stext_char *ch,
+	      int n)
+{
+  /* A character takes at most four bytes.  */
+  unsigned char *start = reserve (ctx, buf, 4 * (size_t) n);
+  unsigned char *p = start;
+  const fz_stext_char *end = ch + n;
+
+  while (ch < end)
+    {
+      /* Runs of ASCII characters other than null.  */
+      while (ch < end && (unsigned) ch->c - 1 < 0x7f)
+	*p++ = ch++->c;
+      if (ch == end)
+	break;
+
+      int c = ch++->c;
+      if (c == 0)
+	pdfout_warn (ctx, "process_block: skipping null character");
+      else
+	p += fz_runetochar ((char *) p, c);
+    }
+
+  buf->len += p - start;
+}
+
+/* Append the spans of LINE, separated by spaces.  */
+static void
+append_line (fz_context *ctx, fz_buffer *buf, fz_stext_line *line)
+{
+  fz_stext_span *span;
+  for (span = line->first_span; span; span = span->next)
+    {
+      if (span != line->first_span)
+	fz_write_buffer_byte (ctx, buf, ' ');
+      append_chars (ctx, buf, span->text, span->len);
+    }
+}
+
+static void
+process_block (fz_context *ctx, fz_buffer *buf, fz_stext_block *block)
 {
   fz_stext_line *line;
-  /* printf ("in process block, block->len = %d\n", block->len); */
   for (line = block->lines; line - block->lines < block->len;
        line++)
     {
-      fz_stext_span *span;
-      for (span = line->first_span; span; span = span->next)
-	{
-	  fz_stext_char *ch;
-	    
-	  if (span != line->first_span)
-	      putc (' ', memstream);
-	  for (ch = span->text; ch < span->text + span->len; ch++)
-	    {
-	      char utf[4];
-	      int len = fz_runetochar (utf, ch->c);
-	      if (utf[0] == '\0')
-		{
-		  pdfout_warn (ctx, "process_block: skipping null character");
-		  continue;
-		}
-	      fwrite (utf, len, 1, memstream);
-	    }
-	}
-      putc ('\n', memstream);
+      append_line (ctx, buf, line);
+      fz_write_buffer_byte (ctx, buf, '\n');
     }
 }
 
+pdfout_text_session *
+pdfout_text_session_new (fz_context *ctx, pdf_document *doc)
+{
+  pdfout_text_session *session = fz_malloc_struct (ctx, pdfout_text_session);
+
+  session->doc = doc;
+  fz_try (ctx)
+  {
+    session->sheet = fz_new_stext_sheet (ctx);
+    session->buf = fz_new_buffer (ctx, 4096);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_text_session_drop (ctx, session);
+    fz_rethrow (ctx);
+  }
+
+  return session;
+}
+
 void
-pdfout_text_get_page (FILE *stream, fz_context *ctx,
-		      pdf_document *doc, int page_number)
+pdfout_text_session_drop (fz_context *ctx, pdfout_text_session *session)
 {
-  fz_stext_sheet *sheet;
+  if (session == NULL)
+    return;
+
+  fz_drop_buffer (ctx, session->buf);
+  fz_drop_stext_sheet (ctx, session->sheet);
+  free (session);
+}
+
+fz_buffer *
+pdfout_text_session_extract (fz_context *ctx, pdfout_text_session *session,
+			     int page_number)
+{
+  fz_buffer *buf = session->buf;
   fz_stext_page *text;
 
-  sheet = fz_new_stext_sheet (ctx);
+  buf->len = 0;
+  text = fz_new_stext_page_from_page_number (ctx, &session->doc->super,
+					     page_number, session->sheet, 0);
+
+  fz_try (ctx)
+  {
+    for (int i = 0; i < text->len; ++i)
+      {
+	fz_page_block *block = &text->blocks[i];
+	if (block->type == FZ_PAGE_BLOCK_TEXT)
+	  process_block (ctx, buf, block->u.text);
+      }
+
+    fz_write_buffer (ctx, buf, "\f\n", 2);
+  }
+  fz_always (ctx)
+    fz_drop_stext_page (ctx, text);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return buf;
+}
+
+void
+pdfout_text_session_write_page (fz_context *ctx,
+				pdfout_text_session *session,
+				int page_number, fz_output *out)
+{
+  fz_buffer *buf = pdfout_text_session_extract (ctx, session, page_number);
+  fz_write (ctx, out, buf->data, buf->len);
+}
+
+/* Structured output.  The text of the scalars is collected in the
+   session buffer.  */
+
+static void
+emit_number (fz_context *ctx, pdfout_emitter *emitter, float number)
+{
+  char buf[32];
+  int len = pdfout_snprintf (ctx, buf, "%g", number);
+  pdfout_emitter_scalar (ctx, emitter, buf, len);
+}
+
+static void
+emit_bbox (fz_context *ctx, pdfout_emitter *emitter, const fz_rect *bbox)
+{
+  pdfout_emitter_string (ctx, emitter, "bbox");
+  pdfout_emitter_array_start (ctx, emitter);
+  emit_number (ctx, emitter, bbox->x0);
+  emit_number (ctx, emitter, bbox->y0);
+  emit_number (ctx, emitter, bbox->x1);
+  emit_number (ctx, emitter, bbox->y1);
+  pdfout_emitter_array_end (ctx, emitter);
+}
+
+/* Emit the "text" key and the contents of BUF.  */
+static void
+emit_text (fz_context *ctx, pdfout_emitter *emitter, fz_buffer *buf)
+{
+  pdfout_emitter_string (ctx, emitter, "text");
+  pdfout_emitter_string_scalar (ctx, emitter, (const char *) buf->data,
+				buf->len);
+}
+
+static void
+emit_style (fz_context *ctx, pdfout_emitter *emitter, fz_stext_span *span)
+{
+  fz_stext_style *style = span->style;
+  if (style == NULL)
+    return;
+  if (style->font)
+    {
+      pdfout_emitter_string (ctx, emitter, "font");
+      pdfout_emitter_string_scalar (ctx, emitter, style->font->name,
+				    strlen (style->font->name));
+    }
+  pdfout_emitter_string (ctx, emitter, "size");
+  emit_number (ctx, emitter, style->size);
+}
 
-  text = fz_new_stext_page_from_page_number (ctx, &doc->super, page_number,
-					     sheet, 0);
-  
-  /* printf ("in pdfout_text_get_page, page_number: %d, page->len: %d\n", */
-  /* 	  page_number, text->len); */
+static bool
+is_word_separator (int c)
+{
+  return c <= ' ';
+}
+
+static void
+emit_words (fz_context *ctx, pdfout_text_session *session,
+	    pdfout_emitter *emitter, fz_stext_span *span)
+{
+  fz_buffer *buf = session->buf;
+  int i = 0;
 
-  for (int i = 0; i < text->len; ++i)
+  while (i < span->len)
     {
-      fz_page_block *block = &text->blocks[i];
-      if (block->type == FZ_PAGE_BLOCK_TEXT)
-	process_block (ctx, stream, block->u.text);
+      if (is_word_separator (span->text[i].c))
+	{
+	  ++i;
+	  continue;
+	}
+
+      int start = i;
+      fz_rect bbox, char_bbox;
+      fz_stext_char_bbox (ctx, &bbox, span, i);
+      while (++i < span->len && is_word_separator (span->text[i].c) == false)
+	fz_union_rect (&bbox, fz_stext_char_bbox (ctx, &char_bbox, span, i));
+
+      pdfout_emitter_hash_start (ctx, emitter);
+      emit_bbox (ctx, emitter, &bbox);
+      buf->len = 0;
+      append_chars (ctx, buf, span->text + start, i - start);
+      emit_text (ctx, emitter, buf);
+      emit_style (ctx, emitter, span);
+      pdfout_emitter_hash_end (ctx, emitter);
     }
-  
-  fprintf (stream, "\f\n");
+}
+
+static void
+emit_chars (fz_context *ctx, pdfout_emitter *emitter, fz_stext_span *span)
+{
+  pdfout_emitter_string (ctx, emitter, "chars");
+  pdfout_emitter_array_start (ctx, emitter);
+  for (int i = 0; i < span->len; ++i)
+    {
+      char utf[4];
+      fz_rect bbox;
+      int c = span->text[i].c;
+      if (c == 0)
+	continue;
+
+      pdfout_emitter_hash_start (ctx, emitter);
+      pdfout_emitter_string (ctx, emitter, "c");
+      pdfout_emitter_string_scalar (ctx, emitter, utf,
+				    fz_runetochar (utf, c));
+      emit_bbox (ctx, emitter, fz_stext_char_bbox (ctx, &bbox, span, i));
+      pdfout_emitter_hash_end (ctx, emitter);
+    }
+  pdfout_emitter_array_end (ctx, emitter);
+}
+
+static void
+emit_line (fz_context *ctx, pdfout_text_session *session,
+	   pdfout_emitter *emitter, fz_stext_line *line,
+	   pdfout_text_granularity granularity)
+{
+  fz_stext_span *span;
+
+  pdfout_emitter_hash_start (ctx, emitter);
+  emit_bbox (ctx, emitter, &line->bbox);
+
+  switch (granularity)
+    {
+    case PDFOUT_TEXT_WORD:
+      pdfout_emitter_string (ctx, emitter, "words");
+      pdfout_emitter_array_start (ctx, emitter);
+      for (span = line->first_span; span; span = span->next)
+	emit_words (ctx, session, emitter, span);
+      pdfout_emitter_array_end (ctx, emitter);
+      break;
+    case PDFOUT_TEXT_CHAR:
+      pdfout_emitter_string (ctx, emitter, "spans");
+      pdfout_emitter_array_start (ctx, emitter);
+      for (span = line->first_span; span; span = span->next)
+	{
+	  pdfout_emitter_hash_start (ctx, emitter);
+	  emit_bbox (ctx, emitter, &span->bbox);
+	  session->buf->len = 0;
+	  append_chars (ctx, session->buf, span->text, span->len);
+	  emit_text (ctx, emitter, session->buf);
+	  emit_style (ctx, emitter, span);
+	  emit_chars (ctx, emitter, span);
+	  pdfout_emitter_hash_end (ctx, emitter);
+	}
+      pdfout_emitter_array_end (ctx, emitter);
+      break;
+    default:
+      session->buf->len = 0;
+      append_line (ctx, session->buf, line);
+      emit_text (ctx, emitter, session->buf);
+    }
+
+  pdfout_emitter_hash_end (ctx, emitter);
+}
+
+static void
+emit_block (fz_context *ctx, pdfout_text_session *session,
+	    pdfout_emitter *emitter, fz_stext_block *block,
+	    pdfout_text_granularity granularity)
+{
+  pdfout_emitter_hash_start (ctx, emitter);
+  emit_bbox (ctx, emitter, &block->bbox);
+
+  if (granularity == PDFOUT_TEXT_BLOCK)
+    {
+      session->buf->len = 0;
+      process_block (ctx, session->buf, block);
+      /* No newline after the last line.  */
+      if (session->buf->len)
+	--session->buf->len;
+      emit_text (ctx, emitter, session->buf);
+    }
+  else
+    {
+      pdfout_emitter_string (ctx, emitter, "lines");
+      pdfout_emitter_array_start (ctx, emitter);
+      for (int i = 0; i < block->len; ++i)
+	emit_line (ctx, session, emitter, &block->lines[i], granularity);
+      pdfout_emitter_array_end (ctx, emitter);
+    }
+
+  pdfout_emitter_hash_end (ctx, emitter);
+}
+
+void
+pdfout_text_session_emit_page (fz_context *ctx,
+			       pdfout_text_session *session,
+			       int page_number,
+			       pdfout_text_granularity granularity,
+			       pdfout_emitter *emitter)
+{
+  fz_stext_page *text =
+    fz_new_stext_page_from_page_number (ctx, &session->doc->super,
+					page_number, session->sheet, 0);
+
+  fz_try (ctx)
+  {
+    pdfout_emitter_hash_start (ctx, emitter);
+    pdfout_emitter_string (ctx, emitter, "page");
+    emit_number (ctx, emitter, page_number + 1);
+    pdfout_emitter_string (ctx, emitter, "width");
+    emit_number (ctx, emitter, text->mediabox.x1 - text->mediabox.x0);
+    pdfout_emitter_string (ctx, emitter, "height");
+    emit_number (ctx, emitter, text->mediabox.y1 - text->mediabox.y0);
 
-  /* cleanup */
-  fz_drop_stext_page (ctx, text);
-  fz_drop_stext_sheet (ctx, sheet);
+    pdfout_emitter_string (ctx, emitter, "blocks");
+    pdfout_emitter_array_start (ctx, emitter);
+    for (int i = 0; i < text->len; ++i)
+      {
+	fz_page_block *block = &text->blocks[i];
+	if (block->type == FZ_PAGE_BLOCK_TEXT)
+	  emit_block (ctx, session, emitter, block->u.text, granularity);
+      }
+    pdfout_emitter_array_end (ctx, emitter);
+    pdfout_emitter_hash_end (ctx, emitter);
+  }
+  fz_always (ctx)
+    fz_drop_stext_page (ctx, text);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
 }
@@ -0,0 +1,49 @@
+#ifndef HAVE_PDFOUT_TEXT_EXTRACTION_H
+#define HAVE_PDFOUT_TEXT_EXTRACTION_H
+
+/* Text extraction from the pages of a document.  A session owns the
+   resources which are reused for all pages: the style sheet, so that the
+   styles are shared by all pages, and the buffer holding the text of the
+   current page.  */
+typedef struct pdfout_text_session_s pdfout_text_session;
+
+/* DOC is borrowed and must outlive the session.  */
+pdfout_text_session *pdfout_text_session_new (fz_context *ctx,
+					      pdf_document *doc);
+
+void pdfout_text_session_drop (fz_context *ctx,
+			       pdfout_text_session *session);
+
+/* Return the text of the zero-based page PAGE_NUMBER, followed by a form
+   feed and a newline.  The buffer is owned by SESSION and overwritten by
+   the next call.  */
+fz_buffer *pdfout_text_session_extract (fz_context *ctx,
+					pdfout_text_session *session,
+					int page_number);
+
+/* Extract the text of PAGE_NUMBER and write it to OUT.  */
+void pdfout_text_session_write_page (fz_context *ctx,
+				     pdfout_text_session *session,
+				     int page_number, fz_output *out);
+
+typedef enum {
+  /* Blocks with their text.  */
+  PDFOUT_TEXT_BLOCK,
+  /* Blocks with lines with their text.  */
+  PDFOUT_TEXT_LINE,
+  /* Lines with words, with font and size.  */
+  PDFOUT_TEXT_WORD,
+  /* Lines with spans, with font and size, and their characters.  */
+  PDFOUT_TEXT_CHAR
+} pdfout_text_granularity;
+
+/* Feed the structure of PAGE_NUMBER to EMITTER, as a hash with the keys
+   page, width, height and blocks.  Everything has a bounding box "bbox",
+   the level given by GRANULARITY has its "text".  */
+void pdfout_text_session_emit_page (fz_context *ctx,
+				    pdfout_text_session *session,
+				    int page_number,
+				    pdfout_text_granularity granularity,
+				    pdfout_emitter *emitter);
+
+#endif	/* ! HAVE_PDFOUT_TEXT_EXTRACTION_H */
@@ -0,0 +1,901 @@
+#include "common.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef _WIN32
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+/* All integers of the index file are little endian.  The tables have
+   fixed-size entries and can be used in place, so opening an index only
+   maps the file and checks the header.  */
+
+#define MAGIC "PDFOUTIX"
+#define VERSION 1
+
+enum {
+  HEADER_SIZE = 48,
+  FILE_ENTRY_SIZE = 40,
+  TERM_ENTRY_SIZE = 24
+};
+
+static void
+put_u32 (fz_context *ctx, fz_buffer *buf, uint32_t x)
+{
+  unsigned char b[4];
+  for (int i = 0; i < 4; ++i)
+    b[i] = x >> (8 * i);
+  fz_write_buffer (ctx, buf, b, 4);
+}
+
+static void
+put_u64 (fz_context *ctx, fz_buffer *buf, uint64_t x)
+{
+  put_u32 (ctx, buf, x);
+  put_u32 (ctx, buf, x >> 32);
+}
+
+static void
+put_varint (fz_context *ctx, fz_buffer *buf, uint32_t x)
+{
+  while (x >= 0x80)
+    {
+      fz_write_buffer_byte (ctx, buf, (x & 0x7f) | 0x80);
+      x >>= 7;
+    }
+  fz_write_buffer_byte (ctx, buf, x);
+}
+
+static void
+pad (fz_context *ctx, fz_buffer *buf)
+{
+  while (buf->len % 8)
+    fz_write_buffer_byte (ctx, buf, 0);
+}
+
+static uint32_t
+get_u32 (const unsigned char *p)
+{
+  return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16
+    | (uint32_t) p[3] << 24;
+}
+
+static uint64_t
+get_u64 (const unsigned char *p)
+{
+  return get_u32 (p) | (uint64_t) get_u32 (p + 4) << 32;
+}
+
+/* Terms.  */
+
+/* Whether the character C belongs to a term.  */
+static bool
+is_term_char (int c)
+{
+  if (c < 0x80)
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+      || (c >= 'A' && c <= 'Z');
+  /* Latin-1 punctuation and symbols.  */
+  if (c < 0xc0 || c == 0xd7 || c == 0xf7)
+    return false;
+  /* General punctuation up to the arrows and symbols before Glagolitic,
+     and CJK punctuation.  */
+  if ((c >= 0x2000 && c < 0x2c00) || (c >= 0x3000 && c < 0x3040))
+    return false;
+  return c != 0xfffd;
+}
+
+/* Only ASCII and Latin-1 letters are folded.  */
+static int
+fold_case (int c)
+{
+  if ((c >= 'A' && c <= 'Z') || (c >= 0xc0 && c <= 0xde && c != 0xd7))
+    return c + 0x20;
+  return c;
+}
+
+static int
+decode_char (const char *p, const char *end, int *c)
+{
+  if ((unsigned char) *p < 0x80)
+    {
+      *c = (unsigned char) *p;
+      return 1;
+    }
+  if (end - p < 4)
+    {
+      /* Do not let a truncated sequence read past END.  */
+      char tail[5] = { 0 };
+      memcpy (tail, p, end - p);
+      return fz_chartorune (c, tail);
+    }
+  return fz_chartorune (c, p);
+}
+
+/* Store the next term of the text from *P to END in TERM, which must have
+   room for PDFOUT_TEXT_INDEX_MAX_TERM bytes, and return its length.
+   Runs which are longer, e.g. CJK text without spaces, are split into
+   several terms at character boundaries.  Return -1 at the end of the
+   text.  */
+static int
+next_term (const char **p, const char *end, char *term)
+{
+  int c, n;
+
+  while (*p < end && (n = decode_char (*p, end, &c),
+		      is_term_char (c) == false))
+    *p += n;
+  if (*p == end)
+    return -1;
+
+  int len = 0;
+  while (*p < end && (n = decode_char (*p, end, &c), is_term_char (c)))
+    {
+      char utf[4];
+      int utf_len = fz_runetochar (utf, fold_case (c));
+      if (len + utf_len > PDFOUT_TEXT_INDEX_MAX_TERM)
+	break;
+      memcpy (term + len, utf, utf_len);
+      len += utf_len;
+      *p += n;
+    }
+  return len;
+}
+
+static int
+compare_terms (const char *a, int a_len, const char *b, int b_len)
+{
+  int cmp = memcmp (a, b, fz_mini (a_len, b_len));
+  return cmp ? cmp : a_len - b_len;
+}
+
+/* Reading.  */
+
+struct pdfout_text_index_s {
+  /* Either mapped or in BUF.  */
+  const unsigned char *data;
+  size_t len;
+  fz_buffer *buf;
+
+  int n_files, n_terms;
+  const unsigned char *files, *terms, *postings, *strings;
+  size_t postings_len, strings_len;
+};
+
+static void
+throw_corrupt (fz_context *ctx)
+{
+  pdfout_throw (ctx, "corrupt text index");
+}
+
+static void
+check_header (fz_context *ctx, pdfout_text_index *index)
+{
+  const unsigned char *d = index->data;
+  size_t len = index->len;
+
+  if (len < HEADER_SIZE || memcmp (d, MAGIC, 8))
+    pdfout_throw (ctx, "not a text index");
+  if (get_u32 (d + 8) != VERSION)
+    pdfout_throw (ctx, "unsupported text index version %u",
+		  (unsigned) get_u32 (d + 8));
+
+  uint64_t n_files = get_u32 (d + 12);
+  uint64_t n_terms = get_u32 (d + 16);
+  uint64_t files = get_u64 (d + 24);
+  uint64_t postings = get_u64 (d + 32);
+  uint64_t strings = get_u64 (d + 40);
+
+  /* Bound the offsets by LEN first, so that the sums below cannot
+     overflow.  */
+  if (files < HEADER_SIZE || files > postings || postings > strings
+      || strings > len || n_files > INT_MAX || n_terms > INT_MAX)
+    throw_corrupt (ctx);
+
+  /* The term table follows the file table, so that
+     FILES <= TERMS <= POSTINGS.  */
+  if (n_files * FILE_ENTRY_SIZE > postings - files)
+    throw_corrupt (ctx);
+  uint64_t terms = files + n_files * FILE_ENTRY_SIZE;
+  if (n_terms * TERM_ENTRY_SIZE > postings - terms)
+    throw_corrupt (ctx);
+
+  index->n_files = n_files;
+  index->n_terms = n_terms;
+  index->files = d + files;
+  index->terms = d + terms;
+  index->postings = d + postings;
+  index->postings_len = strings - postings;
+  index->strings = d + strings;
+  index->strings_len = len - strings;
+}
+
+pdfout_text_index *
+pdfout_text_index_new_from_buffer (fz_context *ctx, fz_buffer *buf)
+{
+  pdfout_text_index *index = fz_malloc_struct (ctx, pdfout_text_index);
+
+  index->buf = fz_keep_buffer (ctx, buf);
+  index->data = buf->data;
+  index->len = buf->len;
+  fz_try (ctx)
+    check_header (ctx, index);
+  fz_catch (ctx)
+  {
+    pdfout_text_index_drop (ctx, index);
+    fz_rethrow (ctx);
+  }
+
+  return index;
+}
+
+#ifdef _WIN32
+
+pdfout_text_index *
+pdfout_text_index_open (fz_context *ctx, const char *filename)
+{
+  fz_stream *stm = fz_open_file (ctx, filename);
+  fz_buffer *buf = NULL;
+  pdfout_text_index *index = NULL;
+
+  fz_var (buf);
+  fz_try (ctx)
+  {
+    buf = fz_read_all (ctx, stm, 0);
+    index = pdfout_text_index_new_from_buffer (ctx, buf);
+  }
+  fz_always (ctx)
+  {
+    fz_drop_buffer (ctx, buf);
+    fz_drop_stream (ctx, stm);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+
+  return index;
+}
+
+#else
+
+pdfout_text_index *
+pdfout_text_index_open (fz_context *ctx, const char *filename)
+{
+  pdfout_text_index *index = fz_malloc_struct (ctx, pdfout_text_index);
+  int fd = -1;
+  struct stat st;
+
+  fz_var (fd);
+  fz_try (ctx)
+  {
+    fd = open (filename, O_RDONLY);
+    if (fd < 0 || fstat (fd, &st))
+      pdfout_throw_errno (ctx, "cannot open '%s'", filename);
+    if (st.st_size < HEADER_SIZE)
+      pdfout_throw (ctx, "'%s' is not a text index", filename);
+
+    void *data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+      pdfout_throw_errno (ctx, "cannot map '%s'", filename);
+    index->data = data;
+    index->len = st.st_size;
+
+    check_header (ctx, index);
+  }
+  fz_always (ctx)
+  {
+    /* The mapping stays valid.  */
+    if (fd >= 0)
+      close (fd);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_text_index_drop (ctx, index);
+    fz_rethrow (ctx);
+  }
+
+  return index;
+}
+
+#endif
+
+void
+pdfout_text_index_drop (fz_context *ctx, pdfout_text_index *index)
+{
+  if (index == NULL)
+    return;
+
+  if (index->buf)
+    fz_drop_buffer (ctx, index->buf);
+#ifndef _WIN32
+  else if (index->data)
+    munmap ((void *) index->data, index->len);
+#endif
+  free (index);
+}
+
+int
+pdfout_text_index_file_count (fz_context *ctx, pdfout_text_index *index)
+{
+  return index->n_files;
+}
+
+void
+pdfout_text_index_get_file (fz_context *ctx, pdfout_text_index *index,
+			    int i, pdfout_text_index_file *file)
+{
+  const unsigned char *entry = index->files + (size_t) i * FILE_ENTRY_SIZE;
+  uint64_t name = get_u32 (entry);
+  uint64_t name_len = get_u32 (entry + 4);
+
+  /* Names are null-terminated.  */
+  if (name + name_len >= index->strings_len
+      || index->strings[name + name_len] != '\0')
+    throw_corrupt (ctx);
+
+  file->name = (const char *) index->strings + name;
+  file->page_count = get_u32 (entry + 8);
+  file->size = get_u64 (entry + 16);
+  file->mtime = get_u64 (entry + 24);
+  file->hash = get_u64 (entry + 32);
+}
+
+static int
+entry_count (const unsigned char *entry)
+{
+  return get_u32 (entry + 8);
+}
+
+/* Check that the postings of the term ENTRY are inside the index.  */
+static void
+check_entry (fz_context *ctx, pdfout_text_index *index,
+	     const unsigned char *entry)
+{
+  uint64_t count = get_u32 (entry + 8);
+  uint64_t len = get_u32 (entry + 12);
+  uint64_t start = get_u64 (entry + 16);
+
+  /* A posting takes at least two bytes.  */
+  if (start > index->postings_len || len > index->postings_len - start
+      || count > len / 2)
+    throw_corrupt (ctx);
+}
+
+/* Return the entry of TERM, or NULL if it is not in the index.  */
+static const unsigned char *
+find_term (fz_context *ctx, pdfout_text_index *index, const char *term,
+	   int len)
+{
+  int low = 0, high = index->n_terms;
+
+  while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+      const unsigned char *entry =
+	index->terms + (size_t) mid * TERM_ENTRY_SIZE;
+      uint64_t start = get_u32 (entry);
+      uint64_t entry_len = get_u32 (entry + 4);
+      if (start + entry_len > index->strings_len)
+	throw_corrupt (ctx);
+
+      int cmp = compare_terms ((const char *) index->strings + start,
+			       entry_len, term, len);
+      if (cmp == 0)
+	{
+	  check_entry (ctx, index, entry);
+	  return entry;
+	}
+      if (cmp < 0)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+  return NULL;
+}
+
+static uint32_t
+get_varint (fz_context *ctx, const unsigned char **p,
+	    const unsigned char *end)
+{
+  uint32_t x = 0;
+  for (int shift = 0; shift < 35; shift += 7)
+    {
+      if (*p == end)
+	break;
+      unsigned char b = *(*p)++;
+      x |= (uint32_t) (b & 0x7f) << shift;
+      if (b < 0x80)
+	return x;
+    }
+  throw_corrupt (ctx);
+  return 0;
+}
+
+/* Decode the postings of the term ENTRY, which passed check_entry, into
+   HITS, which must have room for the count of the entry.  Each posting is
+   the difference of the file number to the previous posting, followed by
+   the page, which is relative to the previous page if the file is the
+   same.  */
+static void
+decode_postings (fz_context *ctx, pdfout_text_index *index,
+		 const unsigned char *entry, pdfout_text_hit *hits)
+{
+  uint32_t count = get_u32 (entry + 8);
+  const unsigned char *p = index->postings + get_u64 (entry + 16);
+  const unsigned char *end = p + get_u32 (entry + 12);
+  int64_t file = 0, page = 0;
+
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      uint32_t file_delta = get_varint (ctx, &p, end);
+      uint32_t page_value = get_varint (ctx, &p, end);
+      file += file_delta;
+      page = file_delta ? page_value : page + page_value;
+      if (file >= index->n_files || page > INT_MAX)
+	throw_corrupt (ctx);
+      hits[i].file = file;
+      hits[i].page = page;
+    }
+}
+
+static int
+compare_entry_counts (const void *a, const void *b)
+{
+  int count_a = entry_count (*(const unsigned char **) a);
+  int count_b = entry_count (*(const unsigned char **) b);
+  return (count_a > count_b) - (count_a < count_b);
+}
+
+static int
+compare_hits (const pdfout_text_hit *a, const pdfout_text_hit *b)
+{
+  if (a->file != b->file)
+    return a->file < b->file ? -1 : 1;
+  return (a->page > b->page) - (a->page < b->page);
+}
+
+/* Keep the hits of HITS which are also in OTHER.  Return their number.  */
+static int
+intersect (pdfout_text_hit *hits, int n, const pdfout_text_hit *other,
+	   int n_other)
+{
+  int i = 0, j = 0, len = 0;
+  while (i < n && j < n_other)
+    {
+      int cmp = compare_hits (&hits[i], &other[j]);
+      if (cmp == 0)
+	{
+	  hits[len++] = hits[i];
+	  ++i, ++j;
+	}
+      else if (cmp < 0)
+	++i;
+      else
+	++j;
+    }
+  return len;
+}
+
+pdfout_text_hit *
+pdfout_text_index_search (fz_context *ctx, pdfout_text_index *index,
+			  const char *query, int *n_hits)
+{
+  const unsigned char **entries = NULL;
+  pdfout_text_hit *hits = NULL, *other = NULL;
+  int n_entries = 0, cap = 0, n = 0;
+  const char *p = query, *end = query + strlen (query);
+  char term[PDFOUT_TEXT_INDEX_MAX_TERM];
+  int len;
+  bool missing = false;
+
+  fz_var (entries);
+  fz_var (hits);
+  fz_var (other);
+  fz_try (ctx)
+  {
+    while ((len = next_term (&p, end, term)) >= 0)
+      {
+	const unsigned char *entry = find_term (ctx, index, term, len);
+	if (entry == NULL)
+	  missing = true;
+	if (n_entries == cap)
+	  entries = pdfout_x2nrealloc (ctx, entries, &cap,
+				       const unsigned char *);
+	entries[n_entries++] = entry;
+      }
+    if (n_entries == 0)
+      pdfout_throw (ctx, "no search terms in '%s'", query);
+
+    if (missing == false)
+      {
+	/* Start with the rarest term, every step can only remove hits.  */
+	qsort (entries, n_entries, sizeof *entries, compare_entry_counts);
+	n = entry_count (entries[0]);
+	hits = fz_malloc_array (ctx, n, sizeof *hits);
+	decode_postings (ctx, index, entries[0], hits);
+	for (int i = 1; i < n_entries && n; ++i)
+	  {
+	    int n_other = entry_count (entries[i]);
+	    other = fz_resize_array (ctx, other, n_other, sizeof *other);
+	    decode_postings (ctx, index, entries[i], other);
+	    n = intersect (hits, n, other, n_other);
+	  }
+      }
+  }
+  fz_always (ctx)
+  {
+    free (entries);
+    free (other);
+  }
+  fz_catch (ctx)
+  {
+    free (hits);
+    fz_rethrow (ctx);
+  }
+
+  *n_hits = n;
+  return hits;
+}
+
+/* Building.  */
+
+typedef struct {
+  /* File number in the upper, page in the lower 32 bits, so that the
+     postings sort by file and page.  */
+  uint64_t *postings;
+  int len, cap;
+} posting_list;
+
+typedef struct {
+  char *name;
+  pdfout_text_index_file info;
+} builder_file;
+
+struct pdfout_text_index_builder_s {
+  builder_file *files;
+  int n_files, files_cap;
+
+  /* The lists are in the order of the terms in TERMS.  */
+  pdfout_hash *terms;
+  posting_list *lists;
+  int lists_cap;
+};
+
+pdfout_text_index_builder *
+pdfout_text_index_builder_new (fz_context *ctx)
+{
+  pdfout_text_index_builder *builder =
+    fz_malloc_struct (ctx, pdfout_text_index_builder);
+
+  fz_try (ctx)
+    builder->terms = pdfout_hash_new (ctx);
+  fz_catch (ctx)
+  {
+    free (builder);
+    fz_rethrow (ctx);
+  }
+
+  return builder;
+}
+
+void
+pdfout_text_index_builder_drop (fz_context *ctx,
+				pdfout_text_index_builder *builder)
+{
+  if (builder == NULL)
+    return;
+
+  for (int i = 0; i < builder->n_files; ++i)
+    free (builder->files[i].name);
+  free (builder->files);
+  if (builder->terms)
+    for (int i = 0; i < pdfout_hash_count (ctx, builder->terms); ++i)
+      free (builder->lists[i].postings);
+  free (builder->lists);
+  pdfout_hash_drop (ctx, builder->terms);
+  free (builder);
+}
+
+int
+pdfout_text_index_builder_add_file (fz_context *ctx,
+				    pdfout_text_index_builder *builder,
+				    const pdfout_text_index_file *file)
+{
+  if (builder->n_files == builder->files_cap)
+    builder->files = pdfout_x2nrealloc (ctx, builder->files,
+					&builder->files_cap, builder_file);
+
+  builder_file *f = &builder->files[builder->n_files];
+  f->name = fz_strdup (ctx, file->name);
+  f->info = *file;
+  f->info.name = f->name;
+  return builder->n_files++;
+}
+
+void
+pdfout_text_index_builder_set_file (fz_context *ctx,
+				    pdfout_text_index_builder *builder,
+				    int file, int page_count, uint64_t hash)
+{
+  builder->files[file].info.page_count = page_count;
+  builder->files[file].info.hash = hash;
+}
+
+static void
+add_posting (fz_context *ctx, pdfout_text_index_builder *builder,
+	     const char *term, int len, int file, int page)
+{
+  uint64_t posting = (uint64_t) file << 32 | (uint32_t) page;
+  int i = pdfout_hash_find (ctx, builder->terms, term, len);
+
+  if (i < 0)
+    {
+      i = pdfout_hash_count (ctx, builder->terms);
+      if (i == builder->lists_cap)
+	{
+	  int old_cap = builder->lists_cap;
+	  builder->lists = pdfout_x2nrealloc (ctx, builder->lists,
+					      &builder->lists_cap,
+					      posting_list);
+	  memset (builder->lists + old_cap, 0,
+		  (builder->lists_cap - old_cap) * sizeof *builder->lists);
+	}
+      pdfout_hash_insert (ctx, builder->terms, term, len, NULL);
+    }
+
+  posting_list *list = &builder->lists[i];
+  /* A term which occurs again on the same page.  */
+  if (list->len && list->postings[list->len - 1] == posting)
+    return;
+  if (list->len == list->cap)
+    list->postings = pdfout_x2nrealloc (ctx, list->postings, &list->cap,
+					uint64_t);
+  list->postings[list->len++] = posting;
+}
+
+void
+pdfout_text_index_builder_add_text (fz_context *ctx,
+				    pdfout_text_index_builder *builder,
+				    int file, int page, const char *text,
+				    size_t len)
+{
+  const char *p = text, *end = text + len;
+  char term[PDFOUT_TEXT_INDEX_MAX_TERM];
+  int term_len;
+
+  while ((term_len = next_term (&p, end, term)) >= 0)
+    add_posting (ctx, builder, term, term_len, file, page);
+}
+
+void
+pdfout_text_index_builder_copy (fz_context *ctx,
+				pdfout_text_index_builder *builder,
+				pdfout_text_index *old, const int *map)
+{
+  pdfout_text_hit *hits = NULL;
+  int cap = 0;
+
+  fz_var (hits);
+  fz_try (ctx)
+  {
+    for (int i = 0; i < old->n_terms; ++i)
+      {
+	const unsigned char *entry = old->terms + (size_t) i * TERM_ENTRY_SIZE;
+	uint64_t start = get_u32 (entry);
+	uint64_t len = get_u32 (entry + 4);
+	int n = entry_count (entry);
+	if (start + len > old->strings_len || len > PDFOUT_TEXT_INDEX_MAX_TERM)
+	  throw_corrupt (ctx);
+	check_entry (ctx, old, entry);
+
+	if (n > cap)
+	  {
+	    hits = fz_resize_array (ctx, hits, n, sizeof *hits);
+	    cap = n;
+	  }
+	decode_postings (ctx, old, entry, hits);
+	for (int k = 0; k < n; ++k)
+	  if (map[hits[k].file] >= 0)
+	    add_posting (ctx, builder, (const char *) old->strings + start,
+			 len, map[hits[k].file], hits[k].page);
+      }
+  }
+  fz_always (ctx)
+    free (hits);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+typedef struct {
+  const char *key;
+  int len;
+  int list;
+} sorted_term;
+
+static int
+compare_sorted_terms (const void *a, const void *b)
+{
+  const sorted_term *x = a, *y = b;
+  return compare_terms (x->key, x->len, y->key, y->len);
+}
+
+static int
+compare_postings (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+/* Append the postings of LIST to BUF, renumbering the files with FILE_MAP.
+   Return their number.  */
+static int
+encode_postings (fz_context *ctx, fz_buffer *buf, posting_list *list,
+		 const int *file_map)
+{
+  int prev_file = -1;
+  int64_t prev_page = 0;
+  int count = 0;
+
+  qsort (list->postings, list->len, sizeof *list->postings,
+	 compare_postings);
+  for (int i = 0; i < list->len; ++i)
+    {
+      int file = file_map[list->postings[i] >> 32];
+      int64_t page = (uint32_t) list->postings[i];
+      if (file < 0 || (file == prev_file && page == prev_page))
+	continue;
+
+      if (file == prev_file)
+	{
+	  put_varint (ctx, buf, 0);
+	  put_varint (ctx, buf, page - prev_page);
+	}
+      else
+	{
+	  put_varint (ctx, buf, file - fz_maxi (prev_file, 0));
+	  put_varint (ctx, buf, page);
+	}
+      prev_file = file;
+      prev_page = page;
+      ++count;
+    }
+  return count;
+}
+
+static uint32_t
+add_string (fz_context *ctx, fz_buffer *strings, const char *s, size_t len)
+{
+  size_t start = strings->len;
+  if (start + len >= UINT32_MAX)
+    pdfout_throw (ctx, "text index too large");
+  fz_write_buffer (ctx, strings, s, len);
+  return start;
+}
+
+void
+pdfout_text_index_builder_write (fz_context *ctx,
+				 pdfout_text_index_builder *builder,
+				 fz_output *out)
+{
+  int n_terms = pdfout_hash_count (ctx, builder->terms);
+  int *file_map = fz_malloc_array (ctx, fz_maxi (builder->n_files, 1),
+				   sizeof *file_map);
+  sorted_term *terms = NULL;
+  fz_buffer *head = NULL, *postings = NULL, *strings = NULL;
+  int n_files = 0, n_written = 0;
+
+  fz_var (terms);
+  fz_var (head);
+  fz_var (postings);
+  fz_var (strings);
+  fz_try (ctx)
+  {
+    head = fz_new_buffer (ctx, 4096);
+    postings = fz_new_buffer (ctx, 4096);
+    strings = fz_new_buffer (ctx, 4096);
+
+    fz_write_buffer (ctx, head, MAGIC, 8);
+    put_u32 (ctx, head, VERSION);
+    /* Counts and offsets, filled in below.  */
+    while (head->len < HEADER_SIZE)
+      fz_write_buffer_byte (ctx, head, 0);
+
+    for (int i = 0; i < builder->n_files; ++i)
+      {
+	pdfout_text_index_file *f = &builder->files[i].info;
+	if (f->page_count <= 0)
+	  {
+	    file_map[i] = -1;
+	    continue;
+	  }
+	file_map[i] = n_files++;
+	size_t len = strlen (f->name);
+	put_u32 (ctx, head, add_string (ctx, strings, f->name, len + 1));
+	put_u32 (ctx, head, len);
+	put_u32 (ctx, head, f->page_count);
+	put_u32 (ctx, head, 0);
+	put_u64 (ctx, head, f->size);
+	put_u64 (ctx, head, f->mtime);
+	put_u64 (ctx, head, f->hash);
+      }
+
+    terms = fz_malloc_array (ctx, fz_maxi (n_terms, 1), sizeof *terms);
+    for (int i = 0; i < n_terms; ++i)
+      {
+	terms[i].key = pdfout_hash_key (ctx, builder->terms, i, &terms[i].len);
+	terms[i].list = i;
+      }
+    qsort (terms, n_terms, sizeof *terms, compare_sorted_terms);
+
+    for (int i = 0; i < n_terms; ++i)
+      {
+	size_t start = postings->len;
+	int count = encode_postings (ctx, postings,
+				     &builder->lists[terms[i].list], file_map);
+	/* Terms of left out files only.  */
+	if (count == 0)
+	  continue;
+	put_u32 (ctx, head, add_string (ctx, strings, terms[i].key,
+					 terms[i].len));
+	put_u32 (ctx, head, terms[i].len);
+	put_u32 (ctx, head, count);
+	put_u32 (ctx, head, postings->len - start);
+	put_u64 (ctx, head, start);
+	++n_written;
+      }
+    pad (ctx, postings);
+
+    unsigned char *h = head->data;
+    uint64_t postings_start = head->len;
+    uint64_t strings_start = postings_start + postings->len;
+    for (int i = 0; i < 4; ++i)
+      {
+	h[12 + i] = (uint32_t) n_files >> (8 * i);
+	h[16 + i] = (uint32_t) n_written >> (8 * i);
+      }
+    for (int i = 0; i < 8; ++i)
+      {
+	h[24 + i] = (uint64_t) HEADER_SIZE >> (8 * i);
+	h[32 + i] = postings_start >> (8 * i);
+	h[40 + i] = strings_start >> (8 * i);
+      }
+
+    fz_write (ctx, out, head->data, head->len);
+    fz_write (ctx, out, postings->data, postings->len);
+    fz_write (ctx, out, strings->data, strings->len);
+  }
+  fz_always (ctx)
+  {
+    fz_drop_buffer (ctx, strings);
+    fz_drop_buffer (ctx, postings);
+    fz_drop_buffer (ctx, head);
+    free (terms);
+    free (file_map);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+uint64_t
+pdfout_text_index_hash_file (fz_context *ctx, const char *filename)
+{
+  FILE *f = fopen (filename, "rb");
+  if (f == NULL)
+    pdfout_throw_errno (ctx, "cannot open '%s'", filename);
+
+  /* FNV-1a, 64 bits.  */
+  uint64_t hash = UINT64_C (14695981039346656037);
+  unsigned char buf[65536];
+  size_t n;
+  while ((n = fread (buf, 1, sizeof buf, f)) > 0)
+    for (size_t i = 0; i < n; ++i)
+      {
+	hash ^= buf[i];
+	hash *= UINT64_C (1099511628211);
+      }
+
+  bool failed = ferror (f);
+  fclose (f);
+  if (failed)
+    pdfout_throw (ctx, "cannot read '%s'", filename);
+  return hash;
+}
@@ -0,0 +1,98 @@
+#ifndef HAVE_PDFOUT_TEXT_INDEX_H
+#define HAVE_PDFOUT_TEXT_INDEX_H
+
+/* Inverted index from terms to the pages of many PDF files, stored in a
+   single file.  See doc/internal/misc.pod for the format.  */
+
+/* Terms are runs of letters and digits, lowercased, of at most this many
+   bytes.  Longer runs are split into several terms.  */
+#define PDFOUT_TEXT_INDEX_MAX_TERM 64
+
+/* A file as recorded in the index.  */
+typedef struct {
+  /* Null-terminated.  */
+  const char *name;
+  int64_t size;
+  /* Modification time in seconds since the epoch.  */
+  int64_t mtime;
+  /* Of the contents, see pdfout_text_index_hash_file.  */
+  uint64_t hash;
+  int page_count;
+} pdfout_text_index_file;
+
+typedef struct {
+  int file;
+  /* Zero-based.  */
+  int page;
+} pdfout_text_hit;
+
+/* Reading.  */
+
+typedef struct pdfout_text_index_s pdfout_text_index;
+
+/* Map the index file FILENAME into memory.  Throw if it is not an
+   index.  */
+pdfout_text_index *pdfout_text_index_open (fz_context *ctx,
+					   const char *filename);
+
+/* Use the index in BUF, which is kept.  */
+pdfout_text_index *pdfout_text_index_new_from_buffer (fz_context *ctx,
+						      fz_buffer *buf);
+
+void pdfout_text_index_drop (fz_context *ctx, pdfout_text_index *index);
+
+int pdfout_text_index_file_count (fz_context *ctx, pdfout_text_index *index);
+
+/* Fill FILE with file number I.  The name points into the index.  */
+void pdfout_text_index_get_file (fz_context *ctx, pdfout_text_index *index,
+				 int i, pdfout_text_index_file *file);
+
+/* Return the pages containing all terms of QUERY, sorted by file and page,
+   and set *N_HITS to their number.  Throw if QUERY has no terms.  */
+pdfout_text_hit *pdfout_text_index_search (fz_context *ctx,
+					   pdfout_text_index *index,
+					   const char *query, int *n_hits);
+
+/* Building.  */
+
+typedef struct pdfout_text_index_builder_s pdfout_text_index_builder;
+
+pdfout_text_index_builder *pdfout_text_index_builder_new (fz_context *ctx);
+
+void pdfout_text_index_builder_drop (fz_context *ctx,
+				     pdfout_text_index_builder *builder);
+
+/* Add FILE, whose name is copied, and return its number.  Files are
+   written in the order they were added.  */
+int pdfout_text_index_builder_add_file (fz_context *ctx,
+					pdfout_text_index_builder *builder,
+					const pdfout_text_index_file *file);
+
+/* Set what is only known after reading FILE.  Files without pages, e.g.
+   those which could not be read, are left out of the index.  */
+void pdfout_text_index_builder_set_file (fz_context *ctx,
+					 pdfout_text_index_builder *builder,
+					 int file, int page_count,
+					 uint64_t hash);
+
+/* Add the terms of the LEN bytes of UTF-8 TEXT to PAGE of FILE.  The
+   pages of a file must be added in increasing order.  */
+void pdfout_text_index_builder_add_text (fz_context *ctx,
+					 pdfout_text_index_builder *builder,
+					 int file, int page, const char *text,
+					 size_t len);
+
+/* Add the terms of the files of OLD for which MAP gives a file number of
+   BUILDER, i.e. MAP[I] is the new number of file I of OLD, or -1.  */
+void pdfout_text_index_builder_copy (fz_context *ctx,
+				     pdfout_text_index_builder *builder,
+				     pdfout_text_index *old, const int *map);
+
+void pdfout_text_index_builder_write (fz_context *ctx,
+				      pdfout_text_index_builder *builder,
+				      fz_output *out);
+
+/* Return the FNV-1a hash of the contents of FILENAME.  */
+uint64_t pdfout_text_index_hash_file (fz_context *ctx, const char *filename);
+
+#endif	/* ! HAVE_PDFOUT_TEXT_INDEX_H */
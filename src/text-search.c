@@ -0,0 +1,357 @@
+#include "common.h"
+#include <regex.h>
+
+/* Lines are searched in two steps.  A literal string which every match
+   must contain is looked up with memchr and memcmp first, and only the
+   lines containing it are passed to regexec.  If the whole pattern is
+   literal, regexec is not needed at all.  */
+
+struct pdfout_matcher_s {
+  regex_t regex;
+  bool has_regex;
+
+  char *literal;
+  int literal_len;
+};
+
+/* Scanner for the required literal of a regular expression.  The runs of
+   literal characters which are not made optional by a quantifier are
+   candidates, the longest one wins.  Everything else ends a run.  */
+typedef struct {
+  const char *p;
+  bool extended;
+  /* The current and the best run.  */
+  char *run, *best;
+  int run_len, best_len;
+  /* Whether the pattern only consists of literal characters.  */
+  bool pure;
+} literal_scanner;
+
+static void
+end_run (literal_scanner *s)
+{
+  if (s->run_len > s->best_len)
+    {
+      memcpy (s->best, s->run, s->run_len);
+      s->best_len = s->run_len;
+    }
+  s->run_len = 0;
+}
+
+/* Something which is not a literal character.  */
+static void
+special (literal_scanner *s)
+{
+  end_run (s);
+  s->pure = false;
+}
+
+/* Whether the quantifier at P applies to the preceding atom.  */
+static bool
+is_quantifier (literal_scanner *s, const char *p)
+{
+  if (p[0] == '*')
+    return true;
+  if (s->extended)
+    return p[0] == '+' || p[0] == '?' || p[0] == '{';
+  return p[0] == '\\' && (p[1] == '{' || p[1] == '+' || p[1] == '?');
+}
+
+/* Skip the bracket expression starting at P, after the '['.  */
+static const char *
+skip_bracket (const char *p)
+{
+  if (*p == '^')
+    ++p;
+  if (*p == ']')
+    ++p;
+  while (*p && *p != ']')
+    {
+      if (p[0] == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+	{
+	  char delim = p[1];
+	  p += 2;
+	  while (*p && !(p[0] == delim && p[1] == ']'))
+	    ++p;
+	  if (*p)
+	    p += 2;
+	}
+      else
+	++p;
+    }
+  return *p ? p + 1 : p;
+}
+
+/* Skip the interval expression starting at P, after the '{' or '\{'.
+   Its bounds are not literal text.  */
+static const char *
+skip_interval (literal_scanner *s, const char *p)
+{
+  while (*p)
+    {
+      if (s->extended && p[0] == '}')
+	return p + 1;
+      if (s->extended == false && p[0] == '\\' && p[1] == '}')
+	return p + 2;
+      ++p;
+    }
+  return p;
+}
+
+/* Append the literal atom of LEN bytes at ATOM, unless the next token
+   makes it optional.  */
+static void
+literal_atom (literal_scanner *s, const char *atom, int len)
+{
+  if (is_quantifier (s, s->p))
+    {
+      special (s);
+      return;
+    }
+  memcpy (s->run + s->run_len, atom, len);
+  s->run_len += len;
+}
+
+/* Return false if the pattern has alternatives or groups, which may make
+   anything optional.  */
+static bool
+scan_literal (literal_scanner *s)
+{
+  while (*s->p)
+    {
+      const char *atom = s->p;
+      unsigned char c = *s->p++;
+
+      if (c == '\\')
+	{
+	  c = *s->p;
+	  if (c == '\0')
+	    return false;
+	  ++s->p;
+	  if (s->extended == false && strchr ("|()", c))
+	    return false;
+	  if (strchr (".[]*^$\\", c)
+	      || (s->extended && strchr ("+?{}|()", c)))
+	    literal_atom (s, s->p - 1, 1);
+	  else if (s->extended == false && c == '{')
+	    {
+	      s->p = skip_interval (s, s->p);
+	      special (s);
+	    }
+	  else
+	    /* Back references, word boundaries, \{ and the like.  */
+	    special (s);
+	}
+      else if (c == '[')
+	{
+	  s->p = skip_bracket (s->p);
+	  special (s);
+	}
+      else if (s->extended && (c == '|' || c == '(' || c == ')'))
+	return false;
+      else if (s->extended && c == '{')
+	{
+	  s->p = skip_interval (s, s->p);
+	  special (s);
+	}
+      else if (c == '.' || c == '^' || c == '$' || c == '*'
+	       || (s->extended && strchr ("+?{}", c)))
+	special (s);
+      else
+	{
+	  /* A multibyte character is a single atom.  */
+	  while ((*s->p & 0xc0) == 0x80)
+	    ++s->p;
+	  literal_atom (s, atom, s->p - atom);
+	}
+    }
+  end_run (s);
+  return true;
+}
+
+static void
+set_literal (fz_context *ctx, pdfout_matcher *m, const char *literal,
+	     int len)
+{
+  m->literal = fz_malloc (ctx, len + 1);
+  memcpy (m->literal, literal, len);
+  m->literal[len] = '\0';
+  m->literal_len = len;
+}
+
+/* Escape the special characters of a basic regular expression.  */
+static char *
+escape_fixed (fz_context *ctx, const char *pattern)
+{
+  char *result = fz_malloc (ctx, 2 * strlen (pattern) + 1);
+  char *q = result;
+  for (const char *p = pattern; *p; ++p)
+    {
+      if (strchr (".[]*^$\\", *p))
+	*q++ = '\\';
+      *q++ = *p;
+    }
+  *q = '\0';
+  return result;
+}
+
+static void
+compile_regex (fz_context *ctx, pdfout_matcher *m, const char *pattern,
+	       int flags)
+{
+  int err = regcomp (&m->regex, pattern, flags | REG_NOSUB);
+  if (err)
+    {
+      char msg[200];
+      regerror (err, &m->regex, msg, sizeof msg);
+      pdfout_throw (ctx, "invalid regular expression '%s': %s", pattern,
+		    msg);
+    }
+  m->has_regex = true;
+}
+
+pdfout_matcher *
+pdfout_matcher_new (fz_context *ctx, const char *pattern,
+		    pdfout_match_syntax syntax, bool ignore_case)
+{
+  pdfout_matcher *m = fz_malloc_struct (ctx, pdfout_matcher);
+  literal_scanner s = { pattern, syntax == PDFOUT_MATCH_EXTENDED };
+  char *escaped = NULL;
+
+  fz_var (escaped);
+  fz_try (ctx)
+  {
+    if (ignore_case)
+      {
+	/* The prefilter compares bytes, so leave everything to regexec.  */
+	if (syntax == PDFOUT_MATCH_FIXED)
+	  pattern = escaped = escape_fixed (ctx, pattern);
+	compile_regex (ctx, m, pattern, REG_ICASE
+		       | (syntax == PDFOUT_MATCH_EXTENDED ? REG_EXTENDED : 0));
+      }
+    else if (syntax == PDFOUT_MATCH_FIXED)
+      set_literal (ctx, m, pattern, strlen (pattern));
+    else
+      {
+	size_t len = strlen (pattern);
+	s.run = fz_malloc (ctx, len + 1);
+	s.best = fz_malloc (ctx, len + 1);
+	s.pure = true;
+	if (scan_literal (&s) == false)
+	  {
+	    s.best_len = 0;
+	    s.pure = false;
+	  }
+	if (s.best_len)
+	  set_literal (ctx, m, s.best, s.best_len);
+	/* A pure literal is found by the prefilter alone.  */
+	if (s.pure == false)
+	  compile_regex (ctx, m, pattern, s.extended ? REG_EXTENDED : 0);
+      }
+  }
+  fz_always (ctx)
+  {
+    free (escaped);
+    free (s.run);
+    free (s.best);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_matcher_drop (ctx, m);
+    fz_rethrow (ctx);
+  }
+
+  return m;
+}
+
+void
+pdfout_matcher_drop (fz_context *ctx, pdfout_matcher *m)
+{
+  if (m == NULL)
+    return;
+  if (m->has_regex)
+    regfree (&m->regex);
+  free (m->literal);
+  free (m);
+}
+
+const char *
+pdfout_matcher_literal (fz_context *ctx, pdfout_matcher *m, int *len)
+{
+  *len = m->literal_len;
+  return m->literal;
+}
+
+/* Return the offset of the first occurrence of the literal in DATA
+   between POS and END, or -1.  */
+static int
+find_literal (pdfout_matcher *m, const char *data, int pos, int end)
+{
+  const char *literal = m->literal;
+  int n = m->literal_len;
+  const char *p = data + pos;
+  const char *last = data + end - n;
+
+  while (p <= last)
+    {
+      p = memchr (p, literal[0], last - p + 1);
+      if (p == NULL)
+	return -1;
+      if (memcmp (p + 1, literal + 1, n - 1) == 0)
+	return p - data;
+      ++p;
+    }
+  return -1;
+}
+
+/* Run the regular expression on the line from START to STOP.  DATA must
+   be writable at STOP.  */
+static bool
+line_matches (pdfout_matcher *m, char *data, int start, int stop)
+{
+  char saved = data[stop];
+  data[stop] = '\0';
+  bool result = regexec (&m->regex, data + start, 0, NULL, 0) == 0;
+  data[stop] = saved;
+  return result;
+}
+
+int
+pdfout_matcher_next_line (fz_context *ctx, pdfout_matcher *m,
+			  fz_buffer *buf, int *pos, int *len)
+{
+  /* Make the byte after the last line writable.  */
+  fz_terminate_buffer (ctx, buf);
+
+  char *data = (char *) buf->data;
+  int end = buf->len;
+  int p = *pos;
+
+  while (p < end)
+    {
+      int candidate = p;
+      if (m->literal_len)
+	{
+	  candidate = find_literal (m, data, p, end);
+	  if (candidate < 0)
+	    break;
+	}
+
+      int start = candidate;
+      while (start > p && data[start - 1] != '\n')
+	--start;
+      char *newline = memchr (data + candidate, '\n', end - candidate);
+      int stop = newline ? newline - data : end;
+      p = newline ? stop + 1 : end;
+
+      if (m->has_regex == false || line_matches (m, data, start, stop))
+	{
+	  *pos = p;
+	  *len = stop - start;
+	  return start;
+	}
+    }
+
+  *pos = end;
+  return -1;
+}
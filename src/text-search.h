@@ -0,0 +1,37 @@
+#ifndef HAVE_PDFOUT_TEXT_SEARCH_H
+#define HAVE_PDFOUT_TEXT_SEARCH_H
+
+/* Line matcher for searching extracted text.  A matcher is not thread
+   safe; use one per thread.  */
+typedef struct pdfout_matcher_s pdfout_matcher;
+
+typedef enum {
+  /* POSIX basic regular expressions, like grep -G.  */
+  PDFOUT_MATCH_BASIC,
+  /* POSIX extended regular expressions, like grep -E.  */
+  PDFOUT_MATCH_EXTENDED,
+  /* Fixed string, like grep -F.  */
+  PDFOUT_MATCH_FIXED
+} pdfout_match_syntax;
+
+/* Throw if PATTERN is not a valid regular expression.  */
+pdfout_matcher *pdfout_matcher_new (fz_context *ctx, const char *pattern,
+				    pdfout_match_syntax syntax,
+				    bool ignore_case);
+
+void pdfout_matcher_drop (fz_context *ctx, pdfout_matcher *matcher);
+
+/* Return the string which every match contains, used to skip text with a
+   memchr prefilter before the regular expression is tried.  Set LEN to
+   its length, which is 0 if there is none.  */
+const char *pdfout_matcher_literal (fz_context *ctx,
+				    pdfout_matcher *matcher, int *len);
+
+/* Find the next matching line of BUF, starting at offset *POS, which must
+   be the start of a line.  Lines are terminated by newlines.  Return the
+   offset of the line, set *LEN to its length without the newline and *POS
+   to the start of the following line.  Return -1 if no line matches.  */
+int pdfout_matcher_next_line (fz_context *ctx, pdfout_matcher *matcher,
+			      fz_buffer *buf, int *pos, int *len);
+
+#endif	/* ! HAVE_PDFOUT_TEXT_SEARCH_H */
@@ -0,0 +1,1156 @@
+#include "common.h"
+
+/* XMP metadata.  Packets can be several megabytes, so there is no DOM.  A
+   tokenizer walks the packet once, and the rewriter copies everything
+   between the supported properties verbatim.  Only the values which
+   actually change are replaced.
+
+   Namespace prefixes are resolved, but the bindings are not scoped: the
+   last declaration of a prefix wins.  */
+
+#define NS_RDF "http://www.w3.org/1999/02/22-rdf-syntax-ns#"
+#define NS_DC "http://purl.org/dc/elements/1.1/"
+#define NS_XMP "http://ns.adobe.com/xap/1.0/"
+#define NS_PDF "http://ns.adobe.com/pdf/1.3/"
+
+typedef enum { XMP_SIMPLE, XMP_ALT, XMP_SEQ } xmp_kind;
+
+typedef struct {
+  const char *name;
+  int prefix_len;
+  const char *ns;
+  xmp_kind kind;
+  /* The corresponding info dict key.  */
+  pdfout_key info_key;
+} xmp_property;
+
+static const xmp_property properties[] = {
+  { "dc:title", 2, NS_DC, XMP_ALT, PDFOUT_KEY_Title },
+  { "dc:creator", 2, NS_DC, XMP_SEQ, PDFOUT_KEY_Author },
+  { "dc:description", 2, NS_DC, XMP_ALT, PDFOUT_KEY_Subject },
+  { "pdf:Keywords", 3, NS_PDF, XMP_SIMPLE, PDFOUT_KEY_Keywords },
+  { "xmp:CreatorTool", 3, NS_XMP, XMP_SIMPLE, PDFOUT_KEY_Creator },
+  { "pdf:Producer", 3, NS_PDF, XMP_SIMPLE, PDFOUT_KEY_Producer },
+  { "xmp:CreateDate", 3, NS_XMP, XMP_SIMPLE, PDFOUT_KEY_CreationDate },
+  { "xmp:ModifyDate", 3, NS_XMP, XMP_SIMPLE, PDFOUT_KEY_ModDate },
+  { "pdf:Trapped", 3, NS_PDF, XMP_SIMPLE, PDFOUT_KEY_Trapped },
+};
+
+#define PROPERTY_COUNT (int) (sizeof properties / sizeof properties[0])
+
+/* Used if the document has no metadata stream.  */
+static const char xmp_template[] =
+  "<?xpacket begin=\"\xef\xbb\xbf\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n"
+  "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+  " <rdf:RDF xmlns:rdf=\"" NS_RDF "\">\n"
+  " </rdf:RDF>\n"
+  "</x:xmpmeta>\n"
+  "<?xpacket end=\"w\"?>";
+
+/* Tokenizer.  */
+
+typedef enum {
+  XML_EOF, XML_TEXT, XML_CDATA, XML_START, XML_END, XML_EMPTY, XML_OTHER
+} xml_type;
+
+typedef struct {
+  /* From the whitespace before the attribute to the closing quote.  */
+  const char *start, *end;
+  const char *name;
+  int name_len;
+  /* Raw value, without the quotes.  */
+  const char *value;
+  int value_len;
+} xml_attr;
+
+typedef struct {
+  const char *pos, *end;
+
+  /* The current token.  */
+  xml_type type;
+  const char *start, *stop;
+  /* Tag name, or the content of text and CDATA sections.  */
+  const char *name;
+  int name_len;
+  xml_attr *attrs;
+  int attrs_len, attrs_cap;
+} xml_tokenizer;
+
+static void
+malformed (fz_context *ctx)
+{
+  pdfout_throw (ctx, "malformed XMP packet");
+}
+
+static bool
+is_space (char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static const char *
+skip_space (const char *p, const char *end)
+{
+  while (p < end && is_space (*p))
+    ++p;
+  return p;
+}
+
+static const char *
+scan_name (const char *p, const char *end)
+{
+  while (p < end && is_space (*p) == false && *p != '/' && *p != '>'
+	 && *p != '=')
+    ++p;
+  return p;
+}
+
+static bool
+starts_with (const char *p, const char *end, const char *s)
+{
+  int len = strlen (s);
+  return end - p >= len && memcmp (p, s, len) == 0;
+}
+
+static const char *
+find_string (fz_context *ctx, const char *p, const char *end, const char *s)
+{
+  while ((p = memchr (p, s[0], end - p)))
+    {
+      if (starts_with (p, end, s))
+	return p;
+      ++p;
+    }
+  malformed (ctx);
+  return NULL;
+}
+
+static const char *
+scan_tag (fz_context *ctx, xml_tokenizer *t, const char *p)
+{
+  const char *end = t->end;
+
+  t->name = p;
+  p = scan_name (p, end);
+  t->name_len = p - t->name;
+  if (t->name_len == 0)
+    malformed (ctx);
+
+  while (true)
+    {
+      const char *attr_start = p;
+      p = skip_space (p, end);
+      if (p == end)
+	malformed (ctx);
+      if (*p == '>')
+	{
+	  t->type = XML_START;
+	  return p + 1;
+	}
+      if (*p == '/')
+	{
+	  if (p + 1 == end || p[1] != '>')
+	    malformed (ctx);
+	  t->type = XML_EMPTY;
+	  return p + 2;
+	}
+      if (p == attr_start)
+	malformed (ctx);
+
+      xml_attr attr = { attr_start };
+      attr.name = p;
+      p = scan_name (p, end);
+      attr.name_len = p - attr.name;
+      p = skip_space (p, end);
+      if (attr.name_len == 0 || p == end || *p != '=')
+	malformed (ctx);
+      p = skip_space (p + 1, end);
+      if (p == end || (*p != '"' && *p != '\''))
+	malformed (ctx);
+      const char *close = memchr (p + 1, *p, end - p - 1);
+      if (close == NULL)
+	malformed (ctx);
+      attr.value = p + 1;
+      attr.value_len = close - attr.value;
+      attr.end = p = close + 1;
+
+      if (t->attrs_len == t->attrs_cap)
+	t->attrs = pdfout_x2nrealloc (ctx, t->attrs, &t->attrs_cap, xml_attr);
+      t->attrs[t->attrs_len++] = attr;
+    }
+}
+
+static xml_type
+xml_next (fz_context *ctx, xml_tokenizer *t)
+{
+  const char *p = t->pos, *end = t->end;
+
+  t->start = p;
+  t->attrs_len = 0;
+
+  if (p == end)
+    {
+      t->stop = p;
+      return t->type = XML_EOF;
+    }
+
+  if (*p != '<')
+    {
+      const char *lt = memchr (p, '<', end - p);
+      t->stop = lt ? lt : end;
+      t->name = p;
+      t->name_len = t->stop - p;
+      t->type = XML_TEXT;
+    }
+  else if (starts_with (p, end, "<!--"))
+    {
+      t->stop = find_string (ctx, p + 4, end, "-->") + 3;
+      t->type = XML_OTHER;
+    }
+  else if (starts_with (p, end, "<![CDATA["))
+    {
+      t->name = p + 9;
+      const char *close = find_string (ctx, t->name, end, "]]>");
+      t->name_len = close - t->name;
+      t->stop = close + 3;
+      t->type = XML_CDATA;
+    }
+  else if (starts_with (p, end, "<?"))
+    {
+      t->stop = find_string (ctx, p + 2, end, "?>") + 2;
+      t->type = XML_OTHER;
+    }
+  else if (starts_with (p, end, "<!"))
+    {
+      t->stop = find_string (ctx, p + 2, end, ">") + 1;
+      t->type = XML_OTHER;
+    }
+  else if (starts_with (p, end, "</"))
+    {
+      t->name = p + 2;
+      p = scan_name (t->name, end);
+      t->name_len = p - t->name;
+      p = skip_space (p, end);
+      if (t->name_len == 0 || p == end || *p != '>')
+	malformed (ctx);
+      t->stop = p + 1;
+      t->type = XML_END;
+    }
+  else
+    t->stop = scan_tag (ctx, t, p + 1);
+
+  t->pos = t->stop;
+  return t->type;
+}
+
+/* Character data.  */
+
+static void
+append_text (fz_context *ctx, fz_buffer *buf, const char *s, int len)
+{
+  static const struct { const char *name; char c; } entities[] = {
+    { "lt", '<' }, { "gt", '>' }, { "amp", '&' }, { "quot", '"' },
+    { "apos", '\'' }
+  };
+  const char *end = s + len;
+
+  while (s < end)
+    {
+      const char *amp = memchr (s, '&', end - s);
+      if (amp == NULL)
+	amp = end;
+      fz_write_buffer (ctx, buf, s, amp - s);
+      if (amp == end)
+	return;
+
+      const char *semicolon = memchr (amp, ';', end - amp);
+      if (semicolon == NULL)
+	malformed (ctx);
+      const char *name = amp + 1;
+      int name_len = semicolon - name;
+      s = semicolon + 1;
+
+      if (name_len > 1 && name[0] == '#')
+	{
+	  char *tail;
+	  long c = (name[1] == 'x'
+		    ? strtol (name + 2, &tail, 16) : strtol (name + 1, &tail,
+							     10));
+	  if (tail != semicolon || c <= 0 || c > 0x10ffff)
+	    malformed (ctx);
+	  fz_write_buffer_rune (ctx, buf, c);
+	  continue;
+	}
+
+      int i;
+      for (i = 0; i < 5; ++i)
+	if (strlen (entities[i].name) == name_len
+	    && memcmp (entities[i].name, name, name_len) == 0)
+	  break;
+      if (i == 5)
+	malformed (ctx);
+      fz_write_buffer_byte (ctx, buf, entities[i].c);
+    }
+}
+
+/* Escape S for element content, or for an attribute value if ATTRIBUTE
+   is true.  */
+static void
+write_escaped (fz_context *ctx, fz_buffer *buf, const char *s, int len,
+	       bool attribute)
+{
+  for (int i = 0; i < len; ++i)
+    switch (s[i])
+      {
+      case '<':
+	fz_write_buffer (ctx, buf, "&lt;", 4);
+	break;
+      case '>':
+	fz_write_buffer (ctx, buf, "&gt;", 4);
+	break;
+      case '&':
+	fz_write_buffer (ctx, buf, "&amp;", 5);
+	break;
+      case '"':
+	if (attribute)
+	  fz_write_buffer (ctx, buf, "&quot;", 6);
+	else
+	  fz_write_buffer_byte (ctx, buf, s[i]);
+	break;
+      case '\'':
+	if (attribute)
+	  fz_write_buffer (ctx, buf, "&apos;", 6);
+	else
+	  fz_write_buffer_byte (ctx, buf, s[i]);
+	break;
+      default:
+	fz_write_buffer_byte (ctx, buf, s[i]);
+      }
+}
+
+/* Walking the packet.  */
+
+typedef struct {
+  const char *prefix;
+  int prefix_len;
+  const char *uri;
+  int uri_len;
+} xml_ns;
+
+typedef enum { ACTION_KEEP, ACTION_SET, ACTION_REMOVE } xmp_action_type;
+
+typedef struct {
+  xmp_action_type type;
+  const char *value;
+  int len;
+  bool done;
+} xmp_action;
+
+typedef struct {
+  xml_tokenizer t;
+  xml_ns *ns;
+  int ns_len, ns_cap;
+  int depth;
+  /* Depth of the current top-level rdf:Description, or 0.  */
+  int description;
+
+  /* The rewritten packet.  Everything before COPIED is done.  */
+  fz_buffer *out;
+  const char *copied;
+} xmp_walk;
+
+static void
+walk_drop (fz_context *ctx, xmp_walk *w)
+{
+  free (w->t.attrs);
+  free (w->ns);
+}
+
+static void
+track_namespaces (fz_context *ctx, xmp_walk *w)
+{
+  xml_tokenizer *t = &w->t;
+  for (int i = 0; i < t->attrs_len; ++i)
+    {
+      xml_attr *a = &t->attrs[i];
+      if (a->name_len > 6 && memcmp (a->name, "xmlns:", 6) == 0)
+	{
+	  if (w->ns_len == w->ns_cap)
+	    w->ns = pdfout_x2nrealloc (ctx, w->ns, &w->ns_cap, xml_ns);
+	  w->ns[w->ns_len++] = (xml_ns) { a->name + 6, a->name_len - 6,
+					  a->value, a->value_len };
+	}
+    }
+}
+
+static const xml_ns *
+lookup_prefix (xmp_walk *w, const char *prefix, int len)
+{
+  for (int i = w->ns_len - 1; i >= 0; --i)
+    if (w->ns[i].prefix_len == len
+	&& memcmp (w->ns[i].prefix, prefix, len) == 0)
+      return &w->ns[i];
+  return NULL;
+}
+
+/* Return whether the qualified NAME is LOCAL in namespace NS.  */
+static bool
+name_is (xmp_walk *w, const char *name, int len, const char *ns,
+	 const char *local)
+{
+  const char *colon = memchr (name, ':', len);
+  int local_len = strlen (local);
+  if (colon == NULL || name + len - colon - 1 != local_len
+      || memcmp (colon + 1, local, local_len))
+    return false;
+
+  const xml_ns *binding = lookup_prefix (w, name, colon - name);
+  return (binding && binding->uri_len == strlen (ns)
+	  && memcmp (binding->uri, ns, binding->uri_len) == 0);
+}
+
+static int
+find_property (xmp_walk *w, const char *name, int len)
+{
+  for (int i = 0; i < PROPERTY_COUNT; ++i)
+    {
+      const xmp_property *p = &properties[i];
+      if (name_is (w, name, len, p->ns, p->name + p->prefix_len + 1))
+	return i;
+    }
+  return -1;
+}
+
+static bool
+is_lang_default (xml_tokenizer *t)
+{
+  for (int i = 0; i < t->attrs_len; ++i)
+    {
+      xml_attr *a = &t->attrs[i];
+      if (a->name_len == 8 && memcmp (a->name, "xml:lang", 8) == 0)
+	return a->value_len == 9 && memcmp (a->value, "x-default", 9) == 0;
+    }
+  return false;
+}
+
+/* Where the x-default item of an rdf:Alt is, so that it can be replaced
+   without touching the other languages.  */
+typedef struct {
+  /* After the start tag of the rdf:Alt, or NULL.  */
+  const char *alt_content;
+  /* The content of the x-default item, or its whole tag if it is an empty
+     element.  NULL if there is no such item.  */
+  const char *item_start, *item_end;
+  bool item_empty;
+  const char *item_name;
+  int item_name_len;
+} alt_layout;
+
+/* The current token is the start tag of a property element of KIND.  Read
+   up to its end tag and store the value in VALUE.  Alternatives yield the
+   x-default item or the first one, sequences and bags all items separated
+   by "; ".  If LAYOUT is not NULL, store where the parts of an
+   alternative are.  */
+static void
+read_property_value (fz_context *ctx, xmp_walk *w, xmp_kind kind,
+		     fz_buffer *value, alt_layout *layout)
+{
+  xml_tokenizer *t = &w->t;
+  int depth = 1, li_depth = 0, items = 0;
+  bool take = false, have_default = false, in_default = false;
+
+  value->len = 0;
+  if (layout)
+    *layout = (alt_layout) { NULL };
+  while (depth)
+    {
+      switch (xml_next (ctx, t))
+	{
+	case XML_EOF:
+	  malformed (ctx);
+	case XML_START:
+	case XML_EMPTY:
+	  track_namespaces (ctx, w);
+	  if (t->type == XML_START)
+	    ++depth;
+	  if (layout && depth == 2 && t->type == XML_START
+	      && layout->alt_content == NULL
+	      && name_is (w, t->name, t->name_len, NS_RDF, "Alt"))
+	    layout->alt_content = t->stop;
+	  if (li_depth || name_is (w, t->name, t->name_len, NS_RDF, "li")
+	      == false)
+	    break;
+
+	  if (items == 0)
+	    /* Drop the whitespace before the first item.  */
+	    value->len = 0;
+	  if (kind == XMP_ALT)
+	    {
+	      take = false;
+	      if (have_default == false && is_lang_default (t))
+		{
+		  value->len = 0;
+		  take = have_default = true;
+		  if (layout)
+		    {
+		      layout->item_empty = t->type == XML_EMPTY;
+		      layout->item_start = layout->item_empty ? t->start
+			: t->stop;
+		      layout->item_end = t->stop;
+		      layout->item_name = t->name;
+		      layout->item_name_len = t->name_len;
+		      in_default = t->type == XML_START;
+		    }
+		}
+	      else if (items == 0)
+		take = true;
+	    }
+	  else
+	    {
+	      if (items)
+		fz_write_buffer (ctx, value, "; ", 2);
+	      take = true;
+	    }
+	  ++items;
+	  if (t->type == XML_START)
+	    li_depth = depth;
+	  break;
+	case XML_END:
+	  if (depth == li_depth)
+	    {
+	      if (in_default)
+		layout->item_end = t->start;
+	      li_depth = 0;
+	      in_default = false;
+	    }
+	  --depth;
+	  break;
+	case XML_TEXT:
+	case XML_CDATA:
+	  if (li_depth ? take == false : items > 0)
+	    break;
+	  if (t->type == XML_CDATA)
+	    fz_write_buffer (ctx, value, t->name, t->name_len);
+	  else
+	    append_text (ctx, value, t->name, t->name_len);
+	  break;
+	default:
+	  break;
+	}
+    }
+}
+
+/* Call FUNC for each top-level property, with the tokenizer at the start
+   tag of the property element or at the rdf:Description tag for
+   properties given as attributes (with ATTR set).  FUNC must consume the
+   property element.  At the end tag of rdf:RDF, FUNC is called with
+   PROPERTY -1.  */
+typedef void walk_func (fz_context *ctx, xmp_walk *w, int property,
+			xml_attr *attr, void *opaque);
+
+static void
+walk_packet (fz_context *ctx, xmp_walk *w, walk_func *func, void *opaque)
+{
+  xml_tokenizer *t = &w->t;
+
+  while (xml_next (ctx, t) != XML_EOF)
+    switch (t->type)
+      {
+      case XML_START:
+      case XML_EMPTY:
+	track_namespaces (ctx, w);
+	if (w->description && w->depth == w->description)
+	  {
+	    int p = find_property (w, t->name, t->name_len);
+	    if (p >= 0)
+	      {
+		func (ctx, w, p, NULL, opaque);
+		break;
+	      }
+	  }
+	else if (w->description == 0
+		 && name_is (w, t->name, t->name_len, NS_RDF, "Description"))
+	  {
+	    for (int i = 0; i < t->attrs_len; ++i)
+	      {
+		xml_attr *a = &t->attrs[i];
+		int p = find_property (w, a->name, a->name_len);
+		if (p >= 0)
+		  func (ctx, w, p, a, opaque);
+	      }
+	    if (t->type == XML_START)
+	      w->description = w->depth + 1;
+	  }
+	if (t->type == XML_START)
+	  ++w->depth;
+	break;
+      case XML_END:
+	if (name_is (w, t->name, t->name_len, NS_RDF, "RDF"))
+	  func (ctx, w, -1, NULL, opaque);
+	if (w->depth == w->description)
+	  w->description = 0;
+	--w->depth;
+	break;
+      default:
+	break;
+      }
+}
+
+/* Reading.  */
+
+static void
+read_func (fz_context *ctx, xmp_walk *w, int property, xml_attr *attr,
+	   void *opaque)
+{
+  fz_buffer **values = opaque;
+  if (property < 0)
+    return;
+
+  if (values[property] == NULL)
+    values[property] = fz_new_buffer (ctx, 64);
+  fz_buffer *value = values[property];
+
+  if (attr)
+    {
+      value->len = 0;
+      append_text (ctx, value, attr->value, attr->value_len);
+    }
+  else if (w->t.type == XML_EMPTY)
+    value->len = 0;
+  else
+    read_property_value (ctx, w, properties[property].kind, value, NULL);
+}
+
+pdfout_data *
+pdfout_xmp_get (fz_context *ctx, pdf_document *doc)
+{
+  pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, doc), PDF_NAME_Root);
+  pdf_obj *metadata = pdf_dict_get (ctx, root, PDF_NAME_Metadata);
+  pdfout_data *result = pdfout_data_hash_new (ctx);
+  if (pdf_is_stream (ctx, metadata) == false)
+    return result;
+
+  fz_buffer *packet = NULL;
+  fz_buffer *values[PROPERTY_COUNT] = { NULL };
+  xmp_walk w = { { NULL } };
+
+  fz_var (packet);
+  fz_try (ctx)
+  {
+    packet = pdf_load_stream (ctx, doc, pdf_to_num (ctx, metadata),
+			      pdf_to_gen (ctx, metadata));
+    w.t.pos = (const char *) packet->data;
+    w.t.end = w.t.pos + packet->len;
+    walk_packet (ctx, &w, read_func, values);
+
+    for (int i = 0; i < PROPERTY_COUNT; ++i)
+      if (values[i])
+	pdfout_data_hash_push_key_value (ctx, result, properties[i].name,
+					 (const char *) values[i]->data,
+					 values[i]->len);
+  }
+  fz_always (ctx)
+  {
+    walk_drop (ctx, &w);
+    for (int i = 0; i < PROPERTY_COUNT; ++i)
+      fz_drop_buffer (ctx, values[i]);
+    fz_drop_buffer (ctx, packet);
+  }
+  fz_catch (ctx)
+  {
+    pdfout_data_drop (ctx, result);
+    fz_rethrow (ctx);
+  }
+
+  return result;
+}
+
+/* Rewriting.  */
+
+static void
+copy_to (fz_context *ctx, xmp_walk *w, const char *p)
+{
+  fz_write_buffer (ctx, w->out, w->copied, p - w->copied);
+  w->copied = p;
+}
+
+static void
+write_string (fz_context *ctx, xmp_walk *w, const char *s)
+{
+  fz_write_buffer (ctx, w->out, s, strlen (s));
+}
+
+static void
+write_rdf_name (fz_context *ctx, xmp_walk *w, const char *local)
+{
+  const char *prefix = "rdf";
+  int len = 3;
+  for (int i = w->ns_len - 1; i >= 0; --i)
+    if (w->ns[i].uri_len == strlen (NS_RDF)
+	&& memcmp (w->ns[i].uri, NS_RDF, w->ns[i].uri_len) == 0
+	&& lookup_prefix (w, w->ns[i].prefix, w->ns[i].prefix_len)
+	== &w->ns[i])
+      {
+	prefix = w->ns[i].prefix;
+	len = w->ns[i].prefix_len;
+	break;
+      }
+  fz_write_buffer (ctx, w->out, prefix, len);
+  fz_write_buffer_byte (ctx, w->out, ':');
+  write_string (ctx, w, local);
+}
+
+/* Write the content of a property element.  */
+static void
+write_value (fz_context *ctx, xmp_walk *w, xmp_kind kind,
+	     xmp_action *action)
+{
+  if (kind == XMP_SIMPLE)
+    {
+      write_escaped (ctx, w->out, action->value, action->len, false);
+      return;
+    }
+
+  const char *array = kind == XMP_ALT ? "Alt" : "Seq";
+  fz_write_buffer_byte (ctx, w->out, '<');
+  write_rdf_name (ctx, w, array);
+  write_string (ctx, w, "><");
+  write_rdf_name (ctx, w, "li");
+  if (kind == XMP_ALT)
+    write_string (ctx, w, " xml:lang=\"x-default\"");
+  fz_write_buffer_byte (ctx, w->out, '>');
+  write_escaped (ctx, w->out, action->value, action->len, false);
+  write_string (ctx, w, "</");
+  write_rdf_name (ctx, w, "li");
+  write_string (ctx, w, "></");
+  write_rdf_name (ctx, w, array);
+  fz_write_buffer_byte (ctx, w->out, '>');
+}
+
+static bool
+value_eq (fz_buffer *value, xmp_action *action)
+{
+  return (value->len == action->len
+	  && memcmp (value->data, action->value, action->len) == 0);
+}
+
+/* Add the properties which are not in the packet yet, in a new
+   rdf:Description before the end tag of rdf:RDF.  */
+static void
+write_missing (fz_context *ctx, xmp_walk *w, xmp_action *actions)
+{
+  static const char *const ns[][2] = {
+    { "dc", NS_DC }, { "pdf", NS_PDF }, { "xmp", NS_XMP }
+  };
+  bool missing = false;
+  for (int i = 0; i < PROPERTY_COUNT; ++i)
+    if (actions[i].type == ACTION_SET && actions[i].done == false)
+      missing = true;
+  if (missing == false)
+    return;
+
+  copy_to (ctx, w, w->t.start);
+  fz_write_buffer_byte (ctx, w->out, '<');
+  write_rdf_name (ctx, w, "Description");
+  write_string (ctx, w, " ");
+  write_rdf_name (ctx, w, "about");
+  write_string (ctx, w, "=\"\"");
+  for (int i = 0; i < 3; ++i)
+    {
+      write_string (ctx, w, "\n   xmlns:");
+      write_string (ctx, w, ns[i][0]);
+      write_string (ctx, w, "=\"");
+      write_string (ctx, w, ns[i][1]);
+      write_string (ctx, w, "\"");
+    }
+  write_string (ctx, w, ">\n");
+
+  for (int i = 0; i < PROPERTY_COUNT; ++i)
+    {
+      xmp_action *action = &actions[i];
+      if (action->type != ACTION_SET || action->done)
+	continue;
+      write_string (ctx, w, "  <");
+      write_string (ctx, w, properties[i].name);
+      write_string (ctx, w, ">");
+      write_value (ctx, w, properties[i].kind, action);
+      write_string (ctx, w, "</");
+      write_string (ctx, w, properties[i].name);
+      write_string (ctx, w, ">\n");
+      action->done = true;
+    }
+
+  write_string (ctx, w, " </");
+  write_rdf_name (ctx, w, "Description");
+  write_string (ctx, w, ">\n ");
+}
+
+/* Replace the x-default item of the rdf:Alt described by LAYOUT, or add
+   one as the first item.  The other languages are kept.  */
+static void
+write_alt_default (fz_context *ctx, xmp_walk *w, alt_layout *layout,
+		   xmp_action *action)
+{
+  if (layout->item_start == NULL)
+    {
+      copy_to (ctx, w, layout->alt_content);
+      fz_write_buffer_byte (ctx, w->out, '<');
+      write_rdf_name (ctx, w, "li");
+      write_string (ctx, w, " xml:lang=\"x-default\">");
+      write_escaped (ctx, w->out, action->value, action->len, false);
+      write_string (ctx, w, "</");
+      write_rdf_name (ctx, w, "li");
+      fz_write_buffer_byte (ctx, w->out, '>');
+    }
+  else if (layout->item_empty)
+    {
+      copy_to (ctx, w, layout->item_end - 2);
+      fz_write_buffer_byte (ctx, w->out, '>');
+      write_escaped (ctx, w->out, action->value, action->len, false);
+      write_string (ctx, w, "</");
+      fz_write_buffer (ctx, w->out, layout->item_name,
+		       layout->item_name_len);
+      fz_write_buffer_byte (ctx, w->out, '>');
+      w->copied = layout->item_end;
+    }
+  else
+    {
+      copy_to (ctx, w, layout->item_start);
+      write_escaped (ctx, w->out, action->value, action->len, false);
+      w->copied = layout->item_end;
+    }
+}
+
+typedef struct {
+  xmp_action *actions;
+  fz_buffer *value;
+  bool found_rdf;
+} rewrite_state;
+
+static void
+rewrite_func (fz_context *ctx, xmp_walk *w, int property, xml_attr *attr,
+	      void *opaque)
+{
+  rewrite_state *s = opaque;
+  xml_tokenizer *t = &w->t;
+
+  if (property < 0)
+    {
+      s->found_rdf = true;
+      write_missing (ctx, w, s->actions);
+      return;
+    }
+
+  xmp_action *action = &s->actions[property];
+  const xmp_property *p = &properties[property];
+
+  if (attr)
+    {
+      if (action->type == ACTION_REMOVE)
+	{
+	  copy_to (ctx, w, attr->start);
+	  w->copied = attr->end;
+	}
+      else if (action->type == ACTION_SET)
+	{
+	  action->done = true;
+	  s->value->len = 0;
+	  append_text (ctx, s->value, attr->value, attr->value_len);
+	  if (value_eq (s->value, action) == false)
+	    {
+	      copy_to (ctx, w, attr->value);
+	      write_escaped (ctx, w->out, action->value, action->len, true);
+	      w->copied = attr->value + attr->value_len;
+	    }
+	}
+      return;
+    }
+
+  const char *start = t->start, *content = t->stop;
+  alt_layout layout = { NULL };
+  if (t->type == XML_EMPTY)
+    s->value->len = 0;
+  else
+    read_property_value (ctx, w, p->kind, s->value, &layout);
+
+  if (action->type == ACTION_REMOVE)
+    {
+      copy_to (ctx, w, start);
+      w->copied = t->stop;
+    }
+  else if (action->type == ACTION_SET)
+    {
+      action->done = true;
+      if (value_eq (s->value, action))
+	return;
+      if (t->type == XML_EMPTY)
+	{
+	  /* Turn <pdf:Producer/> into <pdf:Producer>...</pdf:Producer>,
+	     keeping the attributes.  */
+	  copy_to (ctx, w, t->stop - 2);
+	  fz_write_buffer_byte (ctx, w->out, '>');
+	  write_value (ctx, w, p->kind, action);
+	  write_string (ctx, w, "</");
+	  fz_write_buffer (ctx, w->out, t->name, t->name_len);
+	  fz_write_buffer_byte (ctx, w->out, '>');
+	  w->copied = t->stop;
+	}
+      else if (layout.alt_content)
+	write_alt_default (ctx, w, &layout, action);
+      else
+	{
+	  copy_to (ctx, w, content);
+	  write_value (ctx, w, p->kind, action);
+	  w->copied = t->start;
+	}
+    }
+}
+
+/* Return the packet DATA with ACTIONS applied.  */
+static fz_buffer *
+rewrite_packet (fz_context *ctx, const char *data, int len,
+		xmp_action *actions)
+{
+  xmp_walk w = { { NULL } };
+  rewrite_state s = { actions };
+  fz_buffer *out = NULL;
+
+  fz_var (out);
+  fz_try (ctx)
+  {
+    s.value = fz_new_buffer (ctx, 64);
+    out = fz_new_buffer (ctx, len + 256);
+    w.out = out;
+    w.copied = w.t.pos = data;
+    w.t.end = data + len;
+
+    walk_packet (ctx, &w, rewrite_func, &s);
+    copy_to (ctx, &w, w.t.end);
+
+    for (int i = 0; i < PROPERTY_COUNT; ++i)
+      if (actions[i].type == ACTION_SET && actions[i].done == false)
+	pdfout_throw (ctx, "no rdf:RDF element in XMP packet");
+  }
+  fz_always (ctx)
+  {
+    fz_drop_buffer (ctx, s.value);
+    walk_drop (ctx, &w);
+  }
+  fz_catch (ctx)
+  {
+    fz_drop_buffer (ctx, out);
+    fz_rethrow (ctx);
+  }
+
+  return out;
+}
+
+/* Apply ACTIONS to the metadata stream of DOC.  The stream is only
+   written if the packet changes.  */
+static void
+update_metadata (fz_context *ctx, pdf_document *doc, xmp_action *actions)
+{
+  pdf_obj *root = pdf_dict_get (ctx, pdf_trailer (ctx, doc), PDF_NAME_Root);
+  if (root == NULL)
+    pdfout_throw (ctx, "no document catalog, cannot set XMP metadata");
+
+  pdf_obj *metadata = pdf_dict_get (ctx, root, PDF_NAME_Metadata);
+  if (pdf_is_stream (ctx, metadata) == false)
+    {
+      bool set = false;
+      for (int i = 0; i < PROPERTY_COUNT; ++i)
+	set |= actions[i].type == ACTION_SET;
+      if (set == false)
+	return;
+      metadata = NULL;
+    }
+
+  fz_buffer *packet = NULL, *out = NULL;
+  pdf_obj *dict = NULL, *ref = NULL;
+
+  fz_var (packet);
+  fz_var (out);
+  fz_var (dict);
+  fz_var (ref);
+  fz_try (ctx)
+  {
+    const char *data = xmp_template;
+    int len = sizeof xmp_template - 1;
+    if (metadata)
+      {
+	packet = pdf_load_stream (ctx, doc, pdf_to_num (ctx, metadata),
+				  pdf_to_gen (ctx, metadata));
+	data = (const char *) packet->data;
+	len = packet->len;
+      }
+
+    out = rewrite_packet (ctx, data, len, actions);
+
+    if (metadata == NULL)
+      {
+	dict = pdf_new_dict (ctx, doc, 2);
+	pdf_dict_put_drop (ctx, dict, PDF_NAME_Type,
+			   pdf_new_name (ctx, doc, "Metadata"));
+	pdf_dict_put_drop (ctx, dict, PDF_NAME_Subtype,
+			   pdf_new_name (ctx, doc, "XML"));
+	ref = pdf_add_object (ctx, doc, dict);
+	pdf_update_stream (ctx, doc, ref, out, 0);
+	pdf_dict_put (ctx, root, PDF_NAME_Metadata, ref);
+      }
+    else if (out->len != len || memcmp (out->data, data, len))
+      pdf_update_stream (ctx, doc, metadata, out, 0);
+  }
+  fz_always (ctx)
+  {
+    pdf_drop_obj (ctx, ref);
+    pdf_drop_obj (ctx, dict);
+    fz_drop_buffer (ctx, out);
+    fz_drop_buffer (ctx, packet);
+  }
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
+
+static int
+property_by_name (const char *name)
+{
+  for (int i = 0; i < PROPERTY_COUNT; ++i)
+    if (strcmp (properties[i].name, name) == 0)
+      return i;
+  return -1;
+}
+
+void
+pdfout_xmp_set (fz_context *ctx, pdf_document *doc, pdfout_data *xmp,
+		bool append)
+{
+  xmp_action actions[PROPERTY_COUNT];
+  for (int i = 0; i < PROPERTY_COUNT; ++i)
+    actions[i] = (xmp_action) { append ? ACTION_KEEP : ACTION_REMOVE };
+
+  int len = xmp ? pdfout_data_hash_len (ctx, xmp) : 0;
+  for (int i = 0; i < len; ++i)
+    {
+      char *key, *value;
+      int value_len;
+      pdfout_data_hash_get_key_value (ctx, xmp, &key, &value, &value_len, i);
+
+      int p = property_by_name (key);
+      if (p < 0)
+	pdfout_throw (ctx, "'%s' is not a supported XMP property. Supported\
+ properties are:\ndc:title,dc:creator,dc:description,pdf:Keywords,\
+xmp:CreatorTool,pdf:Producer,xmp:CreateDate,xmp:ModifyDate,pdf:Trapped",
+		      key);
+      actions[p] = (xmp_action) { ACTION_SET, value, value_len };
+    }
+
+  update_metadata (ctx, doc, actions);
+}
+
+/* Convert the PDF date DATE, like D:20150701123000+02'00', to the XMP
+   format 2015-07-01T12:30:00+02:00.  Return false if DATE is malformed.  */
+static bool
+convert_date (const char *date, char *out)
+{
+  int fields[7] = { 0 }, count = 0;
+  static const int digits[] = { 4, 2, 2, 2, 2, 2 };
+
+  if (strncmp (date, "D:", 2) == 0)
+    date += 2;
+
+  for (; count < 6 && pdfout_isdigit (date[0]); ++count)
+    for (int i = 0; i < digits[count]; ++i, ++date)
+      {
+	if (pdfout_isdigit (date[0]) == false)
+	  return false;
+	fields[count] = fields[count] * 10 + date[0] - '0';
+      }
+  if (count == 0)
+    return false;
+
+  out += sprintf (out, "%04d", fields[0]);
+  if (count > 1)
+    out += sprintf (out, "-%02d", fields[1]);
+  if (count > 2)
+    out += sprintf (out, "-%02d", fields[2]);
+  if (count < 4)
+    return date[0] == '\0';
+
+  /* A time needs hours and minutes in XMP.  */
+  out += sprintf (out, "T%02d:%02d", fields[3], fields[4]);
+  if (count > 5)
+    out += sprintf (out, ":%02d", fields[5]);
+
+  char sign = date[0];
+  if (sign == '\0')
+    return true;
+  if (sign == 'Z')
+    {
+      strcpy (out, "Z");
+      return true;
+    }
+  if (sign != '+' && sign != '-')
+    return false;
+
+  int hour = 0, minute = 0;
+  if (sscanf (date + 1, "%2d'%2d", &hour, &minute) < 1)
+    return false;
+  sprintf (out, "%c%02d:%02d", sign, hour, minute);
+  return true;
+}
+
+void
+pdfout_xmp_sync_info (fz_context *ctx, pdf_document *doc)
+{
+  xmp_action actions[PROPERTY_COUNT];
+  char dates[PROPERTY_COUNT][40];
+  pdfout_data *info = pdfout_info_dict_get (ctx, doc);
+
+  fz_try (ctx)
+  {
+    for (int i = 0; i < PROPERTY_COUNT; ++i)
+      actions[i] = (xmp_action) { ACTION_REMOVE };
+
+    int len = pdfout_data_hash_len (ctx, info);
+    for (int i = 0; i < len; ++i)
+      {
+	char *key, *value;
+	int value_len;
+	pdfout_data_hash_get_key_value (ctx, info, &key, &value, &value_len,
+					i);
+	pdfout_key info_key = pdfout_key_classify (key, strlen (key));
+
+	int p;
+	for (p = 0; p < PROPERTY_COUNT; ++p)
+	  if (properties[p].info_key == info_key)
+	    break;
+	if (p == PROPERTY_COUNT)
+	  continue;
+
+	switch (info_key)
+	  {
+	  case PDFOUT_KEY_CreationDate:
+	  case PDFOUT_KEY_ModDate:
+	    if (value_len > 30 || convert_date (value, dates[p]) == false)
+	      {
+		pdfout_warn (ctx, "not syncing malformed date '%s' to XMP",
+			     value);
+		actions[p].type = ACTION_KEEP;
+		continue;
+	      }
+	    value = dates[p];
+	    value_len = strlen (value);
+	    break;
+	  default:
+	    break;
+	  }
+	actions[p] = (xmp_action) { ACTION_SET, value, value_len };
+      }
+
+    update_metadata (ctx, doc, actions);
+  }
+  fz_always (ctx)
+    pdfout_data_drop (ctx, info);
+  fz_catch (ctx)
+    fz_rethrow (ctx);
+}
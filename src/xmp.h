@@ -0,0 +1,19 @@
+#ifndef HAVE_PDFOUT_XMP_H
+#define HAVE_PDFOUT_XMP_H
+
+/* Return the supported properties of the /Root/Metadata packet as hash
+   with keys like "dc:title".  The hash is empty if there is no XMP
+   metadata.  */
+pdfout_data *pdfout_xmp_get (fz_context *ctx, pdf_document *doc);
+
+/* Set the properties in the hash XMP.  The rest of the packet is copied
+   verbatim.  If APPEND is false, supported properties which are missing
+   from XMP are removed.  XMP may be NULL, to remove all of them.  */
+void pdfout_xmp_set (fz_context *ctx, pdf_document *doc, pdfout_data *xmp,
+		     bool append);
+
+/* Update the XMP properties corresponding to the entries of the info dict,
+   e.g. dc:title for Title.  Dates are converted to the XMP format.  */
+void pdfout_xmp_sync_info (fz_context *ctx, pdf_document *doc);
+
+#endif	/* ! HAVE_PDFOUT_XMP_H */
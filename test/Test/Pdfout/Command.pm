@@ -168,6 +168,10 @@ sub command_subtest (%args) {
     if ($err_msg) {
         $tb->diag("err_msg: $err_msg");
     }
+    if ( $args{expected_err} ) {
+        $retval &&= $tb->like( $err_msg // '', $args{expected_err},
+            "error message matches regexp" );
+    }
 
     close_fh($out_fh);
     close_fh($err_fh);
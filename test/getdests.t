@@ -0,0 +1,90 @@
+#!/usr/bin/env perl
+use warnings;
+use strict;
+use 5.020;
+
+use Test::Pdfout::Command;
+use Test::More;
+use Testlib;
+use File::Copy qw/cp/;
+
+my $pdf = new_tempfile();
+cp( test_data("named-dests.pdf"), $pdf )
+    or die "cp";
+
+# Destinations from the /Dests dictionary come first, then the name tree.
+pdfout_ok(
+    command      => [ 'getdests', $pdf ],
+    expected_out => <<'EOD'
+[
+  {
+    "name": "chap1",
+    "page": 1,
+    "view": [
+      "XYZ",
+      0,
+      800,
+      null
+    ]
+  },
+  {
+    "name": "sec1",
+    "page": 2,
+    "view": [
+      "Fit"
+    ]
+  },
+  {
+    "name": "sec2",
+    "page": 3,
+    "view": [
+      "FitH",
+      700
+    ]
+  },
+  {
+    "name": "sec3",
+    "page": 1,
+    "view": [
+      "FitB"
+    ]
+  }
+]
+EOD
+);
+
+# Outline items with named destinations.
+pdfout_ok(
+    command      => [ 'getoutline', $pdf ],
+    expected_out => <<'EOD'
+[
+  {
+    "title": "Chapter 1",
+    "page": 1,
+    "view": [
+      "XYZ",
+      0,
+      800,
+      null
+    ]
+  },
+  {
+    "title": "Section 2",
+    "page": 3,
+    "view": [
+      "FitH",
+      700
+    ]
+  }
+]
+EOD
+);
+
+pdfout_ok(
+    command      => [ 'getdests', new_pdf() ],
+    expected_out => "[]\n"
+);
+
+test_usage_help('getdests');
+
+done_testing();
@@ -8,6 +8,9 @@ use Test::More;
 
 use Testlib;
 use File::Copy qw/cp/;
+use Encode qw/encode/;
+use JSON::PP qw/decode_json/;
+use File::Slurper qw/read_binary/;
 
 my $pdf = new_tempfile();
 cp( test_data("hello-world.pdf"), $pdf )
@@ -24,6 +27,14 @@ EOD
 
 pdfout_ok( command => [ 'gettxt', $pdf ], expected_out => $expected );
 
+# Parallel extraction keeps the page order.
+for my $jobs ( 2, 5 ) {
+    pdfout_ok(
+        command      => [ 'gettxt', '-j', $jobs, $pdf ],
+        expected_out => $expected
+    );
+}
+
 my $expected_page_1 = "Hello, World from page 1!\n\f\n";
 
 pdfout_ok(
@@ -36,6 +47,167 @@ pdfout_ok(
     expected_out => $expected
 );
 
+pdfout_ok(
+    command      => [ 'gettxt', '-j2', '-p3,1', $pdf ],
+    expected_out => "Hello, World from page 3!\n\f\n" . $expected_page_1
+);
+
+pdfout_ok(
+    command      => [ 'gettxt', '-p1', '--encoding', 'UTF-16', $pdf ],
+    expected_out => "\xfe\xff" . encode( 'UTF-16BE', $expected_page_1 )
+);
+
+pdfout_ok(
+    command      => [ 'gettxt', '--encoding', 'UTF-32LE', $pdf ],
+    expected_out => encode( 'UTF-32LE', $expected )
+);
+
+# structured output
+pdfout_ok(
+    command      => [ 'gettxt', '--json', '-p1', $pdf ],
+    expected_out => qr/\A\[\n  \{\n    "page": 1,.*"bbox": \[.*"text": "Hello, World from page 1!"\n.*\]\n\z/s
+);
+
+pdfout_ok(
+    command => [ 'gettxt', '--granularity=word', '-j2', '-p2', $pdf ],
+    expected_out =>
+        qr/"page": 2,.*"words":.*"text": "Hello,".*"font":.*"size":/s
+);
+
+# Return the decoded output of gettxt --json for FILE.
+sub get_json {
+    my ( $file, @options ) = @_;
+    pdfout_ok( command => [ 'gettxt', '--json', '-d', @options, $file ] );
+    my $json = read_binary("$file.json");
+    return ( decode_json($json), $json );
+}
+
+sub keys_are {
+    my ( $hash, $keys, $name ) = @_;
+    is( join( ',', sort keys %$hash ), join( ',', sort @$keys ), $name );
+}
+
+{
+    my %keys = (
+        block => [qw/bbox text/],
+        line  => [qw/bbox lines/],
+        word  => [qw/bbox lines/],
+        char  => [qw/bbox lines/],
+    );
+    my %line_keys = (
+        line => [qw/bbox text/],
+        word => [qw/bbox words/],
+        char => [qw/bbox spans/]
+    );
+    for my $level (qw/block line word char/) {
+        my ($pages) = get_json( $pdf, "--granularity=$level", '-p3' );
+        is( scalar @$pages, 1, "$level: one page" );
+        my $page = $pages->[0];
+        keys_are( $page, [qw/page width height blocks/], "$level: page" );
+        is( $page->{page}, 3, "$level: page number" );
+
+        my $block = $page->{blocks}[0];
+        keys_are( $block, $keys{$level}, "$level: block" );
+        if ( $level eq 'block' ) {
+            is( $block->{text}, 'Hello, World from page 3!' );
+            next;
+        }
+
+        my $line = $block->{lines}[0];
+        keys_are( $line, $line_keys{$level}, "$level: line" );
+        if ( $level eq 'line' ) {
+            is( $line->{text}, 'Hello, World from page 3!' );
+        }
+        elsif ( $level eq 'word' ) {
+            keys_are( $line->{words}[0], [qw/bbox text font size/],
+                'word' );
+            is( join( ' ', map { $_->{text} } @{ $line->{words} } ),
+                'Hello, World from page 3!' );
+        }
+        else {
+            my $span = $line->{spans}[0];
+            keys_are( $span, [qw/bbox text font size chars/], 'span' );
+            keys_are( $span->{chars}[0], [qw/c bbox/], 'char' );
+            is( $span->{chars}[0]{c}, 'H' );
+        }
+    }
+}
+
+# Text which looks like a number or literal is still a string.
+{
+    my $literal = new_tempfile();
+    cp( test_data("literal-text.pdf"), $literal )
+        or die "cp";
+    for my $jobs ( 1, 2 ) {
+        my ( $pages, $json )
+            = get_json( $literal, '--granularity=line', "-j$jobs" );
+        my @lines = map { @{ $_->{lines} } } @{ $pages->[0]{blocks} };
+        is_deeply( [ map { $_->{text} } @lines ], [qw/42 null true/],
+            "text of lines, $jobs jobs" );
+        like( $json, qr/"text": "42"/, 'number quoted' );
+        unlike( $json, qr/"text": (42|null|true)\b/, 'no bare literals' );
+    }
+    my ( $pages, $json ) = get_json( $literal, '--granularity=char' );
+    like( $json, qr/"c": "4"/, 'characters quoted' );
+}
+
+pdfout_ok(
+    command => [ 'gettxt', '--granularity=paragraph', $pdf ],
+    status  => 1
+);
+
+pdfout_ok(
+    command => [ 'gettxt', '--json', '--encoding', 'UTF-16', $pdf ],
+    status  => 1
+);
+
+# page ranges given as page labels
+pdfout_ok(
+    command => [ 'setpagelabels', $pdf ],
+    input   => '[{"page": 1, "style": "roman"}, {"page": 3, "prefix": "A-"}]'
+);
+
+pdfout_ok(
+    command      => [ 'gettxt', '-p', 'ii-A-', $pdf ],
+    expected_out => "Hello, World from page 2!\n\f\nHello, World from page 3!\n\f\n"
+);
+
+pdfout_ok(
+    command      => [ 'gettxt', '-p', 'i,3', $pdf ],
+    expected_out => $expected_page_1 . "Hello, World from page 3!\n\f\n"
+);
+
+pdfout_ok(
+    command => [ 'gettxt', '-p', 'xx', $pdf ],
+    status  => 1
+);
+
+# Numbers stay page numbers when a page has a numeric label.
+pdfout_ok(
+    command => [ 'setpagelabels', $pdf ],
+    input   => '[{"page": 1, "style": "roman"}, {"page": 2, "style": "arabic"}]'
+);
+
+pdfout_ok(
+    command      => [ 'gettxt', '-p', '1', $pdf ],
+    expected_out => $expected_page_1
+);
+
+pdfout_ok(
+    command      => [ 'gettxt', '-p', 'label:1', $pdf ],
+    expected_out => "Hello, World from page 2!\n\f\n"
+);
+
+pdfout_ok(
+    command      => [ 'gettxt', '-p', 'label:1-label:2', $pdf ],
+    expected_out => "Hello, World from page 2!\n\f\nHello, World from page 3!\n\f\n"
+);
+
+pdfout_ok(
+    command => [ 'gettxt', '-p', 'label:3', $pdf ],
+    status  => 1
+);
+
 test_usage_help('gettxt');
 
 done_testing();
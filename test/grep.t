@@ -0,0 +1,114 @@
+#!/usr/bin/env perl
+use warnings;
+use strict;
+use 5.020;
+
+use Test::Pdfout::Command;
+use Test::More;
+
+use Testlib;
+use File::Copy qw/cp/;
+
+my $pdf = new_tempfile();
+cp( test_data("hello-world.pdf"), $pdf )
+    or die "cp";
+
+pdfout_ok(
+    command      => [ 'grep', 'page 2', $pdf ],
+    expected_out => "2:Hello, World from page 2!\n"
+);
+
+# The page order does not depend on the number of jobs.
+my $all = join '', map {"$_:Hello, World from page $_!\n"} 1 .. 3;
+for my $jobs ( 1, 2, 5 ) {
+    pdfout_ok(
+        command      => [ 'grep', '-j', $jobs, 'World', $pdf ],
+        expected_out => $all
+    );
+}
+
+pdfout_ok(
+    command      => [ 'grep', '-m', 2, 'World', $pdf ],
+    expected_out => "1:Hello, World from page 1!\n2:Hello, World from page 2!\n"
+);
+
+pdfout_ok(
+    command      => [ 'grep', '-i', 'WORLD FROM PAGE 3', $pdf ],
+    expected_out => "3:Hello, World from page 3!\n"
+);
+
+pdfout_ok(
+    command      => [ 'grep', '-E', 'page (1|3)!$', $pdf ],
+    expected_out => "1:Hello, World from page 1!\n3:Hello, World from page 3!\n"
+);
+
+pdfout_ok(
+    command      => [ 'grep', '-F', 'page .', $pdf ],
+    expected_out => '',
+    status       => 1
+);
+
+pdfout_ok( command => [ 'grep', '-q', 'World', $pdf ], expected_out => '' );
+
+pdfout_ok(
+    command      => [ 'grep', 'Goodbye', $pdf ],
+    expected_out => '',
+    status       => 1
+);
+
+pdfout_ok(
+    command => [ 'grep', '-E', 'page (', $pdf ],
+    status  => 2
+);
+
+# Several files.
+{
+    my $empty = new_pdf();
+    pdfout_ok(
+        command      => [ 'grep', '-l', 'World', $empty, $pdf ],
+        expected_out => "$pdf\n"
+    );
+    pdfout_ok(
+        command      => [ 'grep', 'page 1', $empty, $pdf ],
+        expected_out => "$pdf:1:Hello, World from page 1!\n"
+    );
+
+    # Files are searched in parallel, but printed in order.
+    my @copies = map { my $copy = new_tempfile(); cp( $pdf, $copy ); $copy }
+        1 .. 4;
+    for my $jobs ( 1, 3 ) {
+        pdfout_ok(
+            command => [ 'grep', '-j', $jobs, 'page [13]', @copies ],
+            expected_out => join '',
+            map {
+                "$_:1:Hello, World from page 1!\n"
+                    . "$_:3:Hello, World from page 3!\n"
+            } @copies
+        );
+    }
+    pdfout_ok(
+        command      => [ 'grep', '-m', 1, '-j', 2, 'World', @copies ],
+        expected_out => join '',
+        map {"$_:1:Hello, World from page 1!\n"} @copies
+    );
+
+    pdfout_ok(
+        command      => [ 'grep', 'page 1', $pdf, 'nonexistent.pdf' ],
+        expected_out => "$pdf:1:Hello, World from page 1!\n",
+        status       => 2
+    );
+}
+
+# Page labels.
+pdfout_ok(
+    command => [ 'setpagelabels', $pdf ],
+    input   => qq([{"page": 1, "style": "roman"}]\n)
+);
+pdfout_ok(
+    command      => [ 'grep', '--page-label', 'page 3', $pdf ],
+    expected_out => "3:iii:Hello, World from page 3!\n"
+);
+
+test_usage_help('grep');
+
+done_testing();
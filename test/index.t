@@ -0,0 +1,110 @@
+#!/usr/bin/env perl
+use warnings;
+use strict;
+use 5.020;
+
+use Test::Pdfout::Command;
+use Test::More;
+
+use Testlib;
+use File::Copy qw/cp/;
+use File::Temp qw/tempdir/;
+use File::Spec::Functions qw/catfile/;
+
+my $dir = tempdir( CLEANUP => 1 );
+my $index = new_tempfile();
+my $hello = catfile( $dir, 'hello.pdf' );
+cp( test_data("hello-world.pdf"), $hello )
+    or die "cp";
+cp( new_pdf(), catfile( $dir, 'empty.pdf' ) )
+    or die "cp";
+
+pdfout_ok( command => [ 'index', 'build', '-f', $index, $dir ] );
+
+pdfout_ok(
+    command      => [ 'index', 'search', '-f', $index, 'page', '2' ],
+    expected_out => "$hello:2\n"
+);
+
+pdfout_ok(
+    command      => [ 'index', 'search', '-f', $index, 'HELLO WORLD' ],
+    expected_out => join '', map {"$hello:$_\n"} 1 .. 3
+);
+
+pdfout_ok(
+    command      => [ 'index', 'search', '-f', $index, '-l', 'world' ],
+    expected_out => "$hello\n"
+);
+
+pdfout_ok(
+    command      => [ 'index', 'search', '-f', $index, 'world', 'goodbye' ],
+    expected_out => '',
+    status       => 1
+);
+
+# Incremental rebuild with a new and a touched file.
+my $subdir = catfile( $dir, 'sub' );
+mkdir $subdir
+    or die "mkdir";
+my $copy = catfile( $subdir, 'copy.PDF' );
+cp( $hello, $copy )
+    or die "cp";
+utime undef, undef, $hello
+    or die "utime";
+
+pdfout_ok( command => [ 'index', 'build', '-f', $index, $dir ] );
+pdfout_ok(
+    command      => [ 'index', 'search', '-f', $index, 'page 3' ],
+    expected_out => "$hello:3\n$copy:3\n"
+);
+
+# Removed files are dropped.
+unlink $copy
+    or die "unlink";
+pdfout_ok( command => [ 'index', 'build', '-f', $index, $dir ] );
+pdfout_ok(
+    command      => [ 'index', 'search', '-f', $index, '-l', 'page' ],
+    expected_out => "$hello\n"
+);
+
+pdfout_ok(
+    command => [ 'index', 'search', '-f', new_tempfile(), 'world' ],
+    status  => 2
+);
+
+# A file of the same size and modification time is not read again.
+{
+    my $dir   = tempdir( CLEANUP => 1 );
+    my $index = new_tempfile();
+    my $file  = catfile( $dir, 'hello.pdf' );
+    cp( test_data("hello-world.pdf"), $file )
+        or die "cp";
+    pdfout_ok( command => [ 'index', 'build', '-f', $index, $dir ] );
+
+    my @stat = stat $file
+        or die "stat";
+    open my $fh, '>:raw', $file
+        or die "open";
+    print {$fh} 'x' x $stat[7];
+    close $fh
+        or die "close";
+    utime $stat[8], $stat[9], $file
+        or die "utime";
+    is( -s $file, $stat[7], "size restored" );
+
+    pdfout_ok( command => [ 'index', 'build', '-f', $index, $dir ] );
+    pdfout_ok(
+        command      => [ 'index', 'search', '-f', $index, '-l', 'world' ],
+        expected_out => "$file\n"
+    );
+}
+
+test_usage_help('index');
+for my $subcommand (qw/build search/) {
+    pdfout_ok(
+        command      => [ 'index', $subcommand, '--help' ],
+        expected_out => qr/^Usage:.*^ Options:\n/ms
+    );
+}
+
+done_testing();
@@ -7,6 +7,7 @@ use 5.020;
 use Test::Pdfout::Command;
 use Test::More;
 use Testlib;
+use File::Copy qw/cp/;
 
 my $input = <<'EOD';
 {
@@ -71,4 +72,35 @@ EOD
     );
 }
 
+# A value shared with the outline is not freed by either setter.
+{
+    my $pdf = new_tempfile();
+    cp( test_data("info-shared-value.pdf"), $pdf )
+        or die "cp";
+    pdfout_ok(
+        command => [ 'setinfo', $pdf ],
+        input   => '{"Author": "x"}',
+    );
+    pdfout_ok(
+        command      => [ 'getoutline', $pdf ],
+        expected_out => qr/"title": "shared"/,
+    );
+
+    cp( test_data("info-shared-value.pdf"), $pdf )
+        or die "cp";
+    pdfout_ok(
+        command => [ 'setoutline', $pdf ],
+        input   => '[{"title": "new", "page": 1}]',
+    );
+    pdfout_ok(
+        command      => [ 'getinfo', $pdf ],
+        expected_out => <<'EOD',
+{
+  "Title": "shared",
+  "Author": "pdfout"
+}
+EOD
+    );
+}
+
 done_testing();
@@ -6,6 +6,8 @@ use 5.020;
 use Test::Pdfout::Command;
 use Test::More;
 use Testlib;
+use File::Copy qw/cp/;
+use File::Slurper qw/read_binary/;
 
 set_get_test(
     command => ['outline'],
@@ -145,4 +147,146 @@ EOD
     );
 }
 
+# empty outline
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'setoutline', $pdf ],
+        input   => '[]'
+    );
+    pdfout_ok(
+        command      => [ 'getoutline', $pdf ],
+        expected_out => "[]\n"
+    );
+}
+
+# patch an existing outline
+{
+    my $pdf = new_pdf();
+    my $input = <<'EOD';
+[
+  {
+    "title": "one",
+    "page": 1,
+    "kids": [
+      {
+        "title": "two",
+        "page": 1
+      }
+    ]
+  }
+]
+EOD
+    pdfout_ok(
+        command => [ 'setoutline', $pdf ],
+        input   => $input
+    );
+    $input =~ s/"two"/"three"/;
+    pdfout_ok(
+        command => [ 'setoutline', '--patch', $pdf ],
+        input   => $input
+    );
+    pdfout_ok(
+        command      => [ 'getoutline', $pdf ],
+        expected_out => <<'EOD'
+[
+  {
+    "title": "one",
+    "page": 1,
+    "view": [
+      "XYZ",
+      null,
+      null,
+      null
+    ],
+    "open": false,
+    "kids": [
+      {
+        "title": "three",
+        "page": 1,
+        "view": [
+          "XYZ",
+          null,
+          null,
+          null
+        ]
+      }
+    ]
+  }
+]
+EOD
+    );
+}
+
+# patching only appends the retitled item
+{
+    my $pdf   = new_pdf();
+    my $input = <<'EOD';
+[
+  {"title": "a", "page": 1},
+  {"title": "b", "page": 2, "kids": [
+    {"title": "c", "page": 3},
+    {"title": "d", "page": 4}
+  ]},
+  {"title": "e", "page": 5}
+]
+EOD
+    pdfout_ok(
+        command => [ 'setoutline', $pdf ],
+        input   => $input
+    );
+    my $size = -s $pdf;
+    $input =~ s/"c"/"x"/;
+    pdfout_ok(
+        command => [ 'setoutline', '--patch', $pdf ],
+        input   => $input
+    );
+    my $update = substr( read_binary($pdf), $size );
+    my @objects = $update =~ /^\d+ \d+ obj\b(.*?)endobj/msg;
+    is( scalar @objects, 1, "only one object appended" );
+    like( $objects[0], qr/\(x\)/, "appended object is the retitled item" );
+}
+
+# Return the number of objects and of free xref entries in FILE.
+sub count_objects {
+    my ($file) = @_;
+    my $pdf = read_binary($file);
+    my $objects = () = $pdf =~ /^\d+ \d+ obj\b/mg;
+    my $free    = () = $pdf =~ /^\d{10} \d{5} f/mg;
+    return ( $objects, $free );
+}
+
+# replaced outline objects are freed
+{
+    my $pdf   = new_pdf();
+    my $out1  = new_tempfile();
+    my $out2  = new_tempfile();
+    my $input = '[{"title": "a", "page": 1, "kids": [{"title": "b", "page": 1}]}]';
+    pdfout_ok(
+        command => [ 'setoutline', $pdf, '-o', $out1 ],
+        input   => $input
+    );
+    pdfout_ok(
+        command => [ 'setoutline', $out1, '-o', $out2 ],
+        input   => $input
+    );
+    my ( $objects1, $free1 ) = count_objects($out1);
+    my ( $objects2, $free2 ) = count_objects($out2);
+    is( $objects2, $objects1, "rewritten outline does not accumulate objects" );
+
+    # The old outline dict and its two items.
+    is( $free2 - $free1, 3, "old outline objects are free xref entries" );
+}
+
+# circular reference in the outline
+{
+    my $pdf = new_tempfile();
+    cp( test_data("outline-cycle.pdf"), $pdf )
+        or die "cp";
+    pdfout_ok(
+        command => [ 'getoutline', $pdf ],
+        status  => 1
+    );
+}
+
 done_testing();
@@ -0,0 +1,84 @@
+#!/usr/bin/env perl
+use warnings;
+use strict;
+use 5.020;
+
+use Test::Pdfout::Command;
+use Test::More;
+use Testlib;
+
+sub source_pdf {
+    my ( $pages, $outline ) = @_;
+    my $pdf = new_tempfile();
+    pdfout_ok( command => [ 'create', "-p$pages", '-o', $pdf ] );
+    pdfout_ok(
+        command => [ 'setoutline', '--wysiwyg', $pdf ],
+        input   => $outline
+    );
+    return $pdf;
+}
+
+my $chapter1 = source_pdf( 3, <<'EOD' );
+One 1
+    One.1 2
+    One.2 3
+EOD
+my $chapter2 = source_pdf( 2, <<'EOD' );
+Two 1
+    Two.1 2
+EOD
+
+# graft at the top level
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'outline-merge', '--first-page=2', $pdf, $chapter1,
+            $chapter2 ]
+    );
+    pdfout_ok(
+        command      => [ 'getoutline', '--wysiwyg', $pdf ],
+        expected_out => <<'EOD'
+One 2
+    One.1 3
+    One.2 4
+Two 5
+    Two.1 6
+EOD
+    );
+}
+
+# graft under parent entries, appending to an existing outline
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'setoutline', '--wysiwyg', $pdf ],
+        input   => "Cover 1\n"
+    );
+    pdfout_ok(
+        command => [ 'outline-merge', '-p', '-f2', $pdf, $chapter1, $chapter2 ]
+    );
+    pdfout_ok(
+        command      => [ 'getoutline', '--wysiwyg', $pdf ],
+        expected_out => <<"EOD"
+Cover 1
+$chapter1 2
+    One 2
+        One.1 3
+        One.2 4
+$chapter2 5
+    Two 5
+        Two.1 6
+EOD
+    );
+}
+
+# sources do not fit into the document
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'outline-merge', '-f9', $pdf, $chapter1 ],
+        status  => 1
+    );
+}
+
+done_testing();
@@ -0,0 +1,108 @@
+#!/usr/bin/env perl
+use warnings;
+use strict;
+use 5.020;
+
+use Test::Pdfout::Command;
+use Test::More;
+use Testlib;
+
+my $wysiwyg = <<'EOD';
+Chapter 1 1
+    Section 1.1 2
+        Subsection 1.1.1 3
+Chapter 2 4
+    Section 2.1 5
+EOD
+
+sub outline_pdf {
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'setoutline', '--wysiwyg', $pdf ],
+        input   => $wysiwyg
+    );
+    return $pdf;
+}
+
+# page offset, depth truncation and title replace
+{
+    my $pdf = outline_pdf();
+    pdfout_ok(
+        command => [
+            'outline-transform', $pdf,
+            '--page-offset=2',   '--max-depth=2',
+            '--title-regex=^(Chapter|Section) ([0-9.]+)$',
+            '--title-replace=\2 \1'
+        ]
+    );
+    pdfout_ok(
+        command      => [ 'getoutline', '--wysiwyg', $pdf ],
+        expected_out => <<'EOD'
+1 Chapter 3
+    1.1 Section 4
+2 Chapter 6
+    2.1 Section 7
+EOD
+    );
+}
+
+# open all items and convert Fit views
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'setoutline', $pdf ],
+        input   => <<'EOD'
+[{"title": "a", "page": 1, "view": ["Fit"], "open": false,
+  "kids": [{"title": "b", "page": 2, "view": ["FitH", 10]}]}]
+EOD
+    );
+    pdfout_ok( command => [ 'outline-transform', '-a', '-x', $pdf ] );
+    pdfout_ok(
+        command      => [ 'getoutline', $pdf ],
+        expected_out => <<'EOD'
+[
+  {
+    "title": "a",
+    "page": 1,
+    "view": [
+      "XYZ",
+      null,
+      null,
+      null
+    ],
+    "open": true,
+    "kids": [
+      {
+        "title": "b",
+        "page": 2,
+        "view": [
+          "FitH",
+          10
+        ]
+      }
+    ]
+  }
+]
+EOD
+    );
+}
+
+# page out of range
+{
+    my $pdf = outline_pdf();
+    pdfout_ok(
+        command => [ 'outline-transform', '--page-offset=100', $pdf ],
+        status  => 1
+    );
+}
+
+# invalid regex
+{
+    my $pdf = outline_pdf();
+    pdfout_ok(
+        command => [ 'outline-transform', '--title-regex=(', $pdf ],
+        status  => 1
+    );
+}
+
+done_testing();
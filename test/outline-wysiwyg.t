@@ -50,4 +50,30 @@ EOD
     empty => "",
 );
 
+# Leading empty lines count, and the first item must not be indented
+# after them either.
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command      => [ 'setoutline', '--wysiwyg', $pdf ],
+        input        => "\n \t\n    abc 1\ndef 2\n",
+        status       => 1,
+        expected_err => qr/In line 3: first line must not have indentation:\n    abc 1/
+    );
+    pdfout_ok(
+        command      => [ 'setoutline', '--wysiwyg', $pdf ],
+        input        => "\n\nabc 1\n        def 2\n",
+        status       => 1,
+        expected_err => qr/In line 4: too mutch indentation/
+    );
+    pdfout_ok(
+        command => [ 'setoutline', '--wysiwyg', $pdf ],
+        input   => "\n\nabc 1\n    def 2\n"
+    );
+    pdfout_ok(
+        command      => [ 'getoutline', '--wysiwyg', $pdf ],
+        expected_out => "abc 1\n    def 2\n"
+    );
+}
+
 done_testing();
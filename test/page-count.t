@@ -6,6 +6,9 @@ use 5.020;
 use Test::Pdfout::Command;
 use Test::More;
 use Testlib;
+use File::Copy qw/cp/;
+use File::Temp qw/tempdir/;
+use File::Spec::Functions qw/catfile/;
 
 my $pdf = new_pdf();
 
@@ -14,6 +17,53 @@ pdfout_ok(
     expected_out => "10\n"
 );
 
+# Batch mode: one JSON line per file, errors are reported inline.
+{
+    my $hello   = test_data('hello-world.pdf');
+    my $missing = new_tempfile() . '.missing';
+    my $expected =
+        qr/^\{"file":"\Q$pdf\E","result":10\}\n
+           \{"file":"\Q$missing\E","error":"[^\n]+"\}\n
+           \{"file":"\Q$hello\E","result":3\}\n\z/x;
+
+    pdfout_ok(
+        command      => [ 'pagecount', '-j', 2, $pdf, $missing, $hello ],
+        expected_out => $expected,
+        status       => 1,
+    );
+
+    pdfout_ok(
+        command      => [ 'pagecount', '-' ],
+        input        => "$pdf\n$missing\n$hello\n",
+        expected_out => $expected,
+        status       => 1,
+    );
+
+    pdfout_ok(
+        command      => [ 'getinfo', $pdf, $hello ],
+        expected_out => qr/^\{"file":"\Q$pdf\E","result":\{[^\n]*\}\}\n
+                           \{"file":"\Q$hello\E","result":\{[^\n]*\}\}\n\z/x,
+    );
+}
+
+# File names which are not UTF-8 get U+FFFD for the bad bytes, and the
+# batch goes on after them.
+{
+    my $dir = tempdir( CLEANUP => 1 );
+    my $latin1 = catfile( $dir, "caf\xe9.pdf" );
+    cp( test_data('hello-world.pdf'), $latin1 )
+        or die "cp";
+    my $missing = catfile( $dir, "miss\xff.pdf" );
+    pdfout_ok(
+        command      => [ 'pagecount', $latin1, $missing, $pdf ],
+        expected_out =>
+            qr/^\{"file":"\Q$dir\E.caf\xef\xbf\xbd\.pdf","result":3\}\n
+               \{"file":"\Q$dir\E.miss\xef\xbf\xbd\.pdf","error":"[^\n]+"\}\n
+               \{"file":"\Q$pdf\E","result":10\}\n\z/x,
+        status => 1,
+    );
+}
+
 test_usage_help('pagecount');
 
 done_testing();
@@ -6,6 +6,7 @@ use 5.020;
 use Test::Pdfout::Command;
 use Test::More;
 use Testlib;
+use File::Copy qw/cp/;
 
 my $input = <<'EOD';
 [
@@ -48,6 +49,7 @@ set_get_test(
 	'[{"style": "arabic"}]',
 	'[{"page": 1, "style": "goofy"}]',
 	'[{"page": 1, "first": -1}]',
+	'[{"page": 1, "first": 100001}]',
 	'[{"page": 1}, {"page": 3}, {"page": 2}]',
 	'[{"page": 1, "prefix": []}]'
     ],
@@ -57,4 +59,83 @@ set_get_test(
 
 );
 
+# write and read a nested number tree
+{
+    my $pdf = new_pdf();
+    my $input = "[\n"
+      . join( ",\n",
+        map { qq(  {\n    "page": $_,\n    "style": "arabic"\n  }) } 1 .. 10 )
+      . "\n]\n";
+    pdfout_ok(
+        command => [ 'setpagelabels', '--fanout', 2, $pdf ],
+        input   => $input
+    );
+    pdfout_ok(
+        command      => [ 'getpagelabels', $pdf ],
+        expected_out => $input
+    );
+}
+
+# labels of single pages
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'setpagelabels', $pdf ],
+        input   => $input
+    );
+    pdfout_ok(
+        command      => [ 'pagelabel', $pdf ],
+        expected_out => "\n1\n∂ρ⇒∂↦⇒Φi\nI\nA\na\nb\nc\nd\ne\n"
+    );
+    pdfout_ok(
+        command      => [ 'pagelabel', '-p', '9-10,2', $pdf ],
+        expected_out => "d\ne\n1\n"
+    );
+}
+
+# Number tree from another producer, with zero-based keys.
+{
+    my $pdf = new_tempfile();
+    cp( test_data("page-labels-zero-based.pdf"), $pdf )
+        or die "cp";
+    pdfout_ok(
+        command      => [ 'getpagelabels', $pdf ],
+        expected_out => <<'EOD'
+[
+  {
+    "page": 1,
+    "style": "roman"
+  },
+  {
+    "page": 3,
+    "style": "arabic",
+    "first": 5
+  },
+  {
+    "page": 5,
+    "style": "arabic",
+    "prefix": "A-"
+  }
+]
+EOD
+    );
+    pdfout_ok(
+        command      => [ 'pagelabel', $pdf ],
+        expected_out => "i\nii\n5\n6\nA-1\nA-2\n"
+    );
+}
+
+# A huge start value would give huge labels.
+{
+    my $pdf = new_tempfile();
+    cp( test_data("page-labels-huge-start.pdf"), $pdf )
+        or die "cp";
+    for my $command (qw/getpagelabels pagelabel/) {
+        pdfout_ok(
+            command => [ $command, $pdf ],
+            status  => 1
+        );
+    }
+}
+
 done_testing();
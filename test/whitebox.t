@@ -14,6 +14,9 @@ my @tests = qw/
     --json
     --data
     --strsep
+    --kernels
+    --matcher
+    --text-index
     /;
 
 for my $test (@tests) {
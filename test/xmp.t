@@ -0,0 +1,163 @@
+#!/usr/bin/env perl
+use warnings;
+use strict;
+use utf8;
+use 5.020;
+
+use Test::Pdfout::Command;
+use Test::More;
+use Testlib;
+use File::Copy qw/cp/;
+
+my $input = <<'EOD';
+{
+  "dc:title": "pdfout XMP test",
+  "dc:creator": "pdfout",
+  "dc:description": "<testing> & \"quoting\"",
+  "pdf:Keywords": "la la la",
+  "xmp:CreatorTool": "none",
+  "pdf:Producer": "la la",
+  "xmp:CreateDate": "2015-07-01T12:30:00+02:00",
+  "xmp:ModifyDate": "2015-07-02",
+  "pdf:Trapped": "Unknown"
+}
+EOD
+
+set_get_test(
+    command => ['xmp'],
+
+    broken_input => [
+        '"abc"',
+
+        # no such property
+        '{"dc:titel": "myfile"}',
+
+        # not a scalar
+        '{"dc:title": ["a"]}'
+    ],
+    input => $input,
+    empty => "{}\n",
+);
+
+# append option
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'setxmp', $pdf ],
+        input   => '{"dc:title": "title", "pdf:Producer": "producer"}',
+    );
+
+    pdfout_ok(
+        command => [ 'setxmp', '--append', $pdf ],
+        input   => '{"dc:title": "new title"}',
+    );
+
+    pdfout_ok(
+        command      => [ 'getxmp', $pdf ],
+        expected_out => <<'EOD',
+{
+  "dc:title": "new title",
+  "pdf:Producer": "producer"
+}
+EOD
+    );
+}
+
+# sync with the info dict
+{
+    my $pdf = new_pdf();
+    pdfout_ok(
+        command => [ 'setinfo', '--sync-xmp', $pdf ],
+        input   => <<'EOD',
+{
+  "Title": "info title",
+  "Author": "me",
+  "CreationDate": "D:20150701123000+02'00'",
+  "Trapped": "True"
+}
+EOD
+    );
+
+    pdfout_ok(
+        command      => [ 'getxmp', $pdf ],
+        expected_out => <<'EOD',
+{
+  "dc:title": "info title",
+  "dc:creator": "me",
+  "xmp:CreateDate": "2015-07-01T12:30:00+02:00",
+  "pdf:Trapped": "True"
+}
+EOD
+    );
+
+    # Keys missing from the info dict are removed from XMP as well.
+    pdfout_ok(
+        command => [ 'setinfo', '--sync-xmp', $pdf ],
+        input   => '{"Title": "info title"}',
+    );
+
+    pdfout_ok(
+        command      => [ 'getxmp', $pdf ],
+        expected_out => <<'EOD',
+{
+  "dc:title": "info title"
+}
+EOD
+    );
+}
+
+# A packet written by another toolkit.  Only the changed values may differ.
+sub read_packet {
+    my $file = shift;
+    open my $fh, '<:raw', $file
+        or die "open: $!";
+    local $/;
+    my $data = <$fh>;
+
+    # The updated stream is appended by the incremental save.
+    $data =~ /.*(<\?xpacket begin=.*?<\?xpacket end="w"\?>)/s
+        or die "no XMP packet";
+    return $1;
+}
+
+{
+    my $original = read_packet( test_data('xmp-foreign.pdf') );
+
+    my $pdf = new_tempfile();
+    cp( test_data('xmp-foreign.pdf'), $pdf )
+        or die "cp";
+    pdfout_ok(
+        command => [ 'setxmp', '--append', $pdf ],
+        input   => '{"dc:title": "New <title>"}',
+    );
+    my $expected = $original;
+    $expected
+        =~ s{(<rdf:li xml:lang="x-default">)Old title(</rdf:li>)}{$1New &lt;title&gt;$2}
+        or die;
+    is( read_packet($pdf), $expected, 'other languages of dc:title kept' );
+
+    # No x-default item yet: one is added in front of the others.
+    pdfout_ok(
+        command => [ 'setxmp', '--append', $pdf ],
+        input   => '{"dc:description": "Beschreibung", "pdf:Producer": "P"}',
+    );
+    $expected =~ s{(<dc:description>\s*<rdf:Alt>)}
+        {$1<rdf:li xml:lang="x-default">Beschreibung</rdf:li>}
+        or die;
+    $expected =~ s{pdf:Producer="Other Producer"}{pdf:Producer="P"}
+        or die;
+    is( read_packet($pdf), $expected, 'attributes and padding kept' );
+
+    pdfout_ok(
+        command      => [ 'getxmp', $pdf ],
+        expected_out => <<'EOD',
+{
+  "dc:title": "New <title>",
+  "dc:description": "Beschreibung",
+  "pdf:Producer": "P"
+}
+EOD
+    );
+}
+
+done_testing();